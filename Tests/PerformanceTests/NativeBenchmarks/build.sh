@@ -0,0 +1,103 @@
+#!/bin/bash
+set -e
+
+# ------------------------------
+# Native DNG SDK benchmark build
+# ------------------------------
+#
+# Builds dng_benchmark and dng_burst_generator from the DNG SDK, libjpeg, the
+# burstphoto wrapper with its C++ helpers and the C++ alignment code, without Xcode. On macOS the XMP Toolkit in
+# dng_sdk/xmp_lib is used; on Linux set XMP_LIB_DIR to a directory holding
+# libXMPCoreStatic.a and libXMPFilesStatic.a built for the host.
+#
+# Usage: build.sh            (output in build/native_benchmarks)
+#        BUILD_DIR=dir build.sh
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+REPO_DIR="$(cd "$SCRIPT_DIR/../../.." && pwd)"
+BUILD_DIR="${BUILD_DIR:-$REPO_DIR/build/native_benchmarks}"
+TOOLS="dng_benchmark dng_burst_generator"
+JOBS="${JOBS:-$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 4)}"
+
+CC="${CC:-cc}"
+CXX="${CXX:-c++}"
+
+DNG_FLAGS="-O2 -DNDEBUG -DqDNGUseStdInt=1 -DqDNGThreadSafe=1 -DqDNGDebug=0 -DqDNGValidate=1 -DqDNGValidateTarget=1 -DqDNGUseLibJPEG=1"
+XMP_FLAGS="-DENABLE_CPP_DOM_MODEL=0 -DXML_STATIC=1 -DHAVE_EXPAT_CONFIG_H=1 -DXMP_StaticBuild=1 -DXMP_64=1"
+INCLUDES="-I$REPO_DIR/dng_sdk/dng_sdk -I$REPO_DIR/dng_sdk/libjpeg -I$REPO_DIR/dng_sdk/xmp_headers -I$REPO_DIR/burstphoto/io_dng -I$REPO_DIR/burstphoto/align"
+
+case "$(uname -s)" in
+    Darwin)
+        PLATFORM_FLAGS="-DqMacOS=1 -DMAC_ENV=1"
+        XMP_LIB_DIR="${XMP_LIB_DIR:-$REPO_DIR/dng_sdk/xmp_lib}"
+        XMP_LIBS="$XMP_LIB_DIR/libXMPFilesStaticRelease.a $XMP_LIB_DIR/libXMPCoreStaticRelease.a"
+        SYSTEM_LIBS="-lz -framework CoreFoundation -framework CoreServices"
+        ;;
+    Linux)
+        PLATFORM_FLAGS="-DqLinux=1 -DUNIX_ENV=1"
+        if [ -z "$XMP_LIB_DIR" ]; then
+            echo "Set XMP_LIB_DIR to a Linux build of the Adobe XMP Toolkit" >&2
+            exit 1
+        fi
+        XMP_LIBS="$XMP_LIB_DIR/libXMPFilesStatic.a $XMP_LIB_DIR/libXMPCoreStatic.a"
+        SYSTEM_LIBS="-lpthread -lz -ldl"
+        ;;
+    *)
+        echo "Unsupported platform: $(uname -s)" >&2
+        exit 1
+        ;;
+esac
+
+CFLAGS="$DNG_FLAGS $XMP_FLAGS $PLATFORM_FLAGS $INCLUDES -Wall"
+
+# Code written for Burst Photo also gets -Wextra: the wrapper and its helpers,
+# the alignment code, the tools and the files added to the DNG SDK. The rest
+# of the SDK and libjpeg are upstream code, which -Wextra floods with style
+# warnings.
+EXTRA_WARNINGS="-Wextra"
+SDK_ADDITIONS="dng_cancel_sniffer dng_paged_image dng_threaded_host dng_trace dng_tracking_allocator"
+
+mkdir -p "$BUILD_DIR/obj" "$BUILD_DIR/tools"
+
+# Compile one source file unless its object is up to date. Objects of the
+# tools go to a separate directory, since each has its own main.
+compile() {
+    local source="$1"
+    local object="$BUILD_DIR/obj/$(basename "$source").o"
+    if [ "$(dirname "$source")" = "$SCRIPT_DIR" ]; then
+        object="$BUILD_DIR/tools/$(basename "$source").o"
+    fi
+    if [ "$object" -nt "$source" ]; then
+        return 0
+    fi
+    local flags="$CFLAGS"
+    case "$source" in
+        */dng_sdk/libjpeg/*) ;;
+        */dng_sdk/dng_sdk/*)
+            case " $SDK_ADDITIONS " in
+                *" $(basename "$source" .cpp) "*) flags="$flags $EXTRA_WARNINGS" ;;
+            esac
+            ;;
+        *) flags="$flags $EXTRA_WARNINGS" ;;
+    esac
+    case "$source" in
+        *.c)   $CC $flags -c "$source" -o "$object" ;;
+        *.cpp) $CXX -std=c++11 $flags -c "$source" -o "$object" ;;
+    esac
+}
+export -f compile
+export CC CXX CFLAGS EXTRA_WARNINGS SDK_ADDITIONS BUILD_DIR SCRIPT_DIR
+
+echo "Compiling DNG SDK, libjpeg, wrapper and alignment code into $BUILD_DIR"
+ls "$REPO_DIR"/dng_sdk/dng_sdk/*.cpp \
+   "$REPO_DIR"/dng_sdk/libjpeg/*.c \
+   "$REPO_DIR"/burstphoto/io_dng/*.cpp \
+   "$REPO_DIR"/burstphoto/align/*.cpp \
+   "$SCRIPT_DIR"/*.cpp |
+    grep -v -e '/dng_validate\.cpp$' |
+    xargs -n 1 -P "$JOBS" bash -c 'compile "$0"'
+
+for tool in $TOOLS; do
+    $CXX -o "$BUILD_DIR/$tool" "$BUILD_DIR/tools/$tool.cpp.o" "$BUILD_DIR"/obj/*.o $XMP_LIBS $SYSTEM_LIBS
+    echo "Built $BUILD_DIR/$tool"
+done
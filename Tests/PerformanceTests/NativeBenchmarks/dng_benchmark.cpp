@@ -0,0 +1,1082 @@
+/**
+ * @file dng_benchmark.cpp
+ * @brief Native benchmarks of the DNG SDK code paths used by Burst Photo
+ *
+ * Times the wrapper calls (read_dng_from_disk, write_dng_to_disk, align_tiles), IFD parsing,
+ * lossless JPEG decoding and encoding, BuildStage2Image, BuildStage3Image, dng_render and
+ * resampling on synthetic Bayer DNG files of several sizes and with several thread counts.
+ *
+ * Results are written as JSON. With --compare, the results are checked against a stored
+ * baseline and the program exits with status 1 if any benchmark got slower than the tolerance.
+ *
+ * With --check-alignment, it instead aligns a burst written by dng_burst_generator with the
+ * exhaustive and the adaptive tile alignment, and exits with status 1 if the adaptive one matches
+ * the ground truth shifts of fewer tiles.
+ *
+ * Run with --help for the options.
+ */
+
+#include "dng_sdk_wrapper.h"
+
+#include "dng_auto_ptr.h"
+#include "dng_bottlenecks.h"
+#include "dng_camera_profile.h"
+#include "dng_color_space.h"
+#include "dng_exceptions.h"
+#include "dng_exif.h"
+#include "dng_file_stream.h"
+#include "dng_ifd.h"
+#include "dng_image_writer.h"
+#include "dng_info.h"
+#include "dng_lossless_jpeg.h"
+#include "dng_memory_stream.h"
+#include "dng_negative.h"
+#include "dng_render.h"
+#include "dng_resample.h"
+#include "dng_simd_type.h"
+#include "dng_simple_image.h"
+#include "dng_threaded_host.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Options from the command line
+ */
+struct benchmark_options {
+    std::vector<double> megapixels = {12.0, 24.0, 50.0};
+    std::vector<uint32> threads = {1, 0};
+    int repeats = 5;
+    std::string filter;
+    std::string work_dir = "/tmp";
+    std::string out_path;
+    std::string baseline_path;
+    double tolerance = 0.10;
+    std::string alignment_dir;
+    double alignment_margin = 0.01;
+};
+
+/**
+ * Timing of one benchmark at one size and thread count
+ */
+struct benchmark_result {
+    std::string name;
+    double megapixels = 0.0;
+    uint32 threads = 0;
+    int repeats = 0;
+    double min_ms = 0.0;
+    double median_ms = 0.0;
+    double mean_ms = 0.0;
+};
+
+/**
+ * One timed run of a benchmark; returns the time of the measured part in seconds
+ */
+typedef std::function<double()> benchmark_body;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Time a callable
+ */
+static double time_it(const std::function<void()>& body) {
+    const auto start = std::chrono::steady_clock::now();
+    body();
+    return seconds_since(start);
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Synthetic input
+// ---------------------------------------------------------------------------------------------
+
+/**
+ * Width and height of a 3:2 image with about the given number of megapixels, both even
+ */
+static void image_size(double megapixels, uint32& width, uint32& height) {
+    const double w = std::sqrt(megapixels * 1.0e6 * 1.5);
+    width = uint32(w / 2.0) * 2;
+    height = uint32(w / 1.5 / 2.0) * 2;
+}
+
+/**
+ * Bayer mosaic with smooth gradients, edges and noise, so that compression and demosaicing
+ * do realistic work
+ */
+static void fill_mosaic(dng_pixel_buffer& buffer, uint32 width, uint32 height) {
+    uint32 seed = 12345;
+    for (uint32 row = 0; row < height; row++) {
+        uint16* p = buffer.DirtyPixel_uint16(row, 0);
+        for (uint32 col = 0; col < width; col++) {
+            seed = seed * 1664525u + 1013904223u;
+            const int32 phase = int32((row & 1) * 2 + (col & 1));
+            const int32 gradient = int32((row * 1500) / height + (col * 1500) / width);
+            const int32 edge = (((row >> 6) + (col >> 6)) & 1) ? 1200 : 0;
+            const int32 noise = int32(seed >> 26);
+            p[col] = uint16(std::min<int32>(256 + phase * 300 + gradient + edge + noise, 16383));
+        }
+    }
+}
+
+/**
+ * Hash of a block position to [0, 1000)
+ */
+static int32 block_value(int32 x, int32 y, uint32 seed) {
+    uint32 h = uint32(x) * 374761393u + uint32(y) * 668265263u + seed * 3266489917u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return int32((h ^ (h >> 16)) % 1000u);
+}
+
+/**
+ * Reference and comparison frames for the tile alignment, with one value per Bayer pattern as
+ * the alignment sees them
+ *
+ * The top quarter is a smooth gradient, like a clear sky, and the rest has random blocks at two
+ * scales, which do not repeat. The comparison frame shows the content of the reference frame
+ * shifted by (shift_x, shift_y), and each frame has its own noise.
+ */
+static void make_alignment_pair(uint32 width, uint32 height, int32 shift_x, int32 shift_y,
+                                std::vector<float>& ref, std::vector<float>& comp) {
+    const int32 sky_height = int32(height / 4);
+    auto scene = [&](int32 x, int32 y) {
+        if (y < sky_height) {
+            return 2000.0f + 1000.0f * float(y) / float(sky_height);
+        }
+        // the offset keeps the shifted positions positive, so that blocks do not straddle 0
+        const int32 bx = x + 1024;
+        const int32 by = y + 1024;
+        const int32 coarse = block_value(bx / 24, by / 24, 1);
+        const int32 fine = block_value(bx / 5, by / 5, 2);
+        return 1000.0f + 2.0f * float(coarse) + 0.5f * float(fine);
+    };
+
+    ref.resize(size_t(width) * height);
+    comp.resize(size_t(width) * height);
+    uint32 seed = 12345;
+    for (uint32 y = 0; y < height; y++) {
+        for (uint32 x = 0; x < width; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            ref[size_t(y) * width + x] = scene(int32(x), int32(y)) + float(int32(seed >> 26) - 32);
+            seed = seed * 1664525u + 1013904223u;
+            comp[size_t(y) * width + x] = scene(int32(x) - shift_x, int32(y) - shift_y) + float(int32(seed >> 26) - 32);
+        }
+    }
+}
+
+/**
+ * Negative holding a synthetic 14-bit RGGB raw image
+ */
+static dng_negative* make_negative(dng_host& host, uint32 width, uint32 height) {
+    AutoPtr<dng_negative> negative(host.Make_dng_negative());
+    AutoPtr<dng_image> image(new dng_simple_image(dng_rect(height, width), 1, ttShort, host.Allocator()));
+    dng_pixel_buffer buffer;
+    ((dng_simple_image*) image.Get())->GetPixelBuffer(buffer);
+    fill_mosaic(buffer, width, height);
+
+    negative->SetModelName("Burst Photo Benchmark");
+    negative->SetLocalName("Burst Photo Benchmark");
+    negative->SetColorChannels(3);
+    negative->SetColorKeys(colorKeyRed, colorKeyGreen, colorKeyBlue);
+    negative->SetBayerMosaic(1);
+    negative->SetBlackLevel(256.0);
+    negative->SetWhiteLevel(16383);
+    negative->SetDefaultCropOrigin(8, 8);
+    negative->SetDefaultCropSize(width - 16, height - 16);
+
+    const dng_matrix_3by3 color_matrix(0.70, -0.10, -0.05,
+                                       -0.40, 1.20, 0.20,
+                                       -0.05, 0.15, 0.60);
+    AutoPtr<dng_camera_profile> profile(new dng_camera_profile);
+    profile->SetColorMatrix1(color_matrix);
+    profile->SetCalibrationIlluminant1(lsD65);
+    profile->SetName("Benchmark");
+    negative->AddProfile(profile);
+    negative->SetCameraNeutral(dng_vector_3(0.5, 1.0, 0.7));
+
+    // read_dng_from_disk expects the exposure tags cameras write
+    dng_exif* exif = negative->GetExif();
+    exif->fExposureTime = dng_urational(1, 100);
+    exif->fExposureBiasValue = dng_srational(0, 1);
+    exif->fISOSpeedRatings[0] = 100;
+
+    negative->SetStage1Image(image);
+    return negative.Release();
+}
+
+/**
+ * Write a synthetic DNG file with a lossless JPEG compressed raw image
+ */
+static void write_synthetic_dng(const std::string& path, uint32 width, uint32 height) {
+    dng_host host;
+    AutoPtr<dng_negative> negative(make_negative(host, width, height));
+    dng_file_stream stream(path.c_str(), true);
+    dng_image_writer writer;
+    writer.WriteDNG(host, stream, *negative.Get(), NULL);
+    stream.Flush();
+}
+
+/**
+ * Negative read from a DNG file up to its stage 1 image
+ */
+static dng_negative* read_negative(dng_host& host, dng_stream& stream) {
+    dng_info info;
+    info.Parse(host, stream);
+    info.PostParse(host);
+    if (!info.IsValidDNG()) {
+        ThrowBadFormat();
+    }
+    AutoPtr<dng_negative> negative(host.Make_dng_negative());
+    negative->Parse(host, stream, info);
+    negative->PostParse(host, stream, info);
+    negative->ReadStage1Image(host, stream, info);
+    negative->SynchronizeMetadata();
+    return negative.Release();
+}
+
+/**
+ * Spooler that copies decoded lossless JPEG data into a buffer
+ */
+class buffer_spooler : public dng_spooler {
+public:
+    explicit buffer_spooler(std::vector<uint8>& buffer) : buffer_(buffer), offset_(0) {}
+
+    virtual void Spool(const void* data, uint32 count) {
+        if (offset_ + count > buffer_.size()) {
+            ThrowBadFormat();
+        }
+        memcpy(&buffer_[offset_], data, count);
+        offset_ += count;
+    }
+
+private:
+    std::vector<uint8>& buffer_;
+    size_t offset_;
+};
+
+
+// ---------------------------------------------------------------------------------------------
+// Benchmarks
+// ---------------------------------------------------------------------------------------------
+
+/**
+ * A benchmark at one size and thread count
+ */
+struct benchmark_case {
+    std::string name;
+    double megapixels;
+    uint32 threads;
+    benchmark_body body;
+};
+
+/**
+ * Check the adaptive tile alignment against the exhaustive one on the same frames and print
+ * how many tile comparisons it saved and how often both found the true shift
+ */
+static void report_alignment(double megapixels, const std::vector<float>& ref, const std::vector<float>& comp, int width, int height,
+                             int32 shift_x, int32 shift_y, const std::vector<int>& adaptive, const dng_tile_alignment_stats& stats) {
+    std::vector<int> exhaustive(adaptive.size());
+    if (align_tiles(ref.data(), comp.data(), width, height, 32, 64, 0, exhaustive.data(), NULL) != 0) {
+        ThrowProgramError("align_tiles failed");
+    }
+    const size_t tiles = adaptive.size() / 2;
+    size_t adaptive_true = 0;
+    size_t exhaustive_true = 0;
+    size_t equal = 0;
+    for (size_t tile = 0; tile < tiles; tile++) {
+        adaptive_true += adaptive[2 * tile] == shift_x && adaptive[2 * tile + 1] == shift_y;
+        exhaustive_true += exhaustive[2 * tile] == shift_x && exhaustive[2 * tile + 1] == shift_y;
+        equal += adaptive[2 * tile] == exhaustive[2 * tile] && adaptive[2 * tile + 1] == exhaustive[2 * tile + 1];
+    }
+    const double saved = 1.0 - double(stats.evaluations) / double(stats.exhaustive_evaluations);
+    fprintf(stderr, "%-24s %6.1f MP  %.1f%% of tile comparisons saved (%llu flat tiles, %llu early exits of %llu)\n",
+            "align_tiles_adaptive", megapixels, saved * 100.0, stats.flat_tiles, stats.early_exits, stats.tiles);
+    fprintf(stderr, "%-24s %6.1f MP  true shift found for %.1f%% of tiles (exhaustive %.1f%%), same vector as exhaustive for %.1f%%\n",
+            "align_tiles_adaptive", megapixels, 100.0 * adaptive_true / tiles, 100.0 * exhaustive_true / tiles, 100.0 * equal / tiles);
+}
+
+static void add_cases(std::vector<benchmark_case>& cases, const benchmark_options& options, double megapixels, const std::string& dng_path) {
+
+    uint32 width = 0;
+    uint32 height = 0;
+    image_size(megapixels, width, height);
+    const std::string out_path = dng_path + ".out.dng";
+
+    // thread count independent benchmarks
+    // - the wrapper calls use their own hosts
+    // - IFD parsing and lossless JPEG coding run on one thread
+
+    cases.push_back({"read_dng_from_disk", megapixels, dng_threaded_host::CoreCount(), [=]() {
+        void* pixels = NULL;
+        int w, h, pattern, white, exposure_bias;
+        int black[36] = {0};
+        int masked[16] = {0};
+        int masked_black[36] = {0};
+        float iso_exposure_time, r, g, b;
+        const auto start = std::chrono::steady_clock::now();
+        const int error = read_dng_from_disk(dng_path.c_str(), &pixels, &w, &h, &pattern, &white, black, masked, masked_black, &exposure_bias, &iso_exposure_time, &r, &g, &b, NULL);
+        const double seconds = seconds_since(start);
+        free(pixels);
+        if (error != 0) {
+            ThrowProgramError("read_dng_from_disk failed");
+        }
+        return seconds;
+    }});
+
+    cases.push_back({"write_dng_to_disk", megapixels, 1, [=]() {
+        std::vector<uint16> pixels(size_t(width) * height);
+        dng_pixel_buffer buffer(dng_rect(height, width), 0, 1, ttShort, pcInterleaved, pixels.data());
+        fill_mosaic(buffer, width, height);
+        void* pixel_pointer = pixels.data();
+        const auto start = std::chrono::steady_clock::now();
+        const int error = write_dng_to_disk(dng_path.c_str(), out_path.c_str(), &pixel_pointer, 0, NULL);
+        const double seconds = seconds_since(start);
+        remove(out_path.c_str());
+        if (error != 0) {
+            ThrowProgramError("write_dng_to_disk failed");
+        }
+        return seconds;
+    }});
+
+    cases.push_back({"parse_ifd", megapixels, 1, [=]() {
+        dng_host host;
+        dng_file_stream stream(dng_path.c_str());
+        dng_info info;
+        return time_it([&]() {
+            info.Parse(host, stream);
+            info.PostParse(host);
+        });
+    }});
+
+    // the mosaic is coded as one single-component image, the way dng_image_writer codes a tile
+
+    cases.push_back({"lossless_jpeg_encode", megapixels, 1, [=]() {
+        std::vector<uint16> pixels(size_t(width) * height);
+        dng_pixel_buffer buffer(dng_rect(height, width), 0, 1, ttShort, pcInterleaved, pixels.data());
+        fill_mosaic(buffer, width, height);
+        dng_memory_stream stream(gDefaultDNGMemoryAllocator);
+        return time_it([&]() {
+            DoEncodeLosslessJPEG(pixels.data(), height, width, 1, 14, int32(width), 1, stream);
+            stream.Flush();
+        });
+    }});
+
+    cases.push_back({"lossless_jpeg_decode", megapixels, 1, [=]() {
+        std::vector<uint16> pixels(size_t(width) * height);
+        dng_pixel_buffer buffer(dng_rect(height, width), 0, 1, ttShort, pcInterleaved, pixels.data());
+        fill_mosaic(buffer, width, height);
+        dng_memory_stream stream(gDefaultDNGMemoryAllocator);
+        DoEncodeLosslessJPEG(pixels.data(), height, width, 1, 14, int32(width), 1, stream);
+        stream.Flush();
+        const uint64 length = stream.Length();
+        std::vector<uint8> decoded(size_t(width) * height * 2);
+        buffer_spooler spooler(decoded);
+        stream.SetReadPosition(0);
+        return time_it([&]() {
+            DoDecodeLosslessJPEG(stream, spooler, uint32(decoded.size()), uint32(decoded.size()), false, length);
+        });
+    }});
+
+    // tile alignment on the CPU, as with the "Medium" tile size and search distance; the warm-up
+    // run of the adaptive search also reports how it compares to the exhaustive one
+
+    const int32 shift_x = 12;
+    const int32 shift_y = -8;
+    const std::shared_ptr<bool> reported = std::make_shared<bool>(false);
+
+    for (int adaptive = 0; adaptive <= 1; adaptive++) {
+        cases.push_back({adaptive ? "align_tiles_adaptive" : "align_tiles_exhaustive", megapixels, 1, [=]() {
+            const int w = int(width / 2);
+            const int h = int(height / 2);
+            std::vector<float> ref;
+            std::vector<float> comp;
+            make_alignment_pair(w, h, shift_x, shift_y, ref, comp);
+            std::vector<int> alignment(2 * size_t(w / 16 - 1) * size_t(h / 16 - 1));
+            dng_tile_alignment_stats stats;
+            const auto start = std::chrono::steady_clock::now();
+            const int error = align_tiles(ref.data(), comp.data(), w, h, 32, 64, adaptive, alignment.data(), &stats);
+            const double seconds = seconds_since(start);
+            if (error != 0) {
+                ThrowProgramError("align_tiles failed");
+            }
+            if (adaptive && !*reported) {
+                *reported = true;
+                report_alignment(megapixels, ref, comp, w, h, shift_x, shift_y, alignment, stats);
+            }
+            return seconds;
+        }});
+    }
+
+    // thread count dependent benchmarks
+
+    // 0 means one thread per core, which may equal another requested count
+    std::vector<uint32> thread_counts;
+    for (uint32 threads : options.threads) {
+        const uint32 thread_count = threads ? threads : dng_threaded_host::CoreCount();
+        if (std::find(thread_counts.begin(), thread_counts.end(), thread_count) == thread_counts.end()) {
+            thread_counts.push_back(thread_count);
+        }
+    }
+
+    for (uint32 thread_count : thread_counts) {
+
+        cases.push_back({"build_stage2", megapixels, thread_count, [=]() {
+            dng_threaded_host host(NULL, NULL, thread_count);
+            dng_file_stream stream(dng_path.c_str());
+            AutoPtr<dng_negative> negative(read_negative(host, stream));
+            return time_it([&]() {
+                negative->BuildStage2Image(host);
+            });
+        }});
+
+        cases.push_back({"build_stage3", megapixels, thread_count, [=]() {
+            dng_threaded_host host(NULL, NULL, thread_count);
+            dng_file_stream stream(dng_path.c_str());
+            AutoPtr<dng_negative> negative(read_negative(host, stream));
+            negative->BuildStage2Image(host);
+            return time_it([&]() {
+                negative->BuildStage3Image(host);
+            });
+        }});
+
+        cases.push_back({"render", megapixels, thread_count, [=]() {
+            dng_threaded_host host(NULL, NULL, thread_count);
+            dng_file_stream stream(dng_path.c_str());
+            AutoPtr<dng_negative> negative(read_negative(host, stream));
+            negative->BuildStage2Image(host);
+            negative->BuildStage3Image(host);
+            AutoPtr<dng_image> image;
+            return time_it([&]() {
+                dng_render render(host, *negative.Get());
+                render.SetFinalSpace(dng_space_sRGB::Get());
+                render.SetFinalPixelType(ttByte);
+                image.Reset(render.Render());
+            });
+        }});
+
+        // resampling to a 2 MP preview, as done for thumbnails and proxies
+
+        cases.push_back({"resample_to_2mp", megapixels, thread_count, [=]() {
+            dng_threaded_host host(NULL, NULL, thread_count);
+            dng_simple_image src(dng_rect(height, width), 3, ttShort, host.Allocator());
+            dng_pixel_buffer buffer;
+            src.GetPixelBuffer(buffer);
+            for (uint32 row = 0; row < height; row++) {
+                for (uint32 col = 0; col < width; col++) {
+                    for (uint32 plane = 0; plane < 3; plane++) {
+                        *buffer.DirtyPixel_uint16(row, col, plane) = uint16((row * 7 + col * 13 + plane * 4099) & 0xFFFF);
+                    }
+                }
+            }
+            uint32 dst_width = 0;
+            uint32 dst_height = 0;
+            image_size(2.0, dst_width, dst_height);
+            const dng_rect dst_bounds(dst_height, dst_width);
+            dng_simple_image dst(dst_bounds, 3, ttShort, host.Allocator());
+            return time_it([&]() {
+                ResampleImage(host, src, dst, src.Bounds(), dst_bounds, dng_resample_bicubic::Get());
+            });
+        }});
+    }
+}
+
+/**
+ * Run a benchmark once to warm up and then repeats times
+ */
+static benchmark_result run_case(const benchmark_case& bench, int repeats) {
+    bench.body();
+    std::vector<double> times;
+    for (int index = 0; index < repeats; index++) {
+        times.push_back(bench.body() * 1000.0);
+    }
+    std::sort(times.begin(), times.end());
+    benchmark_result result;
+    result.name = bench.name;
+    result.megapixels = bench.megapixels;
+    result.threads = bench.threads;
+    result.repeats = repeats;
+    result.min_ms = times.front();
+    result.median_ms = times.size() % 2 ? times[times.size() / 2] : 0.5 * (times[times.size() / 2 - 1] + times[times.size() / 2]);
+    double sum = 0.0;
+    for (double t : times) {
+        sum += t;
+    }
+    result.mean_ms = sum / double(times.size());
+    return result;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// JSON
+// ---------------------------------------------------------------------------------------------
+
+static const char* simd_name() {
+    switch (gDNGMaxSIMD) {
+        case Scalar: return "Scalar";
+        case SSE2: return "SSE2 or NEON";
+        case AVX: return "AVX";
+        case AVX2: return "AVX2";
+        case AVX512_SKX: return "AVX512_SKX";
+        default: return "other";
+    }
+}
+
+static bool write_json(const std::string& path, const std::vector<benchmark_result>& results) {
+    FILE* file = path.empty() ? stdout : fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "{\n  \"schema\": 1,\n  \"cores\": %u,\n  \"simd\": \"%s\",\n  \"results\": [\n", (unsigned) dng_threaded_host::CoreCount(), simd_name());
+    for (size_t index = 0; index < results.size(); index++) {
+        const benchmark_result& r = results[index];
+        fprintf(file, "    {\"name\": \"%s\", \"megapixels\": %.1f, \"threads\": %u, \"repeats\": %d, \"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f}%s\n",
+                r.name.c_str(), r.megapixels, (unsigned) r.threads, r.repeats, r.min_ms, r.median_ms, r.mean_ms,
+                index + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    const bool ok = ferror(file) == 0;
+    if (file != stdout) {
+        return fclose(file) == 0 && ok;
+    }
+    fflush(file);
+    return ok;
+}
+
+/**
+ * Minimal reader for the JSON written by write_json
+ *
+ * Reads the objects of the "results" array; each is a flat object of string and number values.
+ */
+class json_reader {
+public:
+    explicit json_reader(const std::string& text) : text_(text), pos_(0) {}
+
+    bool read_results(std::vector<benchmark_result>& results) {
+        const size_t key = text_.find("\"results\"");
+        if (key == std::string::npos) {
+            return false;
+        }
+        pos_ = text_.find('[', key);
+        if (pos_ == std::string::npos) {
+            return false;
+        }
+        pos_++;
+        while (true) {
+            skip_space();
+            if (peek() == ']') {
+                return true;
+            }
+            benchmark_result result;
+            if (!read_object(result)) {
+                return false;
+            }
+            results.push_back(result);
+            skip_space();
+            if (peek() == ',') {
+                pos_++;
+            }
+        }
+    }
+
+private:
+    const std::string& text_;
+    size_t pos_;
+
+    char peek() const {
+        return pos_ < text_.size() ? text_[pos_] : 0;
+    }
+
+    void skip_space() {
+        while (pos_ < text_.size() && isspace((unsigned char) text_[pos_])) {
+            pos_++;
+        }
+    }
+
+    bool read_string(std::string& value) {
+        skip_space();
+        if (peek() != '"') {
+            return false;
+        }
+        pos_++;
+        value.clear();
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) {
+                pos_++;
+            }
+            value += text_[pos_++];
+        }
+        pos_++;
+        return pos_ <= text_.size();
+    }
+
+    bool read_object(benchmark_result& result) {
+        skip_space();
+        if (peek() != '{') {
+            return false;
+        }
+        pos_++;
+        while (true) {
+            skip_space();
+            if (peek() == '}') {
+                pos_++;
+                return true;
+            }
+            std::string key;
+            if (!read_string(key)) {
+                return false;
+            }
+            skip_space();
+            if (peek() != ':') {
+                return false;
+            }
+            pos_++;
+            skip_space();
+            if (peek() == '"') {
+                std::string value;
+                if (!read_string(value)) {
+                    return false;
+                }
+                if (key == "name") {
+                    result.name = value;
+                }
+            } else {
+                char* end = NULL;
+                const double value = strtod(text_.c_str() + pos_, &end);
+                if (end == text_.c_str() + pos_) {
+                    return false;
+                }
+                pos_ = end - text_.c_str();
+                if (key == "megapixels") {result.megapixels = value;}
+                else if (key == "threads") {result.threads = uint32(value);}
+                else if (key == "repeats") {result.repeats = int(value);}
+                else if (key == "min_ms") {result.min_ms = value;}
+                else if (key == "median_ms") {result.median_ms = value;}
+                else if (key == "mean_ms") {result.mean_ms = value;}
+            }
+            skip_space();
+            if (peek() == ',') {
+                pos_++;
+            }
+        }
+    }
+};
+
+static bool read_text(const std::string& path, std::string& text) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == NULL) {
+        return false;
+    }
+    text.clear();
+    char chunk[4096];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        text.append(chunk, count);
+    }
+    fclose(file);
+    return true;
+}
+
+static bool read_baseline(const std::string& path, std::vector<benchmark_result>& results) {
+    std::string text;
+    if (!read_text(path, text)) {
+        return false;
+    }
+    json_reader reader(text);
+    return reader.read_results(results);
+}
+
+/**
+ * Compare the median times against a baseline; returns the number of regressions
+ */
+static int compare(const std::vector<benchmark_result>& results, const std::vector<benchmark_result>& baseline, double tolerance) {
+    std::map<std::string, const benchmark_result*> by_key;
+    char key[256];
+    for (const benchmark_result& b : baseline) {
+        snprintf(key, sizeof(key), "%s/%.1f/%u", b.name.c_str(), b.megapixels, (unsigned) b.threads);
+        by_key[key] = &b;
+    }
+    int regressions = 0;
+    fprintf(stderr, "\n%-24s %8s %7s %12s %12s %8s\n", "benchmark", "MP", "threads", "baseline ms", "median ms", "change");
+    for (const benchmark_result& r : results) {
+        snprintf(key, sizeof(key), "%s/%.1f/%u", r.name.c_str(), r.megapixels, (unsigned) r.threads);
+        const auto it = by_key.find(key);
+        if (it == by_key.end() || it->second->median_ms <= 0.0) {
+            fprintf(stderr, "%-24s %8.1f %7u %12s %12.3f %8s\n", r.name.c_str(), r.megapixels, (unsigned) r.threads, "-", r.median_ms, "new");
+            continue;
+        }
+        const double change = r.median_ms / it->second->median_ms - 1.0;
+        const bool regressed = change > tolerance;
+        regressions += regressed ? 1 : 0;
+        fprintf(stderr, "%-24s %8.1f %7u %12.3f %12.3f %+7.1f%%%s\n", r.name.c_str(), r.megapixels, (unsigned) r.threads,
+                it->second->median_ms, r.median_ms, change * 100.0, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Alignment check
+// ---------------------------------------------------------------------------------------------
+
+/**
+ * Tile shifts of the frames of a burst written by dng_burst_generator
+ */
+struct ground_truth {
+    int tile_size = 0;
+    int tile_rows = 0;
+    int tile_cols = 0;
+    int reference_frame = 0;
+    std::vector<std::string> files;
+    /// per frame, two values (dx, dy) per tile in raw pixels, row by row
+    std::vector<std::vector<int>> tile_shifts;
+};
+
+static bool read_int_after(const std::string& text, const char* key, size_t from, int& value) {
+    const size_t pos = text.find(key, from);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    const size_t colon = text.find(':', pos);
+    if (colon == std::string::npos) {
+        return false;
+    }
+    value = atoi(text.c_str() + colon + 1);
+    return true;
+}
+
+/**
+ * Read the ground_truth.json of a generated burst; only the fields the check needs are read
+ */
+static bool read_ground_truth(const std::string& path, ground_truth& truth) {
+    std::string text;
+    if (!read_text(path, text) ||
+        !read_int_after(text, "\"tile_size\"", 0, truth.tile_size) ||
+        !read_int_after(text, "\"tile_rows\"", 0, truth.tile_rows) ||
+        !read_int_after(text, "\"tile_cols\"", 0, truth.tile_cols) ||
+        !read_int_after(text, "\"reference_frame\"", 0, truth.reference_frame)) {
+        return false;
+    }
+    const size_t tiles = size_t(truth.tile_rows) * size_t(truth.tile_cols);
+    size_t pos = text.find("\"frames\"");
+    while (pos != std::string::npos && (pos = text.find("\"file\"", pos)) != std::string::npos) {
+        const size_t begin = text.find('"', text.find(':', pos)) + 1;
+        const size_t end = text.find('"', begin);
+        pos = text.find("\"tile_shifts\"", end);
+        if (begin == 0 || end == std::string::npos || pos == std::string::npos) {
+            return false;
+        }
+        truth.files.push_back(text.substr(begin, end - begin));
+        std::vector<int> shifts;
+        const char* p = text.c_str() + text.find('[', pos) + 1;
+        while (shifts.size() < 2 * tiles) {
+            int dx = 0;
+            int dy = 0;
+            p += strspn(p, " ,");
+            if (sscanf(p, "[%d , %d ]", &dx, &dy) != 2) {
+                return false;
+            }
+            shifts.push_back(dx);
+            shifts.push_back(dy);
+            p = strchr(p, ']');
+            if (p == NULL) {
+                return false;
+            }
+            p++;
+        }
+        truth.tile_shifts.push_back(shifts);
+        pos = size_t(p - text.c_str());
+    }
+    return !truth.files.empty() && truth.reference_frame >= 0 && truth.reference_frame < int(truth.files.size());
+}
+
+/**
+ * Read a DNG file and average each mosaic pattern to one value, as the alignment sees the frame
+ */
+static bool read_gray(const std::string& path, std::vector<float>& gray, int& width, int& height, int& pattern) {
+    void* pixels = NULL;
+    int w, h, white, exposure_bias;
+    int black[36] = {0};
+    int masked[16] = {0};
+    int masked_black[36] = {0};
+    float iso_exposure_time, r, g, b;
+    if (read_dng_from_disk(path.c_str(), &pixels, &w, &h, &pattern, &white, black, masked, masked_black, &exposure_bias, &iso_exposure_time, &r, &g, &b, NULL) != 0) {
+        return false;
+    }
+    const uint16* raw = static_cast<const uint16*>(pixels);
+    width = w / pattern;
+    height = h / pattern;
+    gray.assign(size_t(width) * height, 0.0f);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float sum = 0.0f;
+            for (int j = 0; j < pattern; j++) {
+                for (int i = 0; i < pattern; i++) {
+                    sum += raw[size_t(y * pattern + j) * w + x * pattern + i];
+                }
+            }
+            gray[size_t(y) * width + x] = sum / float(pattern * pattern);
+        }
+    }
+    free(pixels);
+    return true;
+}
+
+/**
+ * Align every frame of a generated burst to its reference frame with the exhaustive and the
+ * adaptive search and compare both with the ground truth; returns 1 if the adaptive search
+ * found the true shift for fewer tiles than the exhaustive one, less the margin
+ *
+ * The alignment tiles are half the size of the ground truth tiles in pattern units, as the
+ * generator uses the "Medium" tile size, and overlap by half, so every second tile in each
+ * direction is a ground truth tile. The search works in whole patterns, so a vector is true if
+ * it is within half a pattern of the ground truth shift.
+ */
+static int check_alignment(const std::string& dir, double margin) {
+    ground_truth truth;
+    if (!read_ground_truth(dir + "/ground_truth.json", truth)) {
+        fprintf(stderr, "could not read %s/ground_truth.json\n", dir.c_str());
+        return 1;
+    }
+    std::vector<float> ref;
+    int width = 0;
+    int height = 0;
+    int pattern = 0;
+    if (!read_gray(dir + "/" + truth.files[truth.reference_frame], ref, width, height, pattern)) {
+        fprintf(stderr, "could not read %s\n", truth.files[truth.reference_frame].c_str());
+        return 1;
+    }
+    const int tile_size = truth.tile_size / pattern;
+    if (truth.tile_size % pattern != 0 || tile_size < 8 || tile_size > 64 || (tile_size & (tile_size - 1)) != 0) {
+        fprintf(stderr, "ground truth tiles of %d pixels do not match alignment tiles with a mosaic pattern of %d\n", truth.tile_size, pattern);
+        return 1;
+    }
+    const int tiles_h = width / (tile_size / 2) - 1;
+    const int tiles_v = height / (tile_size / 2) - 1;
+
+    int failures = 0;
+    for (size_t frame = 0; frame < truth.files.size(); frame++) {
+        if (int(frame) == truth.reference_frame) {
+            continue;
+        }
+        std::vector<float> comp;
+        int comp_width = 0;
+        int comp_height = 0;
+        int comp_pattern = 0;
+        if (!read_gray(dir + "/" + truth.files[frame], comp, comp_width, comp_height, comp_pattern) ||
+            comp_width != width || comp_height != height) {
+            fprintf(stderr, "could not read %s\n", truth.files[frame].c_str());
+            return 1;
+        }
+        std::vector<int> exhaustive(2 * size_t(tiles_h) * size_t(tiles_v));
+        std::vector<int> adaptive(exhaustive.size());
+        dng_tile_alignment_stats stats;
+        if (align_tiles(ref.data(), comp.data(), width, height, tile_size, 64, 0, exhaustive.data(), NULL) != 0 ||
+            align_tiles(ref.data(), comp.data(), width, height, tile_size, 64, 1, adaptive.data(), &stats) != 0) {
+            fprintf(stderr, "align_tiles failed for %s\n", truth.files[frame].c_str());
+            return 1;
+        }
+
+        const std::vector<int>& shifts = truth.tile_shifts[frame];
+        auto is_true = [&](const std::vector<int>& alignment, int tile, int truth_tile) {
+            return std::abs(pattern * alignment[2 * tile] - shifts[2 * truth_tile]) <= pattern / 2 &&
+                   std::abs(pattern * alignment[2 * tile + 1] - shifts[2 * truth_tile + 1]) <= pattern / 2;
+        };
+        int checked = 0;
+        int exhaustive_true = 0;
+        int adaptive_true = 0;
+        for (int ty = 0; ty < tiles_v && ty / 2 < truth.tile_rows; ty += 2) {
+            for (int tx = 0; tx < tiles_h && tx / 2 < truth.tile_cols; tx += 2) {
+                const int tile = ty * tiles_h + tx;
+                const int truth_tile = (ty / 2) * truth.tile_cols + tx / 2;
+                checked++;
+                exhaustive_true += is_true(exhaustive, tile, truth_tile);
+                adaptive_true += is_true(adaptive, tile, truth_tile);
+            }
+        }
+
+        const bool failed = checked == 0 || adaptive_true < exhaustive_true - margin * checked;
+        failures += failed ? 1 : 0;
+        const double saved = 1.0 - double(stats.evaluations) / double(stats.exhaustive_evaluations);
+        fprintf(stderr, "%-16s true shift for %5.1f%% of %d tiles (exhaustive %5.1f%%), %.1f%% of tile comparisons saved%s\n",
+                truth.files[frame].c_str(), 100.0 * adaptive_true / std::max(checked, 1), checked,
+                100.0 * exhaustive_true / std::max(checked, 1), saved * 100.0, failed ? "  MISMATCH" : "");
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "\n%d frame(s) aligned worse by the adaptive search than by the exhaustive one\n", failures);
+        return 1;
+    }
+    return 0;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Main
+// ---------------------------------------------------------------------------------------------
+
+template <typename T>
+static std::vector<T> parse_list(const char* text) {
+    std::vector<T> values;
+    const char* p = text;
+    while (*p) {
+        char* end = NULL;
+        const double value = strtod(p, &end);
+        if (end == p) {
+            break;
+        }
+        values.push_back(T(value));
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+static void show_help(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "Options:\n"
+            "  --sizes LIST         Image sizes in megapixels (default: 12,24,50)\n"
+            "  --threads LIST       Thread counts, 0 for one per core (default: 1,0)\n"
+            "  --repeats N          Timed runs per benchmark after one warm-up run (default: 5)\n"
+            "  --filter TEXT        Run only benchmarks whose name contains TEXT\n"
+            "  --work-dir DIR       Directory for the synthetic DNG files (default: /tmp)\n"
+            "  --out FILE           Write the JSON results to FILE instead of stdout\n"
+            "  --compare FILE       Compare against the JSON results in FILE and exit with 1 on regressions\n"
+            "  --tolerance FRACTION Allowed slowdown of the median time (default: 0.10)\n"
+            "  --check-alignment DIR\n"
+            "                       Instead of the benchmarks, align the burst written by dng_burst_generator to DIR\n"
+            "                       and exit with 1 if the adaptive search finds the ground truth shift for fewer\n"
+            "                       tiles than the exhaustive one\n"
+            "  --alignment-margin FRACTION\n"
+            "                       Share of the tiles the adaptive search may miss more (default: 0.01)\n",
+            program);
+}
+
+int main(int argc, char** argv) {
+
+    benchmark_options options;
+
+    for (int index = 1; index < argc; index++) {
+        const std::string arg = argv[index];
+        const char* value = index + 1 < argc ? argv[index + 1] : NULL;
+        if (arg == "-h" || arg == "--help") {
+            show_help(argv[0]);
+            return 0;
+        } else if (value == NULL) {
+            show_help(argv[0]);
+            return 2;
+        } else if (arg == "--sizes") {
+            options.megapixels = parse_list<double>(value);
+        } else if (arg == "--threads") {
+            options.threads = parse_list<uint32>(value);
+        } else if (arg == "--repeats") {
+            options.repeats = std::max(1, atoi(value));
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--work-dir") {
+            options.work_dir = value;
+        } else if (arg == "--out") {
+            options.out_path = value;
+        } else if (arg == "--compare") {
+            options.baseline_path = value;
+        } else if (arg == "--tolerance") {
+            options.tolerance = atof(value);
+        } else if (arg == "--check-alignment") {
+            options.alignment_dir = value;
+        } else if (arg == "--alignment-margin") {
+            options.alignment_margin = atof(value);
+        } else {
+            show_help(argv[0]);
+            return 2;
+        }
+        index++;
+    }
+
+    initialize_xmp_sdk();
+
+    if (!options.alignment_dir.empty()) {
+        int status = 1;
+        try {
+            status = check_alignment(options.alignment_dir, options.alignment_margin);
+        } catch(...) {
+            fprintf(stderr, "alignment check failed\n");
+        }
+        terminate_xmp_sdk();
+        return status;
+    }
+
+    std::vector<benchmark_result> results;
+    std::vector<std::string> files;
+    int status = 0;
+
+    try {
+        for (double megapixels : options.megapixels) {
+            uint32 width = 0;
+            uint32 height = 0;
+            image_size(megapixels, width, height);
+            char name[64];
+            snprintf(name, sizeof(name), "/dng_benchmark_%.1fmp.dng", megapixels);
+            const std::string path = options.work_dir + name;
+            fprintf(stderr, "writing %s (%u x %u)\n", path.c_str(), (unsigned) width, (unsigned) height);
+            write_synthetic_dng(path, width, height);
+            files.push_back(path);
+
+            std::vector<benchmark_case> cases;
+            add_cases(cases, options, megapixels, path);
+            for (const benchmark_case& bench : cases) {
+                if (!options.filter.empty() && bench.name.find(options.filter) == std::string::npos) {
+                    continue;
+                }
+                const benchmark_result result = run_case(bench, options.repeats);
+                fprintf(stderr, "%-24s %6.1f MP %3u threads  median %10.3f ms  min %10.3f ms\n",
+                        result.name.c_str(), result.megapixels, (unsigned) result.threads, result.median_ms, result.min_ms);
+                results.push_back(result);
+            }
+        }
+    } catch(const dng_exception& exception) {
+        fprintf(stderr, "benchmark failed with DNG SDK error %d\n", (int) exception.ErrorCode());
+        status = 1;
+    } catch(...) {
+        fprintf(stderr, "benchmark failed\n");
+        status = 1;
+    }
+
+    for (const std::string& path : files) {
+        remove(path.c_str());
+    }
+    terminate_xmp_sdk();
+
+    if (status != 0) {
+        return status;
+    }
+
+    if (!write_json(options.out_path, results)) {
+        fprintf(stderr, "could not write %s\n", options.out_path.c_str());
+        return 1;
+    }
+
+    if (!options.baseline_path.empty()) {
+        std::vector<benchmark_result> baseline;
+        if (!read_baseline(options.baseline_path, baseline)) {
+            fprintf(stderr, "could not read baseline %s\n", options.baseline_path.c_str());
+            return 1;
+        }
+        const int regressions = compare(results, baseline, options.tolerance);
+        if (regressions > 0) {
+            fprintf(stderr, "\n%d benchmark(s) regressed by more than %.0f%%\n", regressions, options.tolerance * 100.0);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,535 @@
+/**
+ * @file dng_burst_generator.cpp
+ * @brief Writes synthetic raw DNG bursts with known motion for tests and benchmarks
+ *
+ * Renders one textured scene and writes N Bayer or X-Trans frames of it, each displaced by a
+ * random global shift plus an optional random shift per tile. Shot and read noise, exposure
+ * brackets, hot pixels, bit depth and compression are configurable. The true shift of every
+ * tile of every frame is written to ground_truth.json, so alignment results can be checked
+ * against it.
+ *
+ * Run with --help for the options.
+ */
+
+#include "dng_sdk_wrapper.h"
+
+#include "dng_auto_ptr.h"
+#include "dng_camera_profile.h"
+#include "dng_exceptions.h"
+#include "dng_exif.h"
+#include "dng_file_stream.h"
+#include "dng_image_writer.h"
+#include "dng_mosaic_info.h"
+#include "dng_negative.h"
+#include "dng_simple_image.h"
+#include "dng_threaded_host.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Options from the command line
+ */
+struct burst_options {
+    std::string out_dir = "burst";
+    uint32 frames = 8;
+    uint32 width = 4032;
+    uint32 height = 3024;
+    uint32 bits = 14;
+    std::string cfa = "bayer";
+    std::string compression = "ljpeg";
+    int32 max_shift = 16;
+    int32 local_shift = 0;
+    uint32 tile_size = 64;
+    double shot_noise = 0.5;
+    double read_noise = 2.0;
+    std::vector<double> brackets = {0.0};
+    uint32 hot_pixels = 0;
+    uint32 seed = 1;
+};
+
+/**
+ * Shift of the content of one tile relative to the reference frame, in pixels
+ */
+struct tile_shift {
+    int32 dx;
+    int32 dy;
+};
+
+/**
+ * Ground truth of one frame
+ */
+struct frame_truth {
+    std::string file;
+    double exposure_bias = 0.0;
+    tile_shift global = {0, 0};
+    std::vector<tile_shift> tiles;
+};
+
+/**
+ * Position of a hot pixel
+ */
+struct pixel_position {
+    uint32 x;
+    uint32 y;
+};
+
+
+// ---------------------------------------------------------------------------------------------
+// Scene
+// ---------------------------------------------------------------------------------------------
+
+/**
+ * Linear RGB scene, larger than the frames by the largest possible shift on each side
+ *
+ * Values are stored as uint16 with 65535 standing for 1.0.
+ */
+struct scene_image {
+    uint32 width = 0;
+    uint32 height = 0;
+    uint32 margin = 0;
+    std::vector<uint16> planes[3];
+
+    uint16 at(uint32 plane, uint32 x, uint32 y) const {
+        return planes[plane][size_t(y) * width + x];
+    }
+};
+
+/**
+ * Hash of a lattice point to [0, 1)
+ */
+static double lattice_value(int32 x, int32 y, uint32 octave, uint32 seed) {
+    uint32 h = uint32(x) * 374761393u + uint32(y) * 668265263u + octave * 2246822519u + seed * 3266489917u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    h ^= h >> 16;
+    return double(h & 0xFFFFFF) / double(0x1000000);
+}
+
+/**
+ * Smoothly interpolated value noise with a lattice spacing of scale pixels
+ */
+static double value_noise(double x, double y, double scale, uint32 octave, uint32 seed) {
+    const double fx = x / scale;
+    const double fy = y / scale;
+    const int32 ix = int32(std::floor(fx));
+    const int32 iy = int32(std::floor(fy));
+    double tx = fx - ix;
+    double ty = fy - iy;
+    tx = tx * tx * (3.0 - 2.0 * tx);
+    ty = ty * ty * (3.0 - 2.0 * ty);
+    const double v00 = lattice_value(ix, iy, octave, seed);
+    const double v10 = lattice_value(ix + 1, iy, octave, seed);
+    const double v01 = lattice_value(ix, iy + 1, octave, seed);
+    const double v11 = lattice_value(ix + 1, iy + 1, octave, seed);
+    return (v00 * (1.0 - tx) + v10 * tx) * (1.0 - ty) + (v01 * (1.0 - tx) + v11 * tx) * ty;
+}
+
+/**
+ * Render the scene
+ *
+ * The top quarter is a smooth gradient with no texture, like a clear sky. The rest is a grid of
+ * blocks with random brightness and tint, which gives strong edges, overlaid with multi-scale
+ * value noise for fine texture.
+ */
+static void render_scene(scene_image& scene, const burst_options& options) {
+    const uint32 block_size = 120;
+    const double sky_height = 0.25 * scene.height;
+
+    for (uint32 plane = 0; plane < 3; plane++) {
+        scene.planes[plane].resize(size_t(scene.width) * scene.height);
+    }
+
+    for (uint32 y = 0; y < scene.height; y++) {
+        for (uint32 x = 0; x < scene.width; x++) {
+            double rgb[3];
+            if (y < sky_height) {
+                const double t = y / sky_height;
+                rgb[0] = 0.35 + 0.15 * t;
+                rgb[1] = 0.45 + 0.15 * t;
+                rgb[2] = 0.70 + 0.10 * t;
+            } else {
+                const int32 bx = int32(x / block_size);
+                const int32 by = int32(y / block_size);
+                const double brightness = 0.15 + 0.65 * lattice_value(bx, by, 100, options.seed);
+                const double texture = 0.40 * value_noise(x, y, 64.0, 1, options.seed) +
+                                       0.35 * value_noise(x, y, 16.0, 2, options.seed) +
+                                       0.25 * value_noise(x, y, 4.0, 3, options.seed);
+                for (uint32 plane = 0; plane < 3; plane++) {
+                    const double tint = 0.6 + 0.4 * lattice_value(bx, by, 101 + plane, options.seed);
+                    rgb[plane] = brightness * tint * (0.5 + texture);
+                }
+            }
+            for (uint32 plane = 0; plane < 3; plane++) {
+                const double v = std::min(std::max(rgb[plane], 0.0), 1.0);
+                scene.planes[plane][size_t(y) * scene.width + x] = uint16(v * 65535.0 + 0.5);
+            }
+        }
+    }
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Frames
+// ---------------------------------------------------------------------------------------------
+
+/**
+ * Negative with the metadata of one frame and no image yet
+ */
+static dng_negative* make_negative(dng_host& host, const burst_options& options, double exposure_bias) {
+    AutoPtr<dng_negative> negative(host.Make_dng_negative());
+
+    negative->SetModelName("Burst Photo Synthetic");
+    negative->SetLocalName("Burst Photo Synthetic");
+    negative->SetColorChannels(3);
+    negative->SetColorKeys(colorKeyRed, colorKeyGreen, colorKeyBlue);
+    if (options.cfa == "xtrans") {
+        negative->SetFujiMosaic6x6(0);
+    } else {
+        negative->SetBayerMosaic(1);
+    }
+    negative->SetBlackLevel(real64(1u << (options.bits - 5)));
+    negative->SetWhiteLevel((1u << options.bits) - 1);
+    negative->SetDefaultCropOrigin(8, 8);
+    negative->SetDefaultCropSize(options.width - 16, options.height - 16);
+
+    const dng_matrix_3by3 color_matrix(0.70, -0.10, -0.05,
+                                       -0.40, 1.20, 0.20,
+                                       -0.05, 0.15, 0.60);
+    AutoPtr<dng_camera_profile> profile(new dng_camera_profile);
+    profile->SetColorMatrix1(color_matrix);
+    profile->SetCalibrationIlluminant1(lsD65);
+    profile->SetName("Synthetic");
+    negative->AddProfile(profile);
+    negative->SetCameraNeutral(dng_vector_3(0.5, 1.0, 0.7));
+
+    // brackets change the exposure time at a fixed ISO, as cameras do in aperture priority
+    dng_exif* exif = negative->GetExif();
+    exif->SetExposureTime(std::pow(2.0, exposure_bias) / 100.0, false);
+    exif->fExposureBiasValue = dng_srational(int32(std::lround(exposure_bias * 100.0)), 100);
+    exif->fISOSpeedRatings[0] = 100;
+
+    return negative.Release();
+}
+
+/**
+ * Color plane (0 red, 1 green, 2 blue) of each position of the mosaic pattern
+ */
+static std::vector<uint32> pattern_planes(const dng_mosaic_info& info) {
+    std::vector<uint32> planes(size_t(info.fCFAPatternSize.v) * info.fCFAPatternSize.h);
+    for (int32 row = 0; row < info.fCFAPatternSize.v; row++) {
+        for (int32 col = 0; col < info.fCFAPatternSize.h; col++) {
+            const uint8 key = info.fCFAPattern[row][col];
+            planes[size_t(row) * info.fCFAPatternSize.h + col] = key == colorKeyRed ? 0 : (key == colorKeyGreen ? 1 : 2);
+        }
+    }
+    return planes;
+}
+
+/**
+ * Random shifts of one frame; the reference frame (index 0) is not shifted
+ */
+static frame_truth make_truth(const burst_options& options, uint32 index, uint32 tile_rows, uint32 tile_cols, std::mt19937& rng) {
+    frame_truth truth;
+    char name[64];
+    snprintf(name, sizeof(name), "frame_%03u.dng", (unsigned) index);
+    truth.file = name;
+    truth.exposure_bias = options.brackets[index % options.brackets.size()];
+
+    std::uniform_int_distribution<int32> global(-options.max_shift, options.max_shift);
+    std::uniform_int_distribution<int32> local(-options.local_shift, options.local_shift);
+    if (index > 0) {
+        truth.global.dx = global(rng);
+        truth.global.dy = global(rng);
+    }
+    truth.tiles.resize(size_t(tile_rows) * tile_cols);
+    for (tile_shift& tile : truth.tiles) {
+        tile = truth.global;
+        if (index > 0) {
+            tile.dx += local(rng);
+            tile.dy += local(rng);
+        }
+    }
+    return truth;
+}
+
+/**
+ * Store a raw sample in a 16 or 32-bit image
+ */
+static void store(dng_pixel_buffer& buffer, uint32 x, uint32 y, uint32 value) {
+    if (buffer.fPixelType == ttLong) {
+        *buffer.DirtyPixel_uint32(y, x) = value;
+    } else {
+        *buffer.DirtyPixel_uint16(y, x) = uint16(value);
+    }
+}
+
+/**
+ * Fill the raw image of one frame
+ *
+ * A pixel at (x, y) in a tile with shift (dx, dy) shows the scene at (x - dx, y - dy), so the
+ * content of a reference tile at q is found at q + (dx, dy) in the frame.
+ */
+static void fill_frame(dng_pixel_buffer& buffer, const burst_options& options, const scene_image& scene,
+                       const dng_mosaic_info& mosaic, const frame_truth& truth, uint32 tile_cols,
+                       const std::vector<pixel_position>& hot_pixels, std::mt19937& rng) {
+    const std::vector<uint32> planes = pattern_planes(mosaic);
+    const uint32 pattern_rows = uint32(mosaic.fCFAPatternSize.v);
+    const uint32 pattern_cols = uint32(mosaic.fCFAPatternSize.h);
+    const double black = double(1u << (options.bits - 5));
+    const double white = double((1u << options.bits) - 1);
+    const double gain = std::pow(2.0, truth.exposure_bias) * (white - black) / 65535.0;
+    std::normal_distribution<double> normal(0.0, 1.0);
+
+    for (uint32 y = 0; y < options.height; y++) {
+        const uint32 tile_row = y / options.tile_size;
+        const uint32* pattern_row = &planes[size_t(y % pattern_rows) * pattern_cols];
+        for (uint32 x = 0; x < options.width; x++) {
+            const tile_shift& shift = truth.tiles[size_t(tile_row) * tile_cols + x / options.tile_size];
+            const uint32 sx = uint32(int32(x + scene.margin) - shift.dx);
+            const uint32 sy = uint32(int32(y + scene.margin) - shift.dy);
+            const double signal = scene.at(pattern_row[x % pattern_cols], sx, sy) * gain;
+            const double sigma = std::sqrt(options.shot_noise * signal + options.read_noise * options.read_noise);
+            const double value = black + signal + sigma * normal(rng);
+            store(buffer, x, y, uint32(std::min(std::max(std::lround(value), 0L), long(white))));
+        }
+    }
+
+    for (const pixel_position& hot : hot_pixels) {
+        store(buffer, hot.x, hot.y, uint32(white));
+    }
+}
+
+/**
+ * Write one frame as a DNG file
+ */
+static void write_frame(dng_host& host, const burst_options& options, const scene_image& scene,
+                        const frame_truth& truth, uint32 tile_cols,
+                        const std::vector<pixel_position>& hot_pixels, std::mt19937& rng) {
+    AutoPtr<dng_negative> negative(make_negative(host, options, truth.exposure_bias));
+
+    // DNG allows ZIP compression of integer raw data only at 32 bits per sample
+    const uint32 pixel_type = options.compression == "deflate" ? ttLong : ttShort;
+    AutoPtr<dng_image> image(new dng_simple_image(dng_rect(options.height, options.width), 1, pixel_type, host.Allocator()));
+    dng_pixel_buffer buffer;
+    ((dng_simple_image*) image.Get())->GetPixelBuffer(buffer);
+    fill_frame(buffer, options, scene, *negative->GetMosaicInfo(), truth, tile_cols, hot_pixels, rng);
+    negative->SetStage1Image(image);
+
+    const std::string path = options.out_dir + "/" + truth.file;
+    dng_file_stream stream(path.c_str(), true);
+    dng_image_writer writer;
+    writer.WriteDNG(host, stream, *negative.Get(), NULL, dngVersion_SaveDefault, options.compression == "none");
+    stream.Flush();
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Ground truth
+// ---------------------------------------------------------------------------------------------
+
+static bool write_truth(const burst_options& options, uint32 tile_rows, uint32 tile_cols,
+                        const std::vector<frame_truth>& frames, const std::vector<pixel_position>& hot_pixels) {
+    const std::string path = options.out_dir + "/ground_truth.json";
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "{\n  \"schema\": 1,\n  \"width\": %u,\n  \"height\": %u,\n  \"bits\": %u,\n  \"cfa\": \"%s\",\n  \"compression\": \"%s\",\n",
+            (unsigned) options.width, (unsigned) options.height, (unsigned) options.bits, options.cfa.c_str(), options.compression.c_str());
+    fprintf(file, "  \"tile_size\": %u,\n  \"tile_rows\": %u,\n  \"tile_cols\": %u,\n  \"reference_frame\": 0,\n",
+            (unsigned) options.tile_size, (unsigned) tile_rows, (unsigned) tile_cols);
+    fprintf(file, "  \"hot_pixels\": [");
+    for (size_t index = 0; index < hot_pixels.size(); index++) {
+        fprintf(file, "%s[%u, %u]", index ? ", " : "", (unsigned) hot_pixels[index].x, (unsigned) hot_pixels[index].y);
+    }
+    fprintf(file, "],\n  \"frames\": [\n");
+    for (size_t index = 0; index < frames.size(); index++) {
+        const frame_truth& frame = frames[index];
+        fprintf(file, "    {\"file\": \"%s\", \"exposure_bias\": %.2f, \"global_shift\": [%d, %d], \"tile_shifts\": [",
+                frame.file.c_str(), frame.exposure_bias, (int) frame.global.dx, (int) frame.global.dy);
+        for (size_t tile = 0; tile < frame.tiles.size(); tile++) {
+            fprintf(file, "%s[%d, %d]", tile ? ", " : "", (int) frame.tiles[tile].dx, (int) frame.tiles[tile].dy);
+        }
+        fprintf(file, "]}%s\n", index + 1 < frames.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    const bool ok = ferror(file) == 0;
+    return fclose(file) == 0 && ok;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Main
+// ---------------------------------------------------------------------------------------------
+
+static std::vector<double> parse_list(const char* text) {
+    std::vector<double> values;
+    const char* p = text;
+    while (*p) {
+        char* end = NULL;
+        const double value = strtod(p, &end);
+        if (end == p) {
+            break;
+        }
+        values.push_back(value);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+static void show_help(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "Options:\n"
+            "  --out-dir DIR        Directory for the frames and ground_truth.json (default: burst)\n"
+            "  --frames N           Number of frames; frame 0 is the unshifted reference (default: 8)\n"
+            "  --width N            Image width in pixels (default: 4032)\n"
+            "  --height N           Image height in pixels (default: 3024)\n"
+            "  --bits N             Bit depth of the raw data, 8 to 16 (default: 14)\n"
+            "  --cfa TYPE           bayer or xtrans (default: bayer)\n"
+            "  --compression TYPE   none, ljpeg or deflate; deflate stores 32-bit samples (default: ljpeg)\n"
+            "  --max-shift N        Largest global shift of a frame in pixels (default: 16)\n"
+            "  --local-shift N      Largest additional shift of a tile in pixels (default: 0)\n"
+            "  --tile-size N        Size of the tiles of the motion field in pixels (default: 64)\n"
+            "  --shot-noise GAIN    Shot noise variance per DN of signal (default: 0.5)\n"
+            "  --read-noise SIGMA   Read noise standard deviation in DN (default: 2.0)\n"
+            "  --brackets LIST      Exposure bias in EV of consecutive frames, repeated (default: 0)\n"
+            "  --hot-pixels N       Number of pixels stuck at the white level (default: 0)\n"
+            "  --seed N             Seed of the scene and all random choices (default: 1)\n",
+            program);
+}
+
+static bool valid_options(const burst_options& options) {
+    return options.frames > 0 &&
+           options.width >= 64 && options.height >= 64 &&
+           options.bits >= 8 && options.bits <= 16 &&
+           (options.cfa == "bayer" || options.cfa == "xtrans") &&
+           (options.compression == "none" || options.compression == "ljpeg" || options.compression == "deflate") &&
+           options.max_shift >= 0 && options.local_shift >= 0 &&
+           options.tile_size > 0 &&
+           options.shot_noise >= 0.0 && options.read_noise >= 0.0 &&
+           !options.brackets.empty();
+}
+
+int main(int argc, char** argv) {
+
+    burst_options options;
+
+    for (int index = 1; index < argc; index++) {
+        const std::string arg = argv[index];
+        const char* value = index + 1 < argc ? argv[index + 1] : NULL;
+        if (arg == "-h" || arg == "--help") {
+            show_help(argv[0]);
+            return 0;
+        } else if (value == NULL) {
+            show_help(argv[0]);
+            return 2;
+        } else if (arg == "--out-dir") {
+            options.out_dir = value;
+        } else if (arg == "--frames") {
+            options.frames = uint32(atoi(value));
+        } else if (arg == "--width") {
+            options.width = uint32(atoi(value));
+        } else if (arg == "--height") {
+            options.height = uint32(atoi(value));
+        } else if (arg == "--bits") {
+            options.bits = uint32(atoi(value));
+        } else if (arg == "--cfa") {
+            options.cfa = value;
+        } else if (arg == "--compression") {
+            options.compression = value;
+        } else if (arg == "--max-shift") {
+            options.max_shift = atoi(value);
+        } else if (arg == "--local-shift") {
+            options.local_shift = atoi(value);
+        } else if (arg == "--tile-size") {
+            options.tile_size = uint32(atoi(value));
+        } else if (arg == "--shot-noise") {
+            options.shot_noise = atof(value);
+        } else if (arg == "--read-noise") {
+            options.read_noise = atof(value);
+        } else if (arg == "--brackets") {
+            options.brackets = parse_list(value);
+        } else if (arg == "--hot-pixels") {
+            options.hot_pixels = uint32(atoi(value));
+        } else if (arg == "--seed") {
+            options.seed = uint32(atoi(value));
+        } else {
+            show_help(argv[0]);
+            return 2;
+        }
+        index++;
+    }
+
+    if (!valid_options(options)) {
+        show_help(argv[0]);
+        return 2;
+    }
+
+    mkdir(options.out_dir.c_str(), 0755);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    scene_image scene;
+    scene.margin = uint32(options.max_shift + options.local_shift);
+    scene.width = options.width + 2 * scene.margin;
+    scene.height = options.height + 2 * scene.margin;
+    render_scene(scene, options);
+
+    const uint32 tile_rows = (options.height + options.tile_size - 1) / options.tile_size;
+    const uint32 tile_cols = (options.width + options.tile_size - 1) / options.tile_size;
+
+    // hot pixels are at the same positions in all frames, as on a real sensor
+    std::mt19937 rng(options.seed);
+    std::vector<pixel_position> hot_pixels(options.hot_pixels);
+    for (pixel_position& hot : hot_pixels) {
+        hot.x = uint32(rng() % options.width);
+        hot.y = uint32(rng() % options.height);
+    }
+
+    initialize_xmp_sdk();
+
+    std::vector<frame_truth> frames;
+    int status = 0;
+
+    try {
+        dng_threaded_host host;
+        for (uint32 index = 0; index < options.frames; index++) {
+            frames.push_back(make_truth(options, index, tile_rows, tile_cols, rng));
+            std::mt19937 noise_rng(options.seed * 7919u + index);
+            write_frame(host, options, scene, frames.back(), tile_cols, hot_pixels, noise_rng);
+            fprintf(stderr, "wrote %s/%s (shift %d, %d, %+.2f EV)\n", options.out_dir.c_str(), frames.back().file.c_str(),
+                    (int) frames.back().global.dx, (int) frames.back().global.dy, frames.back().exposure_bias);
+        }
+    } catch(const dng_exception& exception) {
+        fprintf(stderr, "generator failed with DNG SDK error %d\n", (int) exception.ErrorCode());
+        status = 1;
+    } catch(...) {
+        fprintf(stderr, "generator failed\n");
+        status = 1;
+    }
+
+    terminate_xmp_sdk();
+
+    if (status != 0) {
+        return status;
+    }
+
+    if (!write_truth(options, tile_rows, tile_cols, frames, hot_pixels)) {
+        fprintf(stderr, "could not write %s/ground_truth.json\n", options.out_dir.c_str());
+        return 1;
+    }
+
+    fprintf(stderr, "%u frames in %.1f s\n", (unsigned) options.frames,
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return 0;
+}
@@ -27,6 +27,14 @@ let find_best_tile_alignment_state              = create_pipeline(with_function_
 let warp_texture_bayer_state                    = create_pipeline(with_function_name: "warp_texture_bayer",                     and_label: "Warp Texture (Bayer)")
 let warp_texture_xtrans_state                   = create_pipeline(with_function_name: "warp_texture_xtrans",                    and_label: "Warp Texture (XTrans)")
 
+// Parameters of the global shift that can seed the alignment
+// - the shift is estimated on the coarsest pyramid level with at least this many pixels on its shorter side
+let global_shift_resolution = 256
+// - confidence below which the estimate is not used (unrelated content scores about 0.45, shifted frames of a burst above 0.85)
+let global_shift_min_confidence: Float32 = 0.7
+// - number of coarsest pyramid levels that are skipped for frames with a confident estimate
+let seeded_levels_skipped = 2
+
 /**
  * Aligns a comparison texture to a reference texture using hierarchical alignment approach
  *
@@ -38,9 +46,10 @@ let warp_texture_xtrans_state                   = create_pipeline(with_function_
  * @param uniform_exposure      Flag indicating whether exposure is uniform between frames
  * @param black_level_mean      Mean black level of the sensor
  * @param color_factors3        Array of color correction factors (R, G, B)
+ * @param seed_alignment        Flag indicating whether to seed the alignment with the global shift of the frame
  * @return                      The aligned comparison texture
  */
-func align_texture(_ ref_pyramid: [MTLTexture], _ comp_texture: MTLTexture, _ downscale_factor_array: Array<Int>, _ tile_size_array: Array<Int>, _ search_dist_array: Array<Int>, _ uniform_exposure: Bool, _ black_level_mean: Double, _ color_factors3: Array<Double>) -> MTLTexture {
+func align_texture(_ ref_pyramid: [MTLTexture], _ comp_texture: MTLTexture, _ downscale_factor_array: Array<Int>, _ tile_size_array: Array<Int>, _ search_dist_array: Array<Int>, _ uniform_exposure: Bool, _ black_level_mean: Double, _ color_factors3: Array<Double>, _ seed_alignment: Bool) -> MTLTexture {
     
     // ISSUE: No validation of array lengths
     // The function assumes that downscale_factor_array, tile_size_array, and search_dist_array
@@ -62,10 +71,45 @@ func align_texture(_ ref_pyramid: [MTLTexture], _ comp_texture: MTLTexture, _ do
     var tile_info = TileInfo(tile_size: 0, tile_size_merge: 0, search_dist: 0, n_tiles_x: 0, n_tiles_y: 0, n_pos_1d: 0, n_pos_2d: 0)
     
     // build comparison pyramid
-    let comp_pyramid = build_pyramid(comp_texture, downscale_factor_array, black_level_mean, color_factors3)
+    // - when seeding, only the levels that a seeded alignment searches are built at first, and the others are only
+    //   added if the global shift is not used
+    var coarsest_level = downscale_factor_array.count-1
+    var comp_pyramid: [MTLTexture]
+    var seeded = false
+    if seed_alignment && coarsest_level > 1 {
+        let seeded_coarsest_level = max(1, coarsest_level - seeded_levels_skipped)
+        let shift_level = global_shift_level(ref_pyramid, coarsest_level)
+        comp_pyramid = build_pyramid(comp_texture, downscale_factor_array, black_level_mean, color_factors3, levels: max(seeded_coarsest_level, shift_level) + 1)
+        
+        // seed the alignment with the global shift of the frame, estimated by phase correlation
+        // - with a confident estimate, the coarsest levels only have to find the remaining local motion, so up to
+        //   'seeded_levels_skipped' of them are skipped (keeping at least two levels)
+        // - otherwise, all levels are searched from zero motion as without seeding
+        if let global_shift = estimate_global_shift(ref_pyramid[shift_level], comp_pyramid[shift_level]) {
+            coarsest_level = seeded_coarsest_level
+            
+            // convert the shift from pixels of the level it was estimated on to pixels of the coarsest level used
+            let level_scale = {(level: Int) in Double(downscale_factor_array[0...level].dropFirst().reduce(1, *))}
+            let scale = level_scale(coarsest_level) / level_scale(shift_level)
+            let seed = [Int16((global_shift[0]/scale).rounded()), Int16((global_shift[1]/scale).rounded())]
+            
+            let command_buffer = command_queue.makeCommandBuffer()!
+            command_buffer.label = "Seed Alignment"
+            let blit_encoder = command_buffer.makeBlitCommandEncoder()!
+            let seed_buffer = device.makeBuffer(bytes: seed, length: MemoryLayout<Int16>.stride * 2)!
+            blit_encoder.copy(from: seed_buffer, sourceOffset: 0, sourceBytesPerRow: MemoryLayout<Int16>.stride * 2, sourceBytesPerImage: MemoryLayout<Int16>.stride * 2, sourceSize: MTLSize(width: 1, height: 1, depth: 1), to: current_alignment, destinationSlice: 0, destinationLevel: 0, destinationOrigin: MTLOrigin(x: 0, y: 0, z: 0))
+            blit_encoder.endEncoding()
+            command_buffer.commit()
+            seeded = true
+        } else {
+            comp_pyramid = build_pyramid(comp_texture, downscale_factor_array, black_level_mean, color_factors3, extending: comp_pyramid)
+        }
+    } else {
+        comp_pyramid = build_pyramid(comp_texture, downscale_factor_array, black_level_mean, color_factors3)
+    }
     
     // align tiles - starting from the coarsest level (highest index) and refining to finer levels
-    for i in (0 ... downscale_factor_array.count-1).reversed() {
+    for i in (0 ... coarsest_level).reversed() {
         
         // load layer params
         let tile_size = tile_size_array[i]
@@ -100,11 +144,12 @@ func align_texture(_ ref_pyramid: [MTLTexture], _ comp_texture: MTLTexture, _ do
         
         // resize previous alignment
         // - 'downscale_factor' has to be loaded from the *previous* layer since that is the layer that generated the current layer
+        // - at the coarsest level, the seed is used as it is, or ignored if there is none
         var downscale_factor: Int
-        if (i < downscale_factor_array.count-1){
+        if (i < coarsest_level){
             downscale_factor = downscale_factor_array[i+1]
         } else {
-            downscale_factor = 0
+            downscale_factor = seeded ? 1 : 0
         }
         
         // upsample alignment vectors by a factor of 2
@@ -199,13 +244,16 @@ func avg_pool(_ input_texture: MTLTexture, _ scale: Int, _ black_level_mean: Dou
  * @param downscale_factor_list Array of scale factors for each pyramid level
  * @param black_level_mean    Mean black level of the sensor
  * @param color_factors3      Array of color correction factors (R, G, B)
+ * @param levels              Number of levels to build (all levels of 'downscale_factor_list' if nil)
+ * @param partial_pyramid     Finest levels of the pyramid if they were built before, which are reused
  * @return                    Array of textures at different resolution levels (finest to coarsest)
  */
-func build_pyramid(_ input_texture: MTLTexture, _ downscale_factor_list: Array<Int>, _ black_level_mean: Double, _ color_factors3: Array<Double>) -> Array<MTLTexture> {
+func build_pyramid(_ input_texture: MTLTexture, _ downscale_factor_list: Array<Int>, _ black_level_mean: Double, _ color_factors3: Array<Double>, levels: Int? = nil, extending partial_pyramid: Array<MTLTexture> = []) -> Array<MTLTexture> {
     
     // iteratively resize the current layer in the pyramid
-    var pyramid: Array<MTLTexture> = []
-    for (i, downscale_factor) in downscale_factor_list.enumerated() {
+    var pyramid = partial_pyramid
+    for i in pyramid.count ..< (levels ?? downscale_factor_list.count) {
+        let downscale_factor = downscale_factor_list[i]
         if i == 0 {
             // If color_factor is NOT available, a negative value will be set and normalization is deactivated.
             // ISSUE: Scale factor not validated for avg_pool_normalization
@@ -220,6 +268,62 @@ func build_pyramid(_ input_texture: MTLTexture, _ downscale_factor_list: Array<I
     return pyramid
 }
 
+/**
+ * Chooses the pyramid level on which the global shift of a frame is estimated
+ *
+ * @param pyramid         Pyramid of the reference texture (finest to coarsest)
+ * @param max_level       Coarsest level that may be chosen
+ * @return                Coarsest level up to 'max_level' with at least 'global_shift_resolution' pixels on its shorter side, or 0 if there is none
+ */
+func global_shift_level(_ pyramid: [MTLTexture], _ max_level: Int) -> Int {
+    
+    var level = 0
+    while level < max_level && min(pyramid[level+1].width, pyramid[level+1].height) >= global_shift_resolution {
+        level += 1
+    }
+    return level
+}
+
+/**
+ * Estimates the global shift between two textures by phase correlation
+ *
+ * Both textures are read back to the CPU, where their phase correlation is computed (see phase_correlate in the
+ * DNG SDK wrapper). The readback is queued behind the commands that write the textures, so the wait for it also
+ * covers the pyramid levels, which the alignment needs anyway, instead of adding a round trip of its own.
+ *
+ * @param ref_texture   Reference texture, e.g. a level of the reference pyramid chosen by global_shift_level
+ * @param comp_texture  Comparison texture of the same size
+ * @return              Shift [dx, dy] in pixels of the input textures such that the comparison texture at (x+dx, y+dy)
+ *                      matches the reference texture at (x, y), or nil if no shift stands out clearly enough
+ */
+func estimate_global_shift(_ ref_texture: MTLTexture, _ comp_texture: MTLTexture) -> [Double]? {
+    
+    // copy both float16 textures into one buffer that the CPU can read
+    let width = ref_texture.width
+    let height = ref_texture.height
+    let bytes_per_row = width * MemoryLayout<UInt16>.stride
+    let bytes_per_image = bytes_per_row * height
+    guard let readback_buffer = device.makeBuffer(length: 2*bytes_per_image, options: .storageModeShared) else {return nil}
+    let command_buffer = command_queue.makeCommandBuffer()!
+    command_buffer.label = "Global Shift Readback"
+    let blit_encoder = command_buffer.makeBlitCommandEncoder()!
+    for (i, texture) in [ref_texture, comp_texture].enumerated() {
+        blit_encoder.copy(from: texture, sourceSlice: 0, sourceLevel: 0, sourceOrigin: MTLOrigin(x: 0, y: 0, z: 0), sourceSize: MTLSize(width: width, height: height, depth: 1), to: readback_buffer, destinationOffset: i*bytes_per_image, destinationBytesPerRow: bytes_per_row, destinationBytesPerImage: bytes_per_image)
+    }
+    blit_encoder.endEncoding()
+    command_buffer.commit()
+    command_buffer.waitUntilCompleted()
+    
+    let pixels = readback_buffer.contents().bindMemory(to: UInt16.self, capacity: 2*width*height)
+    var shift_x: Float32 = 0
+    var shift_y: Float32 = 0
+    var confidence: Float32 = 0
+    if phase_correlate(pixels, pixels + width*height, Int32(width), Int32(height), &shift_x, &shift_y, &confidence) != 0 || confidence < global_shift_min_confidence {
+        return nil
+    }
+    return [Double(shift_x), Double(shift_y)]
+}
+
 /**
  * Computes the differences between tiles in reference and comparison textures
  *
@@ -0,0 +1,348 @@
+/**
+ * @file phase_correlation.cpp
+ * @brief Estimation of the translation between two images by phase correlation
+ */
+
+/*****************************************************************************/
+
+#include "phase_correlation.h"
+
+#include "dng_exceptions.h"
+#include "dng_utils.h"
+
+#include <math.h>
+
+/*****************************************************************************/
+
+namespace
+	{
+
+	// Limits of the side of the correlated square. Larger images are
+	// cropped, since a few hundred pixels are enough for a global shift.
+
+	const uint32 kMinSize = 16;
+	const uint32 kMaxSize = 512;
+
+	// Peaks closer than this to the highest one are part of it.
+
+	const uint32 kPeakRadius = 2;
+
+	// Shift of a correlation index, wrapped to (-size / 2, size / 2].
+
+	int32 WrapShift (uint32 index,
+					 uint32 size)
+		{
+		return index > size / 2 ? (int32) index - (int32) size : (int32) index;
+		}
+
+	// Offset of the top of a parabola through three samples, in [-0.5, 0.5].
+
+	real64 ParabolaPeak (real64 left,
+						 real64 center,
+						 real64 right)
+		{
+
+		real64 curvature = left - 2.0 * center + right;
+
+		if (curvature >= 0.0)
+			{
+			return 0.0;
+			}
+
+		return Pin_real64 (-0.5, 0.5 * (left - right) / curvature, 0.5);
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+phase_correlator::phase_correlator (uint32 width,
+									uint32 height)
+
+	:	fWidth		(width)
+	,	fHeight		(height)
+	,	fSize		(0)
+	,	fLog2Size	(0)
+	,	fBitReverse	()
+	,	fTwiddles	()
+	,	fWindow		()
+
+	{
+
+	uint32 side = Min_uint32 (width, height, kMaxSize);
+
+	if (side < kMinSize)
+		{
+		ThrowBadFormat ("Image too small for phase correlation");
+		}
+
+	while ((2u << fLog2Size) <= side)
+		{
+		fLog2Size++;
+		}
+
+	fSize = 1u << fLog2Size;
+
+	fBitReverse.resize (fSize);
+
+	for (uint32 i = 0; i < fSize; i++)
+		{
+
+		uint32 reversed = 0;
+
+		for (uint32 bit = 0; bit < fLog2Size; bit++)
+			{
+			reversed |= ((i >> bit) & 1) << (fLog2Size - 1 - bit);
+			}
+
+		fBitReverse [i] = reversed;
+
+		}
+
+	fTwiddles.resize (fSize / 2);
+
+	for (uint32 k = 0; k < fSize / 2; k++)
+		{
+
+		real64 angle = -2.0 * M_PI * k / fSize;
+
+		fTwiddles [k] = complex ((real32) cos (angle),
+								 (real32) sin (angle));
+
+		}
+
+	// Hann window, so the image borders do not correlate as an edge at the
+	// center of the wrapped image.
+
+	fWindow.resize (fSize);
+
+	for (uint32 i = 0; i < fSize; i++)
+		{
+		fWindow [i] = (real32) (0.5 - 0.5 * cos (2.0 * M_PI * (i + 0.5) / fSize));
+		}
+
+	}
+
+/*****************************************************************************/
+
+void phase_correlator::Load (const real32 *data,
+							 int32 rowStep,
+							 std::vector<complex> &square) const
+	{
+
+	const uint32 left = (fWidth	 - fSize) / 2;
+	const uint32 top  = (fHeight - fSize) / 2;
+
+	real64 sum = 0.0;
+
+	for (uint32 row = 0; row < fSize; row++)
+		{
+
+		const real32 *src = data + (int64) (top + row) * rowStep + left;
+
+		for (uint32 col = 0; col < fSize; col++)
+			{
+			sum += src [col];
+			}
+
+		}
+
+	const real32 mean = (real32) (sum / ((real64) fSize * fSize));
+
+	square.resize ((size_t) fSize * fSize);
+
+	for (uint32 row = 0; row < fSize; row++)
+		{
+
+		const real32 *src = data + (int64) (top + row) * rowStep + left;
+
+		complex *dst = &square [(size_t) row * fSize];
+
+		for (uint32 col = 0; col < fSize; col++)
+			{
+			dst [col] = complex ((src [col] - mean) * fWindow [row] * fWindow [col], 0.0f);
+			}
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+void phase_correlator::Transform1D (complex *data,
+									uint32 step,
+									bool inverse) const
+	{
+
+	for (uint32 i = 0; i < fSize; i++)
+		{
+
+		uint32 j = fBitReverse [i];
+
+		if (i < j)
+			{
+			std::swap (data [i * step], data [j * step]);
+			}
+
+		}
+
+	for (uint32 length = 2; length <= fSize; length <<= 1)
+		{
+
+		const uint32 half		 = length / 2;
+		const uint32 twiddleStep = fSize / length;
+
+		for (uint32 start = 0; start < fSize; start += length)
+			{
+
+			for (uint32 k = 0; k < half; k++)
+				{
+
+				complex twiddle = fTwiddles [k * twiddleStep];
+
+				if (inverse)
+					{
+					twiddle = std::conj (twiddle);
+					}
+
+				complex &a = data [(start + k		) * step];
+				complex &b = data [(start + k + half) * step];
+
+				complex t = b * twiddle;
+
+				b = a - t;
+				a = a + t;
+
+				}
+
+			}
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+void phase_correlator::Transform2D (std::vector<complex> &data,
+									bool inverse) const
+	{
+
+	for (uint32 row = 0; row < fSize; row++)
+		{
+		Transform1D (&data [(size_t) row * fSize], 1, inverse);
+		}
+
+	for (uint32 col = 0; col < fSize; col++)
+		{
+		Transform1D (&data [col], fSize, inverse);
+		}
+
+	}
+
+/*****************************************************************************/
+
+phase_correlator::estimate phase_correlator::Estimate (const real32 *reference,
+													   const real32 *comparison,
+													   int32 rowStep) const
+	{
+
+	std::vector<complex> surface;
+	std::vector<complex> other;
+
+	Load (reference,  rowStep, surface);
+	Load (comparison, rowStep, other);
+
+	Transform2D (surface, false);
+	Transform2D (other,	  false);
+
+	// Normalized cross power spectrum. Only the phase is kept, so the peak
+	// does not depend on the contrast or exposure of the images.
+
+	for (size_t k = 0; k < surface.size (); k++)
+		{
+
+		complex cross = std::conj (surface [k]) * other [k];
+
+		real32 magnitude = std::abs (cross);
+
+		surface [k] = magnitude > 0.0f ? cross / magnitude : complex (0.0f, 0.0f);
+
+		}
+
+	Transform2D (surface, true);
+
+	const real64 scale = 1.0 / ((real64) fSize * fSize);
+
+	uint32 peakRow = 0;
+	uint32 peakCol = 0;
+
+	real64 peak = -1.0;
+
+	for (uint32 row = 0; row < fSize; row++)
+		{
+
+		for (uint32 col = 0; col < fSize; col++)
+			{
+
+			real64 value = surface [(size_t) row * fSize + col].real () * scale;
+
+			if (value > peak)
+				{
+				peak	= value;
+				peakRow = row;
+				peakCol = col;
+				}
+
+			}
+
+		}
+
+	real64 secondPeak = 0.0;
+
+	for (uint32 row = 0; row < fSize; row++)
+		{
+
+		uint32 dv = Abs_int32 (WrapShift ((row - peakRow) & (fSize - 1), fSize));
+
+		for (uint32 col = 0; col < fSize; col++)
+			{
+
+			uint32 dh = Abs_int32 (WrapShift ((col - peakCol) & (fSize - 1), fSize));
+
+			if (dv <= kPeakRadius && dh <= kPeakRadius)
+				{
+				continue;
+				}
+
+			secondPeak = Max_real64 (secondPeak,
+									 surface [(size_t) row * fSize + col].real () * scale);
+
+			}
+
+		}
+
+	auto sample = [&] (uint32 row, uint32 col)
+		{
+		return (real64) surface [(size_t) (row & (fSize - 1)) * fSize + (col & (fSize - 1))].real ();
+		};
+
+	estimate result;
+
+	result.fShiftH = WrapShift (peakCol, fSize) + ParabolaPeak (sample (peakRow, peakCol - 1),
+																sample (peakRow, peakCol	),
+																sample (peakRow, peakCol + 1));
+
+	result.fShiftV = WrapShift (peakRow, fSize) + ParabolaPeak (sample (peakRow - 1, peakCol),
+																sample (peakRow,	 peakCol),
+																sample (peakRow + 1, peakCol));
+
+	result.fPeak = peak;
+
+	result.fConfidence = peak > 0.0 ? Pin_real64 (0.0, 1.0 - secondPeak / peak, 1.0) : 0.0;
+
+	return result;
+
+	}
+
+/*****************************************************************************/
@@ -0,0 +1,128 @@
+/**
+ * @file phase_correlation.h
+ * @brief Estimation of the translation between two images by phase correlation
+ *
+ * The CPU side of the global shift that can seed the alignment of a burst frame (see estimate_global_shift
+ * in align.swift, which reaches it through phase_correlate in the DNG SDK wrapper). Written in the style
+ * and with the types of the DNG SDK, which it builds on.
+ */
+
+/*****************************************************************************/
+
+#ifndef __phase_correlation__
+#define __phase_correlation__
+
+/*****************************************************************************/
+
+#include "dng_types.h"
+#include "dng_uncopyable.h"
+
+#include <complex>
+#include <vector>
+
+/*****************************************************************************/
+
+/// \brief Finds the translation between two images of the same size from
+/// the peak of their phase correlation.
+///
+/// The correlation uses the largest centered square whose side is a power of
+/// two, windowed to suppress the image borders, and is computed with a
+/// radix-2 FFT. It is meant for small images, a few hundred pixels on a
+/// side, such as a heavily downsampled raw frame.
+
+class phase_correlator: private dng_uncopyable
+	{
+
+	public:
+
+		/// Result of Estimate.
+
+		struct estimate
+			{
+
+			/// Translation such that the comparison image at (x + fShiftH,
+			/// y + fShiftV) matches the reference image at (x, y).
+
+			real64 fShiftH = 0.0;
+
+			real64 fShiftV = 0.0;
+
+			/// Height of the correlation peak, 1 for images that only differ
+			/// by a translation, less for noisy or changing content.
+
+			real64 fPeak = 0.0;
+
+			/// 1 minus the ratio of the second highest peak, away from the
+			/// highest one, to the highest one. Close to 0 when the images
+			/// have no clear translation, such as flat or repetitive content.
+
+			real64 fConfidence = 0.0;
+
+			};
+
+	private:
+
+		typedef std::complex<real32> complex;
+
+		uint32 fWidth;
+
+		uint32 fHeight;
+
+		uint32 fSize;
+
+		uint32 fLog2Size;
+
+		std::vector<uint32> fBitReverse;
+
+		std::vector<complex> fTwiddles;
+
+		std::vector<real32> fWindow;
+
+	public:
+
+		/// Prepare the correlation of images of the given size.
+		/// \exception dng_exception with fErrorCode equal to dng_error_bad_format
+		/// if an image is smaller than 16 pixels on a side.
+
+		phase_correlator (uint32 width,
+						  uint32 height);
+
+		/// Side of the square that is correlated.
+
+		uint32 Size () const
+			{
+			return fSize;
+			}
+
+		/// Estimate the translation between two images of the size passed
+		/// to the constructor.
+		/// \param reference Pixels of the reference image.
+		/// \param comparison Pixels of the comparison image.
+		/// \param rowStep Distance between rows in pixels.
+
+		estimate Estimate (const real32 *reference,
+						   const real32 *comparison,
+						   int32 rowStep) const;
+
+	private:
+
+		// Copy the centered square, without its mean and windowed.
+
+		void Load (const real32 *data,
+				   int32 rowStep,
+				   std::vector<complex> &square) const;
+
+		void Transform1D (complex *data,
+						  uint32 step,
+						  bool inverse) const;
+
+		void Transform2D (std::vector<complex> &data,
+						  bool inverse) const;
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
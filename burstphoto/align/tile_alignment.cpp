@@ -0,0 +1,776 @@
+/**
+ * @file tile_alignment.cpp
+ * @brief Hierarchical tile alignment of two images on the CPU
+ */
+
+/*****************************************************************************/
+
+#include "tile_alignment.h"
+
+#include "dng_exceptions.h"
+#include "dng_utils.h"
+
+#include <algorithm>
+
+/*****************************************************************************/
+
+namespace
+	{
+
+	// Value compared with reference pixels whose comparison pixel is outside
+	// the image, as on the GPU, so that offsets leaving the image lose.
+
+	const real32 kOutsideValue = -65504.0f;
+
+	// Spread of the ratio of the energies FindFlatTiles compares over tiles
+	// of pure noise, times the tile size.
+
+	const real64 kRatioSpread = 3.0;
+
+	// Mean energy of the second differences along both axes of the pixels
+	// of each cell of a grid, which covers the top left of an image. The
+	// second differences are zero on linear gradients, such as a clear sky,
+	// which cannot be aligned either.
+
+	void CellEnergy (const std::vector<real32> &image,
+					 uint32 width,
+					 uint32 cellSize,
+					 uint32 cellsH,
+					 uint32 cellsV,
+					 std::vector<real64> &energy)
+		{
+
+		energy.assign ((size_t) cellsH * cellsV, 0.0);
+
+		std::vector<uint32> counts ((size_t) cellsH * cellsV, 0);
+
+		for (uint32 row = 1; row + 1 < cellsV * cellSize; row++)
+			{
+
+			const real32 *above = &image [(size_t) (row - 1) * width];
+			const real32 *line	= &image [(size_t) (row		) * width];
+			const real32 *below = &image [(size_t) (row + 1) * width];
+
+			const size_t cellRow = (size_t) (row / cellSize) * cellsH;
+
+			for (uint32 col = 1; col + 1 < cellsH * cellSize; col++)
+				{
+
+				real32 dh = line  [col - 1] - 2.0f * line [col] + line  [col + 1];
+				real32 dv = above [col	  ] - 2.0f * line [col] + below [col	];
+
+				const size_t cell = cellRow + col / cellSize;
+
+				energy [cell] += dh * dh + dv * dv;
+
+				counts [cell]++;
+
+				}
+
+			}
+
+		for (size_t cell = 0; cell < energy.size (); cell++)
+			{
+
+			if (counts [cell])
+				{
+				energy [cell] /= counts [cell];
+				}
+
+			}
+
+		}
+
+	// Median of the vectors of a list, axis by axis.
+
+	dng_point MedianVector (std::vector<int32> &h,
+							std::vector<int32> &v)
+		{
+
+		const size_t middle = (h.size () - 1) / 2;
+
+		std::nth_element (h.begin (), h.begin () + middle, h.end ());
+		std::nth_element (v.begin (), v.begin () + middle, v.end ());
+
+		return dng_point (v [middle], h [middle]);
+
+		}
+
+	// Half the size of an image by averaging 2 by 2 blocks.
+
+	void Downsample (const std::vector<real32> &src,
+					 uint32 srcWidth,
+					 std::vector<real32> &dst,
+					 uint32 dstWidth,
+					 uint32 dstHeight)
+		{
+
+		dst.resize ((size_t) dstWidth * dstHeight);
+
+		for (uint32 row = 0; row < dstHeight; row++)
+			{
+
+			const real32 *src0 = &src [(size_t) (2 * row	) * srcWidth];
+			const real32 *src1 = &src [(size_t) (2 * row + 1) * srcWidth];
+
+			real32 *dstPtr = &dst [(size_t) row * dstWidth];
+
+			for (uint32 col = 0; col < dstWidth; col++)
+				{
+				dstPtr [col] = 0.25f * (src0 [2 * col] + src0 [2 * col + 1] +
+										src1 [2 * col] + src1 [2 * col + 1]);
+				}
+
+			}
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+tile_aligner::tile_aligner (uint32 width,
+							uint32 height,
+							uint32 tileSize,
+							uint32 coarsestSize)
+
+	:	fLevels			 ()
+	,	fSearchDistance	 (2)
+	,	fFlatRatio		 (3.0)
+	,	fEarlyExitMargin (0.1)
+
+	{
+
+	if (tileSize < 8 || tileSize > 64 || (tileSize & (tileSize - 1)))
+		{
+		ThrowProgramError ("Bad tile size for tile alignment");
+		}
+
+	if (width < tileSize * 3 / 2 || height < tileSize * 3 / 2)
+		{
+		ThrowBadFormat ("Image too small for tile alignment");
+		}
+
+	level info;
+
+	info.fWidth	   = width;
+	info.fHeight   = height;
+	info.fTileSize = tileSize;
+	info.fTilesH   = width	/ (tileSize / 2) - 1;
+	info.fTilesV   = height / (tileSize / 2) - 1;
+
+	fLevels.push_back (info);
+
+	uint32 resolution = Min_uint32 (width, height);
+
+	while (resolution > coarsestSize)
+		{
+
+		level next;
+
+		next.fWidth	   = info.fWidth  / 2;
+		next.fHeight   = info.fHeight / 2;
+		next.fTileSize = Max_uint32 (info.fTileSize / 2, 8);
+
+		if (next.fWidth	 < next.fTileSize * 3 / 2 ||
+			next.fHeight < next.fTileSize * 3 / 2)
+			{
+			break;
+			}
+
+		next.fTilesH = next.fWidth	/ (next.fTileSize / 2) - 1;
+		next.fTilesV = next.fHeight / (next.fTileSize / 2) - 1;
+
+		fLevels.push_back (next);
+
+		info = next;
+
+		resolution /= 2;
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+void tile_aligner::SetSearchDistance (int32 distance)
+	{
+
+	fSearchDistance = Max_int32 (distance, 0);
+
+	}
+
+/*****************************************************************************/
+
+void tile_aligner::SetFlatRatio (real64 ratio)
+	{
+
+	fFlatRatio = ratio;
+
+	}
+
+/*****************************************************************************/
+
+void tile_aligner::SetEarlyExitMargin (real64 margin)
+	{
+
+	fEarlyExitMargin = Max_real64 (margin, 0.0);
+
+	}
+
+/*****************************************************************************/
+
+real64 tile_aligner::TileCost (const std::vector<real32> &reference,
+							   const std::vector<real32> &comparison,
+							   const level &info,
+							   int32 left,
+							   int32 top,
+							   int32 dh,
+							   int32 dv,
+							   bool squared) const
+	{
+
+	const int32 size   = (int32) info.fTileSize;
+	const int32 width  = (int32) info.fWidth;
+	const int32 height = (int32) info.fHeight;
+
+	// Columns of the tile whose comparison pixel is inside the image.
+
+	const int32 colStart = Pin_int32 (0, -(left + dh),		   size);
+	const int32 colEnd	 = Pin_int32 (0, width - (left + dh), size);
+
+	real64 cost = 0.0;
+
+	for (int32 row = 0; row < size; row++)
+		{
+
+		const real32 *ref = &reference [(size_t) (top + row) * width + left];
+
+		const int32 compRow = top + row + dv;
+
+		const bool rowInside = compRow >= 0 && compRow < height;
+
+		const real32 *comp = rowInside ? &comparison [(size_t) compRow * width + left + dh]
+									   : NULL;
+
+		real32 rowCost = 0.0f;
+
+		for (int32 col = 0; col < size; col++)
+			{
+
+			real32 value = (rowInside && col >= colStart && col < colEnd) ? comp [col]
+																		  : kOutsideValue;
+
+			real32 diff = ref [col] - value;
+
+			rowCost += squared ? diff * diff : Abs_real32 (diff);
+
+			}
+
+		cost += rowCost;
+
+		}
+
+	return cost;
+
+	}
+
+/*****************************************************************************/
+
+void tile_aligner::FindFlatTiles (const std::vector<real32> &reference,
+								  const std::vector<real32> &coarser,
+								  const level &info,
+								  std::vector<uint8> &flat) const
+	{
+
+	const uint32 tiles = info.fTilesH * info.fTilesV;
+
+	const uint32 halfTile = info.fTileSize / 2;
+
+	// Energy per pixel of each half tile at this level and at the next
+	// coarser one, summed to that of the tiles, since tiles overlap by half.
+
+	const uint32 cellsH = info.fTilesH + 1;
+	const uint32 cellsV = info.fTilesV + 1;
+
+	std::vector<real64> fine;
+	std::vector<real64> coarse;
+
+	CellEnergy (reference, info.fWidth,		halfTile,	  cellsH, cellsV, fine);
+	CellEnergy (coarser,   info.fWidth / 2, halfTile / 2, cellsH, cellsV, coarse);
+
+	// The pixels of the coarser level average 2 by 2 pixels, which divides
+	// the energy of white noise by 4. The energy of texture, which extends
+	// over more than a pixel, drops much less or grows. A tile is flat if
+	// the ratio of the two energies is within fFlatRatio times its spread
+	// for pure noise, about 3 / tileSize, of the ratio for pure noise.
+
+	const real64 limit = 1.0 + fFlatRatio * kRatioSpread / info.fTileSize;
+
+	flat.resize (tiles);
+
+	for (uint32 ty = 0; ty < info.fTilesV; ty++)
+		{
+
+		for (uint32 tx = 0; tx < info.fTilesH; tx++)
+			{
+
+			const size_t cell = (size_t) ty * cellsH + tx;
+
+			const real64 fineEnergy = fine [cell		 ] + fine [cell + 1			] +
+									  fine [cell + cellsH] + fine [cell + cellsH + 1];
+
+			const real64 coarseEnergy = coarse [cell		 ] + coarse [cell + 1		  ] +
+										coarse [cell + cellsH] + coarse [cell + cellsH + 1];
+
+			flat [(size_t) ty * info.fTilesH + tx] = 4.0 * coarseEnergy <= limit * fineEnergy;
+
+			}
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+void tile_aligner::Align (const real32 *reference,
+						  const real32 *comparison,
+						  int32 rowStep,
+						  bool adaptive,
+						  std::vector<dng_point> &alignment,
+						  stats *counters) const
+	{
+
+	const uint32 levels = Levels ();
+
+	// Build both pyramids.
+
+	std::vector<std::vector<real32>> refPyramid	 (levels);
+	std::vector<std::vector<real32>> compPyramid (levels);
+
+	const uint32 width	= fLevels [0].fWidth;
+	const uint32 height = fLevels [0].fHeight;
+
+	refPyramid	[0].resize ((size_t) width * height);
+	compPyramid [0].resize ((size_t) width * height);
+
+	for (uint32 row = 0; row < height; row++)
+		{
+
+		std::copy (reference + (int64) row * rowStep,
+				   reference + (int64) row * rowStep + width,
+				   &refPyramid [0] [(size_t) row * width]);
+
+		std::copy (comparison + (int64) row * rowStep,
+				   comparison + (int64) row * rowStep + width,
+				   &compPyramid [0] [(size_t) row * width]);
+
+		}
+
+	for (uint32 index = 1; index < levels; index++)
+		{
+
+		const level &info = fLevels [index];
+
+		Downsample (refPyramid [index - 1],
+					fLevels [index - 1].fWidth,
+					refPyramid [index],
+					info.fWidth,
+					info.fHeight);
+
+		Downsample (compPyramid [index - 1],
+					fLevels [index - 1].fWidth,
+					compPyramid [index],
+					info.fWidth,
+					info.fHeight);
+
+		}
+
+	stats result;
+
+	const int32 side = 2 * fSearchDistance + 1;
+
+	const uint32 positions = (uint32) (side * side);
+
+	const uint32 center = positions / 2;
+
+	std::vector<real64> costs (positions);
+	std::vector<uint8> done (positions);
+
+	std::vector<dng_point> current;
+
+	for (int32 index = (int32) levels - 1; index >= 0; index--)
+		{
+
+		const level &info = fLevels [index];
+
+		const std::vector<real32> &ref	= refPyramid  [index];
+		const std::vector<real32> &comp = compPyramid [index];
+
+		const uint32 tiles = info.fTilesH * info.fTilesV;
+
+		const bool squared = index != 0;
+
+		const bool coarsest = index == (int32) levels - 1;
+
+		// Upsample the vectors of the coarser level by nearest neighbour.
+
+		std::vector<dng_point> upsampled (tiles, dng_point (0, 0));
+
+		if (!coarsest)
+			{
+
+			const level &coarse = fLevels [index + 1];
+
+			for (uint32 ty = 0; ty < info.fTilesV; ty++)
+				{
+
+				const uint32 cy = ty * coarse.fTilesV / info.fTilesV;
+
+				for (uint32 tx = 0; tx < info.fTilesH; tx++)
+					{
+
+					const uint32 cx = tx * coarse.fTilesH / info.fTilesH;
+
+					const dng_point &vector = current [(size_t) cy * coarse.fTilesH + cx];
+
+					upsampled [(size_t) ty * info.fTilesH + tx] = dng_point (vector.v * 2,
+																			 vector.h * 2);
+
+					}
+
+				}
+
+			}
+
+		std::vector<uint8> flat (tiles, 0);
+
+		if (adaptive && !coarsest)
+			{
+			FindFlatTiles (ref, refPyramid [index + 1], info, flat);
+			}
+
+		std::vector<dng_point> next (upsampled);
+
+		for (uint32 ty = 0; ty < info.fTilesV; ty++)
+			{
+
+			for (uint32 tx = 0; tx < info.fTilesH; tx++)
+				{
+
+				const size_t tile = (size_t) ty * info.fTilesH + tx;
+
+				const int32 left = (int32) (tx * info.fTileSize / 2);
+				const int32 top	 = (int32) (ty * info.fTileSize / 2);
+
+				result.fTiles++;
+
+				result.fExhaustiveEvaluations += positions + (coarsest ? 0 : 3);
+
+				if (flat [tile])
+					{
+					result.fFlatTiles++;
+					continue;
+					}
+
+				// Start from the best of the upsampled vectors of this tile
+				// and of its neighbours towards the closer coarse tiles, which
+				// fixes vectors at the borders of moving objects.
+
+				dng_point start = upsampled [tile];
+
+				real64 startCost = 0.0;
+
+				bool startKnown = false;
+
+				if (!coarsest)
+					{
+
+					const uint32 nx = (uint32) Pin_int32 (0, (int32) tx + (tx % 2 == 0 ? -1 : 1), (int32) info.fTilesH - 1);
+					const uint32 ny = (uint32) Pin_int32 (0, (int32) ty + (ty % 2 == 0 ? -1 : 1), (int32) info.fTilesV - 1);
+
+					const dng_point candidates [3] =
+						{
+						upsampled [tile],
+						upsampled [(size_t) ty * info.fTilesH + nx],
+						upsampled [(size_t) ny * info.fTilesH + tx]
+						};
+
+					for (uint32 c = 0; c < 3; c++)
+						{
+
+						real64 cost = TileCost (ref,
+												comp,
+												info,
+												left,
+												top,
+												candidates [c].h,
+												candidates [c].v,
+												squared);
+
+						if (c == 0 || cost < startCost)
+							{
+							start	  = candidates [c];
+							startCost = cost;
+							}
+
+						}
+
+					result.fEvaluations += 3;
+
+					startKnown = true;
+
+					}
+
+				std::fill (done.begin (), done.end (), (uint8) 0);
+
+				auto evaluate = [&] (uint32 position)
+					{
+
+					if (!done [position])
+						{
+
+						if (position == center && startKnown)
+							{
+							costs [position] = startCost;
+							}
+
+						else
+							{
+
+							costs [position] = TileCost (ref,
+														 comp,
+														 info,
+														 left,
+														 top,
+														 start.h + (int32) (position % side) - fSearchDistance,
+														 start.v + (int32) (position / side) - fSearchDistance,
+														 squared);
+
+							result.fEvaluations++;
+
+							}
+
+						done [position] = 1;
+
+						}
+
+					return costs [position];
+
+					};
+
+				// In the adaptive mode, walk from the start vector to the
+				// neighbour with the lowest cost along either axis, and stop
+				// once the costs next to the current offset are all clearly
+				// higher than its own.
+
+				if (adaptive && fSearchDistance > 0)
+					{
+
+					uint32 position = center;
+
+					bool converged = false;
+
+					while (!converged)
+						{
+
+						const real64 cost = evaluate (position);
+
+						const real64 limit = cost * (1.0 + fEarlyExitMargin);
+
+						const int32 col = (int32) (position % side);
+						const int32 row = (int32) (position / side);
+
+						const bool inside [4] =
+							{
+							col > 0,
+							col < side - 1,
+							row > 0,
+							row < side - 1
+							};
+
+						const int32 steps [4] = { -1, 1, -side, side };
+
+						uint32 lowest = position;
+
+						real64 lowestCost = cost;
+
+						bool clear = true;
+
+						for (uint32 k = 0; k < 4; k++)
+							{
+
+							if (!inside [k])
+								{
+								continue;
+								}
+
+							const uint32 neighbour = (uint32) ((int32) position + steps [k]);
+
+							const real64 neighbourCost = evaluate (neighbour);
+
+							clear = clear && neighbourCost > limit;
+
+							if (neighbourCost < lowestCost)
+								{
+								lowest	   = neighbour;
+								lowestCost = neighbourCost;
+								}
+
+							}
+
+						if (clear)
+							{
+
+							next [tile] = dng_point (start.v + row - fSearchDistance,
+													 start.h + col - fSearchDistance);
+
+							converged = true;
+
+							}
+
+						// A minimum that is not clear needs the full search.
+
+						else if (lowest == position)
+							{
+							break;
+							}
+
+						position = lowest;
+
+						}
+
+					if (converged)
+						{
+
+						result.fEarlyExits++;
+
+						continue;
+
+						}
+
+					}
+
+				// Search all offsets, keeping the first of equal costs.
+
+				uint32 best = 0;
+
+				for (uint32 position = 0; position < positions; position++)
+					{
+
+					if (evaluate (position) < costs [best])
+						{
+						best = position;
+						}
+
+					}
+
+				next [tile] = dng_point (start.v + (int32) (best / side) - fSearchDistance,
+										 start.h + (int32) (best % side) - fSearchDistance);
+
+				}
+
+			}
+
+		// Flat tiles take the median vector of their searched neighbours,
+		// spreading ring by ring into larger flat areas. Flat areas with no
+		// searched tile keep the upsampled vectors.
+
+		if (std::find (flat.begin (), flat.end (), (uint8) 1) != flat.end ())
+			{
+
+			std::vector<uint8> known (tiles);
+
+			for (uint32 tile = 0; tile < tiles; tile++)
+				{
+				known [tile] = !flat [tile];
+				}
+
+			std::vector<uint8> ring (tiles);
+
+			std::vector<int32> hs;
+			std::vector<int32> vs;
+
+			bool changed = true;
+
+			while (changed)
+				{
+
+				changed = false;
+
+				ring = known;
+
+				for (uint32 ty = 0; ty < info.fTilesV; ty++)
+					{
+
+					for (uint32 tx = 0; tx < info.fTilesH; tx++)
+						{
+
+						const size_t tile = (size_t) ty * info.fTilesH + tx;
+
+						if (ring [tile])
+							{
+							continue;
+							}
+
+						hs.clear ();
+						vs.clear ();
+
+						for (int32 y = (int32) ty - 1; y <= (int32) ty + 1; y++)
+							{
+
+							for (int32 x = (int32) tx - 1; x <= (int32) tx + 1; x++)
+								{
+
+								if (x < 0 || y < 0 ||
+									x >= (int32) info.fTilesH ||
+									y >= (int32) info.fTilesV)
+									{
+									continue;
+									}
+
+								const size_t neighbour = (size_t) y * info.fTilesH + x;
+
+								if (ring [neighbour])
+									{
+									hs.push_back (next [neighbour].h);
+									vs.push_back (next [neighbour].v);
+									}
+
+								}
+
+							}
+
+						if (!hs.empty ())
+							{
+
+							next [tile] = MedianVector (hs, vs);
+
+							known [tile] = 1;
+
+							changed = true;
+
+							}
+
+						}
+
+					}
+
+				}
+
+			}
+
+		current.swap (next);
+
+		}
+
+	alignment.swap (current);
+
+	if (counters)
+		{
+		*counters = result;
+		}
+
+	}
+
+/*****************************************************************************/
@@ -0,0 +1,213 @@
+/**
+ * @file tile_alignment.h
+ * @brief Hierarchical tile alignment of two images on the CPU
+ *
+ * A CPU counterpart of the tile alignment in align.swift and align.metal, reached through align_tiles in the
+ * DNG SDK wrapper. The native benchmarks time it and check its vectors against the ground truth of generated
+ * bursts. Written in the style and with the types of the DNG SDK, which it builds on.
+ */
+
+/*****************************************************************************/
+
+#ifndef __tile_alignment__
+#define __tile_alignment__
+
+/*****************************************************************************/
+
+#include "dng_point.h"
+#include "dng_types.h"
+#include "dng_uncopyable.h"
+
+#include <vector>
+
+/*****************************************************************************/
+
+/// \brief Finds the translation of every tile of a comparison image relative
+/// to a reference image, from coarse to fine over an image pyramid.
+///
+/// This follows the alignment done on the GPU. Each level halves the size of
+/// the level below it and the tile size, down to 8 pixels. Tiles overlap by
+/// half. At each level, the vector of a tile starts from the best of the
+/// upsampled vectors of its tile and of two neighbours, and is refined by
+/// searching all offsets up to the search distance. Coarse levels compare
+/// tiles by the sum of squared differences, the finest level by the sum of
+/// absolute differences.
+///
+/// In the adaptive mode, most tiles are not searched exhaustively:
+///
+/// - A tile is flat if its texture does not stand out from the noise, which
+/// is judged from how much its energy drops at the next coarser level. Flat
+/// tiles are not compared at all and take the median vector of their
+/// neighbours that were. Tiles of the coarsest level are never flat.
+///
+/// - For the other tiles, the search walks from the start vector to the
+/// neighbouring offset with the lowest cost, and stops once the offsets
+/// next to it along both axes all cost clearly more. Only if the walk ends
+/// without a clear minimum are the remaining offsets searched.
+
+class tile_aligner: private dng_uncopyable
+	{
+
+	public:
+
+		/// Counters of one call to Align.
+
+		struct stats
+			{
+
+			/// Tiles aligned, over all levels.
+
+			uint64 fTiles = 0;
+
+			/// Tiles that were flat and took the vectors of their neighbours.
+
+			uint64 fFlatTiles = 0;
+
+			/// Tiles whose search stopped early.
+
+			uint64 fEarlyExits = 0;
+
+			/// Tile comparisons done.
+
+			uint64 fEvaluations = 0;
+
+			/// Tile comparisons the exhaustive search does for the same images.
+
+			uint64 fExhaustiveEvaluations = 0;
+
+			/// Fraction of the comparisons of the exhaustive search that
+			/// were not done.
+
+			real64 SavedFraction () const
+				{
+				return fExhaustiveEvaluations ? 1.0 - (real64) fEvaluations /
+													  (real64) fExhaustiveEvaluations
+											  : 0.0;
+				}
+
+			};
+
+	private:
+
+		struct level
+			{
+
+			uint32 fWidth;
+
+			uint32 fHeight;
+
+			uint32 fTileSize;
+
+			uint32 fTilesH;
+
+			uint32 fTilesV;
+
+			};
+
+		std::vector<level> fLevels;
+
+		int32 fSearchDistance;
+
+		real64 fFlatRatio;
+
+		real64 fEarlyExitMargin;
+
+	public:
+
+		/// Prepare the alignment of images of the given size.
+		/// \param width Width of the images in pixels.
+		/// \param height Height of the images in pixels.
+		/// \param tileSize Tile size at full resolution, a power of two from
+		/// 8 to 64.
+		/// \param coarsestSize Levels are added while the smaller side of the
+		/// coarsest one is larger than this.
+		/// \exception dng_exception with fErrorCode equal to dng_error_bad_format
+		/// if the images are smaller than two tiles on a side.
+
+		tile_aligner (uint32 width,
+					  uint32 height,
+					  uint32 tileSize,
+					  uint32 coarsestSize);
+
+		/// Number of pyramid levels.
+
+		uint32 Levels () const
+			{
+			return (uint32) fLevels.size ();
+			}
+
+		/// Number of tiles in a row at full resolution.
+
+		uint32 TilesH () const
+			{
+			return fLevels [0].fTilesH;
+			}
+
+		/// Number of tiles in a column at full resolution.
+
+		uint32 TilesV () const
+			{
+			return fLevels [0].fTilesV;
+			}
+
+		/// Largest offset searched at each level, 2 by default.
+
+		void SetSearchDistance (int32 distance);
+
+		/// A tile is flat if the drop of its energy at the next coarser level
+		/// is within this many times its spread for pure noise of the drop for
+		/// pure noise, 3 by default.
+
+		void SetFlatRatio (real64 ratio);
+
+		/// The search stops early at an offset if the costs next to it exceed
+		/// its cost by this fraction, 0.1 by default.
+
+		void SetEarlyExitMargin (real64 margin);
+
+		/// Align the comparison image to the reference image.
+		/// \param reference Pixels of the reference image.
+		/// \param comparison Pixels of the comparison image.
+		/// \param rowStep Distance between rows in pixels.
+		/// \param adaptive Skip flat tiles and stop converged searches early,
+		/// instead of searching every tile exhaustively.
+		/// \param alignment Receives the vector of each tile at full resolution,
+		/// row by row, such that the comparison tile at the tile position plus
+		/// the vector matches the reference tile.
+		/// \param counters Receives the counters, may be NULL.
+
+		void Align (const real32 *reference,
+					const real32 *comparison,
+					int32 rowStep,
+					bool adaptive,
+					std::vector<dng_point> &alignment,
+					stats *counters = NULL) const;
+
+	private:
+
+		// Cost of comparing the reference tile at (left, top) with the
+		// comparison tile offset by (dh, dv).
+
+		real64 TileCost (const std::vector<real32> &reference,
+						 const std::vector<real32> &comparison,
+						 const level &info,
+						 int32 left,
+						 int32 top,
+						 int32 dh,
+						 int32 dv,
+						 bool squared) const;
+
+		// Flags the flat tiles of a level, given the next coarser level.
+
+		void FindFlatTiles (const std::vector<real32> &reference,
+							const std::vector<real32> &coarser,
+							const level &info,
+							std::vector<uint8> &flat) const;
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
@@ -64,14 +64,23 @@ struct MyProgram {
             //"/Volumes/My Burst Folder/Burst 03/",
         ]
         
-        // iterate over bursts
+        // load image paths for all bursts, so the next burst can be prefetched
+        let fm = FileManager.default
+        var burst_image_urls: [[URL]] = []
         for burst_dir in burst_dirs {
-            
-            // load image paths for the burst
-            let fm = FileManager.default
             let burst_url = URL(fileURLWithPath: burst_dir)
             var image_urls = try fm.contentsOfDirectory(at: burst_url, includingPropertiesForKeys: [], options: [.skipsHiddenFiles, .skipsSubdirectoryDescendants])
             image_urls.sort(by: {$0.path < $1.path})
+            burst_image_urls.append(image_urls)
+        }
+        
+        // iterate over bursts
+        for (burst_index, image_urls) in burst_image_urls.enumerated() {
+            
+            // read the next burst into the file cache while this one is processed
+            if burst_index + 1 < burst_image_urls.count {
+                prefetch_images(burst_image_urls[burst_index + 1])
+            }
             
             // ProcessingProgress is only useful for a GUI, but we have to instantiate one anyway
             let progress = ProcessingProgress()
@@ -88,13 +97,22 @@ struct MyProgram {
             let exposure_control = "LinearFullRange"
             // options: "Native" or "16Bit"
             let output_bit_depth = "Native"
+            // options: true or false (keeps decoded frames in ~/Library/Caches, so bursts processed again skip decoding)
+            let frame_cache = false
+            // options: true or false (seeds the alignment of each frame with its global shift, which lets the coarsest levels be skipped)
+            let seed_alignment = false
             
             // align+merge
-            let out_url = try perform_denoising(image_urls: image_urls, progress: progress, merging_algorithm: merging_algorithm, tile_size: tile_size, search_distance: search_distance, noise_reduction: noise_reduction, exposure_control: exposure_control, output_bit_depth: output_bit_depth, out_dir: out_dir, tmp_dir: tmp_dir)
+            let out_url = try perform_denoising(image_urls: image_urls, progress: progress, merging_algorithm: merging_algorithm, tile_size: tile_size, search_distance: search_distance, noise_reduction: noise_reduction, exposure_control: exposure_control, output_bit_depth: output_bit_depth, out_dir: out_dir, tmp_dir: tmp_dir, frame_cache: frame_cache, seed_alignment: seed_alignment)
            
             print("Image saved in:", out_url.relativePath)            
         }
         
+        // report how many DNG loads the prefetch served from the file cache
+        var prefetch_stats = dng_prefetch_stats()
+        get_dng_prefetch_stats(&prefetch_stats)
+        print("Prefetch: \(prefetch_stats.hits) hits, \(prefetch_stats.partial_hits) partial hits, \(prefetch_stats.misses) misses, \(prefetch_stats.bytes_prefetched / 1_000_000) MB read ahead")
+        
         // terminate Adobe XMP SDK
         terminate_xmp_sdk()
         
@@ -106,11 +106,13 @@ let search_distance_dict = [
  *   - output_bit_depth: Bit depth of output image ("Native" or "16Bit")
  *   - out_dir: Directory to save the final image
  *   - tmp_dir: Directory for temporary files
+ *   - frame_cache: Keep decoded frames in the user caches directory between runs (off by default, since it can take several GB of disk space)
+ *   - seed_alignment: Seed the alignment of each frame with its global shift, estimated by phase correlation on the CPU (off by default)
  *
  * Returns: URL to the processed output image
  * Throws: AlignmentError if processing fails at any stage
  */
-func perform_denoising(image_urls: [URL], progress: ProcessingProgress, merging_algorithm: String = "Fast", tile_size: String = "Medium", search_distance: String = "Medium", noise_reduction: Double = 13.0, exposure_control: String = "LinearFullRange", output_bit_depth: String = "Native", out_dir: String, tmp_dir: String) throws -> URL {
+func perform_denoising(image_urls: [URL], progress: ProcessingProgress, merging_algorithm: String = "Fast", tile_size: String = "Medium", search_distance: String = "Medium", noise_reduction: Double = 13.0, exposure_control: String = "LinearFullRange", output_bit_depth: String = "Native", out_dir: String, tmp_dir: String, frame_cache: Bool = false, seed_alignment: Bool = false) throws -> URL {
     
     // Maximum size for the caches
     let textureCacheMaxSizeMB: Double = min(10_000.0,
@@ -124,6 +126,9 @@ func perform_denoising(image_urls: [URL], progress: ProcessingProgress, merging_
                                              2 * textureCacheMaxSizeMB/1000))
     
     textureCache.totalCostLimit = Int(textureCacheMaxSizeMB)
+    if frame_cache {
+        set_frame_cache(max_size: maxDNGFolderSizeGB)
+    }
     
     // measure execution time
     let t0 = DispatchTime.now().uptimeNanoseconds
@@ -235,7 +240,7 @@ func perform_denoising(image_urls: [URL], progress: ProcessingProgress, merging_
     }
       
     let final_texture: MTLTexture
-    let current_settings = String(exposure_control == "Off" && uniform_exposure) + merging_algorithm + String(noise_reduction) + tile_size + String(search_distance) + image_urls.map({$0.absoluteString}).joined(separator: ".")
+    let current_settings = String(exposure_control == "Off" && uniform_exposure) + merging_algorithm + String(noise_reduction) + tile_size + String(search_distance) + String(seed_alignment) + image_urls.map({$0.absoluteString}).joined(separator: ".")
     if last_texture != nil && last_settings == current_settings {
         final_texture = copy_texture(last_texture!)
         DispatchQueue.main.async { progress.int += Int(80_000_000) }
@@ -261,9 +266,9 @@ func perform_denoising(image_urls: [URL], progress: ProcessingProgress, merging_
         if noise_reduction == 23.0 {
             try calculate_temporal_average(progress: progress, mosaic_pattern_width: mosaic_pattern_width, exposure_bias: exposure_bias, white_level: white_level[ref_idx], black_level: black_level, uniform_exposure: uniform_exposure, color_factors: color_factors, textures: textures, hotpixel_weight_texture: hotpixel_weight_texture, final_texture: final_texture)
         } else if merging_algorithm == "Higher quality" {
-            try align_merge_frequency_domain(progress: progress, ref_idx: ref_idx, mosaic_pattern_width: mosaic_pattern_width, search_distance: search_distance_dict[search_distance]!, tile_size: tile_size_dict[tile_size]!, noise_reduction: noise_reduction, uniform_exposure: uniform_exposure, exposure_bias: exposure_bias, white_level: white_level[ref_idx], black_level: black_level, color_factors: color_factors, textures: textures, hotpixel_weight_texture: hotpixel_weight_texture, final_texture: final_texture)
+            try align_merge_frequency_domain(progress: progress, ref_idx: ref_idx, mosaic_pattern_width: mosaic_pattern_width, search_distance: search_distance_dict[search_distance]!, tile_size: tile_size_dict[tile_size]!, noise_reduction: noise_reduction, uniform_exposure: uniform_exposure, exposure_bias: exposure_bias, white_level: white_level[ref_idx], black_level: black_level, color_factors: color_factors, textures: textures, hotpixel_weight_texture: hotpixel_weight_texture, final_texture: final_texture, seed_alignment: seed_alignment)
         } else {
-            try align_merge_spatial_domain(progress: progress, ref_idx: ref_idx, mosaic_pattern_width: mosaic_pattern_width, search_distance: search_distance_dict[search_distance]!, tile_size: tile_size_dict[tile_size]!, noise_reduction: noise_reduction, uniform_exposure: uniform_exposure, exposure_bias: exposure_bias, black_level: black_level, color_factors: color_factors, textures: textures, hotpixel_weight_texture: hotpixel_weight_texture, final_texture: final_texture)
+            try align_merge_spatial_domain(progress: progress, ref_idx: ref_idx, mosaic_pattern_width: mosaic_pattern_width, search_distance: search_distance_dict[search_distance]!, tile_size: tile_size_dict[tile_size]!, noise_reduction: noise_reduction, uniform_exposure: uniform_exposure, exposure_bias: exposure_bias, black_level: black_level, color_factors: color_factors, textures: textures, hotpixel_weight_texture: hotpixel_weight_texture, final_texture: final_texture, seed_alignment: seed_alignment)
         }
         last_texture = copy_texture(final_texture)
         last_settings = current_settings
@@ -12,6 +12,7 @@
  * raw image processing.
  */
 #include "dng_sdk_wrapper.h"
+#include "dng_cancel_sniffer.h"
 #include "dng_exceptions.h"
 #include "dng_file_stream.h"
 #include "dng_host.h"
@@ -20,7 +21,27 @@
 #include "dng_info.h"
 #include "dng_negative.h"
 #include "dng_simple_image.h"
+#include "dng_threaded_host.h"
+#include "dng_trace.h"
+#include "dng_tracking_allocator.h"
 #include "dng_xmp_sdk.h"
+#include "file_prefetcher.h"
+#include "frame_cache.h"
+#include "phase_correlation.h"
+#include "shared_memory.h"
+#include "tile_alignment.h"
+
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 /**
@@ -46,34 +67,490 @@ void terminate_xmp_sdk() {
 
 
 /**
- * Read a DNG file and extract raw pixel data and metadata
+ * Start recording a timeline of the wrapper calls and the DNG SDK work they do
+ */
+void start_dng_trace() {
+    dng_trace::Start();
+}
+
+
+/**
+ * Stop recording and write the timeline as Chrome trace event JSON (viewable in Perfetto)
  *
- * This function reads a DNG file and extracts both the raw sensor data and
- * important metadata such as black levels, white level, mosaic pattern information,
- * exposure settings, and color correction factors.
+ * @param out_path Path where the JSON file will be written
  *
- * @param in_path             Path to the input DNG file
- * @param pixel_bytes_pointer Pointer to receive the raw pixel data
- * @param width               Pointer to receive the image width
- * @param height              Pointer to receive the image height
- * @param mosaic_pattern_width Pointer to receive the width of the color filter array pattern
- * @param white_level         Pointer to receive the white level value
- * @param black_levels        Pointer to receive the black level values for each color in the pattern
- * @param masked_areas        Pointer to receive masked area coordinates
- * @param exposure_bias       Pointer to receive the exposure bias value (in EV*100)
- * @param ISO_exposure_time   Pointer to receive the product of ISO value and exposure time
- * @param color_factor_r      Pointer to receive the red color factor
- * @param color_factor_g      Pointer to receive the green color factor
- * @param color_factor_b      Pointer to receive the blue color factor
+ * @return 0 on success, non-zero on failure
+ */
+int stop_dng_trace(const char* out_path) {
+    try {
+        dng_trace::Stop(out_path);
+    } catch(...) {
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Allocator of all wrapper calls, so their memory use can be inspected and limited
+ */
+static dng_tracking_allocator gWrapperAllocator;
+
+
+/**
+ * Limit the bytes the wrapper calls may allocate through the DNG SDK at once
+ *
+ * @param budget_bytes Largest total allocation in bytes (0 means no limit)
+ */
+void set_dng_memory_budget(unsigned long long budget_bytes) {
+    gWrapperAllocator.SetBudget(budget_bytes);
+}
+
+
+/**
+ * Take a snapshot of the bytes allocated through the DNG SDK by the wrapper calls
+ *
+ * @param usage     Array to receive the entries (may be NULL if max_count is 0)
+ * @param max_count Number of entries the array can hold
+ *
+ * @return the number of entries available, which may be larger than max_count
+ */
+int get_dng_memory_usage(dng_memory_usage* usage, int max_count) {
+    try {
+        const dng_tracking_allocator::snapshot snapshot = gWrapperAllocator.Snapshot();
+        const int count = int(snapshot.fLabels.size()) + 1;
+        for (int index = 0; index < count && index < max_count; index++) {
+            if (index == 0) {
+                strncpy(usage[index].label, "total", sizeof(usage[index].label));
+                usage[index].current_bytes = snapshot.fCurrentBytes;
+                usage[index].peak_bytes = snapshot.fPeakBytes;
+            } else {
+                const dng_tracking_allocator::usage& label = snapshot.fLabels[index - 1];
+                strncpy(usage[index].label, label.fLabel.c_str(), sizeof(usage[index].label));
+                usage[index].current_bytes = label.fCurrentBytes;
+                usage[index].peak_bytes = label.fPeakBytes;
+            }
+            usage[index].label[sizeof(usage[index].label) - 1] = 0;
+        }
+        return count;
+    } catch(...) {
+        return 0;
+    }
+}
+
+
+/**
+ * Prefetcher of all wrapper calls, so read_dng_from_disk can report its hits
+ */
+static file_prefetcher gWrapperPrefetcher;
+
+
+/**
+ * Read files on a background thread so that opening them later is served from the file cache
+ *
+ * @param paths     Paths of the files, in the order they will be opened
+ * @param count     Number of paths
+ * @param max_bytes Stop after reading this many bytes (0 means no limit)
+ */
+void prefetch_dng_files(const char** paths, int count, unsigned long long max_bytes) {
+    try {
+        std::vector<std::string> files;
+        for (int index = 0; index < count; index++) {
+            if (paths[index] != NULL) {
+                files.push_back(paths[index]);
+            }
+        }
+        gWrapperPrefetcher.Prefetch(files, max_bytes);
+    } catch(...) {
+    }
+}
+
+
+/**
+ * Drop all files queued by prefetch_dng_files and stop reading the current one
+ */
+void cancel_dng_prefetch() {
+    gWrapperPrefetcher.Cancel();
+}
+
+
+/**
+ * Take a snapshot of the prefetcher counters
+ *
+ * @param stats Pointer to receive the counters
+ */
+void get_dng_prefetch_stats(dng_prefetch_stats* stats) {
+    const file_prefetcher::stats snapshot = gWrapperPrefetcher.Stats();
+    stats->files_requested = snapshot.fFilesRequested;
+    stats->files_prefetched = snapshot.fFilesPrefetched;
+    stats->bytes_prefetched = snapshot.fBytesPrefetched;
+    stats->files_skipped = snapshot.fFilesSkipped;
+    stats->hits = snapshot.fHits;
+    stats->partial_hits = snapshot.fPartialHits;
+    stats->misses = snapshot.fMisses;
+}
+
+
+/**
+ * Decoded-frame cache of read_dng_from_disk, NULL while off
+ *
+ * Calls keep their own reference, so the cache can be replaced while they run.
+ */
+static std::shared_ptr<frame_cache> gFrameCache;
+static std::string gFrameCacheDir;
+static dng_std_mutex gFrameCacheMutex;
+
+
+/**
+ * Version of the cached frame format, part of every cache key
+ *
+ * Change it whenever read_dng_from_disk would return different data for the same file.
+ */
+static const char* const kFrameCacheVersion = "read_dng_from_disk 1";
+
+
+/**
+ * Outputs of read_dng_from_disk other than the pixels, as stored in the frame cache
+ */
+struct cached_frame_metadata {
+    int32 width;
+    int32 height;
+    int32 mosaic_pattern_width;
+    int32 white_level;
+    int32 black_levels[6*6];
+    int32 masked_area_count;
+    int32 masked_areas[4*kMaxMaskedAreas];
+    int32 masked_area_black_levels[6*6];
+    int32 exposure_bias;
+    real32 ISO_exposure_time;
+    real32 color_factors[3];
+};
+
+
+/**
+ * Keep frames decoded by read_dng_from_disk in a directory, to be reused by later calls and runs
+ *
+ * @param cache_dir    Directory of the cache, created if needed (NULL turns the cache off)
+ * @param budget_bytes Largest total size of the cached frames in bytes (0 means no limit)
  *
  * @return 0 on success, non-zero on failure
  */
-int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* width, int* height, int* mosaic_pattern_width, int* white_level, int* black_levels, int* masked_areas, int* exposure_bias, float* ISO_exposure_time, float* color_factor_r, float* color_factor_g, float* color_factor_b) {
+int set_dng_frame_cache(const char* cache_dir, unsigned long long budget_bytes) {
+    try {
+        dng_lock_std_mutex lock(gFrameCacheMutex);
+        if (cache_dir == NULL) {
+            gFrameCache.reset();
+            gFrameCacheDir.clear();
+        } else if (gFrameCache && gFrameCacheDir == cache_dir) {
+            gFrameCache->SetBudget(budget_bytes);
+        } else {
+            gFrameCache = std::make_shared<frame_cache>(cache_dir, budget_bytes);
+            gFrameCacheDir = cache_dir;
+        }
+    } catch(...) {
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Take a snapshot of the decoded-frame cache counters (all zero if the cache is off)
+ *
+ * @param stats Pointer to receive the counters
+ */
+void get_dng_frame_cache_stats(dng_frame_cache_stats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    std::shared_ptr<frame_cache> cache;
+    {
+        dng_lock_std_mutex lock(gFrameCacheMutex);
+        cache = gFrameCache;
+    }
+    if (cache) {
+        const frame_cache::stats snapshot = cache->Stats();
+        stats->hits = snapshot.fHits;
+        stats->misses = snapshot.fMisses;
+        stats->inserts = snapshot.fInserts;
+        stats->evictions = snapshot.fEvictions;
+        stats->entries = snapshot.fEntries;
+        stats->bytes = snapshot.fBytes;
+    }
+}
+
+
+/**
+ * Cancellation token, deadline and priority of a job
+ */
+struct dng_job {
+    dng_cancel_token token;
+    int priority;
     
+    explicit dng_job(double timeout_seconds) : token(timeout_seconds), priority(dng_job_priority_normal) {}
+};
+
+
+/**
+ * Abort sniffer and priority scope of one wrapper call
+ *
+ * Batch calls run their sniffer below dng_priority_medium, so the SDK puts them on hold
+ * while an interactive call holds the minimum priority at dng_priority_medium.
+ */
+class dng_job_call {
+public:
+    explicit dng_job_call(dng_job* job) {
+        if (job != NULL) {
+            sniffer.Reset(new dng_cancel_sniffer(job->token));
+            if (job->priority == dng_job_priority_batch) {
+                sniffer->SetPriority(dng_priority_low);
+            } else if (job->priority == dng_job_priority_interactive) {
+                minimum_priority.Reset(new dng_set_minimum_priority(dng_priority_medium, "interactive dng_job"));
+            }
+        }
+    }
+    
+    dng_abort_sniffer* Sniffer() {
+        return sniffer.Get();
+    }
+    
+private:
+    AutoPtr<dng_cancel_sniffer> sniffer;
+    AutoPtr<dng_set_minimum_priority> minimum_priority;
+};
+
+
+/**
+ * Create a job that the wrapper calls can be stopped through
+ *
+ * @param timeout_seconds Time from now until the deadline of the job (<= 0 means no deadline)
+ *
+ * @return the job, to be released with release_dng_job
+ */
+dng_job* create_dng_job(double timeout_seconds) {
+    try {
+        return new dng_job(timeout_seconds);
+    } catch(...) {
+        return NULL;
+    }
+}
+
+
+/**
+ * Cancel a job. Can be called from any thread while wrapper calls are using the job.
+ *
+ * @param job Job returned by create_dng_job
+ */
+void cancel_dng_job(dng_job* job) {
+    if (job != NULL) {
+        job->token.Cancel();
+    }
+}
+
+
+/**
+ * Set the priority of a job before passing it to wrapper calls
+ *
+ * @param job      Job returned by create_dng_job
+ * @param priority dng_job_priority_batch, dng_job_priority_normal or dng_job_priority_interactive
+ */
+void set_dng_job_priority(dng_job* job, int priority) {
+    if (job != NULL) {
+        job->priority = priority;
+    }
+}
+
+
+/**
+ * Release a job once no wrapper call is using it
+ *
+ * @param job Job returned by create_dng_job (may be NULL)
+ */
+void release_dng_job(dng_job* job) {
+    delete job;
+}
+
+
+/**
+ * Return code for the exception currently being handled by a wrapper call
+ *
+ * The sniffer of a stopped job throws dng_error_user_canceled; the job then tells
+ * whether it was canceled or ran past its deadline. Other DNG SDK exceptions return
+ * their error code, so callers can tell e.g. an unreadable file from a bad format.
+ *
+ * @param job Job of the call (may be NULL)
+ *
+ * @return dng_wrapper_canceled, dng_wrapper_deadline_exceeded or a dng_error_code
+ */
+static int error_code_for_current_exception(dng_job* job) {
     try {
+        throw;
+    } catch(const dng_exception& exception) {
+        if (exception.ErrorCode() == dng_error_user_canceled && job != NULL) {
+            switch (job->token.Check()) {
+                case dng_cancel_token::kCanceled:
+                    return dng_wrapper_canceled;
+                case dng_cancel_token::kDeadlineExceeded:
+                    return dng_wrapper_deadline_exceeded;
+                default:
+                    break;
+            }
+        }
+        return exception.ErrorCode();
+    } catch(const std::bad_alloc&) {
+        return dng_error_memory;
+    } catch(...) {
+    }
+    return dng_error_unknown;
+}
+
+
+/**
+ * Check whether two paths may name the same file
+ *
+ * Paths are compared by device and inode, so different spellings of a path, symlinks and
+ * hard links are all recognized.
+ *
+ * @param path_a First path
+ * @param path_b Second path
+ *
+ * @return false if the files are known to differ, true otherwise (also if the first one cannot be examined)
+ */
+static bool may_be_same_file(const char* path_a, const char* path_b) {
+    struct stat stat_a;
+    struct stat stat_b;
+    if (stat(path_a, &stat_a) != 0) {return true;}
+    if (stat(path_b, &stat_b) != 0) {return false;}
+    return stat_a.st_dev == stat_b.st_dev && stat_a.st_ino == stat_b.st_ino;
+}
+
+
+/**
+ * Average the masked areas of a raw image for each position in the mosaic pattern
+ *
+ * Only the pixels inside the masked areas are visited, so this is cheap next to decoding.
+ * The pattern position of a pixel is taken from its image coordinates, so areas that do
+ * not start on a pattern boundary are handled too.
+ *
+ * @param buffer         Decoded raw image (8-bit, 16-bit or 32-bit samples)
+ * @param areas          Masked areas in image coordinates
+ * @param area_count     Number of masked areas
+ * @param mosaic_width   Width of the mosaic pattern
+ * @param black_levels   Receives the rounded means at index x + mosaic_width * y, 0 where no pixel was seen
+ */
+static void average_masked_areas(const dng_pixel_buffer& buffer, const dng_rect* areas, uint32 area_count, int mosaic_width, int* black_levels) {
+    uint64 sums[kMaxCFAPattern * kMaxCFAPattern] = {0};
+    uint64 counts[kMaxCFAPattern * kMaxCFAPattern] = {0};
+    for (uint32 index = 0; index < area_count; index++) {
+        const dng_rect area = areas[index] & buffer.fArea;
+        if (area.IsEmpty()) {
+            continue;
+        }
+        for (int32 y = area.t; y < area.b; y++) {
+            const int phase_row = mosaic_width * (y % mosaic_width);
+            if (buffer.fPixelType == ttLong) {
+                const uint32* row = buffer.ConstPixel_uint32(y, area.l);
+                for (int32 x = area.l; x < area.r; x++) {
+                    sums[phase_row + x % mosaic_width] += row[x - area.l];
+                    counts[phase_row + x % mosaic_width]++;
+                }
+            } else if (buffer.fPixelType == ttShort) {
+                const uint16* row = buffer.ConstPixel_uint16(y, area.l);
+                for (int32 x = area.l; x < area.r; x++) {
+                    sums[phase_row + x % mosaic_width] += row[x - area.l];
+                    counts[phase_row + x % mosaic_width]++;
+                }
+            } else {
+                const uint8* row = buffer.ConstPixel_uint8(y, area.l);
+                for (int32 x = area.l; x < area.r; x++) {
+                    sums[phase_row + x % mosaic_width] += row[x - area.l];
+                    counts[phase_row + x % mosaic_width]++;
+                }
+            }
+        }
+    }
+    for (int phase = 0; phase < mosaic_width * mosaic_width; phase++) {
+        black_levels[phase] = counts[phase] ? int((sums[phase] + counts[phase] / 2) / counts[phase]) : 0;
+    }
+}
+
+
+/**
+ * Read a DNG file into malloc'ed memory or a shared memory segment
+ *
+ * Takes the parameters of read_dng_from_disk, plus:
+ *
+ * @param shared_pixels     Receives a shared memory block holding the pixels instead of malloc'ed memory if not NULL;
+ *                          *pixel_bytes_pointer then points into it and must not be freed
+ * @param pixel_bytes_size  Receives the number of bytes of pixels (may be NULL)
+ * @param masked_area_count Receives the number of masked areas (may be NULL)
+ */
+static int read_dng(const char* in_path, AutoPtr<shared_memory_block>* shared_pixels, void** pixel_bytes_pointer, uint64* pixel_bytes_size, int* width, int* height, int* mosaic_pattern_width, int* white_level, int* black_levels, int* masked_area_count, int* masked_areas, int* masked_area_black_levels, int* exposure_bias, float* ISO_exposure_time, float* color_factor_r, float* color_factor_g, float* color_factor_b, dng_job* job) {
+    
+    dng_trace_scope trace("api", "read_dng_from_disk");
+    
+    try {
+        
+        // count whether the background prefetch got to this file first
+        gWrapperPrefetcher.NoteOpen(in_path);
+        
+        // serve frames decoded before, in this run or an earlier one, from the frame cache
+        // - only the outputs the decode would have written are written, so the arrays of the
+        //   caller are left as they would be otherwise
+        std::shared_ptr<frame_cache> cache;
+        dng_fingerprint frame_key;
+        {
+            dng_lock_std_mutex lock(gFrameCacheMutex);
+            cache = gFrameCache;
+        }
+        if (cache) {
+            frame_key = frame_cache::SourceKey(in_path, kFrameCacheVersion);
+            AutoPtr<frame_cache::entry> cached(frame_key.IsValid() ? cache->Lookup(frame_key) : NULL);
+            if (cached.Get() != NULL && cached->MetaSize() == sizeof(cached_frame_metadata)) {
+                const cached_frame_metadata& meta = *(const cached_frame_metadata*) cached->Meta();
+                const int pattern_size = meta.mosaic_pattern_width * meta.mosaic_pattern_width;
+                void* pixel_bytes;
+                if (shared_pixels) {
+                    shared_pixels->Reset(new shared_memory_block(uint32(cached->DataSize())));
+                    pixel_bytes = (*shared_pixels)->Buffer();
+                } else {
+                    pixel_bytes = malloc(cached->DataSize());
+                    if (pixel_bytes == NULL) {
+                        return 1;
+                    }
+                }
+                memcpy(pixel_bytes, cached->Data(), cached->DataSize());
+                *pixel_bytes_pointer = pixel_bytes;
+                if (pixel_bytes_size) {
+                    *pixel_bytes_size = cached->DataSize();
+                }
+                *width = meta.width;
+                *height = meta.height;
+                *mosaic_pattern_width = meta.mosaic_pattern_width;
+                *white_level = meta.white_level;
+                memcpy(black_levels, meta.black_levels, pattern_size * sizeof(int32));
+                memcpy(masked_areas, meta.masked_areas, 4 * meta.masked_area_count * sizeof(int32));
+                if (masked_area_count) {
+                    *masked_area_count = meta.masked_area_count;
+                }
+                memcpy(masked_area_black_levels, meta.masked_area_black_levels, pattern_size * sizeof(int32));
+                *exposure_bias = meta.exposure_bias;
+                *ISO_exposure_time = meta.ISO_exposure_time;
+                *color_factor_r = meta.color_factors[0];
+                *color_factor_g = meta.color_factors[1];
+                *color_factor_b = meta.color_factors[2];
+                trace.SetBytes(cached->DataSize());
+                return 0;
+            }
+        }
+        
+        // the SDK sniffs for an abort once per tile on every thread, and pauses batch jobs there
+        dng_job_call call(job);
         
         // read image
-        dng_host host;
+        // - the threaded host decodes compressed tiles on all cores; its worker pool
+        //   is shared by all frames loaded concurrently, so it does not oversubscribe
+        dng_memory_label label("read_dng_from_disk");
+        dng_threaded_host host(&gWrapperAllocator, call.Sniffer());
+        host.SniffForAbort();
         dng_info info;
         dng_file_stream stream(in_path);
         AutoPtr<dng_negative> negative; {
@@ -92,19 +569,45 @@ int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* wid
         //   a dng_image. For our use case, we require a dng_simple_image,
         //   hence I have reimplemented dng_negative::ReadStage1Image here.
         dng_ifd& rawIFD = *info.fIFD [info.fMainIndex];
-        AutoPtr<dng_simple_image> image_pointer (new dng_simple_image(rawIFD.Bounds(), rawIFD.fSamplesPerPixel, rawIFD.PixelType(), host.Allocator()));
+        // - for shared memory, the image decodes straight into the segment, so the pixels
+        //   are never copied
+        AutoPtr<dng_simple_image> image_pointer;
+        if (shared_pixels) {
+            shared_pixels->Reset(new shared_memory_block(ComputeBufferSize(rawIFD.PixelType(), rawIFD.Bounds().Size(), rawIFD.fSamplesPerPixel, padSIMDBytes)));
+            dng_pixel_buffer shared_buffer(rawIFD.Bounds(), 0, rawIFD.fSamplesPerPixel, rawIFD.PixelType(), pcInterleaved, (*shared_pixels)->Buffer());
+            image_pointer.Reset(new dng_simple_image(shared_buffer, host.Allocator()));
+        } else {
+            image_pointer.Reset(new dng_simple_image(rawIFD.Bounds(), rawIFD.fSamplesPerPixel, rawIFD.PixelType(), host.Allocator()));
+        }
         dng_simple_image& image = *image_pointer.Get();
         rawIFD.ReadImage(host, stream, image);
         dng_pixel_buffer pixel_buffer;
         image.GetPixelBuffer(pixel_buffer);
         
         // copy data
+        // - 32-bit integer raw data, which DNG stores with ZIP compression, is narrowed to the
+        //   16-bit samples callers expect
         *width = image.Width();
         *height = image.Height();
-        int image_size = image.Width() * image.Height() * image.PixelSize();
-        void* pixel_bytes = malloc(image_size);
+        const bool narrow = image.PixelType() == ttLong;
+        int image_size = image.Width() * image.Height() * (narrow ? (int) sizeof(uint16) : image.PixelSize());
+        //   (in place for shared memory, which is safe as each 16-bit sample is written after
+        //   the 32-bit sample it overlaps has been read)
+        void* pixel_bytes = shared_pixels ? pixel_buffer.DirtyPixel(0, 0) : malloc(image_size);
         *pixel_bytes_pointer = pixel_bytes;
-        memcpy(pixel_bytes, pixel_buffer.DirtyPixel(0, 0), image_size);
+        if (narrow) {
+            const uint32* src = pixel_buffer.ConstPixel_uint32(0, 0);
+            uint16* dst = (uint16*) pixel_bytes;
+            for (uint32 index = 0; index < image.Width() * image.Height(); index++) {
+                dst[index] = (uint16) Min_uint32(src[index], 0xFFFF);
+            }
+        } else if (!shared_pixels) {
+            memcpy(pixel_bytes, pixel_buffer.DirtyPixel(0, 0), image_size);
+        }
+        if (pixel_bytes_size) {
+            *pixel_bytes_size = image_size;
+        }
+        trace.SetBytes(image_size);
         
         // get size of mosaic pattern
         // - this affects how raw pixels are aligned
@@ -121,14 +624,22 @@ int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* wid
                
         // Get masked area
         if (rawIFD.fMaskedAreaCount > 0) {
-            for (int i = 0; i < rawIFD.fMaskedAreaCount; i++) {
+            for (uint32 i = 0; i < rawIFD.fMaskedAreaCount; i++) {
                 // Add masked areas to the array
-                *(masked_areas + i + 0) = rawIFD.fMaskedArea[i].t;
-                *(masked_areas + i + 1) = rawIFD.fMaskedArea[i].l;
-                *(masked_areas + i + 2) = rawIFD.fMaskedArea[i].b;
-                *(masked_areas + i + 3) = rawIFD.fMaskedArea[i].r;
+                *(masked_areas + 4*i + 0) = rawIFD.fMaskedArea[i].t;
+                *(masked_areas + 4*i + 1) = rawIFD.fMaskedArea[i].l;
+                *(masked_areas + 4*i + 2) = rawIFD.fMaskedArea[i].b;
+                *(masked_areas + 4*i + 3) = rawIFD.fMaskedArea[i].r;
             }
         }
+        if (masked_area_count) {
+            *masked_area_count = rawIFD.fMaskedAreaCount;
+        }
+        
+        // Average the masked areas per position in the mosaic pattern
+        // - done here on the decoded buffer, which only touches the masked pixels, so callers
+        //   need no second pass over the image on the GPU
+        average_masked_areas(pixel_buffer, rawIFD.fMaskedArea, rawIFD.fMaskedAreaCount, *mosaic_pattern_width, masked_area_black_levels);
         
         int mosaic_width = *mosaic_pattern_width;
         // Get black level, white level and color factors for exposure correction
@@ -145,7 +656,7 @@ int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* wid
             double black_level_delta_adjust[6*6] = { 0 };
             
             if (linearization_info->RowBlackCount() > 0) {
-                for (int row = 0; row < linearization_info->RowBlackCount(); row++) {
+                for (uint32 row = 0; row < linearization_info->RowBlackCount(); row++) {
                     for (int col = 0; col < mosaic_width; col++) {
                         black_level_delta_adjust[(row % mosaic_width) + col * mosaic_width] += linearization_info->fBlackDeltaV->Buffer_real64()[row];
                     }
@@ -156,7 +667,7 @@ int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* wid
             }
             
             if (linearization_info->ColumnBlackCount() > 0) {
-                for (int col = 0; col < linearization_info->ColumnBlackCount(); col++) {
+                for (uint32 col = 0; col < linearization_info->ColumnBlackCount(); col++) {
                     for (int row = 0; row < mosaic_width; row++) {
                         black_level_delta_adjust[(row % mosaic_width) + col * mosaic_width] += linearization_info->fBlackDeltaH->Buffer_real64()[col];
                     }
@@ -174,7 +685,7 @@ int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* wid
                 for (int col = 0; col < mosaic_width; col++) {
                     double black_level = 0.0;
                     // If there are multiple samples, average them out
-                    for (int sample_num = 0; sample_num < rawIFD.fSamplesPerPixel; sample_num++) {
+                    for (uint32 sample_num = 0; sample_num < rawIFD.fSamplesPerPixel; sample_num++) {
                         black_level += linearization_info->fBlackLevel[row][col][sample_num];
                     }
                     black_level /= rawIFD.fSamplesPerPixel;
@@ -226,10 +737,249 @@ int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* wid
             // calculate product of ISO value and exposure time
             *ISO_exposure_time = ISO_speed_value*exposure_time_value.n/float(exposure_time_value.d);
         }
+        
+        // keep the decoded frame for later calls
+        // - a frame that cannot be cached is still returned
+        if (cache && frame_key.IsValid() && mosaic_width <= 6) {
+            cached_frame_metadata meta;
+            memset(&meta, 0, sizeof(meta));
+            const int pattern_size = mosaic_width * mosaic_width;
+            meta.width = *width;
+            meta.height = *height;
+            meta.mosaic_pattern_width = mosaic_width;
+            meta.white_level = *white_level;
+            memcpy(meta.black_levels, black_levels, pattern_size * sizeof(int32));
+            meta.masked_area_count = rawIFD.fMaskedAreaCount;
+            memcpy(meta.masked_areas, masked_areas, 4 * rawIFD.fMaskedAreaCount * sizeof(int32));
+            memcpy(meta.masked_area_black_levels, masked_area_black_levels, pattern_size * sizeof(int32));
+            meta.exposure_bias = *exposure_bias;
+            meta.ISO_exposure_time = *ISO_exposure_time;
+            meta.color_factors[0] = *color_factor_r;
+            meta.color_factors[1] = *color_factor_g;
+            meta.color_factors[2] = *color_factor_b;
+            cache->Insert(frame_key, &meta, sizeof(meta), *pixel_bytes_pointer, image_size);
+        }
         return 0;
+    } catch(...) {
+        return error_code_for_current_exception(job);
+    }
+}
+
+
+/**
+ * Read a DNG file and extract raw pixel data and metadata
+ *
+ * This function reads a DNG file and extracts both the raw sensor data and
+ * important metadata such as black levels, white level, mosaic pattern information,
+ * exposure settings, and color correction factors.
+ *
+ * @param in_path             Path to the input DNG file
+ * @param pixel_bytes_pointer Pointer to receive the raw pixel data
+ * @param width               Pointer to receive the image width
+ * @param height              Pointer to receive the image height
+ * @param mosaic_pattern_width Pointer to receive the width of the color filter array pattern
+ * @param white_level         Pointer to receive the white level value
+ * @param black_levels        Pointer to receive the black level values for each color in the pattern
+ * @param masked_areas        Pointer to receive masked area coordinates
+ * @param masked_area_black_levels Pointer to receive the mean of the masked areas for each position in the mosaic pattern
+ * @param exposure_bias       Pointer to receive the exposure bias value (in EV*100)
+ * @param ISO_exposure_time   Pointer to receive the product of ISO value and exposure time
+ * @param color_factor_r      Pointer to receive the red color factor
+ * @param color_factor_g      Pointer to receive the green color factor
+ * @param color_factor_b      Pointer to receive the blue color factor
+ * @param job                 Job that can stop the call (may be NULL)
+ *
+ * @return 0 on success, dng_wrapper_canceled or dng_wrapper_deadline_exceeded if the job was stopped, other non-zero values on failure
+ */
+int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* width, int* height, int* mosaic_pattern_width, int* white_level, int* black_levels, int* masked_areas, int* masked_area_black_levels, int* exposure_bias, float* ISO_exposure_time, float* color_factor_r, float* color_factor_g, float* color_factor_b, dng_job* job) {
+    return read_dng(in_path, NULL, pixel_bytes_pointer, NULL, width, height, mosaic_pattern_width, white_level, black_levels, NULL, masked_areas, masked_area_black_levels, exposure_bias, ISO_exposure_time, color_factor_r, color_factor_g, color_factor_b, job);
+}
+
+
+/**
+ * Read a DNG file like read_dng_from_disk, but decode the pixels straight into a shared memory segment
+ *
+ * @param in_path Path to the input DNG file
+ * @param frame   Receives the descriptor and metadata; release it with release_dng_shared_frame
+ * @param job     Job that can stop the call (may be NULL)
+ *
+ * @return 0 on success, dng_wrapper_canceled or dng_wrapper_deadline_exceeded if the job was stopped, other non-zero values on failure
+ */
+int read_dng_to_shared_memory(const char* in_path, dng_shared_frame* frame, dng_job* job) {
+    memset(frame, 0, sizeof(*frame));
+    frame->fd = -1;
+    try {
+        AutoPtr<shared_memory_block> shared_pixels;
+        void* pixel_bytes = NULL;
+        uint64 pixel_bytes_size = 0;
+        const int result = read_dng(in_path, &shared_pixels, &pixel_bytes, &pixel_bytes_size, &frame->width, &frame->height, &frame->mosaic_pattern_width, &frame->white_level, frame->black_levels, &frame->masked_area_count, frame->masked_areas, frame->masked_area_black_levels, &frame->exposure_bias, &frame->ISO_exposure_time, &frame->color_factor_r, &frame->color_factor_g, &frame->color_factor_b, job);
+        if (result != 0) {
+            return result;
+        }
+        frame->size = pixel_bytes_size;
+        frame->fd = shared_pixels->Publish();
+    } catch(...) {
+        return error_code_for_current_exception(job);
+    }
+    return 0;
+}
+
+
+/**
+ * Map the pixels of a shared frame for reading
+ *
+ * @param frame Frame from read_dng_to_shared_memory or receive_dng_shared_frame
+ *
+ * @return Pointer to frame->size bytes of pixels, or NULL on failure; unmap it with unmap_dng_shared_frame
+ */
+const void* map_dng_shared_frame(const dng_shared_frame* frame) {
+    return shared_memory_block::MapReadOnly(frame->fd, frame->size);
+}
+
+
+/**
+ * Unmap pixels mapped with map_dng_shared_frame
+ *
+ * @param frame  Frame that was mapped
+ * @param pixels Pointer returned by map_dng_shared_frame (may be NULL)
+ */
+void unmap_dng_shared_frame(const dng_shared_frame* frame, const void* pixels) {
+    shared_memory_block::Unmap(pixels, frame->size);
+}
+
+
+/**
+ * Close the descriptor of a shared frame in this process (existing mappings stay valid)
+ *
+ * @param frame Frame whose descriptor is closed and set to -1
+ */
+void release_dng_shared_frame(dng_shared_frame* frame) {
+    if (frame->fd >= 0) {
+        close(frame->fd);
+        frame->fd = -1;
+    }
+}
+
+
+/**
+ * Send a shared frame to another process over a connected UNIX domain socket
+ *
+ * @param socket Connected UNIX domain socket
+ * @param frame  Frame to send
+ *
+ * @return 0 on success, non-zero on failure
+ */
+int send_dng_shared_frame(int socket, const dng_shared_frame* frame) {
+    return shared_memory_block::SendDescriptor(socket, frame->fd, frame, sizeof(*frame)) ? 0 : 1;
+}
+
+
+/**
+ * Receive a shared frame sent with send_dng_shared_frame
+ *
+ * @param socket Connected UNIX domain socket
+ * @param frame  Receives the frame; release it with release_dng_shared_frame
+ *
+ * @return 0 on success, non-zero on failure
+ */
+int receive_dng_shared_frame(int socket, dng_shared_frame* frame) {
+    const int fd = shared_memory_block::ReceiveDescriptor(socket, frame, sizeof(*frame));
+    frame->fd = fd;
+    return fd >= 0 ? 0 : 1;
+}
+
+
+/**
+ * Estimate the translation between two images by phase correlation
+ *
+ * Meant for heavily downsampled frames, a few hundred pixels on a side, to seed the tile alignment.
+ * Larger images are cropped to their center.
+ *
+ * @param ref_pixels  Reference image as 16-bit floats, as in an r16Float texture
+ * @param comp_pixels Comparison image of the same size and format
+ * @param width       Width of the images in pixels (rows are packed)
+ * @param height      Height of the images in pixels
+ * @param shift_x     Receives the horizontal shift such that the comparison image at x + shift_x matches the reference image at x
+ * @param shift_y     Receives the vertical shift in the same way
+ * @param confidence  Receives a value from 0 (no translation stands out) to 1 (one translation clearly does)
+ *
+ * @return 0 on success, non-zero on failure (e.g. if an image is smaller than 16 pixels on a side)
+ */
+int phase_correlate(const unsigned short* ref_pixels, const unsigned short* comp_pixels, int width, int height, float* shift_x, float* shift_y, float* confidence) {
+    try {
+        if (width <= 0 || height <= 0) {
+            return 1;
+        }
+        phase_correlator correlator(width, height);
+        
+        // widen the 16-bit floats
+        const size_t count = size_t(width) * size_t(height);
+        std::vector<real32> ref(count);
+        std::vector<real32> comp(count);
+        for (size_t i = 0; i < count; i++) {
+            const uint32 ref_bits = DNG_HalfToFloat(ref_pixels[i]);
+            const uint32 comp_bits = DNG_HalfToFloat(comp_pixels[i]);
+            memcpy(&ref[i], &ref_bits, sizeof(real32));
+            memcpy(&comp[i], &comp_bits, sizeof(real32));
+        }
+        
+        const phase_correlator::estimate estimate = correlator.Estimate(ref.data(), comp.data(), width);
+        *shift_x = float(estimate.fShiftH);
+        *shift_y = float(estimate.fShiftV);
+        *confidence = float(estimate.fConfidence);
     } catch(...) {
         return 1;
     }
+    return 0;
+}
+
+/**
+ * Align the tiles of a comparison image to a reference image on the CPU
+ *
+ * Runs the same coarse-to-fine search as the GPU alignment, on images already reduced to one
+ * value per mosaic pattern. The adaptive mode does not search tiles whose texture is below the
+ * noise, which take the median vector of their neighbours, and stops the search of a tile when
+ * its start vector is clearly the best, so it does far fewer tile comparisons.
+ *
+ * @param ref_pixels      Reference image, rows packed
+ * @param comp_pixels     Comparison image of the same size
+ * @param width           Width of the images in pixels
+ * @param height          Height of the images in pixels
+ * @param tile_size       Tile size at full resolution (8, 16, 32 or 64)
+ * @param search_distance Levels are added while the coarsest one is larger than this on its smaller side
+ * @param adaptive        Non-zero for the adaptive search, zero for the exhaustive one
+ * @param alignment       Receives two values (x, y) per tile, row by row, for (width / (tile_size / 2) - 1) x (height / (tile_size / 2) - 1) tiles
+ * @param stats           Receives the counters (may be NULL)
+ *
+ * @return 0 on success, non-zero on failure (e.g. if the images are too small for the tile size)
+ */
+int align_tiles(const float* ref_pixels, const float* comp_pixels, int width, int height, int tile_size, int search_distance, int adaptive, int* alignment, dng_tile_alignment_stats* stats) {
+    try {
+        if (width <= 0 || height <= 0 || tile_size <= 0 || search_distance < 0) {
+            return 1;
+        }
+        const tile_aligner aligner(width, height, tile_size, search_distance);
+        
+        std::vector<dng_point> vectors;
+        tile_aligner::stats counters;
+        aligner.Align(ref_pixels, comp_pixels, width, adaptive != 0, vectors, &counters);
+        
+        for (size_t i = 0; i < vectors.size(); i++) {
+            alignment[2*i+0] = vectors[i].h;
+            alignment[2*i+1] = vectors[i].v;
+        }
+        
+        if (stats != NULL) {
+            stats->tiles = counters.fTiles;
+            stats->flat_tiles = counters.fFlatTiles;
+            stats->early_exits = counters.fEarlyExits;
+            stats->evaluations = counters.fEvaluations;
+            stats->exhaustive_evaluations = counters.fExhaustiveEvaluations;
+        }
+    } catch(...) {
+        return 1;
+    }
+    return 0;
 }
 
 /**
@@ -243,15 +993,22 @@ int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* wid
  * @param out_path            Path where the output DNG file will be written
  * @param pixel_bytes_pointer Pointer to the processed pixel data to write
  * @param white_level         New white level to set in the output DNG file (if > 0)
+ * @param job                 Job that can stop the call (may be NULL)
  *
- * @return 0 on success, non-zero on failure
+ * @return 0 on success, dng_wrapper_canceled or dng_wrapper_deadline_exceeded if the job was stopped, other non-zero values on failure
  */
-int write_dng_to_disk(const char *in_path, const char *out_path, void** pixel_bytes_pointer, const int white_level) {
+int write_dng_to_disk(const char *in_path, const char *out_path, void** pixel_bytes_pointer, const int white_level, dng_job* job) {
+    
+    dng_trace_scope trace("api", "write_dng_to_disk");
     
     try {
         
+        dng_job_call call(job);
+        
         // read image
-        dng_host host;
+        dng_memory_label label("write_dng_to_disk");
+        dng_host host(&gWrapperAllocator, call.Sniffer());
+        host.SniffForAbort();
         dng_info info;
         dng_file_stream stream(in_path);
         AutoPtr<dng_negative> negative; {
@@ -261,13 +1018,22 @@ int write_dng_to_disk(const char *in_path, const char *out_path, void** pixel_by
             negative.Reset(host.Make_dng_negative());
             // this line ensures that the maker notes are copied 
             host.SetSaveDNGVersion(dngVersion_SaveDefault);
+            // the XMP is not edited, so its packet is copied unparsed, which saves the
+            // XMP parse and serialize round trip
+            host.SetPassThroughXMP(true);
+            // maker notes and private data are copied straight from the input file
+            // while writing instead of being read into memory, unless the output
+            // would overwrite the input
+            host.SetReferenceSourceBlocks(!may_be_same_file(in_path, out_path));
             negative->Parse(host, stream, info);
             negative->PostParse(host, stream, info);
         }
    
         // load pixel buffer
+        // - the pixels passed in are 16-bit, also for 32-bit integer input files (see read_dng_from_disk)
         dng_ifd& rawIFD = *info.fIFD [info.fMainIndex];
-        AutoPtr<dng_simple_image> image_pointer (new dng_simple_image(rawIFD.Bounds(), rawIFD.fSamplesPerPixel, rawIFD.PixelType(), host.Allocator()));
+        const uint32 pixel_type = rawIFD.PixelType() == ttLong ? (uint32) ttShort : rawIFD.PixelType();
+        AutoPtr<dng_simple_image> image_pointer (new dng_simple_image(rawIFD.Bounds(), rawIFD.fSamplesPerPixel, pixel_type, host.Allocator()));
         dng_simple_image& image = *image_pointer.Get();
         // rawIFD.ReadImage(host, stream, image);
          
@@ -279,6 +1045,7 @@ int write_dng_to_disk(const char *in_path, const char *out_path, void** pixel_by
         void* pixel_bytes = *pixel_bytes_pointer;
         int image_size = image.Width() * image.Height() * image.PixelSize();
         memcpy(image.fBuffer.DirtyPixel(0, 0), pixel_bytes, image_size);
+        trace.SetBytes(image_size);
                 
         // store modified pixel buffer to the negative
         negative->fStage1Image.Reset(image_pointer.Release());
@@ -310,7 +1077,164 @@ int write_dng_to_disk(const char *in_path, const char *out_path, void** pixel_by
 
     }
     catch(...) {
-        return 1;
+        return error_code_for_current_exception(job);
     }
     return 0;
 }
+
+
+/**
+ * Locate the embedded JPEG preview of a DNG file without decoding the raw data
+ *
+ * Only the IFDs are parsed (dng_info::Parse), the negative and the raw image are never
+ * built. Every IFD flagged as a preview whose data is a single baseline JPEG stream is a
+ * candidate. Of these, the smallest one whose longer side reaches max_size is selected, or
+ * the largest one if none does. The file region holding the selected stream is then mapped
+ * read-only, so the caller gets the compressed bytes straight from the page cache.
+ *
+ * @param in_path            Path to the input DNG file
+ * @param max_size           Requested size of the longer preview side in pixels (<= 0 selects the largest preview)
+ * @param jpeg_bytes_pointer Pointer to receive the address of the JPEG stream
+ * @param length             Pointer to receive the length of the JPEG stream in bytes
+ * @param width              Pointer to receive the width of the selected preview (may be NULL)
+ * @param height             Pointer to receive the height of the selected preview (may be NULL)
+ *
+ * @return 0 on success, dng_wrapper_no_preview if the file contains no JPEG preview, a dng_error_code on failure
+ */
+int read_dng_preview(const char* in_path, int max_size, const void** jpeg_bytes_pointer, int* length, int* width, int* height) {
+    
+    dng_trace_scope trace("api", "read_dng_preview");
+    
+    *jpeg_bytes_pointer = NULL;
+    *length = 0;
+    
+    uint64 preview_offset = 0;
+    uint64 preview_length = 0;
+    uint64 file_length = 0;
+    bool damaged_preview = false;
+    
+    try {
+        
+        // parse the IFD structure only
+        dng_memory_label label("read_dng_preview");
+        dng_host host(&gWrapperAllocator);
+        dng_info info;
+        dng_file_stream stream(in_path);
+        info.Parse(host, stream);
+        info.PostParse(host);
+        if(!info.IsValidDNG()) {return dng_error_bad_format;}
+        file_length = stream.Length();
+        
+        uint32 best_size = 0;
+        
+        for (uint32 index = 0; index < info.IFDCount(); index++) {
+            
+            const dng_ifd& ifd = *info.fIFD[index];
+            
+            if (ifd.fNewSubFileType != sfPreviewImage && ifd.fNewSubFileType != sfAltPreviewImage) {
+                continue;
+            }
+            
+            // the stream must be a complete JPEG file, i.e. a single strip or tile
+            // of an 8-bit YCbCr or grayscale image, or a JPEGInterchangeFormat block
+            uint64 offset = 0;
+            uint64 count = 0;
+            if (ifd.fCompression == ccJPEG &&
+                ifd.fBitsPerSample[0] == 8 &&
+                ifd.fTileOffsetsCount == 1 &&
+                (ifd.fPhotometricInterpretation == piYCbCr ||
+                 ifd.fPhotometricInterpretation == piBlackIsZero)) {
+                offset = ifd.fTileOffset[0];
+                count = ifd.fTileByteCount[0];
+            } else if (ifd.fJPEGInterchangeFormat != 0) {
+                offset = ifd.fJPEGInterchangeFormat;
+                count = ifd.fJPEGInterchangeFormatLength;
+            }
+            
+            if (count < 4 || offset + count > file_length) {
+                damaged_preview = true;
+                continue;
+            }
+            
+            const uint32 size = Max_uint32(ifd.fImageWidth, ifd.fImageLength);
+            
+            // prefer the smallest preview that is large enough, otherwise the largest one
+            const bool size_fits = max_size > 0 && size >= uint32(max_size);
+            const bool best_fits = max_size > 0 && best_size >= uint32(max_size);
+            bool better = false;
+            if (preview_length == 0) {
+                better = true;
+            } else if (size_fits) {
+                better = !best_fits || size < best_size;
+            } else {
+                better = !best_fits && size > best_size;
+            }
+            
+            if (better) {
+                preview_offset = offset;
+                preview_length = count;
+                best_size = size;
+                if (width != NULL) {*width = int(ifd.fImageWidth);}
+                if (height != NULL) {*height = int(ifd.fImageLength);}
+            }
+        }
+    } catch(...) {
+        return error_code_for_current_exception(NULL);
+    }
+    
+    if (preview_length == 0) {
+        if (damaged_preview) {
+            return dng_error_file_is_damaged;
+        }
+        return dng_wrapper_no_preview;
+    }
+    if (preview_length > 0x7FFFFFFF) {
+        return dng_error_overflow;
+    }
+    
+    // map the pages covering the JPEG stream
+    const uint64 page_size = uint64(sysconf(_SC_PAGESIZE));
+    const uint64 map_offset = preview_offset - (preview_offset % page_size);
+    const size_t map_length = size_t(preview_offset - map_offset + preview_length);
+    
+    int file = open(in_path, O_RDONLY);
+    if (file < 0) {
+        return dng_error_open_file;
+    }
+    void* mapping = mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, file, off_t(map_offset));
+    close(file);
+    if (mapping == MAP_FAILED) {
+        return errno == ENOMEM ? dng_error_memory : dng_error_read_file;
+    }
+    
+    const uint8* jpeg_bytes = (const uint8*) mapping + (preview_offset - map_offset);
+    
+    // check for the SOI marker before handing out the stream
+    if (jpeg_bytes[0] != 0xFF || jpeg_bytes[1] != 0xD8) {
+        munmap(mapping, map_length);
+        return dng_error_file_is_damaged;
+    }
+    
+    *jpeg_bytes_pointer = jpeg_bytes;
+    *length = int(preview_length);
+    trace.SetBytes(preview_length);
+    return 0;
+}
+
+/**
+ * Release the JPEG stream returned by read_dng_preview
+ *
+ * @param jpeg_bytes Address returned by read_dng_preview
+ * @param length     Length returned by read_dng_preview
+ */
+void release_dng_preview(const void* jpeg_bytes, int length) {
+    
+    if (jpeg_bytes == NULL) {
+        return;
+    }
+    
+    const uintptr_t page_size = uintptr_t(sysconf(_SC_PAGESIZE));
+    const uintptr_t address = uintptr_t(jpeg_bytes);
+    const uintptr_t map_address = address - (address % page_size);
+    munmap((void*) map_address, size_t(address - map_address) + size_t(length));
+}
@@ -35,6 +35,196 @@ extern "C" {
      */
     void terminate_xmp_sdk();
 
+    /**
+     * Start recording a timeline of the wrapper calls and the DNG SDK work they do
+     *
+     * Records each wrapper call, area task, tile and file read with its thread. Any earlier
+     * recording is discarded. Recording costs about one clock read per event and stays off
+     * until this function is called.
+     */
+    void start_dng_trace();
+
+    /**
+     * Stop recording and write the timeline as Chrome trace event JSON (viewable in Perfetto)
+     *
+     * @param out_path Path where the JSON file will be written
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    int stop_dng_trace(const char* out_path);
+
+    /**
+     * Bytes allocated through the DNG SDK by the wrapper calls, for one label
+     *
+     * Work inside the SDK is labeled with the name of the task doing it, such as
+     * "dng_read_tiles_task"; other work with the name of the wrapper call.
+     */
+    typedef struct {
+        char label[64];                         ///< label, truncated if needed
+        unsigned long long current_bytes;       ///< bytes allocated now
+        unsigned long long peak_bytes;          ///< most bytes allocated at once
+    } dng_memory_usage;
+
+    /**
+     * Limit the bytes the wrapper calls may allocate through the DNG SDK at once
+     *
+     * An allocation that would exceed the budget fails, so the call that made it returns an
+     * error instead of the process running out of memory. The budget is shared by all calls.
+     *
+     * @param budget_bytes Largest total allocation in bytes (0 means no limit)
+     */
+    void set_dng_memory_budget(unsigned long long budget_bytes);
+
+    /**
+     * Take a snapshot of the bytes allocated through the DNG SDK by the wrapper calls
+     *
+     * The first entry, labeled "total", covers all labels. The other entries follow in order
+     * of decreasing peak bytes.
+     *
+     * @param usage     Array to receive the entries (may be NULL if max_count is 0)
+     * @param max_count Number of entries the array can hold
+     *
+     * @return the number of entries available, which may be larger than max_count
+     */
+    int get_dng_memory_usage(dng_memory_usage* usage, int max_count);
+
+    /**
+     * Counters of the file prefetcher since the process started
+     */
+    typedef struct {
+        unsigned long long files_requested;     ///< files passed to prefetch_dng_files
+        unsigned long long files_prefetched;    ///< files read to the end in the background
+        unsigned long long bytes_prefetched;    ///< bytes read in the background
+        unsigned long long files_skipped;       ///< files dropped, over the byte limit or unreadable
+        unsigned long long hits;                ///< files opened by read_dng_from_disk after they were prefetched
+        unsigned long long partial_hits;        ///< files opened while they were being prefetched
+        unsigned long long misses;              ///< files opened before they were prefetched, or never requested
+    } dng_prefetch_stats;
+
+    /**
+     * Read files on a background thread so that opening them later is served from the file cache
+     *
+     * Meant for batch processing: pass the files of the next burst while the current one is
+     * processed. Files from an earlier call that have not been started are dropped. Only the
+     * operating system file cache holds the data, so this costs no process memory.
+     *
+     * @param paths     Paths of the files, in the order they will be opened
+     * @param count     Number of paths
+     * @param max_bytes Stop after reading this many bytes (0 means no limit), so the prefetch
+     *                  does not push the files of the current burst out of the cache
+     */
+    void prefetch_dng_files(const char** paths, int count, unsigned long long max_bytes);
+
+    /**
+     * Drop all files queued by prefetch_dng_files and stop reading the current one
+     */
+    void cancel_dng_prefetch();
+
+    /**
+     * Take a snapshot of the prefetcher counters
+     *
+     * @param stats Pointer to receive the counters
+     */
+    void get_dng_prefetch_stats(dng_prefetch_stats* stats);
+
+    /**
+     * Counters and size of the decoded-frame cache
+     */
+    typedef struct {
+        unsigned long long hits;                ///< frames read_dng_from_disk served from the cache
+        unsigned long long misses;              ///< frames read_dng_from_disk had to decode
+        unsigned long long inserts;             ///< frames added to the cache
+        unsigned long long evictions;           ///< frames removed to stay within the budget
+        unsigned long long entries;             ///< frames in the cache now
+        unsigned long long bytes;               ///< bytes on disk now
+    } dng_frame_cache_stats;
+
+    /**
+     * Keep frames decoded by read_dng_from_disk in a directory, to be reused by later calls and runs
+     *
+     * A frame is found again by a fingerprint of the size, modification time and first bytes of
+     * its file, so renamed or copied files still hit. Frames are stored ready to be mapped, so
+     * reading one costs no decoding. The least recently used frames are removed to stay within
+     * the budget. Calling this again with the same directory only changes the budget. Several
+     * processes, such as the workers of read_dng_to_shared_memory, can share one directory.
+     *
+     * @param cache_dir    Directory of the cache, created if needed (NULL turns the cache off)
+     * @param budget_bytes Largest total size of the cached frames in bytes (0 means no limit)
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    int set_dng_frame_cache(const char* cache_dir, unsigned long long budget_bytes);
+
+    /**
+     * Take a snapshot of the decoded-frame cache counters (all zero if the cache is off)
+     *
+     * @param stats Pointer to receive the counters
+     */
+    void get_dng_frame_cache_stats(dng_frame_cache_stats* stats);
+
+    /**
+     * Return codes of the wrapper for outcomes the DNG SDK has no error code for
+     *
+     * Other failures return 1 or a DNG SDK error code (dng_error_code in dng_errors.h).
+     */
+    enum {
+        dng_wrapper_canceled = 2,           ///< cancel_dng_job was called for the job
+        dng_wrapper_deadline_exceeded = 3,  ///< the deadline of the job passed
+        dng_wrapper_no_preview = 4          ///< read_dng_preview found no JPEG preview in the file
+    };
+
+    /**
+     * Priorities of a job, see set_dng_job_priority
+     */
+    enum {
+        dng_job_priority_batch = 0,         ///< pauses while an interactive job is running
+        dng_job_priority_normal = 1,        ///< never pauses; the default
+        dng_job_priority_interactive = 2    ///< pauses batch jobs while running
+    };
+
+    /**
+     * Cancellation token, deadline and priority shared by the wrapper calls of one job
+     */
+    typedef struct dng_job dng_job;
+
+    /**
+     * Create a job that the wrapper calls can be stopped through
+     *
+     * A call running for a stopped job returns within about one tile of work, from any
+     * decoding or encoding thread.
+     *
+     * @param timeout_seconds Time from now until the deadline of the job (<= 0 means no deadline)
+     *
+     * @return the job, to be released with release_dng_job
+     */
+    dng_job* create_dng_job(double timeout_seconds);
+
+    /**
+     * Cancel a job. Can be called from any thread while wrapper calls are using the job.
+     *
+     * @param job Job returned by create_dng_job
+     */
+    void cancel_dng_job(dng_job* job);
+
+    /**
+     * Set the priority of a job before passing it to wrapper calls
+     *
+     * While a wrapper call for an interactive job is running, the calls for batch jobs stop at
+     * the next tile and their decoding threads help with the interactive job instead. They
+     * resume once no interactive call is left. A paused call can still be canceled.
+     *
+     * @param job      Job returned by create_dng_job
+     * @param priority dng_job_priority_batch, dng_job_priority_normal or dng_job_priority_interactive
+     */
+    void set_dng_job_priority(dng_job* job, int priority);
+
+    /**
+     * Release a job once no wrapper call is using it
+     *
+     * @param job Job returned by create_dng_job (may be NULL)
+     */
+    void release_dng_job(dng_job* job);
+
     /**
      * Read a DNG file and extract raw pixel data and metadata
      *
@@ -46,15 +236,154 @@ extern "C" {
      * @param white_level         Pointer to receive the white level value
      * @param black_level         Pointer to receive the black level values for each color in the pattern
      * @param masked_areas        Pointer to receive masked area coordinates
+     * @param masked_area_black_levels Pointer to receive the mean of the masked areas for each position in the
+     *                            mosaic pattern, at index x + mosaic_pattern_width * y (0 if the file has no masked areas)
      * @param exposure_bias       Pointer to receive the exposure bias value (in EV*100)
      * @param ISO_exposure_time   Pointer to receive the product of ISO value and exposure time
      * @param color_factor_r      Pointer to receive the red color factor
      * @param color_factor_g      Pointer to receive the green color factor
      * @param color_factor_b      Pointer to receive the blue color factor
+     * @param job                 Job that can stop the call (may be NULL)
+     *
+     * @return 0 on success, dng_wrapper_canceled or dng_wrapper_deadline_exceeded if the job was stopped, other non-zero values on failure
+     */
+    int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* width, int* height, int* mosaic_pattern_width, int* white_level, int* black_level, int* masked_areas, int* masked_area_black_levels, int* exposure_bias, float* ISO_exposure_time, float* color_factor_r, float* color_factor_g, float* color_factor_b, dng_job* job);
+
+    /**
+     * Decoded frame in a shared memory segment, as filled by read_dng_to_shared_memory
+     *
+     * The struct holds no pointers, so it can be sent to another process as it is, together with
+     * the descriptor (see send_dng_shared_frame).
+     */
+    typedef struct {
+        int fd;                             ///< read-only descriptor of the segment, -1 if none
+        unsigned long long size;            ///< bytes of pixels at the start of the segment
+        int width;
+        int height;
+        int mosaic_pattern_width;
+        int white_level;
+        int black_levels[36];
+        int masked_area_count;
+        int masked_areas[16];
+        int masked_area_black_levels[36];
+        int exposure_bias;                  ///< in EV*100
+        float ISO_exposure_time;
+        float color_factor_r;
+        float color_factor_g;
+        float color_factor_b;
+    } dng_shared_frame;
+
+    /**
+     * Read a DNG file like read_dng_from_disk, but decode the pixels straight into a shared memory segment
+     *
+     * The segment has no name and can only be read through the descriptor, so any process it is
+     * passed to can map it without copying. The kernel counts the descriptors and mappings of each
+     * process and frees the segment once all are gone, also if a process crashes.
+     *
+     * @param in_path Path to the input DNG file
+     * @param frame   Receives the descriptor and metadata; release it with release_dng_shared_frame
+     * @param job     Job that can stop the call (may be NULL)
+     *
+     * @return 0 on success, dng_wrapper_canceled or dng_wrapper_deadline_exceeded if the job was stopped, other non-zero values on failure
+     */
+    int read_dng_to_shared_memory(const char* in_path, dng_shared_frame* frame, dng_job* job);
+
+    /**
+     * Map the pixels of a shared frame for reading
+     *
+     * @param frame Frame from read_dng_to_shared_memory or receive_dng_shared_frame
+     *
+     * @return Pointer to frame->size bytes of pixels, or NULL on failure; unmap it with unmap_dng_shared_frame
+     */
+    const void* map_dng_shared_frame(const dng_shared_frame* frame);
+
+    /**
+     * Unmap pixels mapped with map_dng_shared_frame
+     *
+     * @param frame  Frame that was mapped
+     * @param pixels Pointer returned by map_dng_shared_frame (may be NULL)
+     */
+    void unmap_dng_shared_frame(const dng_shared_frame* frame, const void* pixels);
+
+    /**
+     * Close the descriptor of a shared frame in this process (existing mappings stay valid)
+     *
+     * @param frame Frame whose descriptor is closed and set to -1
+     */
+    void release_dng_shared_frame(dng_shared_frame* frame);
+
+    /**
+     * Send a shared frame to another process over a connected UNIX domain socket
+     *
+     * The receiving process gets its own descriptor; the frame can be released here afterwards.
+     *
+     * @param socket Connected UNIX domain socket
+     * @param frame  Frame to send
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    int send_dng_shared_frame(int socket, const dng_shared_frame* frame);
+
+    /**
+     * Receive a shared frame sent with send_dng_shared_frame
+     *
+     * @param socket Connected UNIX domain socket
+     * @param frame  Receives the frame; release it with release_dng_shared_frame
      *
      * @return 0 on success, non-zero on failure
      */
-    int read_dng_from_disk(const char* in_path, void** pixel_bytes_pointer, int* width, int* height, int* mosaic_pattern_width, int* white_level, int* black_level, int* masked_areas, int* exposure_bias, float* ISO_exposure_time, float* color_factor_r, float* color_factor_g, float* color_factor_b);
+    int receive_dng_shared_frame(int socket, dng_shared_frame* frame);
+
+    /**
+     * Estimate the translation between two images by phase correlation
+     *
+     * Meant for heavily downsampled frames, a few hundred pixels on a side, to seed the tile alignment.
+     * Larger images are cropped to their center.
+     *
+     * @param ref_pixels  Reference image as 16-bit floats, as in an r16Float texture
+     * @param comp_pixels Comparison image of the same size and format
+     * @param width       Width of the images in pixels (rows are packed)
+     * @param height      Height of the images in pixels
+     * @param shift_x     Receives the horizontal shift such that the comparison image at x + shift_x matches the reference image at x
+     * @param shift_y     Receives the vertical shift in the same way
+     * @param confidence  Receives a value from 0 (no translation stands out) to 1 (one translation clearly does)
+     *
+     * @return 0 on success, non-zero on failure (e.g. if an image is smaller than 16 pixels on a side)
+     */
+    int phase_correlate(const unsigned short* ref_pixels, const unsigned short* comp_pixels, int width, int height, float* shift_x, float* shift_y, float* confidence);
+
+    /**
+     * Counters of one call to align_tiles
+     */
+    typedef struct {
+        unsigned long long tiles;                   ///< tiles aligned, over all pyramid levels
+        unsigned long long flat_tiles;              ///< tiles too flat to search, which took the vectors of their neighbours
+        unsigned long long early_exits;             ///< tiles whose search stopped at the start vector
+        unsigned long long evaluations;             ///< tile comparisons done
+        unsigned long long exhaustive_evaluations;  ///< tile comparisons the exhaustive search does for the same images
+    } dng_tile_alignment_stats;
+
+    /**
+     * Align the tiles of a comparison image to a reference image on the CPU
+     *
+     * Runs the same coarse-to-fine search as the GPU alignment, on images already reduced to one
+     * value per mosaic pattern. The adaptive mode does not search tiles whose texture is below the
+     * noise, which take the median vector of their neighbours, and stops the search of a tile when
+     * its start vector is clearly the best, so it does far fewer tile comparisons.
+     *
+     * @param ref_pixels      Reference image, rows packed
+     * @param comp_pixels     Comparison image of the same size
+     * @param width           Width of the images in pixels
+     * @param height          Height of the images in pixels
+     * @param tile_size       Tile size at full resolution (8, 16, 32 or 64)
+     * @param search_distance Levels are added while the coarsest one is larger than this on its smaller side
+     * @param adaptive        Non-zero for the adaptive search, zero for the exhaustive one
+     * @param alignment       Receives two values (x, y) per tile, row by row, for (width / (tile_size / 2) - 1) x (height / (tile_size / 2) - 1) tiles
+     * @param stats           Receives the counters (may be NULL)
+     *
+     * @return 0 on success, non-zero on failure (e.g. if the images are too small for the tile size)
+     */
+    int align_tiles(const float* ref_pixels, const float* comp_pixels, int width, int height, int tile_size, int search_distance, int adaptive, int* alignment, dng_tile_alignment_stats* stats);
 
     /**
      * Write processed image data to a DNG file
@@ -67,10 +396,42 @@ extern "C" {
      * @param out_path            Path where the output DNG file will be written
      * @param pixel_bytes_pointer Pointer to the processed pixel data to write
      * @param white_level         New white level to set in the output DNG file (if > 0)
+     * @param job                 Job that can stop the call (may be NULL)
      *
-     * @return 0 on success, non-zero on failure
+     * @return 0 on success, dng_wrapper_canceled or dng_wrapper_deadline_exceeded if the job was stopped, other non-zero values on failure
+     */
+    int write_dng_to_disk(const char *in_path, const char *out_path, void** pixel_bytes_pointer, const int white_level, dng_job* job);
+
+    /**
+     * Locate the embedded JPEG preview of a DNG file without decoding the raw data
+     *
+     * Only the IFD structure of the file is parsed. The preview that fits max_size best is
+     * selected: the smallest preview whose longer side is at least max_size, or the largest
+     * preview if none is big enough. The returned bytes are a read-only memory mapping of the
+     * file region holding the JPEG stream, so no pixel data is copied or decoded. They must be
+     * released with release_dng_preview.
+     *
+     * @param in_path            Path to the input DNG file
+     * @param max_size           Requested size of the longer preview side in pixels (<= 0 selects the largest preview)
+     * @param jpeg_bytes_pointer Pointer to receive the address of the JPEG stream
+     * @param length             Pointer to receive the length of the JPEG stream in bytes
+     * @param width              Pointer to receive the width of the selected preview (may be NULL)
+     * @param height             Pointer to receive the height of the selected preview (may be NULL)
+     *
+     * @return 0 on success, dng_wrapper_no_preview if the file contains no JPEG preview, otherwise a DNG SDK
+     *         error code: dng_error_bad_format for a file that is not a DNG, dng_error_file_is_damaged for a
+     *         preview outside the file or not starting with a JPEG SOI marker, dng_error_open_file,
+     *         dng_error_read_file or dng_error_memory if the file could not be read or mapped
+     */
+    int read_dng_preview(const char* in_path, int max_size, const void** jpeg_bytes_pointer, int* length, int* width, int* height);
+
+    /**
+     * Release the JPEG stream returned by read_dng_preview
+     *
+     * @param jpeg_bytes Address returned by read_dng_preview
+     * @param length     Length returned by read_dng_preview
      */
-    int write_dng_to_disk(const char *in_path, const char *out_path, void** pixel_bytes_pointer, const int white_level);
+    void release_dng_preview(const void* jpeg_bytes, int length);
 
 #ifdef __cplusplus
 }
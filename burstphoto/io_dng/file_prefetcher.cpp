@@ -0,0 +1,428 @@
+/**
+ * @file file_prefetcher.cpp
+ * @brief Background reader that warms the operating system file cache for files that will be opened soon
+ */
+
+/*****************************************************************************/
+
+#include "file_prefetcher.h"
+
+#include "dng_flags.h"
+#include "dng_trace.h"
+
+#include <algorithm>
+
+#include <stdio.h>
+
+#if qLinux || qMacOS
+#include <fcntl.h>
+#endif
+
+/*****************************************************************************/
+
+namespace
+	{
+
+	// Size of the read buffer. Large enough for efficient sequential reads
+	// on network volumes, small enough to stay out of the way.
+
+	const size_t kPrefetchBufferSize = 1024 * 1024;
+
+	}
+
+/*****************************************************************************/
+
+file_prefetcher::file_prefetcher ()
+
+	:	fMutex			   ()
+	,	fCondition		   ()
+	,	fQueue			   ()
+	,	fFiles			   ()
+	,	fByteLimit		   (0)
+	,	fBytesThisRequest  (0)
+	,	fStopping		   (false)
+	,	fCancelCurrent	   (false)
+	,	fStats			   ()
+	,	fWorker			   ()
+
+	{
+
+	}
+
+/*****************************************************************************/
+
+file_prefetcher::~file_prefetcher ()
+	{
+
+		{
+
+		dng_lock_std_mutex lock (fMutex);
+
+		fStopping = true;
+
+		}
+
+	fCondition.notify_all ();
+
+	if (fWorker.joinable ())
+		{
+		fWorker.join ();
+		}
+
+	}
+
+/*****************************************************************************/
+
+void file_prefetcher::Prefetch (const std::vector<std::string> &paths,
+								uint64 maxBytes)
+	{
+
+		{
+
+		dng_lock_std_mutex lock (fMutex);
+
+		// Drop what an earlier call left queued.
+
+		for (const std::string &path : fQueue)
+			{
+
+			fFiles.erase (path);
+
+			fStats.fFilesSkipped++;
+
+			}
+
+		fQueue.clear ();
+
+		for (const std::string &path : paths)
+			{
+
+			fStats.fFilesRequested++;
+
+			auto it = fFiles.find (path);
+
+			if (it != fFiles.end () && it->second != kQueued)
+				{
+
+				// Already read, or being read.
+
+				continue;
+
+				}
+
+			fFiles [path] = kQueued;
+
+			fQueue.push_back (path);
+
+			}
+
+		fByteLimit		  = maxBytes;
+		fBytesThisRequest = 0;
+
+		// The worker is started on first use, so processes that never
+		// prefetch do not get an idle thread.
+
+		if (!fWorker.joinable ())
+			{
+			fWorker = std::thread ([this] { WorkerLoop (); });
+			}
+
+		}
+
+	fCondition.notify_all ();
+
+	}
+
+/*****************************************************************************/
+
+void file_prefetcher::Cancel ()
+	{
+
+	dng_lock_std_mutex lock (fMutex);
+
+	fStats.fFilesSkipped += fQueue.size ();
+
+	fQueue.clear ();
+
+	fFiles.clear ();
+
+	fCancelCurrent = true;
+
+	}
+
+/*****************************************************************************/
+
+void file_prefetcher::NoteOpen (const char *path)
+	{
+
+	if (!path)
+		{
+		return;
+		}
+
+	dng_lock_std_mutex lock (fMutex);
+
+	auto it = fFiles.find (path);
+
+	if (it == fFiles.end ())
+		{
+
+		fStats.fMisses++;
+
+		return;
+
+		}
+
+	switch (it->second)
+		{
+
+		case kDone:
+			{
+			fStats.fHits++;
+			break;
+			}
+
+		case kReading:
+			{
+
+			// The worker keeps reading ahead of the caller, which is still
+			// faster than a cold read.
+
+			fStats.fPartialHits++;
+
+			break;
+
+			}
+
+		case kQueued:
+			{
+
+			fStats.fMisses++;
+			fStats.fFilesSkipped++;
+
+			for (auto q = fQueue.begin (); q != fQueue.end (); ++q)
+				{
+
+				if (*q == it->first)
+					{
+					fQueue.erase (q);
+					break;
+					}
+
+				}
+
+			break;
+
+			}
+
+		}
+
+	// Each file is reported once. The worker tolerates a missing entry for
+	// the file it is reading. Entries for files that are read but never
+	// opened are dropped by Cancel.
+
+	fFiles.erase (it);
+
+	}
+
+/*****************************************************************************/
+
+file_prefetcher::stats file_prefetcher::Stats () const
+	{
+
+	dng_lock_std_mutex lock (fMutex);
+
+	return fStats;
+
+	}
+
+/*****************************************************************************/
+
+void file_prefetcher::ResetStats ()
+	{
+
+	dng_lock_std_mutex lock (fMutex);
+
+	fStats = stats ();
+
+	}
+
+/*****************************************************************************/
+
+void file_prefetcher::WorkerLoop ()
+	{
+
+	while (true)
+		{
+
+		std::string path;
+
+			{
+
+			dng_unique_lock lock (fMutex);
+
+			fCondition.wait (lock, [this]
+				{
+				return fStopping || !fQueue.empty ();
+				});
+
+			if (fStopping)
+				{
+				return;
+				}
+
+			if (fByteLimit && fBytesThisRequest >= fByteLimit)
+				{
+
+				for (const std::string &queued : fQueue)
+					{
+					fFiles.erase (queued);
+					}
+
+				fStats.fFilesSkipped += fQueue.size ();
+
+				fQueue.clear ();
+
+				continue;
+
+				}
+
+			path = fQueue.front ();
+
+			fQueue.pop_front ();
+
+			fFiles [path] = kReading;
+
+			fCancelCurrent = false;
+
+			}
+
+		dng_trace_scope trace ("io", "prefetch_file");
+
+		bool complete = ReadFile (path);
+
+			{
+
+			dng_lock_std_mutex lock (fMutex);
+
+			if (complete)
+				{
+				fStats.fFilesPrefetched++;
+				}
+
+			else
+				{
+				fStats.fFilesSkipped++;
+				}
+
+			auto it = fFiles.find (path);
+
+			if (it != fFiles.end ())
+				{
+
+				// A file that is read to the end counts as a hit when it is
+				// opened later. One that is not gains nothing.
+
+				if (complete)
+					{
+					it->second = kDone;
+					}
+
+				else
+					{
+					fFiles.erase (it);
+					}
+
+				}
+
+			}
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+bool file_prefetcher::ReadFile (const std::string &path)
+	{
+
+	FILE *file = fopen (path.c_str (), "rb");
+
+	if (!file)
+		{
+		return false;
+		}
+
+	// Ask the kernel to start reading the whole file now. The reads below
+	// then mostly wait on I/O that is already in flight.
+
+	#if qLinux
+
+	posix_fadvise (fileno (file), 0, 0, POSIX_FADV_WILLNEED);
+
+	#elif qMacOS
+
+	if (fseeko (file, 0, SEEK_END) == 0)
+		{
+
+		off_t length = ftello (file);
+
+		struct radvisory advice;
+
+		advice.ra_offset = 0;
+		advice.ra_count  = (int) std::min<off_t> (length, 0x7FFFFFFF);
+
+		fcntl (fileno (file), F_RDADVISE, &advice);
+
+		}
+
+	fseeko (file, 0, SEEK_SET);
+
+	#endif
+
+	std::vector<char> buffer (kPrefetchBufferSize);
+
+	bool complete = false;
+
+	while (true)
+		{
+
+		size_t count = fread (buffer.data (), 1, buffer.size (), file);
+
+		if (count == 0)
+			{
+			complete = feof (file) != 0;
+			break;
+			}
+
+		dng_lock_std_mutex lock (fMutex);
+
+		fStats.fBytesPrefetched += count;
+
+		fBytesThisRequest += count;
+
+		if (feof (file))
+			{
+			complete = true;
+			break;
+			}
+
+		if (fStopping || fCancelCurrent)
+			{
+			break;
+			}
+
+		if (fByteLimit && fBytesThisRequest >= fByteLimit)
+			{
+			break;
+			}
+
+		}
+
+	fclose (file);
+
+	return complete;
+
+	}
+
+/*****************************************************************************/
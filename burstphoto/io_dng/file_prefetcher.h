@@ -0,0 +1,164 @@
+/**
+ * @file file_prefetcher.h
+ * @brief Background reader that warms the operating system file cache for files that will be opened soon
+ *
+ * Serves the burst loading of the app through prefetch_dng_files in the DNG SDK wrapper. Written in the
+ * style and with the types of the DNG SDK, which it builds on.
+ */
+
+/*****************************************************************************/
+
+#ifndef __file_prefetcher__
+#define __file_prefetcher__
+
+/*****************************************************************************/
+
+#include "dng_mutex.h"
+#include "dng_types.h"
+#include "dng_uncopyable.h"
+
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*****************************************************************************/
+
+/// \brief Reads files on a background thread so that a later read of the
+/// same files is served from the file cache.
+///
+/// Intended for batch processing, where the files of the next burst can be
+/// read while the current burst is being merged. Each file gets an advisory
+/// read-ahead hint, where the platform has one, and is then read through a
+/// small fixed buffer. The read is what makes the prefetch work on network
+/// volumes and other file systems that ignore the hint. No file data is kept
+/// by this object.
+///
+/// Callers report the files they open with NoteOpen, which yields the hit
+/// statistics.
+
+class file_prefetcher: private dng_uncopyable
+	{
+
+	public:
+
+		/// Counters since construction or the last ResetStats.
+
+		struct stats
+			{
+
+			/// Files passed to Prefetch.
+
+			uint64 fFilesRequested = 0;
+
+			/// Files read to the end by the background thread.
+
+			uint64 fFilesPrefetched = 0;
+
+			/// Bytes read by the background thread.
+
+			uint64 fBytesPrefetched = 0;
+
+			/// Files requested but not read, because they were dropped by a
+			/// later Prefetch or Cancel call, did not fit the byte limit, or
+			/// could not be opened.
+
+			uint64 fFilesSkipped = 0;
+
+			/// Opened files that had been read to the end beforehand.
+
+			uint64 fHits = 0;
+
+			/// Opened files that were being read at the time.
+
+			uint64 fPartialHits = 0;
+
+			/// Opened files that had not been read yet.
+
+			uint64 fMisses = 0;
+
+			};
+
+	private:
+
+		enum file_state
+			{
+			kQueued,
+			kReading,
+			kDone
+			};
+
+		mutable dng_std_mutex fMutex;
+
+		std::condition_variable fCondition;
+
+		std::deque<std::string> fQueue;
+
+		// State of each requested file that has not been opened yet.
+
+		std::unordered_map<std::string, file_state> fFiles;
+
+		uint64 fByteLimit;
+
+		uint64 fBytesThisRequest;
+
+		bool fStopping;
+
+		bool fCancelCurrent;
+
+		stats fStats;
+
+		std::thread fWorker;
+
+	public:
+
+		file_prefetcher ();
+
+		/// Stops the background thread. A file being read is abandoned.
+
+		~file_prefetcher ();
+
+		/// Queue files to be read, in order. Files queued by an earlier call
+		/// that have not been started are dropped, so each call should list
+		/// everything that is needed next.
+		/// \param paths Files to read.
+		/// \param maxBytes Stop after reading this many bytes for this call,
+		/// so the prefetch does not push the files in use out of the cache.
+		/// 0 means no limit.
+
+		void Prefetch (const std::vector<std::string> &paths,
+					   uint64 maxBytes = 0);
+
+		/// Drop all queued files and stop reading the current one.
+
+		void Cancel ();
+
+		/// Report that a file is being opened for reading. Updates the hit
+		/// statistics. A file that is still queued is taken off the queue,
+		/// since reading it ahead would no longer help.
+
+		void NoteOpen (const char *path);
+
+		/// Current counters.
+
+		stats Stats () const;
+
+		void ResetStats ();
+
+	private:
+
+		void WorkerLoop ();
+
+		// Read one file. Returns false if it could not be opened.
+
+		bool ReadFile (const std::string &path);
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
@@ -0,0 +1,1032 @@
+/**
+ * @file frame_cache.cpp
+ * @brief Persistent on-disk cache of decoded frames, keyed by a fingerprint of the source file
+ */
+
+/*****************************************************************************/
+
+#include "frame_cache.h"
+
+#include "dng_auto_ptr.h"
+#include "dng_trace.h"
+#include "dng_utils.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iterator>
+
+/*****************************************************************************/
+
+namespace
+	{
+
+	const uint32 kEntryMagic	= 0x43464644;	// "DFFC"
+	const uint32 kIndexMagic	= 0x58464644;	// "DFFX"
+	const uint32 kEntryVersion	= 1;
+	const uint32 kIndexVersion	= 2;
+
+	// Frame data starts at a multiple of this, which covers the page size of
+	// all supported systems.
+
+	const uint64 kDataAlignment = 16384;
+
+	// Inserts are written to the index in batches of this many. Entries
+	// that are not in the saved index yet are still found by lookups, and
+	// are removed after kOrphanSeconds if no process indexes them, so a
+	// crash only loses the last few.
+
+	const uint32 kIndexSaveInterval = 16;
+
+	// Entry files no index lists are removed when the cache is opened once
+	// they are this old. Another process may have written them and not
+	// saved its index yet.
+
+	const int64 kOrphanSeconds = 24 * 60 * 60;
+
+	// Temporary files are removed when the cache is opened once their
+	// writer has exited and they are this old, which also covers writers
+	// on other hosts of a shared directory, as a file being written keeps
+	// changing ...
+
+	const int64 kDeadWriterSeconds = 60;
+
+	// ... or once they are this old, whoever wrote them.
+
+	const int64 kTempSeconds = 60 * 60;
+
+	// Number of leading bytes of a source file that go into its key. This
+	// covers the TIFF header and the IFDs of typical raw files.
+
+	const uint32 kKeyHeaderBytes = 65536;
+
+	const char *kEntrySuffix = ".frame";
+	const char *kTempSuffix	 = ".tmp";
+	const char *kIndexName	 = "index";
+	const char *kLockName	 = "lock";
+
+	struct entry_header
+		{
+		uint32 fMagic;
+		uint32 fVersion;
+		uint8  fKey [dng_fingerprint::kDNGFingerprintSize];
+		uint32 fMetaSize;
+		uint32 fReserved;
+		uint64 fDataOffset;
+		uint64 fDataSize;
+		};
+
+	struct index_header
+		{
+		uint32 fMagic;
+		uint32 fVersion;
+		uint64 fCount;
+		};
+
+	struct index_record
+		{
+		uint8  fKey [dng_fingerprint::kDNGFingerprintSize];
+		uint64 fBytes;
+		uint64 fLastUsed;
+		};
+
+	uint64 NowMicroseconds ()
+		{
+
+		return (uint64) std::chrono::duration_cast<std::chrono::microseconds>
+						(std::chrono::system_clock::now ().time_since_epoch ()).count ();
+
+		}
+
+	// Holds an exclusive flock on a file while in scope. Does nothing for
+	// a descriptor of -1.
+
+	class index_lock: private dng_uncopyable
+		{
+
+		private:
+
+			int fFile;
+
+		public:
+
+			explicit index_lock (int file)
+
+				:	fFile (file)
+
+				{
+
+				while (fFile >= 0 && flock (fFile, LOCK_EX) != 0)
+					{
+
+					if (errno != EINTR)
+						{
+						fFile = -1;
+						}
+
+					}
+
+				}
+
+			~index_lock ()
+				{
+
+				if (fFile >= 0)
+					{
+					flock (fFile, LOCK_UN);
+					}
+
+				}
+
+		};
+
+	// Whether a temporary file named "<target>.<pid>.<counter>.tmp" is left
+	// over from a writer that exited or stopped writing.
+
+	bool IsStaleTemp (const std::string &name,
+					  int64 age)
+		{
+
+		if (age >= kTempSeconds)
+			{
+			return true;
+			}
+
+		const std::string stem = name.substr (0, name.size () - strlen (kTempSuffix));
+
+		const size_t counterDot = stem.rfind ('.');
+
+		const size_t pidDot = counterDot == std::string::npos || counterDot == 0
+							? std::string::npos
+							: stem.rfind ('.', counterDot - 1);
+
+		if (pidDot == std::string::npos)
+			{
+			return false;
+			}
+
+		const long pid = strtol (stem.c_str () + pidDot + 1, NULL, 10);
+
+		const bool writerExited = pid > 0 &&
+								  kill ((pid_t) pid, 0) != 0 &&
+								  errno == ESRCH;
+
+		return writerExited && age >= kDeadWriterSeconds;
+
+		}
+
+	bool EndsWith (const std::string &text,
+				   const char *suffix)
+		{
+
+		const size_t length = strlen (suffix);
+
+		return text.size () >= length &&
+			   text.compare (text.size () - length, length, suffix) == 0;
+
+		}
+
+	// Create a directory and its missing parents.
+
+	void MakeDirectories (const std::string &path)
+		{
+
+		for (size_t slash = path.find ('/', 1);
+			 slash != std::string::npos;
+			 slash = path.find ('/', slash + 1))
+			{
+			mkdir (path.substr (0, slash).c_str (), 0755);
+			}
+
+		mkdir (path.c_str (), 0755);
+
+		}
+
+	// Write all of a buffer. Large frames are written in pieces, since some
+	// systems limit a single write to 2 GB.
+
+	bool WriteAll (int fd,
+				   const void *data,
+				   uint64 size)
+		{
+
+		const uint8 *bytes = (const uint8 *) data;
+
+		while (size)
+			{
+
+			const size_t chunk = (size_t) Min_uint64 (size, 1 << 30);
+
+			const ssize_t written = write (fd, bytes, chunk);
+
+			if (written < 0)
+				{
+
+				if (errno == EINTR)
+					{
+					continue;
+					}
+
+				return false;
+
+				}
+
+			bytes += written;
+			size  -= written;
+
+			}
+
+		return true;
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+frame_cache::entry::entry ()
+
+	:	fBase	  (NULL)
+	,	fLength	  (0)
+	,	fMeta	  (NULL)
+	,	fMetaSize (0)
+	,	fData	  (NULL)
+	,	fDataSize (0)
+
+	{
+
+	}
+
+/*****************************************************************************/
+
+frame_cache::entry::~entry ()
+	{
+
+	if (fBase)
+		{
+		munmap (fBase, (size_t) fLength);
+		}
+
+	}
+
+/*****************************************************************************/
+
+frame_cache::frame_cache (const char *directory,
+						  uint64 budget)
+
+	:	fDirectory		(directory)
+	,	fMutex			()
+	,	fLockFile		(-1)
+	,	fBudget			(budget)
+	,	fBytes			(0)
+	,	fRecords		()
+	,	fIndex			()
+	,	fIndexDirty		(false)
+	,	fUnsavedInserts (0)
+	,	fTempCounter	(0)
+	,	fStats			()
+
+	{
+
+	MakeDirectories (fDirectory);
+
+	fLockFile = open ((fDirectory + "/" + kLockName).c_str (), O_RDWR | O_CREAT, 0644);
+
+	dng_lock_std_mutex lock (fMutex);
+
+	SyncIndex (true);
+
+	}
+
+/*****************************************************************************/
+
+frame_cache::~frame_cache ()
+	{
+
+		{
+
+		dng_lock_std_mutex lock (fMutex);
+
+		if (fIndexDirty)
+			{
+			SyncIndex (false);
+			}
+
+		}
+
+	if (fLockFile >= 0)
+		{
+		close (fLockFile);
+		}
+
+	}
+
+/*****************************************************************************/
+
+dng_fingerprint frame_cache::SourceKey (const char *path,
+										const char *version)
+	{
+
+	int fd = open (path, O_RDONLY);
+
+	if (fd < 0)
+		{
+		return dng_fingerprint ();
+		}
+
+	struct stat info;
+
+	if (fstat (fd, &info) != 0)
+		{
+		close (fd);
+		return dng_fingerprint ();
+		}
+
+	std::vector<uint8> header (kKeyHeaderBytes);
+
+	ssize_t count = read (fd, header.data (), header.size ());
+
+	close (fd);
+
+	if (count < 0)
+		{
+		return dng_fingerprint ();
+		}
+
+	// Whole seconds miss a file rewritten within the same second, so the
+	// nanoseconds and the inode go in as well.
+
+	#if qMacOS || qiPhone
+	const struct timespec &modified = info.st_mtimespec;
+	#else
+	const struct timespec &modified = info.st_mtim;
+	#endif
+
+	const uint64 size	   = (uint64) info.st_size;
+	const int64	 mtime	   = (int64)  modified.tv_sec;
+	const int64	 mtimeNsec = (int64)  modified.tv_nsec;
+	const uint64 inode	   = (uint64) info.st_ino;
+
+	dng_md5_printer printer;
+
+	printer.Process (version);
+
+	printer.Process (&size, sizeof (size));
+
+	printer.Process (&mtime, sizeof (mtime));
+
+	printer.Process (&mtimeNsec, sizeof (mtimeNsec));
+
+	printer.Process (&inode, sizeof (inode));
+
+	printer.Process (header.data (), (uint32) count);
+
+	return printer.Result ();
+
+	}
+
+/*****************************************************************************/
+
+void frame_cache::SetBudget (uint64 budget)
+	{
+
+	dng_lock_std_mutex lock (fMutex);
+
+	fBudget = budget;
+
+	EvictToBudget ();
+
+	if (fIndexDirty)
+		{
+		SyncIndex (false);
+		}
+
+	}
+
+/*****************************************************************************/
+
+frame_cache::entry * frame_cache::Lookup (const dng_fingerprint &key)
+	{
+
+	std::string path;
+
+	bool known = false;
+
+		{
+
+		dng_lock_std_mutex lock (fMutex);
+
+		auto it = fIndex.find (key);
+
+		known = it != fIndex.end ();
+
+		if (known)
+			{
+
+			// Most recently used goes to the front.
+
+			fRecords.splice (fRecords.begin (), fRecords, it->second);
+
+			it->second->fLastUsed = NowMicroseconds ();
+
+			fIndexDirty = true;
+
+			}
+
+		path = EntryPath (key);
+
+		}
+
+	// Unknown keys are still looked up on disk, since another process may
+	// have written the entry and not indexed it yet.
+
+	dng_trace_scope trace ("io", "frame_cache_lookup");
+
+	AutoPtr<entry> result;
+
+	bool valid = false;
+
+	int fd = open (path.c_str (), O_RDONLY);
+
+	struct stat info;
+
+	if (fd >= 0 && fstat (fd, &info) == 0 && (uint64) info.st_size >= sizeof (entry_header))
+		{
+
+		void *base = mmap (NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (base != MAP_FAILED)
+			{
+
+			result.Reset (new entry);
+
+			result->fBase	= base;
+			result->fLength = (uint64) info.st_size;
+
+			const entry_header &header = *(const entry_header *) base;
+
+			valid = header.fMagic	== kEntryMagic &&
+					header.fVersion == kEntryVersion &&
+					memcmp (header.fKey, key.data, dng_fingerprint::kDNGFingerprintSize) == 0 &&
+					sizeof (entry_header) + header.fMetaSize <= header.fDataOffset &&
+					header.fDataOffset <= result->fLength &&
+					header.fDataSize <= result->fLength - header.fDataOffset;
+
+			if (valid)
+				{
+
+				result->fMeta	  = (const uint8 *) base + sizeof (entry_header);
+				result->fMetaSize = header.fMetaSize;
+				result->fData	  = (const uint8 *) base + header.fDataOffset;
+				result->fDataSize = header.fDataSize;
+
+				}
+
+			}
+
+		}
+
+	if (fd >= 0)
+		{
+		close (fd);
+		}
+
+	dng_lock_std_mutex lock (fMutex);
+
+	auto it = fIndex.find (key);
+
+	if (!valid)
+		{
+
+		// Damaged, or evicted since the index lookup above, possibly by
+		// another process. Files this process never indexed are left alone.
+
+		if (known && it != fIndex.end ())
+			{
+			Remove (it->second);
+			}
+
+		fStats.fMisses++;
+
+		return NULL;
+
+		}
+
+	if (it == fIndex.end ())
+		{
+
+		record newRecord;
+
+		newRecord.fKey		= key;
+		newRecord.fBytes	= result->fLength;
+		newRecord.fLastUsed = NowMicroseconds ();
+
+		fRecords.push_front (newRecord);
+
+		fIndex [key] = fRecords.begin ();
+
+		fBytes += newRecord.fBytes;
+
+		fIndexDirty = true;
+
+		EvictToBudget ();
+
+		}
+
+	fStats.fHits++;
+
+	return result.Release ();
+
+	}
+
+/*****************************************************************************/
+
+bool frame_cache::Insert (const dng_fingerprint &key,
+						  const void *meta,
+						  uint32 metaSize,
+						  const void *data,
+						  uint64 dataSize)
+	{
+
+	entry_header header;
+
+	memset (&header, 0, sizeof (header));
+
+	header.fMagic	   = kEntryMagic;
+	header.fVersion	   = kEntryVersion;
+	header.fMetaSize   = metaSize;
+	header.fDataOffset = (sizeof (entry_header) + metaSize + kDataAlignment - 1) / kDataAlignment * kDataAlignment;
+	header.fDataSize   = dataSize;
+
+	memcpy (header.fKey, key.data, dng_fingerprint::kDNGFingerprintSize);
+
+	const uint64 bytes = header.fDataOffset + dataSize;
+
+	std::string tempPath;
+
+		{
+
+		dng_lock_std_mutex lock (fMutex);
+
+		if (fBudget && bytes > fBudget)
+			{
+			return false;
+			}
+
+		tempPath = TempPath (EntryPath (key));
+
+		}
+
+	dng_trace_scope trace ("io", "frame_cache_insert");
+
+	// Write a temporary file and rename it, so readers never see a partial
+	// entry.
+
+	int fd = open (tempPath.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+		{
+		return false;
+		}
+
+	std::vector<uint8> head ((size_t) header.fDataOffset, 0);
+
+	memcpy (head.data (), &header, sizeof (header));
+
+	if (metaSize)
+		{
+		memcpy (head.data () + sizeof (header), meta, metaSize);
+		}
+
+	bool ok = WriteAll (fd, head.data (), head.size ()) &&
+			  WriteAll (fd, data, dataSize);
+
+	ok = (close (fd) == 0) && ok;
+
+	if (!ok || rename (tempPath.c_str (), EntryPath (key).c_str ()) != 0)
+		{
+		unlink (tempPath.c_str ());
+		return false;
+		}
+
+	dng_lock_std_mutex lock (fMutex);
+
+	auto it = fIndex.find (key);
+
+	if (it != fIndex.end ())
+		{
+
+		// The file was replaced by the rename above.
+
+		fBytes -= it->second->fBytes;
+
+		fRecords.erase (it->second);
+
+		fIndex.erase (it);
+
+		}
+
+	record newRecord;
+
+	newRecord.fKey		= key;
+	newRecord.fBytes	= bytes;
+	newRecord.fLastUsed = NowMicroseconds ();
+
+	fRecords.push_front (newRecord);
+
+	fIndex [key] = fRecords.begin ();
+
+	fBytes += bytes;
+
+	fStats.fInserts++;
+
+	fIndexDirty = true;
+
+	EvictToBudget ();
+
+	if (++fUnsavedInserts >= kIndexSaveInterval)
+		{
+		SyncIndex (false);
+		}
+
+	return true;
+
+	}
+
+/*****************************************************************************/
+
+void frame_cache::Flush ()
+	{
+
+	dng_lock_std_mutex lock (fMutex);
+
+	if (fIndexDirty)
+		{
+		SyncIndex (false);
+		}
+
+	}
+
+/*****************************************************************************/
+
+frame_cache::stats frame_cache::Stats () const
+	{
+
+	dng_lock_std_mutex lock (fMutex);
+
+	stats result = fStats;
+
+	result.fEntries = fRecords.size ();
+	result.fBytes	= fBytes;
+	result.fBudget	= fBudget;
+
+	return result;
+
+	}
+
+/*****************************************************************************/
+
+std::string frame_cache::EntryPath (const dng_fingerprint &key) const
+	{
+
+	char hex [2 * dng_fingerprint::kDNGFingerprintSize + 1];
+
+	key.ToUtf8HexString (hex);
+
+	return fDirectory + "/" + hex + kEntrySuffix;
+
+	}
+
+/*****************************************************************************/
+
+std::string frame_cache::IndexPath () const
+	{
+
+	return fDirectory + "/" + kIndexName;
+
+	}
+
+/*****************************************************************************/
+
+std::string frame_cache::TempPath (const std::string &path)
+	{
+
+	char suffix [64];
+
+	snprintf (suffix, sizeof (suffix), ".%d.%u", (int) getpid (), (unsigned) fTempCounter++);
+
+	return path + suffix + kTempSuffix;
+
+	}
+
+/*****************************************************************************/
+
+void frame_cache::SyncIndex (bool removeStale)
+	{
+
+	dng_trace_scope trace ("io", "frame_cache_sync");
+
+	index_lock lock (fLockFile);
+
+	std::vector<record> stored;
+
+	ReadIndex (stored);
+
+	MergeIndex (stored);
+
+	if (removeStale)
+		{
+		RemoveStaleFiles ();
+		}
+
+	EvictToBudget ();
+
+	if (WriteIndex ())
+		{
+		fIndexDirty		= false;
+		fUnsavedInserts = 0;
+		}
+
+	}
+
+/*****************************************************************************/
+
+void frame_cache::ReadIndex (std::vector<record> &records) const
+	{
+
+	FILE *file = fopen (IndexPath ().c_str (), "rb");
+
+	if (!file)
+		{
+		return;
+		}
+
+	index_header header;
+
+	if (fread (&header, sizeof (header), 1, file) == 1 &&
+		header.fMagic	== kIndexMagic &&
+		header.fVersion == kIndexVersion)
+		{
+
+		index_record stored;
+
+		for (uint64 index = 0; index < header.fCount && fread (&stored, sizeof (stored), 1, file) == 1; index++)
+			{
+
+			record entryRecord;
+
+			memcpy (entryRecord.fKey.data, stored.fKey, dng_fingerprint::kDNGFingerprintSize);
+
+			entryRecord.fBytes	  = stored.fBytes;
+			entryRecord.fLastUsed = stored.fLastUsed;
+
+			records.push_back (entryRecord);
+
+			}
+
+		}
+
+	fclose (file);
+
+	}
+
+/*****************************************************************************/
+
+void frame_cache::MergeIndex (const std::vector<record> &records)
+	{
+
+	// Add the entries other processes recorded, and keep the latest use of
+	// the entries both know.
+
+	for (const record &stored : records)
+		{
+
+		auto it = fIndex.find (stored.fKey);
+
+		if (it == fIndex.end ())
+			{
+
+			fRecords.push_back (stored);
+
+			fIndex [stored.fKey] = std::prev (fRecords.end ());
+
+			}
+
+		else if (stored.fLastUsed > it->second->fLastUsed)
+			{
+			it->second->fLastUsed = stored.fLastUsed;
+			}
+
+		}
+
+	// Drop entries whose file is gone, such as entries another process
+	// evicted, and take the size of files another process replaced.
+
+	fBytes = 0;
+
+	for (auto it = fRecords.begin (); it != fRecords.end (); )
+		{
+
+		struct stat info;
+
+		if (stat (EntryPath (it->fKey).c_str (), &info) != 0)
+			{
+
+			fIndex.erase (it->fKey);
+
+			it = fRecords.erase (it);
+
+			continue;
+
+			}
+
+		it->fBytes = (uint64) info.st_size;
+
+		fBytes += it->fBytes;
+
+		++it;
+
+		}
+
+	// Most recently used first. The sort is stable and keeps the iterators
+	// in fIndex valid.
+
+	fRecords.sort ([] (const record &a, const record &b)
+		{
+		return a.fLastUsed > b.fLastUsed;
+		});
+
+	}
+
+/*****************************************************************************/
+
+bool frame_cache::WriteIndex ()
+	{
+
+	const std::string path = IndexPath ();
+
+	const std::string tempPath = TempPath (path);
+
+	FILE *file = fopen (tempPath.c_str (), "wb");
+
+	if (!file)
+		{
+		return false;
+		}
+
+	index_header header;
+
+	header.fMagic	= kIndexMagic;
+	header.fVersion = kIndexVersion;
+	header.fCount	= fRecords.size ();
+
+	bool ok = fwrite (&header, sizeof (header), 1, file) == 1;
+
+	for (const record &entryRecord : fRecords)
+		{
+
+		index_record stored;
+
+		memcpy (stored.fKey, entryRecord.fKey.data, dng_fingerprint::kDNGFingerprintSize);
+
+		stored.fBytes	 = entryRecord.fBytes;
+		stored.fLastUsed = entryRecord.fLastUsed;
+
+		ok = ok && fwrite (&stored, sizeof (stored), 1, file) == 1;
+
+		}
+
+	ok = (fclose (file) == 0) && ok;
+
+	if (ok && rename (tempPath.c_str (), path.c_str ()) == 0)
+		{
+		return true;
+		}
+
+	unlink (tempPath.c_str ());
+
+	return false;
+
+	}
+
+/*****************************************************************************/
+
+void frame_cache::RemoveStaleFiles ()
+	{
+
+	DIR *dir = opendir (fDirectory.c_str ());
+
+	if (!dir)
+		{
+		return;
+		}
+
+	const int64 now = (int64) time (NULL);
+
+	while (struct dirent *item = readdir (dir))
+		{
+
+		const std::string name (item->d_name);
+
+		const std::string path = fDirectory + "/" + name;
+
+		const bool isEntry = EndsWith (name, kEntrySuffix) &&
+							 name.size () == 2 * dng_fingerprint::kDNGFingerprintSize + strlen (kEntrySuffix);
+
+		const bool isTemp = EndsWith (name, kTempSuffix);
+
+		if (!isEntry && !isTemp)
+			{
+
+			// Not ours, such as the index and the lock file.
+
+			continue;
+
+			}
+
+		struct stat info;
+
+		if (stat (path.c_str (), &info) != 0)
+			{
+			continue;
+			}
+
+		const int64 age = now - (int64) info.st_mtime;
+
+		bool stale = false;
+
+		if (isEntry)
+			{
+
+			// Entries no index lists, once another process has had time to
+			// index them.
+
+			dng_fingerprint key;
+
+			stale = key.FromUtf8HexString (name.substr (0, 2 * dng_fingerprint::kDNGFingerprintSize).c_str ()) &&
+					fIndex.count (key) == 0 &&
+					age >= kOrphanSeconds;
+
+			}
+
+		else
+			{
+			stale = IsStaleTemp (name, age);
+			}
+
+		if (stale)
+			{
+			unlink (path.c_str ());
+			}
+
+		}
+
+	closedir (dir);
+
+	}
+
+/*****************************************************************************/
+
+void frame_cache::Remove (record_list::iterator it)
+	{
+
+	unlink (EntryPath (it->fKey).c_str ());
+
+	fBytes -= it->fBytes;
+
+	fIndex.erase (it->fKey);
+
+	fRecords.erase (it);
+
+	fIndexDirty = true;
+
+	}
+
+/*****************************************************************************/
+
+void frame_cache::EvictToBudget ()
+	{
+
+	while (fBudget && fBytes > fBudget && !fRecords.empty ())
+		{
+
+		Remove (std::prev (fRecords.end ()));
+
+		fStats.fEvictions++;
+
+		}
+
+	}
+
+/*****************************************************************************/
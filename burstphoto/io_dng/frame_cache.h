@@ -0,0 +1,257 @@
+/**
+ * @file frame_cache.h
+ * @brief Persistent on-disk cache of decoded frames, keyed by a fingerprint of the source file
+ *
+ * Lets read_dng_from_disk in the DNG SDK wrapper skip decoding frames it has decoded before (see
+ * set_dng_frame_cache). Entries are evicted least recently used first under a byte budget. Written in
+ * the style and with the types of the DNG SDK, which it builds on.
+ */
+
+/*****************************************************************************/
+
+#ifndef __frame_cache__
+#define __frame_cache__
+
+/*****************************************************************************/
+
+#include "dng_fingerprint.h"
+#include "dng_mutex.h"
+#include "dng_types.h"
+#include "dng_uncopyable.h"
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*****************************************************************************/
+
+/// \brief Directory of decoded frames that survives between runs.
+///
+/// Each entry is one file holding a small metadata block chosen by the
+/// caller and the frame data, which starts on a page boundary so the file can
+/// be mapped and used in place. An index file lists the entries with the
+/// time of their last use. Lookups, inserts and evictions only touch the
+/// entries involved. The index is written every few inserts, by Flush and
+/// when the cache is closed.
+///
+/// Several processes can share a directory. Index updates are serialized
+/// with flock on a lock file and merged with the index on disk, so each
+/// process keeps the entries the others recorded, and drops the ones whose
+/// file another process removed. A lookup also finds an entry another process
+/// wrote but has not indexed yet. When the cache is opened, temporary files
+/// are removed once their writer has exited or stopped writing, and entry
+/// files no index lists are removed once they are older than a day.
+///
+/// All methods can be called from several threads. The implementation uses
+/// POSIX file, locking and memory mapping calls.
+
+class frame_cache: private dng_uncopyable
+	{
+
+	public:
+
+		/// Counters since the cache was opened, and its current size.
+
+		struct stats
+			{
+
+			uint64 fHits = 0;
+
+			uint64 fMisses = 0;
+
+			uint64 fInserts = 0;
+
+			uint64 fEvictions = 0;
+
+			uint64 fEntries = 0;
+
+			uint64 fBytes = 0;
+
+			uint64 fBudget = 0;
+
+			};
+
+		/// Read-only mapping of one entry. The entry stays readable while this
+		/// object exists, even if it is evicted meanwhile.
+
+		class entry: private dng_uncopyable
+			{
+
+			friend class frame_cache;
+
+			private:
+
+				void *fBase;
+
+				uint64 fLength;
+
+				const uint8 *fMeta;
+
+				uint32 fMetaSize;
+
+				const uint8 *fData;
+
+				uint64 fDataSize;
+
+				entry ();
+
+			public:
+
+				~entry ();
+
+				const void * Meta () const
+					{
+					return fMeta;
+					}
+
+				uint32 MetaSize () const
+					{
+					return fMetaSize;
+					}
+
+				/// Frame data, aligned to the page size.
+
+				const void * Data () const
+					{
+					return fData;
+					}
+
+				uint64 DataSize () const
+					{
+					return fDataSize;
+					}
+
+			};
+
+	private:
+
+		struct record
+			{
+
+			dng_fingerprint fKey;
+
+			uint64 fBytes;
+
+			// Microseconds since the epoch.
+
+			uint64 fLastUsed;
+
+			};
+
+		typedef std::list<record> record_list;
+
+		const std::string fDirectory;
+
+		mutable dng_std_mutex fMutex;
+
+		// Descriptor of the lock file that serializes index updates between
+		// processes, or -1 if it could not be opened.
+
+		int fLockFile;
+
+		uint64 fBudget;
+
+		uint64 fBytes;
+
+		// Most recently used first.
+
+		record_list fRecords;
+
+		std::unordered_map<dng_fingerprint,
+						   record_list::iterator,
+						   dng_fingerprint_hash> fIndex;
+
+		bool fIndexDirty;
+
+		uint32 fUnsavedInserts;
+
+		uint32 fTempCounter;
+
+		stats fStats;
+
+	public:
+
+		/// Open the cache in a directory, creating the directory if needed.
+		/// \param directory Directory of the cache.
+		/// \param budget Largest total size of the entry files in bytes, or 0
+		/// for no limit.
+
+		frame_cache (const char *directory,
+					 uint64 budget);
+
+		/// Writes the index if it changed since it was last written.
+
+		~frame_cache ();
+
+		/// Key of a source file: MD5 of its size, modification time in
+		/// nanoseconds, inode and first bytes, and of a version string
+		/// chosen by the caller, which should change whenever the cached
+		/// data would be decoded differently. Returns an empty fingerprint
+		/// if the file cannot be read.
+
+		static dng_fingerprint SourceKey (const char *path,
+										  const char *version);
+
+		/// Change the budget, evicting entries if the cache is now too large.
+
+		void SetBudget (uint64 budget);
+
+		/// Map the entry for a key. Returns NULL if there is none, or if its
+		/// file is damaged, in which case the entry is removed.
+
+		entry * Lookup (const dng_fingerprint &key);
+
+		/// Store an entry, replacing an existing one with the same key, and
+		/// evict least recently used entries until the cache fits the
+		/// budget. Returns false if the entry is larger than the budget or
+		/// could not be written.
+
+		bool Insert (const dng_fingerprint &key,
+					 const void *meta,
+					 uint32 metaSize,
+					 const void *data,
+					 uint64 dataSize);
+
+		/// Write the index now if it changed since it was last written.
+
+		void Flush ();
+
+		/// Current counters.
+
+		stats Stats () const;
+
+	private:
+
+		std::string EntryPath (const dng_fingerprint &key) const;
+
+		std::string IndexPath () const;
+
+		// The methods below expect fMutex to be held.
+
+		std::string TempPath (const std::string &path);
+
+		// Merge with the index on disk, evict to the budget and write the
+		// result, holding the lock file. Removes stale files if asked to.
+
+		void SyncIndex (bool removeStale);
+
+		void ReadIndex (std::vector<record> &records) const;
+
+		void MergeIndex (const std::vector<record> &records);
+
+		bool WriteIndex ();
+
+		void RemoveStaleFiles ();
+
+		void Remove (record_list::iterator it);
+
+		void EvictToBudget ();
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
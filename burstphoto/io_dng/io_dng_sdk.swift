@@ -164,7 +164,7 @@ func image_url_to_texture(_ url: URL, _ device: MTLDevice) throws -> (MTLTexture
     var white_level: Int32 = -1
     // Hardcoding mosaic width of 6, I don't think anything has a mosaic width above 6 (X-Trans sensor)
     var black_level_from_dng: [Int32]       = [Int32](repeating: -1, count: 6*6)
-    let black_level_from_masked_area: [Int]
+    var black_level_from_masked_area: [Int32] = [Int32](repeating: 0, count: 6*6)
     var black_level: [Int]
     var exposure_bias: Int32 = -1
     var ISO_exposure_time: Float32 = 0.0;
@@ -179,7 +179,7 @@ func image_url_to_texture(_ url: URL, _ device: MTLDevice) throws -> (MTLTexture
         -1, -1, -1, -1,
         -1, -1, -1, -1]
     
-    error_code = read_dng_from_disk(url.path, &pixel_bytes, &width, &height, &_mosaic_pattern_width, &white_level, &black_level_from_dng, &masked_areas, &exposure_bias, &ISO_exposure_time, &color_factor_r, &color_factor_g, &color_factor_b)
+    error_code = read_dng_from_disk(url.path, &pixel_bytes, &width, &height, &_mosaic_pattern_width, &white_level, &black_level_from_dng, &masked_areas, &black_level_from_masked_area, &exposure_bias, &ISO_exposure_time, &color_factor_r, &color_factor_g, &color_factor_b, nil)
     if (error_code != 0) {throw ImageIOError.load_error}
     
     let mosaic_pattern_width = Int(_mosaic_pattern_width)
@@ -196,9 +196,6 @@ func image_url_to_texture(_ url: URL, _ device: MTLDevice) throws -> (MTLTexture
     
     
     free(pixel_bytes!)
-
-    // If any masked areas exist, calculate the black levels from it
-    black_level_from_masked_area = calculate_black_levels(for: texture, from_masked_areas: &masked_areas, mosaic_pattern_width: mosaic_pattern_width)
     
     // Load black levels either from the values the DNG reported or from the masked area
     black_level = [Int](repeating: 0, count: mosaic_pattern_width*mosaic_pattern_width)
@@ -207,7 +204,7 @@ func image_url_to_texture(_ url: URL, _ device: MTLDevice) throws -> (MTLTexture
         if black_level_from_dng[i] > 0 {
             black_level[i] = Int(black_level_from_dng[i])
         } else {
-            black_level[i] = black_level_from_masked_area[i]
+            black_level[i] = Int(black_level_from_masked_area[i])
         }
     }
     
@@ -425,13 +422,49 @@ func texture_to_dng(_ texture: MTLTexture, _ in_url: URL, _ out_url: URL, _ whit
     texture.getBytes(bytes_pointer!, bytesPerRow: bytes_per_row, from: mtl_region, mipmapLevel: 0)
 
     // save image
-    let error_code = write_dng_to_disk(in_url.path, out_url.path, &bytes_pointer, white_level)
+    let error_code = write_dng_to_disk(in_url.path, out_url.path, &bytes_pointer, white_level, nil)
     if (error_code != 0) {throw ImageIOError.save_error}
     
     // free memory
     free(bytes_pointer!)
 }
 
+/**
+ * Reads files into the operating system file cache on a background thread.
+ *
+ * Intended for batch processing: call it with the files of the next burst while the
+ * current burst is merged, so loading the next burst does not wait for the disk.
+ * Files from an earlier call that have not been read yet are dropped.
+ *
+ * @param urls URLs of the files, in the order they will be loaded
+ * @param max_bytes Stop after reading this many bytes (0 means no limit)
+ */
+func prefetch_images(_ urls: [URL], max_bytes: UInt64 = 0) {
+    let paths = urls.map { strdup($0.path) }
+    defer { paths.forEach { free($0) } }
+    var c_paths = paths.map { UnsafePointer<CChar>($0) }
+    prefetch_dng_files(&c_paths, Int32(c_paths.count), max_bytes)
+}
+
+/**
+ * Keeps decoded frames in a directory that is kept between runs, so that bursts that are
+ * processed again (e.g. with other settings) skip decoding.
+ *
+ * Frames are found again by a fingerprint of their file, not its path. The least recently used
+ * frames are removed to stay within the budget. The cache is off unless this is called.
+ *
+ * @param max_size The maximum size, in gigabytes, of the frame cache
+ */
+func set_frame_cache(max_size: Double) {
+    guard let caches_url = FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first else {
+        return
+    }
+    let cache_dir = caches_url.appendingPathComponent("Burst Photo/frames").path
+    if set_dng_frame_cache(cache_dir, UInt64(max_size * 1_000_000_000)) != 0 {
+        print("Could not open the frame cache in \(cache_dir)")
+    }
+}
+
 /// Function to ensure that the specified cache directory does not become bigger than the specified size.
 /// This folder will be deleted when the application starts and stops, but to ensure it does not become 10s of GBs while the application is running we run this function.
 ///
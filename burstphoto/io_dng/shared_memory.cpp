@@ -0,0 +1,459 @@
+/**
+ * @file shared_memory.cpp
+ * @brief Memory blocks in anonymous shared memory, which other processes can map through a file descriptor
+ */
+
+/*****************************************************************************/
+
+#include "shared_memory.h"
+
+#include "dng_exceptions.h"
+#include "dng_flags.h"
+
+#include <string.h>
+
+#if qLinux || qMacOS
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if qMacOS
+#include <atomic>
+#endif
+
+/*****************************************************************************/
+
+shared_memory_block::shared_memory_block (uint32 logicalSize)
+
+	:	dng_memory_block (logicalSize)
+
+	,	fDescriptor			(-1)
+	,	fReadOnlyDescriptor	(-1)
+	,	fMapping			(NULL)
+	,	fMappingSize		(PhysicalSize ())
+
+	{
+
+	#if qLinux
+
+	fDescriptor = memfd_create ("shared_memory",
+								MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+	#elif qMacOS
+
+	// POSIX shared memory objects need a name. The object is opened under a
+	// unique one, once for writing and once for reading, and the name is
+	// removed at once.
+
+	static std::atomic<uint32> sCounter (0);
+
+	char name [32];
+
+	snprintf (name,
+			  sizeof (name),
+			  "/dng_shm.%d.%u",
+			  (int) getpid (),
+			  (unsigned) sCounter++);
+
+	fDescriptor = shm_open (name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+
+	if (fDescriptor >= 0)
+		{
+
+		fReadOnlyDescriptor = shm_open (name, O_RDONLY, 0);
+
+		shm_unlink (name);
+
+		if (fReadOnlyDescriptor < 0)
+			{
+			Release ();
+			}
+
+		}
+
+	#endif
+
+	#if qLinux || qMacOS
+
+	if (fDescriptor >= 0 &&
+		ftruncate (fDescriptor, (off_t) fMappingSize) == 0)
+		{
+
+		void *mapping = mmap (NULL,
+							  (size_t) fMappingSize,
+							  PROT_READ | PROT_WRITE,
+							  MAP_SHARED,
+							  fDescriptor,
+							  0);
+
+		if (mapping != MAP_FAILED)
+			{
+			fMapping = mapping;
+			}
+
+		}
+
+	#endif
+
+	if (!fMapping)
+		{
+
+		Release ();
+
+		ThrowMemoryFull ("Unable to create shared memory");
+
+		}
+
+	// The mapping is page aligned, so the buffer starts at the beginning of
+	// the segment.
+
+	SetBuffer (fMapping);
+
+	}
+
+/*****************************************************************************/
+
+shared_memory_block::~shared_memory_block ()
+	{
+
+	Release ();
+
+	}
+
+/*****************************************************************************/
+
+void shared_memory_block::Release ()
+	{
+
+	#if qLinux || qMacOS
+
+	if (fMapping)
+		{
+		munmap (fMapping, (size_t) fMappingSize);
+		fMapping = NULL;
+		}
+
+	if (fDescriptor >= 0)
+		{
+		close (fDescriptor);
+		fDescriptor = -1;
+		}
+
+	if (fReadOnlyDescriptor >= 0)
+		{
+		close (fReadOnlyDescriptor);
+		fReadOnlyDescriptor = -1;
+		}
+
+	#endif
+
+	}
+
+/*****************************************************************************/
+
+int shared_memory_block::Publish ()
+	{
+
+	int result = -1;
+
+	#if qLinux || qMacOS
+
+	if (fMapping)
+		{
+		munmap (fMapping, (size_t) fMappingSize);
+		fMapping = NULL;
+		}
+
+	#endif
+
+	#if qLinux
+
+	// Seal the segment so that no process can write or resize it. Write
+	// seals need all writable mappings gone, hence the unmap above.
+
+	if (fcntl (fDescriptor,
+			   F_ADD_SEALS,
+			   F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+		{
+		ThrowProgramError ("Unable to seal shared memory");
+		}
+
+	result = fDescriptor;
+
+	fDescriptor = -1;
+
+	#elif qMacOS
+
+	result = fReadOnlyDescriptor;
+
+	fReadOnlyDescriptor = -1;
+
+	#endif
+
+	Release ();
+
+	return result;
+
+	}
+
+/*****************************************************************************/
+
+const void * shared_memory_block::MapReadOnly (int descriptor,
+											   uint64 size)
+	{
+
+	#if qLinux || qMacOS
+
+	if (descriptor < 0 || size == 0)
+		{
+		return NULL;
+		}
+
+	void *mapping = mmap (NULL,
+						  (size_t) size,
+						  PROT_READ,
+						  MAP_SHARED,
+						  descriptor,
+						  0);
+
+	if (mapping != MAP_FAILED)
+		{
+		return mapping;
+		}
+
+	#endif
+
+	return NULL;
+
+	}
+
+/*****************************************************************************/
+
+void shared_memory_block::Unmap (const void *data,
+								 uint64 size)
+	{
+
+	#if qLinux || qMacOS
+
+	if (data)
+		{
+		munmap ((void *) data, (size_t) size);
+		}
+
+	#endif
+
+	}
+
+/*****************************************************************************/
+
+bool shared_memory_block::SendDescriptor (int socket,
+										  int descriptor,
+										  const void *message,
+										  uint32 messageSize)
+	{
+
+	#if qLinux || qMacOS
+
+	if (messageSize == 0)
+		{
+		return false;
+		}
+
+	struct iovec data;
+
+	data.iov_base = (void *) message;
+	data.iov_len  = messageSize;
+
+	union
+		{
+		struct cmsghdr fHeader;
+		char fBuffer [CMSG_SPACE (sizeof (int))];
+		} control;
+
+	memset (&control, 0, sizeof (control));
+
+	struct msghdr header;
+
+	memset (&header, 0, sizeof (header));
+
+	header.msg_iov		  = &data;
+	header.msg_iovlen	  = 1;
+	header.msg_control	  = control.fBuffer;
+	header.msg_controllen = sizeof (control.fBuffer);
+
+	struct cmsghdr *rights = CMSG_FIRSTHDR (&header);
+
+	rights->cmsg_level = SOL_SOCKET;
+	rights->cmsg_type  = SCM_RIGHTS;
+	rights->cmsg_len   = CMSG_LEN (sizeof (int));
+
+	memcpy (CMSG_DATA (rights), &descriptor, sizeof (int));
+
+	ssize_t sent;
+
+	do
+		{
+		sent = sendmsg (socket, &header, 0);
+		}
+	while (sent < 0 && errno == EINTR);
+
+	if (sent <= 0)
+		{
+		return false;
+		}
+
+	// The descriptor travels with the first byte. A stream socket may take
+	// the rest of the message in more calls.
+
+	const char *rest = (const char *) message + sent;
+
+	uint32 remaining = messageSize - (uint32) sent;
+
+	while (remaining)
+		{
+
+		ssize_t count = send (socket, rest, remaining, 0);
+
+		if (count < 0 && errno == EINTR)
+			{
+			continue;
+			}
+
+		if (count <= 0)
+			{
+			return false;
+			}
+
+		rest	  += count;
+		remaining -= (uint32) count;
+
+		}
+
+	return true;
+
+	#else
+
+	return false;
+
+	#endif
+
+	}
+
+/*****************************************************************************/
+
+int shared_memory_block::ReceiveDescriptor (int socket,
+											void *message,
+											uint32 messageSize)
+	{
+
+	#if qLinux || qMacOS
+
+	if (messageSize == 0)
+		{
+		return -1;
+		}
+
+	struct iovec data;
+
+	data.iov_base = message;
+	data.iov_len  = messageSize;
+
+	union
+		{
+		struct cmsghdr fHeader;
+		char fBuffer [CMSG_SPACE (sizeof (int))];
+		} control;
+
+	memset (&control, 0, sizeof (control));
+
+	struct msghdr header;
+
+	memset (&header, 0, sizeof (header));
+
+	header.msg_iov		  = &data;
+	header.msg_iovlen	  = 1;
+	header.msg_control	  = control.fBuffer;
+	header.msg_controllen = sizeof (control.fBuffer);
+
+	#if qLinux
+	const int flags = MSG_CMSG_CLOEXEC;
+	#else
+	const int flags = 0;
+	#endif
+
+	ssize_t received;
+
+	do
+		{
+		received = recvmsg (socket, &header, flags);
+		}
+	while (received < 0 && errno == EINTR);
+
+	int descriptor = -1;
+
+	if (received > 0 && !(header.msg_flags & MSG_CTRUNC))
+		{
+
+		for (struct cmsghdr *item = CMSG_FIRSTHDR (&header);
+			 item != NULL;
+			 item = CMSG_NXTHDR (&header, item))
+			{
+
+			if (item->cmsg_level == SOL_SOCKET &&
+				item->cmsg_type  == SCM_RIGHTS &&
+				item->cmsg_len	 == CMSG_LEN (sizeof (int)))
+				{
+				memcpy (&descriptor, CMSG_DATA (item), sizeof (int));
+				break;
+				}
+
+			}
+
+		}
+
+	if (descriptor < 0)
+		{
+		return -1;
+		}
+
+	char *rest = (char *) message + received;
+
+	uint32 remaining = messageSize - (uint32) received;
+
+	while (remaining)
+		{
+
+		ssize_t count = recv (socket, rest, remaining, 0);
+
+		if (count < 0 && errno == EINTR)
+			{
+			continue;
+			}
+
+		if (count <= 0)
+			{
+			close (descriptor);
+			return -1;
+			}
+
+		rest	  += count;
+		remaining -= (uint32) count;
+
+		}
+
+	return descriptor;
+
+	#else
+
+	return -1;
+
+	#endif
+
+	}
+
+/*****************************************************************************/
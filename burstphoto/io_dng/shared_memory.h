@@ -0,0 +1,111 @@
+/**
+ * @file shared_memory.h
+ * @brief Memory blocks in anonymous shared memory, which other processes can map through a file descriptor
+ *
+ * Lets read_dng_to_shared_memory in the DNG SDK wrapper hand decoded frames from its worker processes to
+ * the app without copying them. Written in the style and with the types of the DNG SDK, which it builds on.
+ */
+
+/*****************************************************************************/
+
+#ifndef __shared_memory__
+#define __shared_memory__
+
+/*****************************************************************************/
+
+#include "dng_memory.h"
+#include "dng_types.h"
+
+/*****************************************************************************/
+
+/// \brief Memory block in a shared memory segment that has no name.
+///
+/// The segment is a memfd on Linux and an unlinked POSIX shared memory
+/// object on macOS. Since it has no name, the kernel frees it once the last
+/// descriptor and mapping of it are gone, which includes processes that
+/// crash. Each process that holds a descriptor or mapping holds a reference.
+///
+/// The block is filled through Buffer like any other block, then Publish
+/// hands out a descriptor through which the segment can only be read. The
+/// descriptor can be sent to another process with SendDescriptor, which
+/// maps the segment with MapReadOnly. No pixel data is copied on the way.
+///
+/// The buffer starts at the beginning of the segment.
+
+class shared_memory_block: public dng_memory_block
+	{
+
+	private:
+
+		int fDescriptor;
+
+		int fReadOnlyDescriptor;
+
+		void *fMapping;
+
+		uint64 fMappingSize;
+
+	public:
+
+		/// Create and map a segment of at least logicalSize bytes.
+		/// \exception dng_exception with fErrorCode equal to dng_error_memory
+		/// if the segment cannot be created.
+
+		shared_memory_block (uint32 logicalSize);
+
+		/// Unmaps the segment and closes the descriptors not handed out.
+
+		virtual ~shared_memory_block ();
+
+		/// Size of the segment in bytes, at least the physical size of the
+		/// block.
+
+		uint64 SegmentSize () const
+			{
+			return fMappingSize;
+			}
+
+		/// Unmap the segment, make it read-only for good, and return a
+		/// descriptor for it, which the caller must close. The block must not
+		/// be used afterwards, other than to destroy it.
+
+		int Publish ();
+
+		/// Map size bytes of a published segment for reading. Returns NULL on
+		/// failure.
+
+		static const void * MapReadOnly (int descriptor,
+										 uint64 size);
+
+		/// Undo MapReadOnly.
+
+		static void Unmap (const void *data,
+						   uint64 size);
+
+		/// Send a descriptor and a small message, of at least one byte, over
+		/// a connected UNIX domain socket. Returns false on failure.
+
+		static bool SendDescriptor (int socket,
+									int descriptor,
+									const void *message,
+									uint32 messageSize);
+
+		/// Receive a descriptor and a message of exactly messageSize bytes
+		/// sent with SendDescriptor. Returns the new descriptor, which the
+		/// caller must close, or -1 on failure.
+
+		static int ReceiveDescriptor (int socket,
+									  void *message,
+									  uint32 messageSize);
+
+	private:
+
+		void Release ();
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
@@ -979,41 +979,6 @@ kernel void sum_rect_columns_float(texture2d<float, access::read> in_texture [[t
     out_texture.write(total, gid);
 }
 
-/**
- * Used for calculating a black level from masked areas of the DNG.
- * DNG data is storred as UInt, thus need a seperate version from the float one above.
- *
- * Similar to sum_rect_columns_float, but works with unsigned integer textures. It sums
- * pixel values in columns within a rectangular region and stores the result as floats.
- * This is used for calculating black levels from the optical black regions in DNG files.
- *
- * Parameters:
- *   - in_texture: Input uint texture to sum from
- *   - out_texture: Output float texture to store column sums
- *   - top: Top coordinate of the rectangular region
- *   - left: Left coordinate of the rectangular region
- *   - bottom: Bottom coordinate of the rectangular region
- *   - mosaic_pattern_width: Width of the sensor's mosaic pattern
- *   - gid: Thread position in grid (each thread handles one column)
- */
-kernel void sum_rect_columns_uint(texture2d<uint, access::read> in_texture [[texture(0)]],
-                                  texture2d<float, access::write> out_texture [[texture(1)]],
-                                  constant int& top [[buffer(0)]],
-                                  constant int& left [[buffer(1)]],
-                                  constant int& bottom [[buffer(2)]],
-                                  constant int& mosaic_pattern_width [[buffer(3)]],
-                                  uint2 gid [[thread_position_in_grid]]) {
-    uint x = left + gid.x;
-    
-    float total = 0;
-    for (int y = top + gid.y; y < bottom; y += mosaic_pattern_width) {
-        total += in_texture.read(uint2(x, y)).r;
-    }
-
-    out_texture.write(total, gid);
-}
-
-
 /**
  * Sums pixel values across rows in a texture, considering the mosaic pattern.
  *
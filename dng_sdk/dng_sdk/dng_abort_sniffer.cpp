@@ -11,6 +11,10 @@
 
 #include "dng_mutex.h"
 
+#if qDNGThreadSafe
+#include <atomic>
+#endif
+
 /*****************************************************************************/
 
 #if qDNGThreadSafe
@@ -21,6 +25,9 @@
 // pools. Putting worker threads to sleep may result in deadlock because
 // higher priority work may not make progress (the pool may not be able to
 // spin up any new threads).
+//
+// Burst Photo addition: dng_threaded_host keeps its pool workers out of this
+// wait. They yield by running higher priority work instead.
 
 class dng_priority_manager
 	{
@@ -35,6 +42,10 @@ class dng_priority_manager
 		dng_condition fCondition;
 		
 		uint32 fCounter [dng_priority_count];
+
+		// Burst Photo addition: copy of MinPriority for lock-free readers.
+
+		std::atomic<uint32> fMinimum;
 		
 	public:
 	
@@ -48,6 +59,11 @@ class dng_priority_manager
 		
 		void Wait (dng_abort_sniffer *sniffer);
 
+		dng_priority Current () const
+			{
+			return (dng_priority) fMinimum.load (std::memory_order_relaxed);
+			}
+
 	private:
 	
 		dng_priority MinPriority ()
@@ -79,6 +95,7 @@ dng_priority_manager::dng_priority_manager ()
 
 	:	fMutex	   ("dng_priority_manager::fMutex")
 	,	fCondition ()
+	,	fMinimum   (dng_priority_minimum)
 	
 	{
 	
@@ -103,6 +120,8 @@ void dng_priority_manager::Increment (dng_priority priority,
 
 	fCounter [priority] += 1;
 
+	fMinimum.store (MinPriority (), std::memory_order_relaxed);
+
 	#if 0
 
 	printf ("increment priority %d (%s) (%d, %d, %d, %d, %d)\n", 
@@ -141,6 +160,8 @@ void dng_priority_manager::Decrement (dng_priority priority,
 
 		newMin = MinPriority ();
 
+		fMinimum.store (newMin, std::memory_order_relaxed);
+
 		#if 0
 
 		printf ("decrement priority %d (%s) (%d, %d, %d)\n", 
@@ -237,6 +258,23 @@ dng_set_minimum_priority::~dng_set_minimum_priority ()
 
 /*****************************************************************************/
 
+dng_priority dng_set_minimum_priority::Current ()
+	{
+
+	#if qDNGThreadSafe
+
+	return gPriorityManager.Current ();
+
+	#else
+
+	return dng_priority_minimum;
+
+	#endif
+
+	}
+
+/*****************************************************************************/
+
 dng_abort_sniffer::dng_abort_sniffer ()	
 
 	:	fPriority (dng_priority_maximum)
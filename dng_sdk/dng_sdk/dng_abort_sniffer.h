@@ -62,6 +62,13 @@ class dng_set_minimum_priority
 								  const char *name);
 		
 		~dng_set_minimum_priority ();
+
+		// Burst Photo addition: the highest priority any live
+		// dng_set_minimum_priority object has set. Work below this priority
+		// should wait. Cheap enough to call once per tile. Always
+		// dng_priority_minimum without qDNGThreadSafe.
+
+		static dng_priority Current ();
 	
 	};
 
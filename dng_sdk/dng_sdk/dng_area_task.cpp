@@ -14,6 +14,8 @@
 #include "dng_globals.h"
 #include "dng_sdk_limits.h"
 #include "dng_tile_iterator.h"
+#include "dng_trace.h"
+#include "dng_tracking_allocator.h"
 #include "dng_utils.h"
 
 /*****************************************************************************/
@@ -201,6 +203,8 @@ void dng_area_task::ProcessOnThread (uint32 threadIndex,
 									 dng_area_task_progress *progress)
 	{
 
+	dng_memory_label label (Name ());
+
 	dng_rect repeatingTile1 = RepeatingTile1 ();
 	dng_rect repeatingTile2 = RepeatingTile2 ();
 	dng_rect repeatingTile3 = RepeatingTile3 ();
@@ -263,7 +267,13 @@ void dng_area_task::ProcessOnThread (uint32 threadIndex,
 					
 					dng_abort_sniffer::SniffForAbort (sniffer);
 					
-					Process (threadIndex, tile4, sniffer);
+						{
+						
+						dng_trace_scope trace ("tile", Name ());
+						
+						Process (threadIndex, tile4, sniffer);
+						
+						}
 
 					if (progress)
 						{
@@ -311,6 +321,10 @@ void dng_area_task::Perform (dng_area_task &task,
 							 dng_area_task_progress *progress)
 	{
 	
+	dng_trace_scope trace ("task", task.Name ());
+	
+	dng_memory_label label (task.Name ());
+	
 	dng_point tileSize (task.FindTileSize (area));
 		
 	task.Start (1, area, tileSize, allocator, sniffer);
@@ -14,6 +14,7 @@
 #include "dng_image.h"
 #include "dng_negative.h"
 #include "dng_safe_arithmetic.h"
+#include "dng_simd_type.h"
 
 #include <algorithm>
 
@@ -143,6 +144,167 @@ void dng_opcode_FixBadPixelsConstant::Prepare (dng_negative & /* negative */,
 
 /*****************************************************************************/
 
+// Burst Photo addition: scan for the bad pixel constant. Bad pixels are rare,
+// so the vector kernels step over runs of good pixels a register at a time.
+// Each returns the offset of the first pixel equal to value, or count if
+// there is none.
+
+typedef uint32 (FindValueKernel16) (const uint16 *sPtr,
+									uint32 count,
+									uint16 value);
+
+/*****************************************************************************/
+
+static uint32 FindValue16 (const uint16 *sPtr,
+						   uint32 count,
+						   uint16 value)
+	{
+	
+	for (uint32 j = 0; j < count; j++)
+		{
+		
+		if (sPtr [j] == value)
+			{
+			return j;
+			}
+		
+		}
+		
+	return count;
+	
+	}
+
+/*****************************************************************************/
+
+#if qDNGIntrinsicsX86
+
+/*****************************************************************************/
+
+DNG_TARGET_SSE2
+static uint32 FindValue16_SSE2 (const uint16 *sPtr,
+								uint32 count,
+								uint16 value)
+	{
+	
+	const __m128i target = _mm_set1_epi16 ((short) value);
+	
+	uint32 j = 0;
+	
+	for (; j + 8 <= count; j += 8)
+		{
+		
+		__m128i x = _mm_loadu_si128 ((const __m128i *) (sPtr + j));
+		
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi16 (x, target)))
+			{
+			break;
+			}
+		
+		}
+		
+	return j + FindValue16 (sPtr + j, count - j, value);
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX2
+static uint32 FindValue16_AVX2 (const uint16 *sPtr,
+								uint32 count,
+								uint16 value)
+	{
+	
+	const __m256i target = _mm256_set1_epi16 ((short) value);
+	
+	uint32 j = 0;
+	
+	for (; j + 16 <= count; j += 16)
+		{
+		
+		__m256i x = _mm256_loadu_si256 ((const __m256i *) (sPtr + j));
+		
+		if (_mm256_movemask_epi8 (_mm256_cmpeq_epi16 (x, target)))
+			{
+			break;
+			}
+		
+		}
+		
+	return j + FindValue16 (sPtr + j, count - j, value);
+	
+	}
+
+/*****************************************************************************/
+
+#endif	// qDNGIntrinsicsX86
+
+/*****************************************************************************/
+
+#if qDNGIntrinsicsNEON
+
+/*****************************************************************************/
+
+static uint32 FindValue16_NEON (const uint16 *sPtr,
+								uint32 count,
+								uint16 value)
+	{
+	
+	const uint16x8_t target = vdupq_n_u16 (value);
+	
+	uint32 j = 0;
+	
+	for (; j + 8 <= count; j += 8)
+		{
+		
+		if (vmaxvq_u16 (vceqq_u16 (vld1q_u16 (sPtr + j), target)))
+			{
+			break;
+			}
+		
+		}
+		
+	return j + FindValue16 (sPtr + j, count - j, value);
+	
+	}
+
+/*****************************************************************************/
+
+#endif	// qDNGIntrinsicsNEON
+
+/*****************************************************************************/
+
+static FindValueKernel16 * SelectFindValue16 ()
+	{
+	
+	#if qDNGIntrinsicsX86
+	
+	if (gDNGMaxSIMD >= AVX2)
+		{
+		return FindValue16_AVX2;
+		}
+	
+	if (gDNGMaxSIMD >= SSE2)
+		{
+		return FindValue16_SSE2;
+		}
+	
+	#endif	// qDNGIntrinsicsX86
+	
+	#if qDNGIntrinsicsNEON
+	
+	if (gDNGMaxSIMD >= arm64_neon)
+		{
+		return FindValue16_NEON;
+		}
+	
+	#endif	// qDNGIntrinsicsNEON
+	
+	return FindValue16;
+	
+	}
+
+/*****************************************************************************/
+
 void dng_opcode_FixBadPixelsConstant::ProcessArea (dng_negative & /* negative */,
 												   uint32 /* threadIndex */,
 												   dng_pixel_buffer &srcBuffer,
@@ -158,115 +320,122 @@ void dng_opcode_FixBadPixelsConstant::ProcessArea (dng_negative & /* negative */
 						
 	uint16 badPixel = (uint16) fConstant;
 	
+	FindValueKernel16 *findValue = SelectFindValue16 ();
+	
+	const uint32 cols = dstArea.W ();
+	
 	for (int32 dstRow = dstArea.t; dstRow < dstArea.b; dstRow++)
 		{
 		
-		const uint16 *sPtr = srcBuffer.ConstPixel_uint16 (dstRow, dstArea.l, 0);
-			  uint16 *dPtr = dstBuffer.DirtyPixel_uint16 (dstRow, dstArea.l, 0);
+		const uint16 *sRow = srcBuffer.ConstPixel_uint16 (dstRow, dstArea.l, 0);
+			  uint16 *dRow = dstBuffer.DirtyPixel_uint16 (dstRow, dstArea.l, 0);
+			  
+		// Skip straight to each bad pixel in the row.
+		
+		uint32 col = 0;
 		
-		for (int32 dstCol = dstArea.l; dstCol < dstArea.r; dstCol++)
+		while ((col += findValue (sRow + col, cols - col, badPixel)) < cols)
 			{
 			
-			if (*sPtr == badPixel)
+			const uint16 *sPtr = sRow + col;
+				  uint16 *dPtr = dRow + col;
+				  
+			int32 dstCol = dstArea.l + (int32) col;
+			
+			uint32 count = 0;
+			uint32 total = 0;
+			
+			uint16 value;
+			
+			if (IsGreen (dstRow, dstCol))	// Green pixel
 				{
+		
+				value = sPtr [-srcBuffer.fRowStep - 1];
 				
-				uint32 count = 0;
-				uint32 total = 0;
+				if (value != badPixel)
+					{
+					count += 1;
+					total += value;
+					}
 				
-				uint16 value;
+				value = sPtr [-srcBuffer.fRowStep + 1];
 				
-				if (IsGreen (dstRow, dstCol))	// Green pixel
+				if (value != badPixel)
 					{
-			
-					value = sPtr [-srcBuffer.fRowStep - 1];
-					
-					if (value != badPixel)
-						{
-						count += 1;
-						total += value;
-						}
-					
-					value = sPtr [-srcBuffer.fRowStep + 1];
-					
-					if (value != badPixel)
-						{
-						count += 1;
-						total += value;
-						}
-							
-					value = sPtr [srcBuffer.fRowStep - 1];
-					
-					if (value != badPixel)
-						{
-						count += 1;
-						total += value;
-						}
-					
-					value = sPtr [srcBuffer.fRowStep + 1];
-					
-					if (value != badPixel)
-						{
-						count += 1;
-						total += value;
-						}
-													
+					count += 1;
+					total += value;
 					}
-					
-				else	// Red/blue pixel.
-					{
-					
-					value = sPtr [-srcBuffer.fRowStep * 2];
-					
-					if (value != badPixel)
-						{
-						count += 1;
-						total += value;
-						}
-							
-					value = sPtr [srcBuffer.fRowStep * 2];
-					
-					if (value != badPixel)
-						{
-						count += 1;
-						total += value;
-						}
-							
-					value = sPtr [-2];
-					
-					if (value != badPixel)
-						{
-						count += 1;
-						total += value;
-						}
 						
-					value = sPtr [2];
-					
-					if (value != badPixel)
-						{
-						count += 1;
-						total += value;
-						}
+				value = sPtr [srcBuffer.fRowStep - 1];
+				
+				if (value != badPixel)
+					{
+					count += 1;
+					total += value;
+					}
+				
+				value = sPtr [srcBuffer.fRowStep + 1];
+				
+				if (value != badPixel)
+					{
+					count += 1;
+					total += value;
+					}
+												
+				}
+				
+			else	// Red/blue pixel.
+				{
+				
+				value = sPtr [-srcBuffer.fRowStep * 2];
+				
+				if (value != badPixel)
+					{
+					count += 1;
+					total += value;
+					}
 						
+				value = sPtr [srcBuffer.fRowStep * 2];
+				
+				if (value != badPixel)
+					{
+					count += 1;
+					total += value;
 					}
-					
-				if (count == 4)		// Most common case.
+						
+				value = sPtr [-2];
+				
+				if (value != badPixel)
 					{
-					
-					*dPtr = (uint16) ((total + 2) >> 2);
-					
+					count += 1;
+					total += value;
 					}
 					
-				else if (count > 0)
+				value = sPtr [2];
+				
+				if (value != badPixel)
 					{
-					
-					*dPtr = (uint16) ((total + (count >> 1)) / count);
-					
+					count += 1;
+					total += value;
 					}
+					
+				}
+				
+			if (count == 4)		// Most common case.
+				{
+				
+				*dPtr = (uint16) ((total + 2) >> 2);
+				
+				}
+				
+			else if (count > 0)
+				{
+				
+				*dPtr = (uint16) ((total + (count >> 1)) / count);
 				
 				}
 			
-			sPtr++;
-			dPtr++;
+			col++;
 			
 			}
 		
@@ -278,8 +447,16 @@ void dng_opcode_FixBadPixelsConstant::ProcessArea (dng_negative & /* negative */
 
 dng_bad_pixel_list::dng_bad_pixel_list ()
 
-	:	fBadPoints ()
-	,	fBadRects  ()
+	:	fBadPoints	  ()
+	,	fBadRects	  ()
+	,	fIndexBounds  ()
+	,	fBucketSize	  ()
+	,	fBucketsV	  (0)
+	,	fBucketsH	  (0)
+	,	fPointStart	  ()
+	,	fBucketPoints ()
+	,	fRectStart	  ()
+	,	fBucketRects  ()
 	
 	{
 	
@@ -290,6 +467,8 @@ dng_bad_pixel_list::dng_bad_pixel_list ()
 void dng_bad_pixel_list::AddPoint (const dng_point &pt)
 	{
 	
+	ClearIndex ();
+	
 	fBadPoints.push_back (pt);
 	
 	}
@@ -299,6 +478,8 @@ void dng_bad_pixel_list::AddPoint (const dng_point &pt)
 void dng_bad_pixel_list::AddRect (const dng_rect &r)
 	{
 	
+	ClearIndex ();
+	
 	fBadRects.push_back (r);
 	
 	}
@@ -352,6 +533,8 @@ static bool SortBadRects (const dng_rect &a,
 void dng_bad_pixel_list::Sort ()
 	{
 	
+	ClearIndex ();
+	
 	if (PointCount () > 1)
 		{
 	
@@ -374,6 +557,387 @@ void dng_bad_pixel_list::Sort ()
 		
 /*****************************************************************************/
 
+void dng_bad_pixel_list::ClearIndex ()
+	{
+	
+	fBucketsV = 0;
+	fBucketsH = 0;
+	
+	fPointStart	 .clear ();
+	fBucketPoints.clear ();
+	
+	fRectStart	.clear ();
+	fBucketRects.clear ();
+	
+	}
+		
+/*****************************************************************************/
+
+void dng_bad_pixel_list::BucketRange (const dng_rect &area,
+									  uint32 &row0,
+									  uint32 &row1,
+									  uint32 &col0,
+									  uint32 &col1) const
+	{
+	
+	const dng_rect &bounds = fIndexBounds;
+	
+	row0 = (uint32) (Pin_int32 (bounds.t, area.t	, bounds.b - 1) - bounds.t) / fBucketSize.v;
+	row1 = (uint32) (Pin_int32 (bounds.t, area.b - 1, bounds.b - 1) - bounds.t) / fBucketSize.v;
+	
+	col0 = (uint32) (Pin_int32 (bounds.l, area.l	, bounds.r - 1) - bounds.l) / fBucketSize.h;
+	col1 = (uint32) (Pin_int32 (bounds.l, area.r - 1, bounds.r - 1) - bounds.l) / fBucketSize.h;
+	
+	}
+		
+/*****************************************************************************/
+
+void dng_bad_pixel_list::BuildIndex (const dng_rect &bounds,
+									 const dng_point &bucketSize)
+	{
+	
+	ClearIndex ();
+	
+	if (bounds.IsEmpty () || bucketSize.v <= 0 || bucketSize.h <= 0)
+		{
+		return;
+		}
+		
+	fIndexBounds = bounds;
+	fBucketSize	 = bucketSize;
+	
+	fBucketsV = (bounds.H () + bucketSize.v - 1) / bucketSize.v;
+	fBucketsH = (bounds.W () + bucketSize.h - 1) / bucketSize.h;
+	
+	const uint32 buckets = SafeUint32Mult (fBucketsV, fBucketsH);
+	
+	uint32 row0;
+	uint32 row1;
+	uint32 col0;
+	uint32 col1;
+	
+	// Bucket the points with a counting sort, which keeps them in list
+	// order within each bucket.
+	
+	fPointStart.assign (SafeUint32Add (buckets, 1), 0);
+	
+	for (uint32 index = 0; index < PointCount (); index++)
+		{
+		
+		const dng_point &pt = Point (index);
+		
+		BucketRange (dng_rect (pt.v, pt.h, pt.v + 1, pt.h + 1),
+					 row0, row1, col0, col1);
+					 
+		fPointStart [row0 * fBucketsH + col0 + 1]++;
+		
+		}
+		
+	for (uint32 bucket = 0; bucket < buckets; bucket++)
+		{
+		fPointStart [bucket + 1] += fPointStart [bucket];
+		}
+		
+	fBucketPoints.resize (PointCount ());
+	
+	dng_std_vector<uint32> next (fPointStart.begin (),
+								 fPointStart.end () - 1);
+	
+	for (uint32 index = 0; index < PointCount (); index++)
+		{
+		
+		const dng_point &pt = Point (index);
+		
+		BucketRange (dng_rect (pt.v, pt.h, pt.v + 1, pt.h + 1),
+					 row0, row1, col0, col1);
+					 
+		fBucketPoints [next [row0 * fBucketsH + col0]++] = index;
+		
+		}
+		
+	// Rectangles go in every bucket they overlap. Empty rectangles never
+	// overlap anything, so they are left out.
+	
+	fRectStart.assign (SafeUint32Add (buckets, 1), 0);
+	
+	for (uint32 pass = 0; pass < 2; pass++)
+		{
+		
+		if (pass == 1)
+			{
+			
+			for (uint32 bucket = 0; bucket < buckets; bucket++)
+				{
+				fRectStart [bucket + 1] += fRectStart [bucket];
+				}
+				
+			fBucketRects.resize (fRectStart [buckets]);
+			
+			next.assign (fRectStart.begin (),
+						 fRectStart.end () - 1);
+			
+			}
+	
+		for (uint32 index = 0; index < RectCount (); index++)
+			{
+			
+			const dng_rect &r = Rect (index);
+			
+			if (r.IsEmpty ())
+				{
+				continue;
+				}
+			
+			BucketRange (r, row0, row1, col0, col1);
+			
+			for (uint32 row = row0; row <= row1; row++)
+				{
+				
+				for (uint32 col = col0; col <= col1; col++)
+					{
+					
+					uint32 bucket = row * fBucketsH + col;
+					
+					if (pass == 0)
+						{
+						fRectStart [bucket + 1]++;
+						}
+					else
+						{
+						fBucketRects [next [bucket]++] = index;
+						}
+					
+					}
+				
+				}
+			
+			}
+			
+		}
+	
+	}
+		
+/*****************************************************************************/
+
+void dng_bad_pixel_list::FindPoints (const dng_rect &area,
+									 dng_std_vector<uint32> &indices) const
+	{
+	
+	indices.clear ();
+	
+	if (area.IsEmpty ())
+		{
+		return;
+		}
+	
+	if (!HasIndex ())
+		{
+		
+		for (uint32 index = 0; index < PointCount (); index++)
+			{
+			
+			const dng_point &pt = Point (index);
+			
+			if (pt.v >= area.t &&
+				pt.h >= area.l &&
+				pt.v <	area.b &&
+				pt.h <	area.r)
+				{
+				indices.push_back (index);
+				}
+			
+			}
+			
+		return;
+		
+		}
+		
+	uint32 row0;
+	uint32 row1;
+	uint32 col0;
+	uint32 col1;
+	
+	BucketRange (area, row0, row1, col0, col1);
+	
+	for (uint32 row = row0; row <= row1; row++)
+		{
+		
+		for (uint32 col = col0; col <= col1; col++)
+			{
+			
+			uint32 bucket = row * fBucketsH + col;
+			
+			for (uint32 j = fPointStart [bucket]; j < fPointStart [bucket + 1]; j++)
+				{
+				
+				uint32 index = fBucketPoints [j];
+				
+				const dng_point &pt = Point (index);
+				
+				if (pt.v >= area.t &&
+					pt.h >= area.l &&
+					pt.v <	area.b &&
+					pt.h <	area.r)
+					{
+					indices.push_back (index);
+					}
+				
+				}
+			
+			}
+		
+		}
+		
+	// Each point is in only one bucket, but buckets are visited in spatial
+	// rather than list order.
+	
+	if (row0 != row1 || col0 != col1)
+		{
+		std::sort (indices.begin (), indices.end ());
+		}
+	
+	}
+		
+/*****************************************************************************/
+
+void dng_bad_pixel_list::FindRects (const dng_rect &area,
+									dng_std_vector<uint32> &indices) const
+	{
+	
+	indices.clear ();
+	
+	if (area.IsEmpty ())
+		{
+		return;
+		}
+	
+	if (!HasIndex ())
+		{
+		
+		for (uint32 index = 0; index < RectCount (); index++)
+			{
+			
+			if ((area & Rect (index)).NotEmpty ())
+				{
+				indices.push_back (index);
+				}
+			
+			}
+			
+		return;
+		
+		}
+		
+	uint32 row0;
+	uint32 row1;
+	uint32 col0;
+	uint32 col1;
+	
+	BucketRange (area, row0, row1, col0, col1);
+	
+	for (uint32 row = row0; row <= row1; row++)
+		{
+		
+		for (uint32 col = col0; col <= col1; col++)
+			{
+			
+			uint32 bucket = row * fBucketsH + col;
+			
+			for (uint32 j = fRectStart [bucket]; j < fRectStart [bucket + 1]; j++)
+				{
+				
+				uint32 index = fBucketRects [j];
+				
+				if ((area & Rect (index)).NotEmpty ())
+					{
+					indices.push_back (index);
+					}
+				
+				}
+			
+			}
+		
+		}
+		
+	// A rectangle spanning several buckets is found once per bucket.
+		
+	if (row0 != row1 || col0 != col1)
+		{
+		
+		std::sort (indices.begin (), indices.end ());
+		
+		indices.erase (std::unique (indices.begin (), indices.end ()),
+					   indices.end ());
+		
+		}
+	
+	}
+		
+/*****************************************************************************/
+
+bool dng_bad_pixel_list::AnyRectOverlaps (const dng_rect &area,
+										  uint32 skipIndex) const
+	{
+	
+	if (area.IsEmpty ())
+		{
+		return false;
+		}
+	
+	if (!HasIndex ())
+		{
+		
+		for (uint32 index = 0; index < RectCount (); index++)
+			{
+			
+			if (index != skipIndex && (area & Rect (index)).NotEmpty ())
+				{
+				return true;
+				}
+			
+			}
+			
+		return false;
+		
+		}
+		
+	uint32 row0;
+	uint32 row1;
+	uint32 col0;
+	uint32 col1;
+	
+	BucketRange (area, row0, row1, col0, col1);
+	
+	for (uint32 row = row0; row <= row1; row++)
+		{
+		
+		for (uint32 col = col0; col <= col1; col++)
+			{
+			
+			uint32 bucket = row * fBucketsH + col;
+			
+			for (uint32 j = fRectStart [bucket]; j < fRectStart [bucket + 1]; j++)
+				{
+				
+				uint32 index = fBucketRects [j];
+				
+				if (index != skipIndex && (area & Rect (index)).NotEmpty ())
+					{
+					return true;
+					}
+				
+				}
+			
+			}
+		
+		}
+		
+	return false;
+	
+	}
+		
+/*****************************************************************************/
+
 bool dng_bad_pixel_list::IsPointIsolated (uint32 index,
 										  uint32 radius) const
 	{
@@ -425,14 +989,9 @@ bool dng_bad_pixel_list::IsPointIsolated (uint32 index,
 					   pt.v + radius + 1,
 					   pt.h + radius + 1);
 	
-	for (uint32 n = 0; n < RectCount (); n++)
+	if (AnyRectOverlaps (testRect))
 		{
-		
-		if ((testRect & Rect (n)).NotEmpty ())
-			{
-			return false;
-			}
-		
+		return false;
 		}
 
 	// Did not find point anywhere, so bad pixel is isolated.
@@ -454,22 +1013,7 @@ bool dng_bad_pixel_list::IsRectIsolated (uint32 index,
 	testRect.b += radius;
 	testRect.r += radius;
 	
-	for (uint32 n = 0; n < RectCount (); n++)
-		{
-		
-		if (n != index)
-			{
-		
-			if ((testRect & Rect (n)).NotEmpty ())
-				{
-				return false;
-				}
-				
-			}
-		
-		}
-	
-	return true;
+	return !AnyRectOverlaps (testRect, index);
 	
 	}
 							  
@@ -537,19 +1081,9 @@ bool dng_bad_pixel_list::IsPointValid (const dng_point &pt,
 	
 	// Search through bad rectangle list.
 	
-	for (uint32 n = 0; n < RectCount (); n++)
+	if (AnyRectOverlaps (dng_rect (pt.v, pt.h, pt.v + 1, pt.h + 1)))
 		{
-		
-		const dng_rect &r = Rect (n);
-		
-		if (pt.v >= r.t &&
-			pt.h >= r.l &&
-			pt.v <	r.b &&
-			pt.h <	r.r)
-			{
-			return false;
-			}
-		
+		return false;
 		}
 
 	// Did not find point anywhere, so pixel is valid.
@@ -573,6 +1107,9 @@ dng_opcode_FixBadPixelsList::dng_opcode_FixBadPixelsList
 	
 	,	fBayerPhase (bayerPhase)
 	
+	,	fPointIsolated ()
+	,	fRectIsolated  ()
+	
 	{
 	
 	fList.Reset (list.Release ());
@@ -593,6 +1130,9 @@ dng_opcode_FixBadPixelsList::dng_opcode_FixBadPixelsList (dng_stream &stream)
 	
 	,	fBayerPhase (0)
 	
+	,	fPointIsolated ()
+	,	fRectIsolated  ()
+	
 	{
 	
 	uint32 size = stream.Get_uint32 ();
@@ -773,8 +1313,8 @@ dng_point dng_opcode_FixBadPixelsList::SrcRepeat ()
 
 void dng_opcode_FixBadPixelsList::Prepare (dng_negative & /* negative */,
 										   uint32 /* threadCount */,
-										   const dng_point & /* tileSize */,
-										   const dng_rect & /* imageBounds */,
+										   const dng_point &tileSize,
+										   const dng_rect &imageBounds,
 										   uint32 imagePlanes,
 										   uint32 bufferPixelType,
 										   dng_memory_allocator & /* allocator */)
@@ -798,6 +1338,34 @@ void dng_opcode_FixBadPixelsList::Prepare (dng_negative & /* negative */,
 		
 		}
 		
+	// Index the list by tile, so each tile only looks at the nearby bad
+	// pixels, and decide once which of them are isolated.
+		
+	fList->BuildIndex (imageBounds, tileSize);
+	
+	uint32 pointCount = fList->PointCount ();
+	uint32 rectCount  = fList->RectCount  ();
+	
+	fPointIsolated.resize (pointCount);
+	
+	for (uint32 pointIndex = 0; pointIndex < pointCount; pointIndex++)
+		{
+		
+		fPointIsolated [pointIndex] = fList->IsPointIsolated (pointIndex,
+															  kBadPointPadding) ? 1 : 0;
+		
+		}
+	
+	fRectIsolated.resize (rectCount);
+	
+	for (uint32 rectIndex = 0; rectIndex < rectCount; rectIndex++)
+		{
+		
+		fRectIsolated [rectIndex] = fList->IsRectIsolated (rectIndex,
+														   kBadRectPadding) ? 1 : 0;
+		
+		}
+		
 	}
 	
 /*****************************************************************************/
@@ -1740,48 +2308,45 @@ void dng_opcode_FixBadPixelsList::ProcessArea (dng_negative & /* negative */,
 		}
 		
 	bool didFixPoint = false;
+	
+	dng_std_vector<uint32> indices;
 		
 	if (pointCount)
 		{
 		
-		for (uint32 pointIndex = 0; pointIndex < pointCount; pointIndex++)
+		fList->FindPoints (fixArea, indices);
+		
+		for (size_t j = 0; j < indices.size (); j++)
 			{
 			
+			uint32 pointIndex = indices [j];
+			
 			dng_point badPoint = fList->Point (pointIndex);
 			
-			if (badPoint.v >= fixArea.t &&
-				badPoint.h >= fixArea.l &&
-				badPoint.v <  fixArea.b &&
-				badPoint.h <  fixArea.r)
+			bool isIsolated = fPointIsolated [pointIndex] != 0;
+			
+			if (isIsolated &&
+				badPoint.v >= imageBounds.t + kBadPointPadding &&
+				badPoint.h >= imageBounds.l + kBadPointPadding &&
+				badPoint.v <  imageBounds.b - kBadPointPadding &&
+				badPoint.h <  imageBounds.r - kBadPointPadding)
 				{
 				
-				bool isIsolated = fList->IsPointIsolated (pointIndex,
-														  kBadPointPadding);
+				FixIsolatedPixel (srcBuffer,
+								  badPoint);
 				
-				if (isIsolated &&
-					badPoint.v >= imageBounds.t + kBadPointPadding &&
-					badPoint.h >= imageBounds.l + kBadPointPadding &&
-					badPoint.v <  imageBounds.b - kBadPointPadding &&
-					badPoint.h <  imageBounds.r - kBadPointPadding)
-					{
-					
-					FixIsolatedPixel (srcBuffer,
-									  badPoint);
-					
-					}
-					
-				else
-					{
-					
-					FixClusteredPixel (srcBuffer,
-									   pointIndex,
-									   imageBounds);
-					
-					}
-					
-				didFixPoint = true;
+				}
+				
+			else
+				{
+				
+				FixClusteredPixel (srcBuffer,
+								   pointIndex,
+								   imageBounds);
 				
 				}
+				
+			didFixPoint = true;
 			
 			}
 
@@ -1798,51 +2363,49 @@ void dng_opcode_FixBadPixelsList::ProcessArea (dng_negative & /* negative */,
 									 SrcRepeat ().h);
 			
 			}
+			
+		fList->FindRects (dstArea, indices);
 	
-		for (uint32 rectIndex = 0; rectIndex < rectCount; rectIndex++)
+		for (size_t j = 0; j < indices.size (); j++)
 			{
 			
+			uint32 rectIndex = indices [j];
+			
 			dng_rect badRect = fList->Rect (rectIndex);
 			
 			dng_rect overlap = dstArea & badRect;
-
-			if (overlap.NotEmpty ())
+				
+			bool isIsolated = fRectIsolated [rectIndex] != 0;
+													 
+			if (isIsolated &&
+				badRect.r == badRect.l + 1 &&
+				badRect.l >= imageBounds.l + SrcRepeat ().h &&
+				badRect.r <= imageBounds.r - SrcRepeat ().v)
 				{
 				
-				bool isIsolated = fList->IsRectIsolated (rectIndex,
-														 kBadRectPadding);
-														 
-				if (isIsolated &&
-					badRect.r == badRect.l + 1 &&
-					badRect.l >= imageBounds.l + SrcRepeat ().h &&
-					badRect.r <= imageBounds.r - SrcRepeat ().v)
-					{
-					
-					FixSingleColumn (srcBuffer,
-									 overlap);
-									 
-					}
-					
-				else if (isIsolated &&
-						 badRect.b == badRect.t + 1 &&
-						 badRect.t >= imageBounds.t + SrcRepeat ().h &&
-						 badRect.b <= imageBounds.b - SrcRepeat ().v)
-					{
-					
-					FixSingleRow (srcBuffer,
-								  overlap);
-									 
-					}
-					
-				else
-					{
-					
-					FixClusteredRect (srcBuffer,
-									  overlap,
-									  imageBounds);
-									 
-					}
+				FixSingleColumn (srcBuffer,
+								 overlap);
+								 
+				}
 				
+			else if (isIsolated &&
+					 badRect.b == badRect.t + 1 &&
+					 badRect.t >= imageBounds.t + SrcRepeat ().h &&
+					 badRect.b <= imageBounds.b - SrcRepeat ().v)
+				{
+				
+				FixSingleRow (srcBuffer,
+							  overlap);
+								 
+				}
+				
+			else
+				{
+				
+				FixClusteredRect (srcBuffer,
+								  overlap,
+								  imageBounds);
+								 
 				}
 			
 			}
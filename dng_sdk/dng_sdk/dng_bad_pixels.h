@@ -109,6 +109,27 @@ class dng_bad_pixel_list
 		
 		dng_std_vector<dng_rect> fBadRects;
 		
+		// Burst Photo addition: optional spatial index, built by BuildIndex.
+		// The image is divided into buckets of fBucketSize pixels. Bucket b
+		// lists the indices of the bad points inside it in
+		// fBucketPoints [fPointStart [b] .. fPointStart [b + 1]), and of the
+		// bad rectangles overlapping it in the same way in fBucketRects.
+		// Points and rectangles outside the indexed bounds go in the nearest
+		// edge bucket.
+		
+		dng_rect fIndexBounds;
+		
+		dng_point fBucketSize;
+		
+		uint32 fBucketsV;
+		uint32 fBucketsH;
+		
+		dng_std_vector<uint32> fPointStart;
+		dng_std_vector<uint32> fBucketPoints;
+		
+		dng_std_vector<uint32> fRectStart;
+		dng_std_vector<uint32> fBucketRects;
+		
 	public:
 
 		/// Create an empty bad pixel list.
@@ -183,6 +204,43 @@ class dng_bad_pixel_list
 
 		void Sort ();
 		
+		/// Burst Photo addition: build a spatial index of the bad single pixels
+		/// and bad rectangles, so that the pixels near an area can be found
+		/// without scanning the whole list. The list must already be sorted.
+		/// Adding pixels or sorting again discards the index.
+		///
+		/// \param bounds The image bounds to index.
+		/// \param bucketSize Size of each index bucket, usually the tile size.
+
+		void BuildIndex (const dng_rect &bounds,
+						 const dng_point &bucketSize);
+						 
+		/// Returns true iff BuildIndex has been called since the list last
+		/// changed.
+		
+		bool HasIndex () const
+			{
+			return !fPointStart.empty ();
+			}
+			
+		/// Finds the bad single pixels that lie in the specified area, in list
+		/// order. Uses the spatial index if there is one.
+		///
+		/// \param area The area to search.
+		/// \param indices Receives the list indices of the pixels.
+		
+		void FindPoints (const dng_rect &area,
+						 dng_std_vector<uint32> &indices) const;
+						 
+		/// Finds the bad rectangles that overlap the specified area, in list
+		/// order. Uses the spatial index if there is one.
+		///
+		/// \param area The area to search.
+		/// \param indices Receives the list indices of the rectangles.
+		
+		void FindRects (const dng_rect &area,
+						dng_std_vector<uint32> &indices) const;
+		
 		/// Returns true iff the specified bad single pixel is isolated, i.e., there
 		/// is no other bad single pixel or bad rectangle that lies within radius
 		/// pixels of this bad single pixel.
@@ -216,6 +274,23 @@ class dng_bad_pixel_list
 		bool IsPointValid (const dng_point &pt,
 						   const dng_rect &imageBounds,
 						   uint32 index = kNoIndex) const;
+						   
+	private:
+	
+		void ClearIndex ();
+		
+		// Range of buckets covering area, clamped to the index.
+		
+		void BucketRange (const dng_rect &area,
+						  uint32 &row0,
+						  uint32 &row1,
+						  uint32 &col0,
+						  uint32 &col1) const;
+						  
+		// True iff any bad rectangle other than skipIndex overlaps area.
+		
+		bool AnyRectOverlaps (const dng_rect &area,
+							  uint32 skipIndex = kNoIndex) const;
 		
 	};
 
@@ -240,6 +315,12 @@ class dng_opcode_FixBadPixelsList: public dng_filter_opcode
 		AutoPtr<dng_bad_pixel_list> fList;
 		
 		uint32 fBayerPhase;
+		
+		// Burst Photo addition: isolation of each bad point and rectangle,
+		// found once in Prepare.
+		
+		dng_std_vector<uint8> fPointIsolated;
+		dng_std_vector<uint8> fRectIsolated;
 	
 	public:
 	
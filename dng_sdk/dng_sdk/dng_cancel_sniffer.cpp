@@ -0,0 +1,71 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+#include "dng_cancel_sniffer.h"
+
+#include "dng_exceptions.h"
+
+#include <chrono>
+
+/*****************************************************************************/
+
+static int64 SteadyNanos ()
+	{
+
+	using namespace std::chrono;
+
+	return (int64) duration_cast<nanoseconds>
+				   (steady_clock::now ().time_since_epoch ()).count ();
+
+	}
+
+/*****************************************************************************/
+
+dng_cancel_token::dng_cancel_token (real64 timeoutSecs)
+
+	:	fState	  (kRunning)
+	,	fDeadline (timeoutSecs > 0.0 ? SteadyNanos () + (int64) (timeoutSecs * 1.0e9)
+									 : 0)
+
+	{
+
+	}
+
+/*****************************************************************************/
+
+dng_cancel_token::State dng_cancel_token::Check ()
+	{
+
+	uint32 state = fState.load (std::memory_order_relaxed);
+
+	if (state == kRunning && fDeadline && SteadyNanos () >= fDeadline)
+		{
+
+		uint32 expected = kRunning;
+
+		fState.compare_exchange_strong (expected, kDeadlineExceeded);
+
+		state = fState.load ();
+
+		}
+
+	return (State) state;
+
+	}
+
+/*****************************************************************************/
+
+void dng_cancel_sniffer::Sniff ()
+	{
+
+	if (fToken.Check () != dng_cancel_token::kRunning)
+		{
+
+		ThrowUserCanceled ();
+
+		}
+
+	}
+
+/*****************************************************************************/
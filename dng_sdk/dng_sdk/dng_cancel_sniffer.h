@@ -0,0 +1,119 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+/** \file
+ * Abort sniffer driven by a cancellation token with an optional deadline.
+ */
+
+/*****************************************************************************/
+
+#ifndef __dng_cancel_sniffer__
+#define __dng_cancel_sniffer__
+
+/*****************************************************************************/
+
+#include "dng_abort_sniffer.h"
+#include "dng_types.h"
+#include "dng_uncopyable.h"
+
+#include <atomic>
+
+/*****************************************************************************/
+
+/// \brief Cancellation state shared by a job and the code running it.
+///
+/// The token may be canceled from any thread. If a deadline is set, the
+/// token counts as expired once the deadline has passed. The first of the
+/// two to happen is kept as the reason.
+
+class dng_cancel_token: private dng_uncopyable
+	{
+
+	public:
+
+		enum State
+			{
+			kRunning = 0,
+			kCanceled,
+			kDeadlineExceeded
+			};
+
+	private:
+
+		std::atomic<uint32> fState;
+
+		// Steady clock time in nanoseconds, or 0 for no deadline.
+
+		const int64 fDeadline;
+
+	public:
+
+		/// Create a token.
+		/// \param timeoutSecs Time from now until the deadline, in seconds.
+		/// 0 or less means no deadline.
+
+		explicit dng_cancel_token (real64 timeoutSecs = 0.0);
+
+		/// Request cancellation. Has no effect once the token has expired.
+
+		void Cancel ()
+			{
+			uint32 expected = kRunning;
+			fState.compare_exchange_strong (expected, kCanceled);
+			}
+
+		/// Current state. Checks the deadline.
+
+		State Check ();
+
+	};
+
+/*****************************************************************************/
+
+/// \brief dng_abort_sniffer that throws dng_error_user_canceled once its
+/// token is canceled or past its deadline.
+///
+/// Sniffing loads a single atomic, plus a clock read if the token has a
+/// deadline, so it is cheap enough to run once per tile on every thread.
+/// Use dng_cancel_token::Check afterwards to tell the two reasons apart.
+
+class dng_cancel_sniffer: public dng_abort_sniffer
+	{
+
+	private:
+
+		dng_cancel_token &fToken;
+
+	public:
+
+		explicit dng_cancel_sniffer (dng_cancel_token &token)
+			:	fToken (token)
+			{
+			}
+
+		virtual bool ThreadSafe () const
+			{
+			return true;
+			}
+
+		// Below the maximum priority, sniffing on a plain dng_host sleeps
+		// while higher priority work runs. dng_threaded_host does its own
+		// waiting, which also notices cancellation.
+
+		virtual bool SupportsPriorityWait () const
+			{
+			return true;
+			}
+
+	protected:
+
+		virtual void Sniff ();
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
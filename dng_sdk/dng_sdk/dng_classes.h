@@ -33,6 +33,8 @@ class dng_camera_profile;
 class dng_camera_profile_id;
 class dng_camera_profile_info;
 class dng_camera_profile_metadata;
+class dng_cancel_sniffer;
+class dng_cancel_token;
 class dng_color_space;
 class dng_color_spec;
 class dng_date_time;
@@ -63,6 +65,7 @@ class dng_md5_printer;
 class dng_memory_allocator;
 class dng_memory_block;
 class dng_memory_data;
+class dng_memory_label;
 class dng_memory_stream;
 class dng_metadata;
 class dng_mosaic_info;
@@ -74,6 +77,7 @@ class dng_opcode_list;
 class dng_orientation;
 class dng_negative;
 class dng_oriented_bounding_box;
+class dng_paged_image;
 class dng_piecewise_linear;
 class dng_pixel_buffer;
 class dng_point;
@@ -98,10 +102,14 @@ class dng_srational;
 class dng_stream;
 class dng_string;
 class dng_string_list;
+class dng_threaded_host;
 class dng_tiff_directory;
 class dng_tile_buffer;
 class dng_time_zone;
 class dng_tone_curve;
+class dng_trace;
+class dng_trace_scope;
+class dng_tracking_allocator;
 class dng_urational;
 class dng_vector;
 class dng_vector_3;
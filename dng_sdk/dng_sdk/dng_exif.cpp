@@ -15,7 +15,7 @@
      4. Lens distortion information (HasLensDistortInfo, SetLensDistortInfo).
      5. Parsing of EXIF tags from data streams (ParseTag, Parse_ifd0_main, Parse_ifd0_exif).
    Note: All original comments and non-English content are preserved.
-   --- End Additional File Documentation ---
+   --- End Additional File Documentation --- */
 
 /**
  * @file dng_exif.cpp
@@ -239,7 +239,7 @@ dng_exif::dng_exif ()
 			fCFAPattern [j] [k] = 255;
 			}
 
-	memset (fLensDistortInfo, 0, sizeof (fLensDistortInfo));
+	// fLensDistortInfo is zeroed by the dng_srational constructor.
 		
 	}
 	
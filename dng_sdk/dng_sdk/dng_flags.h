@@ -318,6 +318,18 @@
 
 /*****************************************************************************/
 
+// Burst Photo addition.
+
+/// \def qDNGMutexProfile
+/// 1 to record acquisition counts, contended waits and hold times for each
+/// dng_mutex name, printed to stderr at exit. 0 otherwise.
+
+#ifndef qDNGMutexProfile
+#define qDNGMutexProfile 0
+#endif
+
+/*****************************************************************************/
+
 /// \def qDNGValidateTarget 
 /// 1 if dng_validate command line tool is being built, 0 otherwise.
 
@@ -51,8 +51,54 @@ bool gBreakOnAsserts = false;
 
 /*****************************************************************************/
 
-// This is declared in dng_simd_type.h
-
-SIMDType gDNGMaxSIMD = Scalar;
+// These are declared in dng_simd_type.h
+
+SIMDType DetectMaxSIMD ()
+	{
+	
+	#if qDNGIntrinsicsX86
+	
+	__builtin_cpu_init ();
+	
+	if (__builtin_cpu_supports ("avx512f" ) &&
+		__builtin_cpu_supports ("avx512cd") &&
+		__builtin_cpu_supports ("avx512bw") &&
+		__builtin_cpu_supports ("avx512dq") &&
+		__builtin_cpu_supports ("avx512vl"))
+		{
+		return AVX512_SKX;
+		}
+		
+	if (__builtin_cpu_supports ("avx2") &&
+		__builtin_cpu_supports ("fma"))
+		{
+		return AVX2;
+		}
+		
+	if (__builtin_cpu_supports ("avx"))
+		{
+		return AVX;
+		}
+		
+	if (__builtin_cpu_supports ("sse2"))
+		{
+		return SSE2;
+		}
+		
+	return Scalar;
+	
+	#elif qDNGIntrinsicsNEON
+	
+	return arm64_neon;
+	
+	#else
+	
+	return Scalar;
+	
+	#endif
+	
+	}
+
+SIMDType gDNGMaxSIMD = DetectMaxSIMD ();
 
 /*****************************************************************************/
@@ -19,6 +19,7 @@
 #include "dng_memory.h"
 #include "dng_misc_opcodes.h"
 #include "dng_negative.h"
+#include "dng_paged_image.h"
 #include "dng_resample.h"
 #include "dng_shared.h"
 #include "dng_simple_image.h"
@@ -49,6 +50,9 @@ dng_host::dng_host (dng_memory_allocator *allocator,
 	,	fForFastSaveToDNG	(false)
 	,	fFastSaveToDNGSize	(0)
 	,	fPreserveStage2		(false)
+	,	fImageMemoryBudget	(0)
+	,	fPassThroughXMP		(false)
+	,	fReferenceSourceBlocks (false)
 	
 	{
 	
@@ -396,10 +400,33 @@ dng_image * dng_host::Make_dng_image (const dng_rect &bounds,
 									  uint32 pixelType)
 	{
 	
-	dng_image *result = new dng_simple_image (bounds,
-											  planes,
-											  pixelType,
-											  Allocator ());
+	dng_image *result = NULL;
+	
+	uint64 bytes = (uint64) bounds.W () *
+				   (uint64) bounds.H () *
+				   (uint64) planes *
+				   (uint64) TagTypeSize (pixelType);
+	
+	if (fImageMemoryBudget != 0 && bytes > fImageMemoryBudget)
+		{
+		
+		result = new dng_paged_image (bounds,
+									  planes,
+									  pixelType,
+									  fImageMemoryBudget,
+									  Allocator ());
+		
+		}
+		
+	else
+		{
+	
+		result = new dng_simple_image (bounds,
+									   planes,
+									   pixelType,
+									   Allocator ());
+									   
+		}
 	
 	if (!result)
 		{
@@ -113,6 +113,21 @@ class dng_host: private dng_uncopyable
 		uint32 fFastSaveToDNGSize;
 
 		bool fPreserveStage2;
+
+		// Images larger than this many bytes are created as paged images
+		// by Make_dng_image. Zero means no limit.
+
+		uint64 fImageMemoryBudget;
+
+		// Burst Photo addition: keep embedded XMP as an opaque packet
+		// instead of parsing it?
+
+		bool fPassThroughXMP;
+
+		// Burst Photo addition: refer to MakerNote and DNGPrivateData in the
+		// source stream instead of reading them?
+
+		bool fReferenceSourceBlocks;
 	
 	public:
 	
@@ -454,6 +469,60 @@ class dng_host: private dng_uncopyable
 			{
 			fPreserveStage2 = flag;
 			}
+
+		/// Setter for the image memory budget. Make_dng_image returns a
+		/// dng_paged_image, keeping about this many bytes of tiles resident,
+		/// for images larger than the budget.
+		/// \param bytes Budget in bytes, or zero for no limit.
+
+		void SetImageMemoryBudget (uint64 bytes)
+			{
+			fImageMemoryBudget = bytes;
+			}
+
+		/// Getter for the image memory budget.
+
+		uint64 ImageMemoryBudget () const
+			{
+			return fImageMemoryBudget;
+			}
+
+		/// Burst Photo addition: setter for flag determining whether
+		/// dng_negative::Parse keeps the embedded XMP packet as opaque bytes
+		/// (see dng_metadata::SetXMPPacket) instead of parsing it. For
+		/// callers that rewrite a DNG without editing its XMP.
+		/// \param passThrough If true, XMP is passed through unparsed.
+
+		void SetPassThroughXMP (bool passThrough)
+			{
+			fPassThroughXMP = passThrough;
+			}
+
+		/// Getter for the XMP pass-through flag.
+
+		bool PassThroughXMP () const
+			{
+			return fPassThroughXMP;
+			}
+
+		/// Burst Photo addition: setter for flag determining whether
+		/// dng_negative::Parse records where the MakerNote and
+		/// DNGPrivateData blocks are in the source stream instead of reading
+		/// them. dng_image_writer then copies them straight from that stream,
+		/// which must stay open until the negative has been written.
+		/// \param reference If true, the blocks are referenced, not read.
+
+		void SetReferenceSourceBlocks (bool reference)
+			{
+			fReferenceSourceBlocks = reference;
+			}
+
+		/// Getter for the source block reference flag.
+
+		bool ReferenceSourceBlocks () const
+			{
+			return fReferenceSourceBlocks;
+			}
 		
 	};
 	
@@ -1056,6 +1056,15 @@ void dng_image::Rotate (const dng_orientation &orientation)
 		
 /*****************************************************************************/
 
+void dng_image::ApplyOrientation (const dng_orientation &orientation)
+	{
+	
+	Rotate (orientation);
+	
+	}
+		
+/*****************************************************************************/
+
 void dng_image::Offset (const dng_point &offset)
 	{
 	
@@ -279,6 +279,13 @@ class dng_image
 
 		virtual void Rotate (const dng_orientation &orientation);
 		
+		/// Rotate image to reflect given orientation change, and store the
+		/// pixels in the new orientation so that rows are read with unit
+		/// column step. The default implementation only calls Rotate.
+		/// \param orientation Directive to rotate image in a certain way.
+
+		virtual void ApplyOrientation (const dng_orientation &orientation);
+
 		/// Offset image.
 		/// \param offset Offset amount.
 		
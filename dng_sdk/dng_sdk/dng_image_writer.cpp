@@ -595,7 +595,8 @@ void tag_iptc::Put (dng_stream &stream) const
 
 /******************************************************************************/
 
-tag_xmp::tag_xmp (const dng_xmp *xmp)
+tag_xmp::tag_xmp (const dng_xmp *xmp,
+				  const dng_memory_block *packet)
 	
 	:	tag_uint8_ptr (tcXMP, NULL, 0)
 	
@@ -603,9 +604,18 @@ tag_xmp::tag_xmp (const dng_xmp *xmp)
 	
 	{
 	
+	if (packet)
+		{
+		
+		SetData (packet->Buffer_uint8 ());
+		
+		SetCount (packet->LogicalSize ());
+		
+		}
+		
 	#if qDNGUseXMP
 	
-	if (xmp)
+	else if (xmp)
 		{
 		
 		fBuffer.Reset (xmp->Serialize (true));
@@ -627,6 +637,37 @@ tag_xmp::tag_xmp (const dng_xmp *xmp)
 
 /******************************************************************************/
 
+// Burst Photo addition to the DNG SDK.
+
+tag_stream_range::tag_stream_range (uint16 code,
+									uint16 type,
+									const dng_stream_range &range)
+	
+	:	tiff_tag (code, type, range.fCount / TagTypeSize (type))
+	
+	,	fRange (range)
+	
+	{
+	
+	}
+
+/******************************************************************************/
+
+void tag_stream_range::Put (dng_stream &stream) const
+	{
+	
+	dng_stream &source = *fRange.fStream;
+	
+	PreserveStreamReadPosition preserve (source);
+	
+	source.SetReadPosition (fRange.fOffset);
+	
+	source.CopyToStream (stream, fRange.fCount);
+	
+	}
+
+/******************************************************************************/
+
 void dng_tiff_directory::Add (tiff_tag *tag)
 	{
 	
@@ -1801,6 +1842,22 @@ exif_tag_set::exif_tag_set (dng_tiff_directory &directory,
 
 /******************************************************************************/
 
+// Burst Photo addition to the DNG SDK.
+
+void exif_tag_set::AddMakerNote (dng_tiff_directory &directory,
+								 tiff_tag &makerNote)
+	{
+	
+	directory.Add (&fMakerNoteSafety);
+	
+	fExifIFD.Add (&makerNote);
+	
+	AddLinks (directory);
+	
+	}
+
+/******************************************************************************/
+
 void exif_tag_set::AddLinks (dng_tiff_directory &directory)
 	{
 	
@@ -4215,6 +4272,407 @@ static void jpeg_set_adobe_quality (struct jpeg_compress_struct *cinfo,
 
 /*****************************************************************************/
 
+// Compresses the rows of area as a complete baseline JPEG stream. If
+// restartEachMCURow is set, a restart marker is emitted between MCU rows,
+// so the entropy coded data of separately compressed row strips can be
+// stitched together (see StitchJPEGStrips).
+
+static void EncodeJPEGRows (dng_host &host,
+							const dng_image &image,
+							const dng_rect &area,
+							int32 quality,
+							bool restartEachMCURow,
+							dng_stream &stream,
+							uint32 *hSampFactor,
+							uint32 *vSampFactor)
+	{
+	
+	struct jpeg_compress_struct cinfo;
+
+	// Setup the error manager.
+	
+	struct jpeg_error_mgr jerr;
+
+	cinfo.err = jpeg_std_error (&jerr);
+	
+	jerr.error_exit		= dng_error_exit;
+	jerr.output_message = dng_output_message;
+
+	try
+		{
+		
+		// Create the compression context.
+
+		jpeg_create_compress (&cinfo);
+		
+		// Setup the destination manager to write to stream.
+		
+		dng_jpeg_stream_dest dest;
+		
+		dest.fStream = &stream;
+		
+		dest.pub.init_destination	 = dng_init_destination;
+		dest.pub.empty_output_buffer = dng_empty_output_buffer;
+		dest.pub.term_destination	 = dng_term_destination;
+		
+		cinfo.dest = &dest.pub;
+		
+		// Setup basic image info.
+		
+		cinfo.image_width	   = area.W ();
+		cinfo.image_height	   = area.H ();
+		cinfo.input_components = image.Planes ();
+		
+		switch (image.Planes ())
+			{
+			
+			case 1:
+				cinfo.in_color_space = JCS_GRAYSCALE;
+				break;
+				
+			case 3:
+				cinfo.in_color_space = JCS_RGB;
+				break;
+				
+			default:
+				ThrowProgramError ();
+				
+			}
+			
+		// Setup the compression parameters.
+
+		jpeg_set_defaults (&cinfo);
+		
+		jpeg_set_adobe_quality (&cinfo, quality);
+		
+		if (restartEachMCURow)
+			{
+			cinfo.restart_in_rows = 1;
+			}
+		
+		*hSampFactor = cinfo.comp_info [0].h_samp_factor;
+		*vSampFactor = cinfo.comp_info [0].v_samp_factor;
+		
+		// Write the JPEG header.
+		
+		jpeg_start_compress (&cinfo, TRUE);
+		
+		// Write the scanlines.
+		
+		dng_pixel_buffer buffer (area, 
+								 0, 
+								 image.Planes (), 
+								 ttByte,
+								 pcInterleaved, 
+								 NULL);
+		
+		AutoPtr<dng_memory_block> bufferData (host.Allocate (buffer.fRowStep));
+		
+		buffer.fData = bufferData->Buffer ();
+		
+		for (int32 row = area.t; row < area.b; row++)
+			{
+			
+			buffer.fArea.t = row;
+			buffer.fArea.b = row + 1;
+			
+			image.Get (buffer);
+			
+			uint8 *sampArray [1];
+
+			sampArray [0] = buffer.DirtyPixel_uint8 (row,
+													 buffer.fArea.l,
+													 0);
+
+			jpeg_write_scanlines (&cinfo, sampArray, 1);
+			
+			}
+
+		// Cleanup.
+			
+		jpeg_finish_compress (&cinfo);
+
+		jpeg_destroy_compress (&cinfo);
+			
+		}
+		
+	catch (...)
+		{
+		
+		jpeg_destroy_compress (&cinfo);
+		
+		throw;
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+// Locates the frame header and the entropy coded data of a JPEG stream
+// written by EncodeJPEGRows.
+
+static void FindJPEGScanData (const uint8 *data,
+							  uint32 size,
+							  uint32 &frameHeader,
+							  uint32 &scanStart,
+							  uint32 &scanEnd)
+	{
+	
+	if (size < 4 || data [0] != 0xFF || data [1] != M_SOI ||
+		data [size - 2] != 0xFF || data [size - 1] != M_EOI)
+		{
+		ThrowBadFormat ("Unexpected JPEG strip layout");
+		}
+		
+	frameHeader = 0;
+	
+	uint32 offset = 2;
+	
+	while (true)
+		{
+		
+		if (offset + 4 > size || data [offset] != 0xFF)
+			{
+			ThrowBadFormat ("Unexpected JPEG strip layout");
+			}
+			
+		uint8 marker = data [offset + 1];
+		
+		uint32 length = (((uint32) data [offset + 2]) << 8) |
+						  (uint32) data [offset + 3];
+						  
+		if (marker == M_SOF0 || marker == M_SOF1)
+			{
+			frameHeader = offset;
+			}
+			
+		offset += 2 + length;
+		
+		if (marker == M_SOS)
+			{
+			break;
+			}
+		
+		}
+		
+	if (frameHeader == 0 || offset > size - 2)
+		{
+		ThrowBadFormat ("Unexpected JPEG strip layout");
+		}
+		
+	scanStart = offset;
+	scanEnd	  = size - 2;
+	
+	}
+
+/*****************************************************************************/
+
+// Joins JPEG streams that each cover a horizontal strip of the image, are
+// a multiple of the MCU height tall, and were compressed with a restart
+// marker after each MCU row. The result is one baseline JPEG of the given
+// height: the header of the first strip with its frame height patched,
+// followed by each strip's entropy coded data with a restart marker
+// between strips and all restart markers renumbered in sequence.
+
+static dng_memory_block * StitchJPEGStrips (dng_host &host,
+											dng_memory_block * const *strips,
+											uint32 stripCount,
+											uint32 imageHeight)
+	{
+	
+	dng_memory_stream stream (host.Allocator ());
+	
+	stream.SetBigEndian ();
+	
+	uint32 restartIndex = 0;
+	
+	for (uint32 index = 0; index < stripCount; index++)
+		{
+		
+		const uint8 *data = strips [index]->Buffer_uint8 ();
+		
+		uint32 frameHeader;
+		uint32 scanStart;
+		uint32 scanEnd;
+		
+		FindJPEGScanData (data,
+						  strips [index]->LogicalSize (),
+						  frameHeader,
+						  scanStart,
+						  scanEnd);
+						  
+		if (index == 0)
+			{
+			
+			// Copy the header, replacing the frame height. The frame header
+			// is FF Cn, length (2), precision (1), height (2), width (2)...
+			
+			stream.Put (data, frameHeader + 5);
+			
+			stream.Put_uint16 ((uint16) imageHeight);
+			
+			stream.Put (data	  + frameHeader + 7,
+						scanStart - frameHeader - 7);
+			
+			}
+			
+		else
+			{
+			
+			stream.Put_uint8 (0xFF);
+			stream.Put_uint8 ((uint8) (M_RST0 + (restartIndex++ & 7)));
+			
+			}
+			
+		// Copy the entropy coded data. 0xFF data bytes are always stuffed
+		// with a following 0x00, so any 0xFF followed by RST0..RST7 is a
+		// restart marker.
+		
+		uint32 runStart = scanStart;
+		
+		for (uint32 offset = scanStart; offset + 1 < scanEnd; offset++)
+			{
+			
+			if (data [offset] == 0xFF &&
+				data [offset + 1] >= M_RST0 &&
+				data [offset + 1] <= M_RST7)
+				{
+				
+				stream.Put (data + runStart, offset - runStart);
+				
+				stream.Put_uint8 (0xFF);
+				stream.Put_uint8 ((uint8) (M_RST0 + (restartIndex++ & 7)));
+				
+				offset++;
+				
+				runStart = offset + 1;
+				
+				}
+			
+			}
+			
+		stream.Put (data + runStart, scanEnd - runStart);
+		
+		}
+		
+	stream.Put_uint8 (0xFF);
+	stream.Put_uint8 (M_EOI);
+	
+	return stream.AsMemoryBlock (host.Allocator ());
+	
+	}
+
+/*****************************************************************************/
+
+class dng_jpeg_preview_encode_task : public dng_area_task,
+									 private dng_uncopyable
+	{
+	
+	private:
+	
+		dng_host &fHost;
+		
+		const dng_image &fImage;
+		
+		int32 fQuality;
+		
+		uint32 fStripHeight;
+		
+		uint32 fStripCount;
+		
+		AutoArray<AutoPtr<dng_memory_block> > &fStrips;
+		
+		std::atomic_uint fNextStripIndex;
+		
+	public:
+	
+		uint32 fHSampFactor;
+		uint32 fVSampFactor;
+	
+		dng_jpeg_preview_encode_task (dng_host &host,
+									  const dng_image &image,
+									  int32 quality,
+									  uint32 stripHeight,
+									  uint32 stripCount,
+									  AutoArray<AutoPtr<dng_memory_block> > &strips)
+									  
+			:	dng_area_task ("dng_jpeg_preview_encode_task")
+			
+			,	fHost			(host)
+			,	fImage			(image)
+			,	fQuality		(quality)
+			,	fStripHeight	(stripHeight)
+			,	fStripCount		(stripCount)
+			,	fStrips			(strips)
+			,	fNextStripIndex (0)
+			,	fHSampFactor	(1)
+			,	fVSampFactor	(1)
+			
+			{
+			
+			fMinTaskArea = 16 * 16;
+			fUnitCell	 = dng_point (16, 16);
+			fMaxTileSize = dng_point (16, 16);
+			
+			}
+			
+		void Process (uint32 /* threadIndex */,
+					  const dng_rect & /* tile */,
+					  dng_abort_sniffer *sniffer)
+			{
+			
+			const dng_rect &bounds = fImage.Bounds ();
+			
+			while (true)
+				{
+				
+				// Note: fNextStripIndex is atomic
+				
+				uint32 stripIndex = fNextStripIndex++;
+				
+				if (stripIndex >= fStripCount)
+					{
+					return;
+					}
+					
+				dng_abort_sniffer::SniffForAbort (sniffer);
+				
+				dng_rect area = bounds;
+				
+				area.t = bounds.t + stripIndex * fStripHeight;
+				area.b = Min_int32 (area.t + fStripHeight, bounds.b);
+				
+				dng_memory_stream stream (fHost.Allocator ());
+				
+				uint32 hSampFactor;
+				uint32 vSampFactor;
+				
+				EncodeJPEGRows (fHost,
+								fImage,
+								area,
+								fQuality,
+								true,
+								stream,
+								&hSampFactor,
+								&vSampFactor);
+								
+				fStrips [stripIndex].Reset (stream.AsMemoryBlock (fHost.Allocator ()));
+				
+				if (stripIndex == 0)
+					{
+					fHSampFactor = hSampFactor;
+					fVSampFactor = vSampFactor;
+					}
+				
+				}
+			
+			}
+		
+	};
+
+/*****************************************************************************/
+
 #endif
 
 /*****************************************************************************/
@@ -4527,132 +4985,102 @@ void dng_image_writer::EncodeJPEGPreview (dng_host &host,
 	{
 	
 	#if qDNGUseLibJPEG
-		
-	dng_memory_stream stream (host.Allocator ());
 	
-	struct jpeg_compress_struct cinfo;
-
-	// Setup the error manager.
+	const dng_rect &bounds = image.Bounds ();
 	
-	struct jpeg_error_mgr jerr;
-
-	cinfo.err = jpeg_std_error (&jerr);
+	// Large previews are compressed as horizontal strips in parallel. Strip
+	// heights are a multiple of 16 rows, the largest MCU height we use, so
+	// chroma downsampling never straddles a strip boundary and the stitched
+	// image decodes identically to one compressed in a single pass.
 	
-	jerr.error_exit		= dng_error_exit;
-	jerr.output_message = dng_output_message;
-
-	try
+	const uint32 kMinParallelPreviewPixels = 1024 * 1024;
+	const uint32 kMinPreviewStripHeight	   = 128;
+	
+	uint32 threadCount = host.PerformAreaTaskThreads ();
+	
+	uint32 stripHeight = bounds.H ();
+	uint32 stripCount  = 1;
+	
+	if (threadCount > 1 &&
+		(uint64) bounds.W () * (uint64) bounds.H () >= kMinParallelPreviewPixels)
 		{
 		
-		// Create the compression context.
-
-		jpeg_create_compress (&cinfo);
-		
-		// Setup the destination manager to write to stream.
+		// Two strips per thread for load balancing.
 		
-		dng_jpeg_stream_dest dest;
+		stripHeight = (bounds.H () + threadCount * 2 - 1) / (threadCount * 2);
 		
-		dest.fStream = &stream;
+		stripHeight = Max_uint32 (RoundUp16 (stripHeight),
+								  kMinPreviewStripHeight);
 		
-		dest.pub.init_destination	 = dng_init_destination;
-		dest.pub.empty_output_buffer = dng_empty_output_buffer;
-		dest.pub.term_destination	 = dng_term_destination;
+		stripCount = (bounds.H () + stripHeight - 1) / stripHeight;
 		
-		cinfo.dest = &dest.pub;
+		}
 		
-		// Setup basic image info.
+	uint32 hSampFactor = 1;
+	uint32 vSampFactor = 1;
 		
-		cinfo.image_width	   = image.Bounds ().W ();
-		cinfo.image_height	   = image.Bounds ().H ();
-		cinfo.input_components = image.Planes ();
+	if (stripCount <= 1)
+		{
 		
-		switch (image.Planes ())
-			{
-			
-			case 1:
-				cinfo.in_color_space = JCS_GRAYSCALE;
-				break;
-				
-			case 3:
-				cinfo.in_color_space = JCS_RGB;
-				break;
-				
-			default:
-				ThrowProgramError ();
-				
-			}
-			
-		// Setup the compression parameters.
-
-		jpeg_set_defaults (&cinfo);
+		dng_memory_stream stream (host.Allocator ());
 		
-		jpeg_set_adobe_quality (&cinfo, quality);
+		EncodeJPEGRows (host,
+						image,
+						bounds,
+						quality,
+						false,
+						stream,
+						&hSampFactor,
+						&vSampFactor);
 		
-		// Find some preview information based on the compression settings.
+		preview.fCompressedData.Reset (stream.AsMemoryBlock (host.Allocator ()));
 		
-		preview.SetIFDInfo (image);
-	
-		if (image.Planes () == 3)
-			{
-			
-			preview.SetYCbCr (cinfo.comp_info [0].h_samp_factor,
-							  cinfo.comp_info [0].v_samp_factor);
-			
-			}
+		}
 		
-		// Write the JPEG header.
+	else
+		{
 		
-		jpeg_start_compress (&cinfo, TRUE);
+		AutoArray<AutoPtr<dng_memory_block> > strips (stripCount);
 		
-		// Write the scanlines.
+		dng_jpeg_preview_encode_task task (host,
+										   image,
+										   quality,
+										   stripHeight,
+										   stripCount,
+										   strips);
+										   
+		host.PerformAreaTask (task,
+							  dng_rect (0, 0, 16, 16 * Min_uint32 (threadCount,
+																  stripCount)));
 		
-		dng_pixel_buffer buffer (image.Bounds (), 
-								 0, 
-								 image.Planes (), 
-								 ttByte,
-								 pcInterleaved, 
-								 NULL);
+		hSampFactor = task.fHSampFactor;
+		vSampFactor = task.fVSampFactor;
 		
-		AutoPtr<dng_memory_block> bufferData (host.Allocate (buffer.fRowStep));
+		AutoArray<dng_memory_block *> stripBlocks (stripCount);
 		
-		buffer.fData = bufferData->Buffer ();
-		
-		for (uint32 row = 0; row < cinfo.image_height; row++)
+		for (uint32 index = 0; index < stripCount; index++)
 			{
-			
-			buffer.fArea.t = row;
-			buffer.fArea.b = row + 1;
-			
-			image.Get (buffer);
-			
-			uint8 *sampArray [1];
-
-			sampArray [0] = buffer.DirtyPixel_uint8 (row,
-													 buffer.fArea.l,
-													 0);
-
-			jpeg_write_scanlines (&cinfo, sampArray, 1);
-			
+			stripBlocks [index] = strips [index].Get ();
 			}
-
-		// Cleanup.
-			
-		jpeg_finish_compress (&cinfo);
-
-		jpeg_destroy_compress (&cinfo);
 			
+		preview.fCompressedData.Reset (StitchJPEGStrips (host,
+														 stripBlocks.Get (),
+														 stripCount,
+														 bounds.H ()));
+		
 		}
 		
-	catch (...)
+	// Find some preview information based on the compression settings.
+	
+	preview.SetIFDInfo (image);
+
+	if (image.Planes () == 3)
 		{
 		
-		jpeg_destroy_compress (&cinfo);
-		
-		throw;
+		preview.SetYCbCr (hSampFactor,
+						  vSampFactor);
 		
 		}
-				   
-	preview.fCompressedData.Reset (stream.AsMemoryBlock (host.Allocator ()));
 
 	#else
 	
@@ -5454,7 +5882,10 @@ void dng_image_writer::CleanUpMetadata (dng_host &host,
 	
 	#if qDNGUseXMP
 	
-	if (metadata.GetXMP () && metadata.GetExif ())
+	// Burst Photo addition: a passed-through XMP packet and the metadata
+	// blocks that go with it are written as they are.
+	
+	if (metadata.GetXMP () && metadata.GetExif () && !metadata.XMPPacket ())
 		{
 		
 		dng_xmp	 &newXMP  (*metadata.GetXMP	 ());
@@ -6349,7 +6780,8 @@ void dng_image_writer::WriteTIFFWithProfile (dng_host &host,
 	
 	#if qDNGUseXMP
 	
-	tag_xmp tagXMP (metadata.Get () ? metadata->GetXMP () : NULL);
+	tag_xmp tagXMP (metadata.Get () ? metadata->GetXMP () : NULL,
+					metadata.Get () ? metadata->XMPPacket () : NULL);
 	
 	if (tagXMP.Count ())
 		{
@@ -6399,6 +6831,21 @@ void dng_image_writer::WriteTIFFWithProfile (dng_host &host,
 						  metadata.Get () ? metadata->MakerNoteLength () : 0,
 						  false);
 						  
+	// Burst Photo addition: MakerNote left in the source stream.
+	
+	const dng_stream_range makerNoteRange = metadata.Get () && metadata->IsMakerNoteSafe ()
+										  ? metadata->MakerNoteRange ()
+										  : dng_stream_range ();
+	
+	tag_stream_range tagMakerNoteRange (tcMakerNote,
+										ttUndefined,
+										makerNoteRange);
+	
+	if (makerNoteRange.IsValid ())
+		{
+		exifSet.AddMakerNote (mainIFD, tagMakerNoteRange);
+		}
+						  
 	// Find header size as 32-bit TIFF
 	
 	uint64 headerSize32 = 8 +
@@ -7659,7 +8106,8 @@ void dng_image_writer::WriteDNGWithMetadata (dng_host &host,
 
 	#if qDNGUseXMP
 		
-	tag_xmp tagXMP (metadata->GetXMP ());
+	tag_xmp tagXMP (metadata->GetXMP (),
+					metadata->XMPPacket ());
 	
 	if (tagXMP.Count ())
 		{
@@ -7678,12 +8126,33 @@ void dng_image_writer::WriteDNGWithMetadata (dng_host &host,
 						  metadata->MakerNoteData	(),
 						  metadata->MakerNoteLength (),
 						  true);
+						  
+	// Burst Photo addition: MakerNote left in the source stream.
+	
+	const dng_stream_range makerNoteRange = metadata->IsMakerNoteSafe ()
+										  ? metadata->MakerNoteRange ()
+										  : dng_stream_range ();
+	
+	tag_stream_range tagMakerNoteRange (tcMakerNote,
+										ttUndefined,
+										makerNoteRange);
+	
+	if (makerNoteRange.IsValid ())
+		{
+		exifSet.AddMakerNote (mainIFD, tagMakerNoteRange);
+		}
 						
 	// Private data.
 	
 	tag_uint8_ptr tagPrivateData (tcDNGPrivateData,
 								  negative.PrivateData (),
 								  negative.PrivateLength ());
+								  
+	// Burst Photo addition: private data left in the source stream.
+	
+	tag_stream_range tagPrivateDataRange (tcDNGPrivateData,
+										  ttByte,
+										  negative.PrivateDataRange ());
 						   
 	if (negative.PrivateLength ())
 		{
@@ -7692,6 +8161,13 @@ void dng_image_writer::WriteDNGWithMetadata (dng_host &host,
 		
 		}
 		
+	else if (negative.PrivateDataRange ().IsValid ())
+		{
+		
+		mainIFD.Add (&tagPrivateDataRange);
+		
+		}
+		
 	// Proxy size tags.
 	
 	uint32 originalDefaultFinalSizeData [2];
@@ -27,6 +27,7 @@
 #include "dng_rational.h"
 #include "dng_safe_arithmetic.h"
 #include "dng_sdk_limits.h"
+#include "dng_stream.h"
 #include "dng_string.h"
 #include "dng_tag_types.h"
 #include "dng_tag_values.h"
@@ -645,12 +646,39 @@ class tag_xmp: public tag_uint8_ptr
 		
 	public:
 		
-		tag_xmp (const dng_xmp *xmp);
+		// Burst Photo addition: write packet, if not NULL, instead of
+		// serializing xmp. The packet must outlive the tag.
+		
+		tag_xmp (const dng_xmp *xmp,
+				 const dng_memory_block *packet = NULL);
 				 
 	};
 
 /******************************************************************************/
 
+// Burst Photo addition to the DNG SDK: a tag whose data is copied from a
+// range of a source stream when it is written, without being read into
+// memory first. The source stream must outlive the tag.
+
+class tag_stream_range: public tiff_tag
+	{
+	
+	private:
+	
+		dng_stream_range fRange;
+		
+	public:
+	
+		tag_stream_range (uint16 code,
+						  uint16 type,
+						  const dng_stream_range &range);
+			
+		virtual void Put (dng_stream &stream) const;
+
+	};
+
+/******************************************************************************/
+
 class dng_tiff_directory: private dng_uncopyable
 	{
 	
@@ -993,6 +1021,13 @@ class exif_tag_set: private dng_uncopyable
 					  const void *makerNoteData = NULL,
 					  uint32 makerNoteLength = 0,
 					  bool insideDNG = false);
+					  
+		// Burst Photo addition: add a MakerNote tag that was not passed to
+		// the constructor, together with its safety tag. The tag must
+		// outlive this object.
+		
+		void AddMakerNote (dng_tiff_directory &directory,
+						   tiff_tag &makerNote);
 					
 		void SetBigTIFF (bool isBigTIFF)
 			{
@@ -17,12 +17,403 @@
 #include "dng_pixel_buffer.h"
 #include "dng_safe_arithmetic.h"
 #include "dng_sdk_limits.h"
+#include "dng_simd_type.h"
 #include "dng_tag_types.h"
 #include "dng_tile_iterator.h"
 #include "dng_utils.h"
 
 /*****************************************************************************/
 
+// Per-phase linearization tables are only built for small black patterns.
+
+const uint32 kMaxLinearizePhaseTables = 16;
+
+// Entries per phase table. The padding lets the vector path use 32-bit
+// gathers, which read one entry past the one requested.
+
+const uint32 kLinearizePhaseTableStep = 0x10000 + 16;
+
+/*****************************************************************************/
+
+// Row kernels for unit-stride linearization.
+
+static void LinearizeRowPhase16 (const uint16 *sPtr,
+								 uint16 *dPtr,
+								 uint32 count,
+								 const uint16 *rowTables,
+								 uint32 firstPhase,
+								 uint32 phases)
+	{
+	
+	const uint16 *tables [kMaxBlackPattern];
+	
+	for (uint32 k = 0; k < phases; k++)
+		{
+		tables [k] = rowTables + ((firstPhase + k) % phases) * kLinearizePhaseTableStep;
+		}
+		
+	uint32 phase = 0;
+	
+	for (uint32 j = 0; j < count; j++)
+		{
+		
+		dPtr [j] = tables [phase] [sPtr [j]];
+		
+		if (++phase == phases)
+			{
+			phase = 0;
+			}
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+static void LinearizeRowReal32_Scalar (const real32 *sPtr,
+									   real32 *dPtr,
+									   uint32 count,
+									   real32 scale,
+									   real32 b1,
+									   const real32 *b2,
+									   bool pin)
+	{
+	
+	for (uint32 j = 0; j < count; j++)
+		{
+		
+		real32 x = sPtr [j] * scale - b1;
+		
+		if (b2)
+			{
+			x -= b2 [j];
+			}
+			
+		if (pin)
+			{
+			x = Pin_real32 (0.0f, x, 1.0f);
+			}
+			
+		dPtr [j] = x;
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+#if qDNGIntrinsicsX86
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX2
+static void LinearizeRowPhase16_AVX2 (const uint16 *sPtr,
+									  uint16 *dPtr,
+									  uint32 count,
+									  const uint16 *rowTables,
+									  uint32 firstPhase,
+									  uint32 phases)
+	{
+	
+	// Requires 8 % phases == 0, so every group of 8 pixels starts at the
+	// same phase.
+	
+	int32 offsets [8];
+	
+	for (uint32 k = 0; k < 8; k++)
+		{
+		offsets [k] = (int32) (((firstPhase + k) % phases) * kLinearizePhaseTableStep);
+		}
+		
+	const __m256i offset = _mm256_loadu_si256 ((const __m256i *) offsets);
+	
+	const __m256i mask = _mm256_set1_epi32 (0xFFFF);
+	
+	const int *base = (const int *) rowTables;
+	
+	uint32 j = 0;
+	
+	for (; j + 16 <= count; j += 16)
+		{
+		
+		__m256i src = _mm256_loadu_si256 ((const __m256i *) (sPtr + j));
+		
+		__m256i idx0 = _mm256_add_epi32 (offset, _mm256_cvtepu16_epi32 (_mm256_castsi256_si128	  (src	 )));
+		__m256i idx1 = _mm256_add_epi32 (offset, _mm256_cvtepu16_epi32 (_mm256_extracti128_si256 (src, 1)));
+		
+		__m256i val0 = _mm256_and_si256 (_mm256_i32gather_epi32 (base, idx0, 2), mask);
+		__m256i val1 = _mm256_and_si256 (_mm256_i32gather_epi32 (base, idx1, 2), mask);
+		
+		__m256i packed = _mm256_permute4x64_epi64 (_mm256_packus_epi32 (val0, val1), 0xD8);
+		
+		_mm256_storeu_si256 ((__m256i *) (dPtr + j), packed);
+		
+		}
+		
+	if (j < count)
+		{
+		
+		LinearizeRowPhase16 (sPtr + j,
+							 dPtr + j,
+							 count - j,
+							 rowTables,
+							 (firstPhase + j) % phases,
+							 phases);
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX2
+static void LinearizeRowReal32_AVX2 (const real32 *sPtr,
+									 real32 *dPtr,
+									 uint32 count,
+									 real32 scale,
+									 real32 b1,
+									 const real32 *b2,
+									 bool pin)
+	{
+	
+	// Separate multiply and subtract (no FMA) to match the scalar results.
+	
+	const __m256 vScale = _mm256_set1_ps (scale);
+	const __m256 vB1	= _mm256_set1_ps (b1);
+	const __m256 vZero	= _mm256_setzero_ps ();
+	const __m256 vOne	= _mm256_set1_ps (1.0f);
+	
+	uint32 j = 0;
+	
+	for (; j + 8 <= count; j += 8)
+		{
+		
+		__m256 x = _mm256_sub_ps (_mm256_mul_ps (_mm256_loadu_ps (sPtr + j), vScale), vB1);
+		
+		if (b2)
+			{
+			x = _mm256_sub_ps (x, _mm256_loadu_ps (b2 + j));
+			}
+			
+		if (pin)
+			{
+			x = _mm256_min_ps (_mm256_max_ps (x, vZero), vOne);
+			}
+			
+		_mm256_storeu_ps (dPtr + j, x);
+		
+		}
+		
+	LinearizeRowReal32_Scalar (sPtr + j,
+							   dPtr + j,
+							   count - j,
+							   scale,
+							   b1,
+							   b2 ? b2 + j : NULL,
+							   pin);
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX2
+static void LinearizeRowLUT32_AVX2 (const uint16 *sPtr,
+									real32 *dPtr,
+									uint32 count,
+									const real32 *lut,
+									real32 b1,
+									const real32 *b2)
+	{
+	
+	const __m256 vB1   = _mm256_set1_ps (b1);
+	const __m256 vZero = _mm256_setzero_ps ();
+	const __m256 vOne  = _mm256_set1_ps (1.0f);
+	
+	uint32 j = 0;
+	
+	for (; j + 8 <= count; j += 8)
+		{
+		
+		__m256i idx = _mm256_cvtepu16_epi32 (_mm_loadu_si128 ((const __m128i *) (sPtr + j)));
+		
+		__m256 x = _mm256_sub_ps (_mm256_i32gather_ps (lut, idx, 4), vB1);
+		
+		if (b2)
+			{
+			x = _mm256_sub_ps (x, _mm256_loadu_ps (b2 + j));
+			}
+			
+		_mm256_storeu_ps (dPtr + j, _mm256_min_ps (_mm256_max_ps (x, vZero), vOne));
+		
+		}
+		
+	for (; j < count; j++)
+		{
+		
+		real32 x = lut [sPtr [j]] - b1;
+		
+		if (b2)
+			{
+			x -= b2 [j];
+			}
+			
+		dPtr [j] = Pin_real32 (0.0f, x, 1.0f);
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+#endif	// qDNGIntrinsicsX86
+
+/*****************************************************************************/
+
+#if qDNGIntrinsicsNEON
+
+/*****************************************************************************/
+
+static void LinearizeRowReal32_NEON (const real32 *sPtr,
+									 real32 *dPtr,
+									 uint32 count,
+									 real32 scale,
+									 real32 b1,
+									 const real32 *b2,
+									 bool pin)
+	{
+	
+	const float32x4_t vB1	= vdupq_n_f32 (b1);
+	const float32x4_t vZero = vdupq_n_f32 (0.0f);
+	const float32x4_t vOne	= vdupq_n_f32 (1.0f);
+	
+	uint32 j = 0;
+	
+	for (; j + 4 <= count; j += 4)
+		{
+		
+		float32x4_t x = vsubq_f32 (vmulq_n_f32 (vld1q_f32 (sPtr + j), scale), vB1);
+		
+		if (b2)
+			{
+			x = vsubq_f32 (x, vld1q_f32 (b2 + j));
+			}
+			
+		if (pin)
+			{
+			x = vminq_f32 (vmaxq_f32 (x, vZero), vOne);
+			}
+			
+		vst1q_f32 (dPtr + j, x);
+		
+		}
+		
+	LinearizeRowReal32_Scalar (sPtr + j,
+							   dPtr + j,
+							   count - j,
+							   scale,
+							   b1,
+							   b2 ? b2 + j : NULL,
+							   pin);
+	
+	}
+
+/*****************************************************************************/
+
+#endif	// qDNGIntrinsicsNEON
+
+/*****************************************************************************/
+
+static void LinearizeRowReal32 (const real32 *sPtr,
+								real32 *dPtr,
+								uint32 count,
+								real32 scale,
+								real32 b1,
+								const real32 *b2,
+								bool pin)
+	{
+	
+	#if qDNGIntrinsicsX86
+	
+	if (gDNGMaxSIMD >= AVX2)
+		{
+		LinearizeRowReal32_AVX2 (sPtr, dPtr, count, scale, b1, b2, pin);
+		return;
+		}
+	
+	#endif
+	
+	#if qDNGIntrinsicsNEON
+	
+	if (gDNGMaxSIMD >= arm64_neon)
+		{
+		LinearizeRowReal32_NEON (sPtr, dPtr, count, scale, b1, b2, pin);
+		return;
+		}
+	
+	#endif
+	
+	LinearizeRowReal32_Scalar (sPtr, dPtr, count, scale, b1, b2, pin);
+	
+	}
+
+/*****************************************************************************/
+
+static void LinearizeRowLUT32 (const uint16 *sPtr,
+							   real32 *dPtr,
+							   uint32 count,
+							   const real32 *lut,
+							   real32 b1,
+							   const real32 *b2)
+	{
+	
+	#if qDNGIntrinsicsX86
+	
+	if (gDNGMaxSIMD >= AVX2)
+		{
+		LinearizeRowLUT32_AVX2 (sPtr, dPtr, count, lut, b1, b2);
+		return;
+		}
+	
+	#endif
+	
+	// Without a gather, look up the row first and then do the arithmetic
+	// in place.
+	
+	for (uint32 j = 0; j < count; j++)
+		{
+		dPtr [j] = lut [sPtr [j]];
+		}
+		
+	LinearizeRowReal32 (dPtr, dPtr, count, 1.0f, b1, b2, true);
+	
+	}
+
+/*****************************************************************************/
+
+static void LinearizeRowPhase16Dispatch (const uint16 *sPtr,
+										 uint16 *dPtr,
+										 uint32 count,
+										 const uint16 *rowTables,
+										 uint32 firstPhase,
+										 uint32 phases)
+	{
+	
+	#if qDNGIntrinsicsX86
+	
+	if (gDNGMaxSIMD >= AVX2 && (8 % phases) == 0)
+		{
+		LinearizeRowPhase16_AVX2 (sPtr, dPtr, count, rowTables, firstPhase, phases);
+		return;
+		}
+	
+	#endif
+	
+	LinearizeRowPhase16 (sPtr, dPtr, count, rowTables, firstPhase, phases);
+	
+	}
+
+/*****************************************************************************/
+
 class dng_linearize_plane
 	{
 	
@@ -53,6 +444,11 @@ class dng_linearize_plane
 		
 		AutoPtr<dng_memory_block> fBlack_1D_buffer;
 		
+		uint32 fPhaseRows;
+		uint32 fPhaseCols;
+		
+		AutoPtr<dng_memory_block> fPhase_buffer;
+		
 	public:
 	
 		dng_linearize_plane (dng_host &host,
@@ -66,6 +462,14 @@ class dng_linearize_plane
 		~dng_linearize_plane ();
 		
 		void Process (const dng_rect &tile);
+		
+	private:
+	
+		void BuildPhaseTables (dng_host &host,
+							   const dng_linearization_info &info,
+							   real64 scale,
+							   uint16 dstBlackLevel,
+							   bool forceClipBlackLevel);
 								  
 	};
 
@@ -93,6 +497,9 @@ dng_linearize_plane::dng_linearize_plane (dng_host &host,
 	,	fBlack_2D_buffer ()
 	,	fBlack_1D_rows (0)
 	,	fBlack_1D_buffer ()
+	,	fPhaseRows (0)
+	,	fPhaseCols (0)
+	,	fPhase_buffer ()
 	
 	{
 	
@@ -152,22 +559,44 @@ dng_linearize_plane::dng_linearize_plane (dng_host &host,
 	real64 scale = 1.0 / minRange;
 	
 	fScale = (real32) scale;
-		
-	// Calculate two-dimensional black pattern, if any.
 	
-	if (info.fBlackDeltaH.Get ())
+	// If the black level only depends on the phase within a small repeating
+	// pattern, then linearization table, black subtraction and scale fuse
+	// into one uint16 to uint16 table per phase.
+	
+	if (fSrcPixelType == ttShort &&
+		fDstPixelType == ttShort &&
+		info.BlackLevelIsPatternOnly ())
 		{
 		
-		fBlack_2D_rows = info.fBlackLevelRepeatRows;
-		fBlack_2D_cols = info.fActiveArea.W ();
+		uint32 phases = info.fBlackLevelRepeatRows *
+						info.fBlackLevelRepeatCols;
+		
+		if (phases > 1 && phases <= kMaxLinearizePhaseTables)
+			{
+			
+			BuildPhaseTables (host,
+							  info,
+							  scale,
+							  dstBlackLevel,
+							  forceClipBlackLevel);
+							  
+			return;
+			
+			}
 		
 		}
 		
-	else if (info.fBlackLevelRepeatCols > 1)
+	// Calculate two-dimensional black pattern, if any. A repeating column
+	// pattern is expanded to the full active width so rows can be processed
+	// with unit stride.
+	
+	if (info.fBlackDeltaH.Get () ||
+		info.fBlackLevelRepeatCols > 1)
 		{
 		
 		fBlack_2D_rows = info.fBlackLevelRepeatRows;
-		fBlack_2D_cols = info.fBlackLevelRepeatCols;
+		fBlack_2D_cols = info.fActiveArea.W ();
 		
 		}
 		
@@ -453,6 +882,86 @@ dng_linearize_plane::~dng_linearize_plane ()
 							 
 /*****************************************************************************/
 
+void dng_linearize_plane::BuildPhaseTables (dng_host &host,
+											const dng_linearization_info &info,
+											real64 scale,
+											uint16 dstBlackLevel,
+											bool forceClipBlackLevel)
+	{
+	
+	fPhaseRows = info.fBlackLevelRepeatRows;
+	fPhaseCols = info.fBlackLevelRepeatCols;
+	
+	uint32 phases = fPhaseRows * fPhaseCols;
+	
+	fPhase_buffer.Reset (host.Allocate (SafeUint32Mult (phases,
+														kLinearizePhaseTableStep,
+														(uint32) sizeof (uint16))));
+														
+	const uint16 *lut = NULL;
+	
+	uint32 lutEntries = 0;
+	
+	if (info.fLinearizationTable.Get ())
+		{
+		
+		lut = info.fLinearizationTable->Buffer_uint16 ();
+		
+		lutEntries = info.fLinearizationTable->LogicalSize () >> 1;
+		
+		}
+		
+	for (uint32 row = 0; row < fPhaseRows; row++)
+		{
+		
+		for (uint32 col = 0; col < fPhaseCols; col++)
+			{
+			
+			uint16 *table = fPhase_buffer->Buffer_uint16 () +
+							(row * fPhaseCols + col) * kLinearizePhaseTableStep;
+							
+			real64 black = info.fBlackLevel [row] [col] [fPlane];
+			
+			for (uint32 j = 0; j < 0x10000; j++)
+				{
+				
+				uint32 x = j;
+				
+				if (lut)
+					{
+					
+					x = Min_uint32 (x, lutEntries - 1);
+					
+					x = lut [x];
+					
+					}
+					
+				real64 y = (x - black) * scale;
+				
+				if (forceClipBlackLevel)
+					{
+					y = Pin_real64 (0.0, y, 1.0);
+					}
+					
+				table [j] = Pin_uint16 (Round_int32 (y * (0x0FFFF - dstBlackLevel) + dstBlackLevel));
+				
+				}
+				
+			// Padding read by the vector path.
+				
+			for (uint32 j = 0x10000; j < kLinearizePhaseTableStep; j++)
+				{
+				table [j] = 0;
+				}
+			
+			}
+		
+		}
+	
+	}
+							 
+/*****************************************************************************/
+
 void dng_linearize_plane::Process (const dng_rect &srcTile)
 	{
 
@@ -485,9 +994,59 @@ void dng_linearize_plane::Process (const dng_rect &srcTile)
 										   dstCol,
 										   fPlane);
 										   
+		// Per-phase table case.
+		
+		if (fPhase_buffer.Get ())
+			{
+			
+			const uint16 *rowTables = fPhase_buffer->Buffer_uint16 () +
+									  (dstRow % fPhaseRows) * fPhaseCols * kLinearizePhaseTableStep;
+									  
+			uint32 firstPhase = dstCol % fPhaseCols;
+			
+			const uint16 *srcPtr = (const uint16 *) sPtr;
+			
+			uint16 *dstPtr = (uint16 *) dPtr;
+			
+			if (sStep == 1 && dStep == 1)
+				{
+				
+				LinearizeRowPhase16Dispatch (srcPtr,
+											 dstPtr,
+											 count,
+											 rowTables,
+											 firstPhase,
+											 fPhaseCols);
+				
+				}
+				
+			else
+				{
+				
+				uint32 phase = firstPhase;
+				
+				for (uint32 j = 0; j < count; j++)
+					{
+					
+					*dstPtr = rowTables [phase * kLinearizePhaseTableStep + *srcPtr];
+					
+					if (++phase == fPhaseCols)
+						{
+						phase = 0;
+						}
+					
+					srcPtr += sStep;
+					dstPtr += dStep;
+					
+					}
+				
+				}
+			
+			}
+		
 		// Floating point source case.
 		
-		if (fSrcPixelType == ttFloat)
+		else if (fSrcPixelType == ttFloat)
 			{
 			
 			real32 scale = fScale;
@@ -496,10 +1055,41 @@ void dng_linearize_plane::Process (const dng_rect &srcTile)
 			
 			real32 *dstPtr = (real32 *) dPtr;
 			
+			if (sStep == 1 && dStep == 1)
+				{
+				
+				real32 b1 = 0.0f;
+				
+				if (fBlack_1D_rows)
+					{
+					b1 = fBlack_1D_buffer->Buffer_real32 () [dstRow % fBlack_1D_rows];
+					}
+					
+				const real32 *b2 = NULL;
+				
+				if (fBlack_2D_cols)
+					{
+					
+					b2 = fBlack_2D_buffer->Buffer_real32 () +
+						 fBlack_2D_cols * (dstRow % fBlack_2D_rows) +
+						 dstCol;
+					
+					}
+					
+				LinearizeRowReal32 (srcPtr,
+									dstPtr,
+									count,
+									scale,
+									b1,
+									b2,
+									false);
+				
+				}
+				
 			// Optimize scale only case, which is the most common.
 			
-			if (fBlack_1D_rows == 0 &&
-				fBlack_2D_cols == 0)
+			else if (fBlack_1D_rows == 0 &&
+					 fBlack_2D_cols == 0)
 				{
 			
 				for (uint32 j = 0; j < count; j++)
@@ -837,6 +1427,18 @@ void dng_linearize_plane::Process (const dng_rect &srcTile)
 						
 					}
 					
+				else if (sStep == 1 && dStep == 1)
+					{
+					
+					LinearizeRowLUT32 ((const uint16 *) sPtr,
+									   dstPtr,
+									   count,
+									   lut,
+									   b1,
+									   b2 ? b2 + b2_phase : NULL);
+					
+					}
+					
 				else
 					{
 				
@@ -1455,6 +2057,39 @@ real64 dng_linearization_info::MaxBlackLevel (uint32 plane) const
 				
 /*****************************************************************************/
 
+bool dng_linearization_info::BlackLevelIsPatternOnly () const
+	{
+	
+	uint32 count = RowBlackCount ();
+	
+	for (uint32 j = 0; j < count; j++)
+		{
+		
+		if (fBlackDeltaV->Buffer_real64 () [j] != 0.0)
+			{
+			return false;
+			}
+		
+		}
+		
+	count = ColumnBlackCount ();
+	
+	for (uint32 j = 0; j < count; j++)
+		{
+		
+		if (fBlackDeltaH->Buffer_real64 () [j] != 0.0)
+			{
+			return false;
+			}
+		
+		}
+		
+	return true;
+	
+	}
+				
+/*****************************************************************************/
+
 void dng_linearization_info::Linearize (dng_host &host,
 										dng_negative &negative,
 										const dng_image &srcImage,
@@ -112,6 +112,13 @@ class dng_linearization_info
 
 		real64 MaxBlackLevel (uint32 plane) const;
 		
+		/// Returns true if the black level depends only on the position within
+		/// the repeating BlackLevel pattern, i.e. there are no non-zero per-row
+		/// or per-column deltas. In that case integer data can be linearized
+		/// with one lookup table per pattern phase.
+		
+		bool BlackLevelIsPatternOnly () const;
+		
 		/// Convert raw data from in-file format to a true linear image using linearization data from DNG.
 		/// \param host Used to allocate buffers, check for aborts, and post progress updates.
 		/// \param negative Used to remember preserved black point.
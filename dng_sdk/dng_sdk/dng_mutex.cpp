@@ -14,6 +14,16 @@
 
 #include <stdlib.h>
 
+#if qDNGMutexProfile
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#endif
+
 /*****************************************************************************/
 
 // do mutex lock level tracking, asserts stripped in non-debug so don't track there
@@ -95,6 +105,249 @@ namespace
 
 /*****************************************************************************/
 
+#if qDNGMutexProfile
+
+// Burst Photo addition: statistics shared by all mutexes with one name.
+// Counters are updated by several mutexes at once, so they are atomic.
+
+class dng_mutex_stats
+	{
+	
+	public:
+	
+		enum
+			{
+			
+			// Hold time buckets: bucket i counts holds shorter than 2^i
+			// microseconds. The last bucket counts all longer holds.
+			
+			kHoldBuckets = 22
+			
+			};
+	
+		std::string fName;
+		
+		std::atomic<uint64> fAcquires;
+		std::atomic<uint64> fContended;
+		std::atomic<uint64> fWaitNanos;
+		std::atomic<uint64> fHoldNanos;
+		
+		std::atomic<uint64> fHoldHistogram [kHoldBuckets];
+		
+		explicit dng_mutex_stats (const std::string &name)
+		
+			:	fName		(name)
+			,	fAcquires	(0)
+			,	fContended	(0)
+			,	fWaitNanos	(0)
+			,	fHoldNanos	(0)
+			
+			{
+			
+			for (uint32 index = 0; index < kHoldBuckets; index++)
+				{
+				fHoldHistogram [index] = 0;
+				}
+			
+			}
+			
+		void AddHold (uint64 nanos)
+			{
+			
+			fHoldNanos.fetch_add (nanos, std::memory_order_relaxed);
+			
+			uint64 micros = nanos / 1000;
+			
+			uint32 bucket = 0;
+			
+			while (bucket < kHoldBuckets - 1 && (micros >> bucket) != 0)
+				{
+				bucket++;
+				}
+				
+			fHoldHistogram [bucket].fetch_add (1, std::memory_order_relaxed);
+			
+			}
+	
+	};
+
+/*****************************************************************************/
+
+namespace
+	{
+	
+	uint64 ProfileNow ()
+		{
+		
+		using namespace std::chrono;
+		
+		return (uint64) duration_cast<nanoseconds>
+						(steady_clock::now ().time_since_epoch ()).count ();
+		
+		}
+	
+	class dng_mutex_registry
+		{
+		
+		private:
+		
+			std::mutex fMutex;
+			
+			std::map<std::string, dng_mutex_stats *> fStats;
+			
+		public:
+		
+			dng_mutex_stats * Find (const char *name)
+				{
+				
+				std::string key (name ? name : "< unknown >");
+				
+				std::lock_guard<std::mutex> lock (fMutex);
+				
+				dng_mutex_stats *&stats = fStats [key];
+				
+				if (!stats)
+					{
+					stats = new dng_mutex_stats (key);
+					}
+					
+				return stats;
+				
+				}
+				
+			std::vector<dng_mutex_stats *> Snapshot ()
+				{
+				
+				std::lock_guard<std::mutex> lock (fMutex);
+				
+				std::vector<dng_mutex_stats *> result;
+				
+				for (auto it = fStats.begin (); it != fStats.end (); ++it)
+					{
+					result.push_back (it->second);
+					}
+					
+				return result;
+				
+				}
+				
+		};
+		
+	void DumpMutexProfileAtExit ()
+		{
+		
+		DumpMutexProfile ();
+		
+		}
+		
+	// Never destroyed, so mutexes used during static destruction still
+	// have somewhere to record to.
+		
+	dng_mutex_registry & MutexRegistry ()
+		{
+		
+		static dng_mutex_registry *registry = NULL;
+		
+		static std::once_flag once;
+		
+		std::call_once (once, []
+			{
+			
+			registry = new dng_mutex_registry;
+			
+			atexit (DumpMutexProfileAtExit);
+			
+			});
+		
+		return *registry;
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void DumpMutexProfile ()
+	{
+	
+	std::vector<dng_mutex_stats *> stats = MutexRegistry ().Snapshot ();
+	
+	std::sort (stats.begin (),
+			   stats.end (),
+			   [] (const dng_mutex_stats *a, const dng_mutex_stats *b)
+			   {
+			   return a->fWaitNanos > b->fWaitNanos;
+			   });
+			   
+	fprintf (stderr,
+			 "dng_mutex profile\n"
+			 "%-40s %10s %10s %6s %10s %10s  %s\n",
+			 "name",
+			 "acquires",
+			 "contended",
+			 "%",
+			 "wait ms",
+			 "hold ms",
+			 "holds by duration (us)");
+	
+	for (size_t index = 0; index < stats.size (); index++)
+		{
+		
+		const dng_mutex_stats &entry = *stats [index];
+		
+		uint64 acquires  = entry.fAcquires;
+		uint64 contended = entry.fContended;
+		
+		if (!acquires)
+			{
+			continue;
+			}
+		
+		fprintf (stderr,
+				 "%-40s %10llu %10llu %6.2f %10.3f %10.3f ",
+				 entry.fName.c_str (),
+				 (unsigned long long) acquires,
+				 (unsigned long long) contended,
+				 100.0 * (double) contended / (double) acquires,
+				 (double) entry.fWaitNanos * 1.0e-6,
+				 (double) entry.fHoldNanos * 1.0e-6);
+				 
+		for (uint32 bucket = 0; bucket < dng_mutex_stats::kHoldBuckets; bucket++)
+			{
+			
+			uint64 count = entry.fHoldHistogram [bucket];
+			
+			if (!count)
+				{
+				continue;
+				}
+				
+			if (bucket == dng_mutex_stats::kHoldBuckets - 1)
+				{
+				fprintf (stderr, " >=%u:%llu",
+						 1u << (bucket - 1),
+						 (unsigned long long) count);
+				}
+				
+			else
+				{
+				fprintf (stderr, " <%u:%llu",
+						 1u << bucket,
+						 (unsigned long long) count);
+				}
+				
+			}
+			
+		fprintf (stderr, "\n");
+		
+		}
+	
+	}
+
+#endif
+
+/*****************************************************************************/
+
 dng_mutex::dng_mutex (const char *mutexName, uint32 mutexLevel)
 
 	#if qDNGThreadSafe
@@ -105,6 +358,12 @@ dng_mutex::dng_mutex (const char *mutexName, uint32 mutexLevel)
 	,	fPrevHeldMutex		(NULL)
 	,	fMutexName			(mutexName)
 	
+	#if qDNGMutexProfile
+	,	fStats				(MutexRegistry ().Find (mutexName))
+	,	fProfileDepth		(0)
+	,	fProfileLockTime	(0)
+	#endif
+	
 	#endif
 	
 	{
@@ -165,16 +424,7 @@ void dng_mutex::Lock ()
 		if (innermostMutex == this)
 			{
 
-			int result = pthread_mutex_lock (&fPthreadMutex);
-
-			if (result != 0)
-				{
-
-				DNG_ASSERT (result == 0, "pthread_mutex_lock failed.");
-
-				ThrowProgramError ();
-
-				}
+			LockPthreadMutex ();
 
 			fRecursiveLockCount++;
 
@@ -210,16 +460,7 @@ void dng_mutex::Lock ()
 
 		}
 
-	int result = pthread_mutex_lock (&fPthreadMutex);
-
-	if (result != 0)
-		{
-
-		DNG_ASSERT (result == 0, "pthread_mutex_lock failed.");
-
-		ThrowProgramError ();
-
-		}
+	LockPthreadMutex ();
 
 	fPrevHeldMutex = innermostMutex;
 
@@ -227,20 +468,7 @@ void dng_mutex::Lock ()
 
 	#else
 	 
-	// Register the fact that we're trying to lock this mutex.
-
-	int result = pthread_mutex_lock (&fPthreadMutex);
-
-	if (result != 0)
-		{
-
-		DNG_REPORT ("pthread_mutex_lock failed");
-
-		ThrowProgramError ();
-		
-		}
-
-	// Register the fact that we've now successfully acquired the mutex.
+	LockPthreadMutex ();
 
 	#endif
 	#endif
@@ -262,7 +490,7 @@ void dng_mutex::Unlock ()
 			
 		fRecursiveLockCount--;
 
-		pthread_mutex_unlock (&fPthreadMutex);
+		UnlockPthreadMutex ();
 			
 		return;
 
@@ -274,14 +502,145 @@ void dng_mutex::Unlock ()
 
 	#endif
 
-	pthread_mutex_unlock (&fPthreadMutex);
+	UnlockPthreadMutex ();
+
+	#endif
+		
+	}
+
+/*****************************************************************************/
+
+#if qDNGThreadSafe
+
+/*****************************************************************************/
+
+void dng_mutex::LockPthreadMutex ()
+	{
+	
+	int result;
+	
+	#if qDNGMutexProfile
+	
+	uint64 waitNanos = 0;
+	
+	bool contended = false;
+	
+	#if qWinOS
+	
+	// No trylock in dng_pthread; count slow acquisitions as contended.
+	
+	uint64 start = ProfileNow ();
+	
+	result = pthread_mutex_lock (&fPthreadMutex);
+	
+	waitNanos = ProfileNow () - start;
+	
+	contended = waitNanos > 1000;
+	
+	#else
+	
+	result = pthread_mutex_trylock (&fPthreadMutex);
+	
+	if (result != 0)
+		{
+		
+		uint64 start = ProfileNow ();
+		
+		result = pthread_mutex_lock (&fPthreadMutex);
+		
+		waitNanos = ProfileNow () - start;
+		
+		contended = true;
+		
+		}
+	
+	#endif
+	
+	#else
+	
+	result = pthread_mutex_lock (&fPthreadMutex);
+	
+	#endif
+	
+	if (result != 0)
+		{
 
+		DNG_REPORT ("pthread_mutex_lock failed");
+
+		ThrowProgramError ();
+		
+		}
+		
+	#if qDNGMutexProfile
+	
+	fStats->fAcquires.fetch_add (1, std::memory_order_relaxed);
+	
+	if (contended)
+		{
+		
+		fStats->fContended.fetch_add (1, std::memory_order_relaxed);
+		
+		fStats->fWaitNanos.fetch_add (waitNanos, std::memory_order_relaxed);
+		
+		}
+	
 	#endif
 		
+	ProfileAcquired ();
+	
 	}
 
 /*****************************************************************************/
 
+void dng_mutex::UnlockPthreadMutex ()
+	{
+	
+	ProfileReleasing ();
+	
+	pthread_mutex_unlock (&fPthreadMutex);
+	
+	}
+
+/*****************************************************************************/
+
+void dng_mutex::ProfileAcquired ()
+	{
+	
+	#if qDNGMutexProfile
+	
+	// Hold time is measured from the outermost lock only.
+	
+	if (fProfileDepth++ == 0)
+		{
+		fProfileLockTime = ProfileNow ();
+		}
+	
+	#endif
+	
+	}
+
+/*****************************************************************************/
+
+void dng_mutex::ProfileReleasing ()
+	{
+	
+	#if qDNGMutexProfile
+	
+	if (--fProfileDepth == 0)
+		{
+		fStats->AddHold (ProfileNow () - fProfileLockTime);
+		}
+	
+	#endif
+	
+	}
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
+
 const char *dng_mutex::MutexName () const
 	{
 	
@@ -424,6 +783,18 @@ bool dng_condition::Wait (dng_mutex &mutex, double timeoutSecs)
 
 	mutex.fPrevHeldMutex = NULL;
 		
+	#endif
+	
+	#if qDNGMutexProfile
+	
+	// The mutex is released while waiting, so end the current hold here.
+	
+	uint32 profileDepth = mutex.fProfileDepth;
+	
+	mutex.fProfileDepth = 1;
+	
+	mutex.ProfileReleasing ();
+	
 	#endif
 		
 	if (timeoutSecs < 0)
@@ -463,6 +834,14 @@ bool dng_condition::Wait (dng_mutex &mutex, double timeoutSecs)
 
 		}
 
+	#if qDNGMutexProfile
+	
+	mutex.ProfileAcquired ();
+	
+	mutex.fProfileDepth = profileDepth;
+	
+	#endif
+	
 	#if qDNGThreadTestMutexLevels
 	
 	mutex.fPrevHeldMutex = innermostMutex;
@@ -32,6 +32,12 @@ typedef std::unique_lock<std::mutex> dng_unique_lock;
 
 /******************************************************************************/
 
+#if qDNGMutexProfile
+class dng_mutex_stats;
+#endif
+
+/******************************************************************************/
+
 class dng_mutex: private dng_uncopyable
 	{
 	
@@ -68,11 +74,53 @@ class dng_mutex: private dng_uncopyable
 
 		const char * const fMutexName;
 
+		#if qDNGMutexProfile
+
+		// Burst Photo addition: profiling state. Only changed while the
+		// mutex is held.
+
+		dng_mutex_stats *fStats;
+
+		uint32 fProfileDepth;
+
+		uint64 fProfileLockTime;
+
+		#endif
+
 		friend class dng_condition;
 		
 		#endif
 
+	private:
+
+		#if qDNGThreadSafe
+
+		// Burst Photo addition: the pthread calls themselves, plus the
+		// profiling hooks.
+
+		void LockPthreadMutex ();
+
+		void UnlockPthreadMutex ();
+
+		void ProfileAcquired ();
+
+		void ProfileReleasing ();
+
+		#endif
+
 	};
+
+/*****************************************************************************/
+
+#if qDNGMutexProfile
+
+/// Burst Photo addition: print the dng_mutex profile to stderr. Runs at
+/// exit automatically. Mutexes are grouped by name and sorted by total
+/// contended wait time.
+
+void DumpMutexProfile ();
+
+#endif
 		
 /*****************************************************************************/
 
@@ -224,6 +224,7 @@ dng_metadata::dng_metadata (dng_host &host)
 	,	fBaseOrientation			()
 	,	fIsMakerNoteSafe			(false)
 	,	fMakerNote					()
+	,	fMakerNoteRange				()
 	,	fExif						(host.Make_dng_exif ())
 	,	fOriginalExif				()
 	,	fIPTCBlock					()
@@ -233,6 +234,7 @@ dng_metadata::dng_metadata (dng_host &host)
 	,	fXMP						(host.Make_dng_xmp ())
 	#endif
 	
+	,	fXMPPacket					()
 	,	fEmbeddedXMPDigest			()
 	,	fXMPinSidecar				(false)
 	,	fXMPisNewer					(false)
@@ -278,6 +280,7 @@ dng_metadata::dng_metadata (const dng_metadata &rhs,
 	,	fBaseOrientation			(rhs.fBaseOrientation)
 	,	fIsMakerNoteSafe			(rhs.fIsMakerNoteSafe)
 	,	fMakerNote					(CloneAutoPtr (rhs.fMakerNote, allocator))
+	,	fMakerNoteRange				(rhs.fMakerNoteRange)
 	,	fExif						(CloneAutoPtr (rhs.fExif))
 	,	fOriginalExif				(CloneAutoPtr (rhs.fOriginalExif))
 	,	fIPTCBlock					(CloneAutoPtr (rhs.fIPTCBlock, allocator))
@@ -287,6 +290,7 @@ dng_metadata::dng_metadata (const dng_metadata &rhs,
 	,	fXMP						(CloneAutoPtr (rhs.fXMP))
 	#endif
 	
+	,	fXMPPacket					(CloneAutoPtr (rhs.fXMPPacket, allocator))
 	,	fEmbeddedXMPDigest			(rhs.fEmbeddedXMPDigest)
 	,	fXMPinSidecar				(rhs.fXMPinSidecar)
 	,	fXMPisNewer					(rhs.fXMPisNewer)
@@ -396,6 +400,17 @@ dng_memory_block * dng_metadata::BuildExifBlock (dng_memory_allocator &allocator
 							  MakerNoteLength (),
 							  false);
 							  
+		// Burst Photo addition: MakerNote left in the source stream.
+		
+		tag_stream_range tagMakerNoteRange (tcMakerNote,
+											ttUndefined,
+											fMakerNoteRange);
+		
+		if (IsMakerNoteSafe () && fMakerNoteRange.IsValid ())
+			{
+			exifSet.AddMakerNote (mainIFD, tagMakerNoteRange);
+			}
+							  
 		// Figure out the Exif IFD offset.
 		
 		uint32 exifOffset = 8 + mainIFD.Size ();
@@ -632,6 +647,8 @@ void dng_metadata::ResetXMP (dng_xmp * newXMP)
 	{
 	
 	fXMP.Reset (newXMP);
+	
+	fXMPPacket.Reset ();
 
 	}
 
@@ -643,6 +660,8 @@ void dng_metadata::ResetXMPSidecarNewer (dng_xmp * newXMP,
 	{
 
 	fXMP.Reset (newXMP);
+	
+	fXMPPacket.Reset ();
 
 	fXMPinSidecar = inSidecar;
 
@@ -752,6 +771,24 @@ void dng_metadata::SetEmbeddedXMP (dng_host &host,
 
 /*****************************************************************************/
 
+void dng_metadata::SetXMPPacket (AutoPtr<dng_memory_block> &block)
+	{
+	
+	fXMPPacket.Reset (block.Release ());
+	
+	}
+
+/*****************************************************************************/
+
+void dng_metadata::ClearXMPPacket ()
+	{
+	
+	fXMPPacket.Reset ();
+	
+	}
+
+/*****************************************************************************/
+
 void dng_metadata::SynchronizeMetadata ()
 	{
 
@@ -768,6 +805,13 @@ void dng_metadata::SynchronizeMetadata ()
 		
 	#if qDNGUseXMP
 	
+	// Burst Photo addition: a passed-through packet is written as is.
+	
+	if (fXMPPacket.Get ())
+		{
+		return;
+		}
+	
 	fXMP->ValidateMetadata ();
 	
 	fXMP->IngestIPTC (*this, fXMPisNewer);
@@ -889,6 +933,7 @@ dng_negative::dng_negative (dng_host &host)
 	,	fOriginalRawFileData			()
 	,	fOriginalRawFileDigest			()
 	,	fDNGPrivateData					()
+	,	fDNGPrivateDataRange			()
 	,	fMetadata						(host)
 	,	fLinearizationInfo				()
 	,	fMosaicInfo						()
@@ -3603,13 +3648,33 @@ void dng_negative::Parse (dng_host &host,
 		
 		uint32 length = shared.fDNGPrivateDataCount;
 		
-		AutoPtr<dng_memory_block> block (host.Allocate (length));
+		// Burst Photo addition: leave the data in the stream if asked to.
 		
-		stream.SetReadPosition (shared.fDNGPrivateDataOffset);
+		if (host.ReferenceSourceBlocks ())
+			{
 			
-		stream.Get (block->Buffer (), length);
-							
-		SetPrivateData (block);
+			dng_stream_range range;
+			
+			range.fStream = &stream;
+			range.fOffset = shared.fDNGPrivateDataOffset;
+			range.fCount  = length;
+			
+			SetPrivateDataRange (range);
+			
+			}
+			
+		else
+			{
+		
+			AutoPtr<dng_memory_block> block (host.Allocate (length));
+			
+			stream.SetReadPosition (shared.fDNGPrivateDataOffset);
+				
+			stream.Get (block->Buffer (), length);
+								
+			SetPrivateData (block);
+			
+			}
 			
 		}
 		
@@ -3908,14 +3973,35 @@ void dng_negative::PostParse (dng_host &host,
 			
 			if (IsMakerNoteSafe ())
 				{
-
-				AutoPtr<dng_memory_block> block (host.Allocate (shared.fMakerNoteCount));
 				
-				stream.SetReadPosition (shared.fMakerNoteOffset);
+				// Burst Photo addition: leave the MakerNote in the stream if
+				// asked to.
+				
+				if (host.ReferenceSourceBlocks ())
+					{
 					
-				stream.Get (block->Buffer (), shared.fMakerNoteCount);
-									
-				SetMakerNote (block);
+					dng_stream_range range;
+					
+					range.fStream = &stream;
+					range.fOffset = shared.fMakerNoteOffset;
+					range.fCount  = shared.fMakerNoteCount;
+					
+					Metadata ().SetMakerNoteRange (range);
+					
+					}
+					
+				else
+					{
+
+					AutoPtr<dng_memory_block> block (host.Allocate (shared.fMakerNoteCount));
+					
+					stream.SetReadPosition (shared.fMakerNoteOffset);
+						
+					stream.Get (block->Buffer (), shared.fMakerNoteCount);
+										
+					SetMakerNote (block);
+					
+					}
 							
 				}
 			
@@ -3953,18 +4039,32 @@ void dng_negative::PostParse (dng_host &host,
 			stream.Get (block->Buffer	   (),
 						block->LogicalSize ());
 						
-			Metadata ().SetEmbeddedXMP (host,
-										block->Buffer	   (),
-										block->LogicalSize ());
-										
-			#if qDNGValidate
+			// Burst Photo addition: keep the packet unparsed if asked to.
 			
-			if (!Metadata ().HaveValidEmbeddedXMP ())
+			if (host.PassThroughXMP ())
 				{
-				ReportError ("The embedded XMP is invalid");
+				
+				Metadata ().SetXMPPacket (block);
+				
+				}
+				
+			else
+				{
+						
+				Metadata ().SetEmbeddedXMP (host,
+											block->Buffer	   (),
+											block->LogicalSize ());
+											
+				#if qDNGValidate
+				
+				if (!Metadata ().HaveValidEmbeddedXMP ())
+					{
+					ReportError ("The embedded XMP is invalid");
+					}
+				
+				#endif
+				
 				}
-			
-			#endif
 			
 			}
 		
@@ -6125,6 +6225,722 @@ void dng_negative::ConvertToProxy (dng_host &host,
 
 /*****************************************************************************/
 
+// Burst Photo addition: support for ConvertToMosaicProxy.
+
+// Divide a rational by an integer, exactly when the denominator allows it.
+
+static dng_urational DivideRational (const dng_urational &x,
+									 uint32 factor)
+	{
+	
+	uint64 d = (uint64) x.d * factor;
+	
+	if (d <= 0xFFFFFFFF)
+		{
+		return dng_urational (x.n, (uint32) d);
+		}
+		
+	dng_urational result;
+	
+	result.Set_real64 (x.As_real64 () / factor);
+	
+	return result;
+	
+	}
+
+/*****************************************************************************/
+
+// Filter one band of a mosaic proxy. Every destination pixel is a weighted
+// sum of the pixels with the same CFA phase in a run of source cells, first
+// down the columns into rowSum and then along that row.
+
+template <typename T>
+static void DownsampleMosaicBand (const dng_pixel_buffer &src,
+								  dng_pixel_buffer &dst,
+								  const dng_rect &dstArea,
+								  uint32 plane,
+								  const dng_point &pattern,
+								  const dng_point &srcCells,
+								  const dng_point &srcOrigin,
+								  uint32 factor,
+								  int32 kernelOffset,
+								  const std::vector<real32> &kernel,
+								  const std::vector<uint32> &colIndex,
+								  real32 *rowSum,
+								  real32 maxValue)
+	{
+	
+	const uint32 taps = (uint32) kernel.size ();
+	
+	const uint32 srcCols = (uint32) (srcCells.h * pattern.h);
+	
+	for (int32 row = dstArea.t; row < dstArea.b; row++)
+		{
+		
+		int32 cell	= row / pattern.v;
+		int32 phase = row - cell * pattern.v;
+		
+		memset (rowSum, 0, srcCols * sizeof (real32));
+		
+		for (uint32 tap = 0; tap < taps; tap++)
+			{
+			
+			int32 srcCell = Pin_int32 (0,
+									   cell * (int32) factor + kernelOffset + (int32) tap,
+									   srcCells.v - 1);
+			
+			const T *sPtr = (const T *) src.ConstPixel (srcOrigin.v + srcCell * pattern.v + phase,
+														srcOrigin.h,
+														plane);
+			
+			const real32 weight = kernel [tap];
+			
+			for (uint32 col = 0; col < srcCols; col++)
+				{
+				rowSum [col] += weight * (real32) sPtr [col];
+				}
+			
+			}
+			
+		T *dPtr = (T *) dst.DirtyPixel (row, dstArea.l, plane);
+		
+		for (int32 col = dstArea.l; col < dstArea.r; col++)
+			{
+			
+			const uint32 *index = &colIndex [(size_t) col * taps];
+			
+			real32 sum = 0.0f;
+			
+			for (uint32 tap = 0; tap < taps; tap++)
+				{
+				sum += kernel [tap] * rowSum [index [tap]];
+				}
+				
+			if (maxValue > 0.0f)
+				{
+				sum = Pin_real32 (0.0f, sum + 0.5f, maxValue);
+				}
+				
+			dPtr [(col - dstArea.l) * dst.fColStep] = (T) sum;
+			
+			}
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+// Shared by all copies of a mosaic proxy image. Holds the stage 2 image and
+// the downsampled pixels, which are computed a band of rows at a time the
+// first time any part of the band is read. The stage 2 image is released
+// once every band has been computed.
+
+class dng_mosaic_proxy_data: private dng_uncopyable
+	{
+	
+	private:
+	
+		dng_memory_allocator &fAllocator;
+	
+		AutoPtr<dng_image> fSource;
+		
+		dng_rect fSrcBounds;
+		
+		uint32 fPlanes;
+		
+		uint32 fPixelType;
+		
+		dng_point fPattern;
+		
+		// Whole mosaic cells in the source image.
+		
+		dng_point fSrcCells;
+		
+		uint32 fFactor;
+		
+		// Filter taps, in source cells. Destination cell c reads source
+		// cells c * fFactor + fKernelOffset onwards, clamped to the image.
+		
+		int32 fKernelOffset;
+		
+		std::vector<real32> fKernel;
+		
+		// Source column read by each tap of each destination column,
+		// relative to the left edge of the source image.
+		
+		std::vector<uint32> fColIndex;
+		
+		AutoPtr<dng_memory_block> fMemory;
+		
+		dng_pixel_buffer fBuffer;
+		
+		uint32 fBandRows;
+		
+		std::vector<uint8> fBandDone;
+		
+		std::unique_ptr<dng_std_mutex []> fBandMutex;
+		
+		dng_std_mutex fSourceMutex;
+		
+		uint32 fBandsLeft;
+		
+	public:
+	
+		dng_mosaic_proxy_data (dng_host &host,
+							   const dng_image &source,
+							   const dng_point &pattern,
+							   uint32 factor,
+							   bool binomial);
+							   
+		// Take ownership of the source image. Must be called before any
+		// pixels are read.
+		
+		void AdoptSource (AutoPtr<dng_image> &source)
+			{
+			fSource.Reset (source.Release ());
+			}
+		
+		const dng_pixel_buffer & Buffer () const
+			{
+			return fBuffer;
+			}
+			
+		uint32 PixelType () const
+			{
+			return fPixelType;
+			}
+			
+		// Compute any bands touched by area that are not done yet.
+		
+		void Prepare (const dng_rect &area);
+		
+	private:
+	
+		void ComputeBand (uint32 band);
+	
+	};
+
+/*****************************************************************************/
+
+dng_mosaic_proxy_data::dng_mosaic_proxy_data (dng_host &host,
+											  const dng_image &source,
+											  const dng_point &pattern,
+											  uint32 factor,
+											  bool binomial)
+	
+	:	fAllocator	  (host.Allocator ())
+	,	fSource		  ()
+	,	fSrcBounds	  (source.Bounds ())
+	,	fPlanes		  (source.Planes ())
+	,	fPixelType	  (source.PixelType ())
+	,	fPattern	  (pattern)
+	,	fSrcCells	  (source.Height () / pattern.v,
+					   source.Width	 () / pattern.h)
+	,	fFactor		  (factor)
+	,	fKernelOffset (0)
+	,	fKernel		  ()
+	,	fColIndex	  ()
+	,	fMemory		  ()
+	,	fBuffer		  ()
+	,	fBandRows	  (0)
+	,	fBandDone	  ()
+	,	fBandMutex	  ()
+	,	fSourceMutex  ()
+	,	fBandsLeft	  (0)
+	
+	{
+	
+	if (binomial)
+		{
+		
+		// Each octave filters with [1 3 3 1] / 8 and decimates by two. The
+		// octaves are folded into a single kernel of 3 * factor - 2 taps,
+		// centered on the same point as a box of factor cells.
+		
+		static const real32 kOctave [4] = { 0.125f, 0.375f, 0.375f, 0.125f };
+		
+		std::vector<real32> kernel (1, 1.0f);
+		
+		int32 offset = 0;
+		
+		for (uint32 step = 1; step < factor; step <<= 1)
+			{
+			
+			std::vector<real32> next (kernel.size () + 3 * step, 0.0f);
+			
+			for (uint32 tap = 0; tap < 4; tap++)
+				{
+				for (size_t index = 0; index < kernel.size (); index++)
+					{
+					next [index + tap * step] += kOctave [tap] * kernel [index];
+					}
+				}
+				
+			kernel.swap (next);
+			
+			offset -= (int32) step;
+			
+			}
+			
+		fKernel.swap (kernel);
+		
+		fKernelOffset = offset;
+		
+		}
+		
+	else
+		{
+		
+		fKernel.assign (factor, 1.0f / (real32) factor);
+		
+		}
+		
+	dng_point dstCells ((fSrcCells.v + factor - 1) / factor,
+						(fSrcCells.h + factor - 1) / factor);
+						
+	dng_rect bounds (dstCells.v * pattern.v,
+					 dstCells.h * pattern.h);
+					 
+	const uint32 taps = (uint32) fKernel.size ();
+	
+	fColIndex.resize (SafeSizetMult (bounds.W (), taps));
+	
+	for (int32 col = 0; col < bounds.r; col++)
+		{
+		
+		int32 cell	= col / pattern.h;
+		int32 phase = col - cell * pattern.h;
+		
+		for (uint32 tap = 0; tap < taps; tap++)
+			{
+			
+			int32 srcCell = Pin_int32 (0,
+									   cell * (int32) factor + fKernelOffset + (int32) tap,
+									   fSrcCells.h - 1);
+									   
+			fColIndex [(size_t) col * taps + tap] = (uint32) (srcCell * pattern.h + phase);
+			
+			}
+		
+		}
+	
+	fBuffer = dng_pixel_buffer (bounds,
+								0,
+								fPlanes,
+								fPixelType,
+								pcInterleaved,
+								NULL);
+								
+	fMemory.Reset (host.Allocate (ComputeBufferSize (fPixelType,
+													 bounds.Size (),
+													 fPlanes,
+													 padNone)));
+	
+	fBuffer.fData = fMemory->Buffer ();
+	
+	// Bands of whole cells, sized so each reads about 128 source cells.
+	
+	fBandRows = Max_uint32 (2, 128 / factor) * pattern.v;
+	
+	fBandsLeft = (bounds.H () + fBandRows - 1) / fBandRows;
+	
+	fBandDone.assign (fBandsLeft, 0);
+	
+	fBandMutex.reset (new dng_std_mutex [fBandsLeft]);
+	
+	}
+
+/*****************************************************************************/
+
+void dng_mosaic_proxy_data::Prepare (const dng_rect &area)
+	{
+	
+	if (area.IsEmpty ())
+		{
+		return;
+		}
+		
+	uint32 band0 = (uint32) (area.t - fBuffer.fArea.t	 ) / fBandRows;
+	uint32 band1 = (uint32) (area.b - fBuffer.fArea.t - 1) / fBandRows;
+	
+	for (uint32 band = band0; band <= band1; band++)
+		{
+		
+		dng_lock_std_mutex lock (fBandMutex [band]);
+		
+		if (!fBandDone [band])
+			{
+			
+			ComputeBand (band);
+			
+			fBandDone [band] = 1;
+			
+			dng_lock_std_mutex sourceLock (fSourceMutex);
+			
+			if (--fBandsLeft == 0)
+				{
+				fSource.Reset ();
+				}
+			
+			}
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void dng_mosaic_proxy_data::ComputeBand (uint32 band)
+	{
+	
+	dng_rect dstArea (fBuffer.fArea.t + band * fBandRows,
+					  fBuffer.fArea.l,
+					  fBuffer.fArea.t + Min_uint32 ((band + 1) * fBandRows,
+												   fBuffer.fArea.H ()),
+					  fBuffer.fArea.r);
+					  
+	const int32 lastTap = fKernelOffset + (int32) fKernel.size () - 1;
+	
+	int32 cell0 = Pin_int32 (0,
+							 (dstArea.t / fPattern.v) * (int32) fFactor + fKernelOffset,
+							 fSrcCells.v - 1);
+	
+	int32 cell1 = Pin_int32 (0,
+							 ((dstArea.b - 1) / fPattern.v) * (int32) fFactor + lastTap,
+							 fSrcCells.v - 1);
+							 
+	dng_rect srcArea (fSrcBounds.t + cell0 * fPattern.v,
+					  fSrcBounds.l,
+					  fSrcBounds.t + (cell1 + 1) * fPattern.v,
+					  fSrcBounds.l + fSrcCells.h * fPattern.h);
+					  
+	dng_pixel_buffer srcBuffer (srcArea,
+								0,
+								fPlanes,
+								fPixelType,
+								pcPlanar,
+								NULL);
+								
+	AutoPtr<dng_memory_block> srcMemory (fAllocator.Allocate (ComputeBufferSize (fPixelType,
+																				 srcArea.Size (),
+																				 fPlanes,
+																				 padNone)));
+	
+	srcBuffer.fData = srcMemory->Buffer ();
+	
+	fSource->Get (srcBuffer);
+	
+	AutoPtr<dng_memory_block> rowSum (fAllocator.Allocate (SafeUint32Mult (srcArea.W (),
+																		   (uint32) sizeof (real32))));
+	
+	for (uint32 plane = 0; plane < fPlanes; plane++)
+		{
+		
+		if (fPixelType == ttShort)
+			{
+			
+			DownsampleMosaicBand<uint16> (srcBuffer,
+										  fBuffer,
+										  dstArea,
+										  plane,
+										  fPattern,
+										  fSrcCells,
+										  fSrcBounds.TL (),
+										  fFactor,
+										  fKernelOffset,
+										  fKernel,
+										  fColIndex,
+										  rowSum->Buffer_real32 (),
+										  65535.0f);
+			
+			}
+			
+		else
+			{
+			
+			DownsampleMosaicBand<real32> (srcBuffer,
+										  fBuffer,
+										  dstArea,
+										  plane,
+										  fPattern,
+										  fSrcCells,
+										  fSrcBounds.TL (),
+										  fFactor,
+										  fKernelOffset,
+										  fKernel,
+										  fColIndex,
+										  rowSum->Buffer_real32 (),
+										  0.0f);
+			
+			}
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+// Read-only CFA image whose pixels come from a dng_mosaic_proxy_data.
+
+class dng_mosaic_proxy_image: public dng_image
+	{
+	
+	private:
+	
+		std::shared_ptr<dng_mosaic_proxy_data> fData;
+		
+	public:
+	
+		dng_mosaic_proxy_image (const std::shared_ptr<dng_mosaic_proxy_data> &data)
+		
+			:	dng_image (data->Buffer ().fArea,
+						   data->Buffer ().fPlanes,
+						   data->PixelType ())
+						   
+			,	fData (data)
+			
+			{
+			}
+			
+		virtual dng_image * Clone () const
+			{
+			return new dng_mosaic_proxy_image (fData);
+			}
+			
+	protected:
+	
+		virtual void AcquireTileBuffer (dng_tile_buffer &buffer,
+										const dng_rect &area,
+										bool dirty) const
+			{
+			
+			if (dirty)
+				{
+				ThrowProgramError ("dng_mosaic_proxy_image is read-only");
+				}
+				
+			fData->Prepare (area);
+			
+			const dng_pixel_buffer &data = fData->Buffer ();
+			
+			buffer.fArea = area;
+			
+			buffer.fPlane	   = data.fPlane;
+			buffer.fPlanes	   = data.fPlanes;
+			buffer.fRowStep	   = data.fRowStep;
+			buffer.fColStep	   = data.fColStep;
+			buffer.fPlaneStep  = data.fPlaneStep;
+			buffer.fPixelType  = data.fPixelType;
+			buffer.fPixelSize  = data.fPixelSize;
+
+			buffer.fData = (void *) data.ConstPixel (area.t,
+													 area.l,
+													 data.fPlane);
+			
+			buffer.fDirty = false;
+			
+			}
+	
+	};
+
+/*****************************************************************************/
+
+bool dng_negative::ConvertToMosaicProxy (dng_host &host,
+										 uint32 proxySize,
+										 MosaicProxyFilterEnum filter)
+	{
+	
+	// Only rectangular CFA layouts can be downsampled by whole cells.
+	
+	const dng_mosaic_info *info = GetMosaicInfo ();
+	
+	if (!fStage2Image.Get () ||
+		fStage3Image.Get () ||
+		!info ||
+		!info->IsColorFilterArray () ||
+		info->fCFALayout != 1)
+		{
+		return false;
+		}
+		
+	const uint32 pixelType = fStage2Image->PixelType ();
+		
+	if (pixelType != ttShort && pixelType != ttFloat)
+		{
+		return false;
+		}
+		
+	// Masks are stored at stage 3 resolution, which a mosaic proxy never
+	// produces.
+	
+	if (fTransparencyMask.Get () ||
+		fRawTransparencyMask.Get () ||
+		fDepthMap.Get () ||
+		fRawDepthMap.Get () ||
+		NumSemanticMasks ())
+		{
+		return false;
+		}
+		
+	// Opcode list 3 still has to run when the proxy is rendered, so it may
+	// only contain opcodes that work in relative image coordinates.
+	
+	for (uint32 index = 0; index < fOpcodeList3.Count (); index++)
+		{
+		
+		switch (fOpcodeList3.Entry (index).OpcodeID ())
+			{
+			
+			case dngOpcode_WarpRectilinear:
+			case dngOpcode_WarpRectilinear2:
+			case dngOpcode_WarpFisheye:
+			case dngOpcode_FixVignetteRadial:
+				break;
+				
+			default:
+				return false;
+				
+			}
+		
+		}
+		
+	// Pick the number of cells to merge in each direction.
+	
+	if (!proxySize)
+		{
+		return false;
+		}
+		
+	real64 cropSide = Max_real64 (DefaultCropSizeH ().As_real64 (),
+								  DefaultCropSizeV ().As_real64 ());
+	
+	uint32 factor = (uint32) ceil (cropSide / (real64) proxySize);
+	
+	if (filter == mosaicProxyBinomial)
+		{
+		
+		uint32 octaves = 1;
+		
+		while (octaves < factor)
+			{
+			octaves <<= 1;
+			}
+			
+		factor = octaves;
+		
+		}
+		
+	const dng_point pattern = info->fCFAPatternSize;
+		
+	if (factor < 2 ||
+		fStage2Image->Height () < (uint32) pattern.v ||
+		fStage2Image->Width	 () < (uint32) pattern.h)
+		{
+		return false;
+		}
+		
+	// Build the proxy data before touching the negative, so a failure
+	// leaves it unchanged.
+		
+	std::shared_ptr<dng_mosaic_proxy_data> data
+		(new dng_mosaic_proxy_data (host,
+									*fStage2Image,
+									pattern,
+									factor,
+									filter == mosaicProxyBinomial));
+									
+	AutoPtr<dng_image> proxyImage (new dng_mosaic_proxy_image (data));
+	
+	AutoPtr<dng_image> rawImage (proxyImage->Clone ());
+	
+	// Remember the full size before changing the crop.
+	
+	SetDefaultOriginalSizes ();
+	
+	// Don't need to keep private data around in proxies.
+	
+	ClearMakerNote ();
+	
+	ClearPrivateData ();
+	
+	// The proxy replaces both the stage 2 image and the saved raw image.
+	// From here on the stage 2 image is only read through the proxy.
+	
+	data->AdoptSource (fStage2Image);
+	
+	fStage2Image.Reset (proxyImage.Release ());
+	
+	fRawImage.Reset (rawImage.Release ());
+	
+	fRawImageStage = rawImageStagePostOpcode2;
+	
+	fRawImageBlackLevel = fStage3BlackLevel;
+	
+	fRawDefaultScaleH.Clear ();
+	fRawDefaultScaleV.Clear ();
+	
+	fRawBestQualityScale.Clear ();
+	
+	fRawDefaultCropSizeH.Clear ();
+	fRawDefaultCropSizeV.Clear ();
+	
+	fRawDefaultCropOriginH.Clear ();
+	fRawDefaultCropOriginV.Clear ();
+	
+	ClearRawJPEGImage ();
+	
+	ClearLinearizationInfo ();
+	
+	fOpcodeList1.Clear ();
+	fOpcodeList2.Clear ();
+	
+	ClearRawImageDigest ();
+	
+	ClearRawJPEGImageDigest ();
+	
+	// Scale the default crop into proxy pixels, keeping it inside the image
+	// when partial cells were dropped at the edges.
+	
+	const dng_rect bounds = fStage2Image->Bounds ();
+	
+	fDefaultCropOriginH = DivideRational (fDefaultCropOriginH, factor);
+	fDefaultCropOriginV = DivideRational (fDefaultCropOriginV, factor);
+	
+	fDefaultCropSizeH = DivideRational (fDefaultCropSizeH, factor);
+	fDefaultCropSizeV = DivideRational (fDefaultCropSizeV, factor);
+	
+	real64 maxSizeH = bounds.W () - fDefaultCropOriginH.As_real64 ();
+	real64 maxSizeV = bounds.H () - fDefaultCropOriginV.As_real64 ();
+	
+	if (fDefaultCropSizeH.As_real64 () > maxSizeH)
+		{
+		fDefaultCropSizeH.Set_real64 (maxSizeH);
+		}
+	
+	if (fDefaultCropSizeV.As_real64 () > maxSizeV)
+		{
+		fDefaultCropSizeV.Set_real64 (maxSizeV);
+		}
+	
+	fRawToFullScaleH = 1.0;
+	fRawToFullScaleV = 1.0;
+	
+	// Don't include separate enhanced image data with proxies.
+	
+	fEnhanceParams.Clear ();
+	
+	// The raw data changed, so the unique ID is found again when the
+	// proxy is saved.
+	
+	fRawDataUniqueID.Clear ();
+	
+	return true;
+	
+	}
+
+/*****************************************************************************/
+
 bool dng_negative::IsProxy () const
 	{
 	
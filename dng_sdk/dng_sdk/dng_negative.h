@@ -33,6 +33,7 @@
 #include "dng_orientation.h"
 #include "dng_rational.h"
 #include "dng_sdk_limits.h"
+#include "dng_stream.h"
 #include "dng_string.h"
 #include "dng_tag_types.h"
 #include "dng_tag_values.h"
@@ -242,6 +243,11 @@ class dng_metadata
 		
 		AutoPtr<dng_memory_block> fMakerNote;
 		
+		// Burst Photo addition: MakerNote in the source stream, used when
+		// fMakerNote is NULL.
+		
+		dng_stream_range fMakerNoteRange;
+		
 		// EXIF data.
 		
 		AutoPtr<dng_exif> fExif;
@@ -262,6 +268,11 @@ class dng_metadata
 		AutoPtr<dng_xmp> fXMP;
 		#endif
 		
+		// Burst Photo addition: original XMP packet, written instead of
+		// fXMP while set.
+		
+		AutoPtr<dng_memory_block> fXMPPacket;
+		
 		// If there a valid embedded XMP block, has is its digest?	NULL if no valid
 		// embedded XMP.
 		
@@ -364,12 +375,29 @@ class dng_metadata
 		void SetMakerNote (AutoPtr<dng_memory_block> &block)
 			{
 			fMakerNote.Reset (block.Release ());
+			fMakerNoteRange = dng_stream_range ();
 			}
 		
 		void ClearMakerNote ()
 			{
 			fIsMakerNoteSafe = false;
 			fMakerNote.Reset ();
+			fMakerNoteRange = dng_stream_range ();
+			}
+		
+		// Burst Photo addition: refer to a MakerNote in a source stream
+		// instead of holding a copy. The stream must outlive any write of
+		// this metadata.
+		
+		void SetMakerNoteRange (const dng_stream_range &range)
+			{
+			fMakerNote.Reset ();
+			fMakerNoteRange = range;
+			}
+		
+		const dng_stream_range & MakerNoteRange () const
+			{
+			return fMakerNoteRange;
 			}
 		
 		const void * MakerNoteData () const
@@ -472,6 +500,23 @@ class dng_metadata
 			
 		#endif	// qDNGUseXMP
 		
+		// Burst Photo addition: opaque XMP packet.
+		//
+		// While a packet is set, it is written to files unchanged in place
+		// of the XMP object, and SynchronizeMetadata and
+		// dng_image_writer::CleanUpMetadata leave the XMP alone. Edits made
+		// through GetXMP are not written; replacing the XMP with SetXMP or
+		// ResetXMP clears the packet.
+		
+		void SetXMPPacket (AutoPtr<dng_memory_block> &block);
+		
+		void ClearXMPPacket ();
+		
+		const dng_memory_block * XMPPacket () const
+			{
+			return fXMPPacket.Get ();
+			}
+		
 		// Synchronize metadata sources.
 		
 		void SynchronizeMetadata ();
@@ -635,6 +680,14 @@ class dng_negative
 			rawImageStagePostOpcode3,
 			rawImageStageNone
 			};
+
+		// Burst Photo addition: filters for ConvertToMosaicProxy.
+
+		enum MosaicProxyFilterEnum
+			{
+			mosaicProxyBox,
+			mosaicProxyBinomial
+			};
 			
     public: // Burst Photo modified (previously was protected)
 	
@@ -888,6 +941,11 @@ class dng_negative
 		
 		AutoPtr<dng_memory_block> fDNGPrivateData;
 		
+		// Burst Photo addition: DNG private data in the source stream, used
+		// when fDNGPrivateData is NULL.
+		
+		dng_stream_range fDNGPrivateDataRange;
+		
 		// Metadata information (XMP, IPTC, EXIF, orientation)
 	
 		dng_metadata fMetadata;
@@ -2228,11 +2286,28 @@ class dng_negative
 		void SetPrivateData (AutoPtr<dng_memory_block> &block)
 			{
 			fDNGPrivateData.Reset (block.Release ());
+			fDNGPrivateDataRange = dng_stream_range ();
 			}
 		
 		void ClearPrivateData ()
 			{
 			fDNGPrivateData.Reset ();
+			fDNGPrivateDataRange = dng_stream_range ();
+			}
+		
+		// Burst Photo addition: refer to DNG private data in a source stream
+		// instead of holding a copy. The stream must outlive any write of
+		// this negative.
+		
+		void SetPrivateDataRange (const dng_stream_range &range)
+			{
+			fDNGPrivateData.Reset ();
+			fDNGPrivateDataRange = range;
+			}
+		
+		const dng_stream_range & PrivateDataRange () const
+			{
+			return fDNGPrivateDataRange;
 			}
 		
 		const uint8 * PrivateData () const
@@ -2784,6 +2859,20 @@ class dng_negative
 							 dng_image_writer &writer,
 							 uint32 proxySize = 0,
 							 uint64 proxyCount = 0);
+
+		// Burst Photo addition: convert to a proxy negative that is still a
+		// CFA image. Must be called after BuildStage2Image and before
+		// BuildStage3Image. Every CFA phase of the stage 2 image is
+		// downsampled by a whole number of mosaic cells, so the proxy keeps
+		// the original pattern and is never demosaiced. The pixels are
+		// computed a band at a time when first read, which lets the DNG
+		// writer downsample and encode each tile in one pass. Returns false,
+		// leaving the negative untouched, if the negative cannot be converted
+		// this way; the caller should then fall back to ConvertToProxy.
+
+		bool ConvertToMosaicProxy (dng_host &host,
+								   uint32 proxySize,
+								   MosaicProxyFilterEnum filter = mosaicProxyBox);
 		
 		// IsProxy API:
 		
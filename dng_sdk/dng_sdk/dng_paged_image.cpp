@@ -0,0 +1,863 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+#include "dng_paged_image.h"
+
+#include "dng_bottlenecks.h"
+#include "dng_exceptions.h"
+#include "dng_file_stream.h"
+#include "dng_mutex.h"
+#include "dng_orientation.h"
+#include "dng_safe_arithmetic.h"
+#include "dng_tag_types.h"
+#include "dng_tag_values.h"
+#include "dng_tile_iterator.h"
+#include "dng_uncopyable.h"
+#include "dng_utils.h"
+
+#include <list>
+#include <vector>
+
+/*****************************************************************************/
+
+// Resident tiles, LRU order and the scratch file of a dng_paged_image. Tiles
+// are locked while a tile buffer or a Get/Put uses them, and only unlocked
+// tiles are paged out. All file I/O happens inside Lock, under fMutex, so
+// Unlock never fails.
+
+class dng_paged_tile_cache: private dng_uncopyable
+	{
+
+	private:
+
+		struct tile_entry
+			{
+
+			dng_memory_block *fMemory;
+
+			uint32 fRefCount;
+
+			bool fDirty;
+
+			bool fOnDisk;
+
+			std::list<uint32>::iterator fLRUEntry;
+
+			tile_entry ()
+				:	fMemory	  (NULL)
+				,	fRefCount (0)
+				,	fDirty	  (false)
+				,	fOnDisk	  (false)
+				,	fLRUEntry ()
+				{
+				}
+
+			};
+
+		dng_memory_allocator &fAllocator;
+
+		const uint32 fTilesAcross;
+
+		const uint32 fTileBytes;
+
+		const uint64 fCacheBytes;
+
+		std::vector<tile_entry> fTiles;
+
+		// Resident tiles, most recently used first.
+
+		std::list<uint32> fLRU;
+
+		uint64 fResidentBytes;
+
+		AutoPtr<dng_file_stream> fScratch;
+
+		uint64 fPageIns;
+		uint64 fPageOuts;
+
+		dng_std_mutex fMutex;
+
+	public:
+
+		dng_paged_tile_cache (dng_memory_allocator &allocator,
+							  uint32 tilesDown,
+							  uint32 tilesAcross,
+							  uint32 tileBytes,
+							  uint64 cacheBytes)
+
+			:	fAllocator	   (allocator)
+			,	fTilesAcross   (tilesAcross)
+			,	fTileBytes	   (tileBytes)
+			,	fCacheBytes	   (cacheBytes)
+			,	fTiles		   (SafeUint32Mult (tilesDown, tilesAcross))
+			,	fLRU		   ()
+			,	fResidentBytes (0)
+			,	fScratch	   ()
+			,	fPageIns	   (0)
+			,	fPageOuts	   (0)
+			,	fMutex		   ()
+
+			{
+
+			}
+
+		~dng_paged_tile_cache ()
+			{
+
+			for (size_t index = 0; index < fTiles.size (); index++)
+				{
+				delete fTiles [index].fMemory;
+				}
+
+			}
+
+		uint32 TileBytes () const
+			{
+			return fTileBytes;
+			}
+
+		uint32 TileIndex (uint32 tileRow,
+						  uint32 tileCol) const
+			{
+			return tileRow * fTilesAcross + tileCol;
+			}
+
+		uint64 PageIns ()
+			{
+			dng_lock_std_mutex lock (fMutex);
+			return fPageIns;
+			}
+
+		uint64 PageOuts ()
+			{
+			dng_lock_std_mutex lock (fMutex);
+			return fPageOuts;
+			}
+
+		/// Make a tile resident and lock it. If load is false the caller is
+		/// about to overwrite the whole tile, so its old contents are not
+		/// read back.
+
+		uint8 * Lock (uint32 index,
+					  bool load);
+
+		/// Unlock a tile locked by Lock, marking it modified if dirty.
+
+		void Unlock (uint32 index,
+					 bool dirty);
+
+	private:
+
+		void PageOut (uint32 index);
+
+	};
+
+/*****************************************************************************/
+
+uint8 * dng_paged_tile_cache::Lock (uint32 index,
+									bool load)
+	{
+
+	dng_lock_std_mutex lock (fMutex);
+
+	tile_entry &entry = fTiles [index];
+
+	if (entry.fMemory)
+		{
+
+		fLRU.splice (fLRU.begin (), fLRU, entry.fLRUEntry);
+
+		entry.fRefCount++;
+
+		return entry.fMemory->Buffer_uint8 ();
+
+		}
+
+	// Page out least recently used tiles to stay within the budget. If
+	// every resident tile is locked the cache grows past the budget rather
+	// than blocking.
+
+	std::list<uint32>::iterator victim = fLRU.end ();
+
+	while (fResidentBytes + fTileBytes > fCacheBytes &&
+		   victim != fLRU.begin ())
+		{
+
+		--victim;
+
+		uint32 victimIndex = *victim;
+
+		if (fTiles [victimIndex].fRefCount == 0)
+			{
+
+			PageOut (victimIndex);
+
+			victim = fLRU.erase (victim);
+
+			}
+
+		}
+
+	AutoPtr<dng_memory_block> memory (fAllocator.Allocate (fTileBytes));
+
+	if (load && entry.fOnDisk)
+		{
+
+		fScratch->SetReadPosition ((uint64) index * fTileBytes);
+
+		fScratch->Get (memory->Buffer (), fTileBytes);
+
+		fPageIns++;
+
+		}
+
+	else if (load)
+		{
+
+		DoZeroBytes (memory->Buffer (), fTileBytes);
+
+		}
+
+	fLRU.push_front (index);
+
+	entry.fLRUEntry = fLRU.begin ();
+
+	entry.fMemory = memory.Release ();
+
+	entry.fRefCount = 1;
+
+	entry.fDirty = !load;
+
+	fResidentBytes += fTileBytes;
+
+	return entry.fMemory->Buffer_uint8 ();
+
+	}
+
+/*****************************************************************************/
+
+void dng_paged_tile_cache::Unlock (uint32 index,
+								   bool dirty)
+	{
+
+	dng_lock_std_mutex lock (fMutex);
+
+	tile_entry &entry = fTiles [index];
+
+	DNG_ASSERT (entry.fRefCount > 0, "Unlocking a tile that is not locked");
+
+	entry.fRefCount--;
+
+	entry.fDirty = entry.fDirty || dirty;
+
+	}
+
+/*****************************************************************************/
+
+void dng_paged_tile_cache::PageOut (uint32 index)
+	{
+
+	tile_entry &entry = fTiles [index];
+
+	if (entry.fDirty)
+		{
+
+		if (!fScratch.Get ())
+			{
+
+			FILE *file = tmpfile ();
+
+			if (!file)
+				{
+				ThrowOpenFile ("Unable to create scratch file for paged image");
+				}
+
+			fScratch.Reset (new dng_file_stream (file));
+
+			}
+
+		fScratch->SetWritePosition ((uint64) index * fTileBytes);
+
+		fScratch->Put (entry.fMemory->Buffer (), fTileBytes);
+
+		fScratch->Flush ();
+
+		entry.fOnDisk = true;
+
+		entry.fDirty = false;
+
+		fPageOuts++;
+
+		}
+
+	delete entry.fMemory;
+
+	entry.fMemory = NULL;
+
+	fResidentBytes -= fTileBytes;
+
+	}
+
+/*****************************************************************************/
+
+// Attached to a dng_tile_buffer by AcquireTileBuffer. Records which tiles
+// are locked and, for areas spanning several tiles, the temporary buffer.
+
+class dng_paged_tile_ref: private dng_uncopyable
+	{
+
+	public:
+
+		uint32 fRow0;
+		uint32 fRow1;
+		uint32 fCol0;
+		uint32 fCol1;
+
+		AutoPtr<dng_memory_block> fTemp;
+
+	public:
+
+		dng_paged_tile_ref ()
+			:	fRow0 (0)
+			,	fRow1 (0)
+			,	fCol0 (0)
+			,	fCol1 (0)
+			,	fTemp ()
+			{
+			}
+
+	};
+
+/*****************************************************************************/
+
+dng_paged_image::dng_paged_image (const dng_rect &bounds,
+								  uint32 planes,
+								  uint32 pixelType,
+								  uint64 cacheBytes,
+								  dng_memory_allocator &allocator,
+								  const dng_point &tileSize)
+
+	:	dng_image (bounds,
+				   planes,
+				   pixelType)
+
+	,	fAllocator	(allocator)
+	,	fCacheBytes (cacheBytes)
+	,	fTileSize	(tileSize)
+	,	fOrigin		(bounds.TL ())
+	,	fCache		()
+
+	{
+
+	if (tileSize.v <= 0 || tileSize.h <= 0)
+		{
+		ThrowProgramError ("Bad tile size for dng_paged_image");
+		}
+
+	uint32 tilesDown   = (bounds.H () + tileSize.v - 1) / tileSize.v;
+	uint32 tilesAcross = (bounds.W () + tileSize.h - 1) / tileSize.h;
+
+	uint32 tileBytes = SafeUint32Mult ((uint32) tileSize.v,
+									   (uint32) tileSize.h,
+									   planes,
+									   PixelSize ());
+
+	fCache.Reset (new dng_paged_tile_cache (allocator,
+											tilesDown,
+											tilesAcross,
+											tileBytes,
+											cacheBytes));
+
+	}
+
+/*****************************************************************************/
+
+dng_paged_image::~dng_paged_image ()
+	{
+
+	}
+
+/*****************************************************************************/
+
+dng_image * dng_paged_image::Clone () const
+	{
+
+	AutoPtr<dng_paged_image> result (new dng_paged_image (Bounds (),
+														  Planes (),
+														  PixelType (),
+														  fCacheBytes,
+														  fAllocator,
+														  fTileSize));
+
+	result->CopyArea (*this,
+					  Bounds (),
+					  0,
+					  Planes ());
+
+	return result.Release ();
+
+	}
+
+/*****************************************************************************/
+
+dng_rect dng_paged_image::TileArea (uint32 tileRow,
+									uint32 tileCol) const
+	{
+
+	dng_rect area;
+
+	area.t = fOrigin.v + (int32) tileRow * fTileSize.v;
+	area.l = fOrigin.h + (int32) tileCol * fTileSize.h;
+
+	area.b = area.t + fTileSize.v;
+	area.r = area.l + fTileSize.h;
+
+	return area;
+
+	}
+
+/*****************************************************************************/
+
+dng_rect dng_paged_image::RepeatingTile () const
+	{
+
+	return TileArea ((uint32) (fBounds.t - fOrigin.v) / fTileSize.v,
+					 (uint32) (fBounds.l - fOrigin.h) / fTileSize.h);
+
+	}
+
+/*****************************************************************************/
+
+void dng_paged_image::Trim (const dng_rect &r)
+	{
+
+	fOrigin = fOrigin - r.TL ();
+
+	fBounds.t = 0;
+	fBounds.l = 0;
+
+	fBounds.b = r.H ();
+	fBounds.r = r.W ();
+
+	}
+
+/*****************************************************************************/
+
+void dng_paged_image::Offset (const dng_point &offset)
+	{
+
+	fBounds = fBounds + offset;
+
+	fOrigin = fOrigin + offset;
+
+	}
+
+/*****************************************************************************/
+
+uint64 dng_paged_image::PageIns () const
+	{
+
+	return fCache->PageIns ();
+
+	}
+
+/*****************************************************************************/
+
+uint64 dng_paged_image::PageOuts () const
+	{
+
+	return fCache->PageOuts ();
+
+	}
+
+/*****************************************************************************/
+
+void dng_paged_image::Rotate (const dng_orientation &orientation)
+	{
+
+	if (orientation == dng_orientation::Normal ())
+		{
+		return;
+		}
+
+	const bool flipD = orientation.FlipD ();
+
+	dng_rect dstBounds = fBounds;
+
+	if (flipD)
+		{
+		dstBounds.b = dstBounds.t + fBounds.W ();
+		dstBounds.r = dstBounds.l + fBounds.H ();
+		}
+
+	dng_paged_image dstImage (dstBounds,
+							  fPlanes,
+							  fPixelType,
+							  fCacheBytes,
+							  fAllocator,
+							  fTileSize);
+
+	dng_rect dstTile;
+
+	dng_tile_iterator iter (dstImage, dstBounds);
+
+	while (iter.GetOneTile (dstTile))
+		{
+
+		// Source rows and columns covered by this destination tile, in
+		// coordinates relative to the image origin.
+
+		int32 rows0 = dstTile.t - dstBounds.t;
+		int32 rows1 = dstTile.b - dstBounds.t;
+		int32 cols0 = dstTile.l - dstBounds.l;
+		int32 cols1 = dstTile.r - dstBounds.l;
+
+		if (flipD)
+			{
+
+			int32 temp0 = rows0;
+			int32 temp1 = rows1;
+
+			rows0 = cols0;
+			rows1 = cols1;
+
+			cols0 = temp0;
+			cols1 = temp1;
+
+			}
+
+		if (orientation.FlipV ())
+			{
+			int32 temp = rows0;
+			rows0 = fBounds.H () - rows1;
+			rows1 = fBounds.H () - temp;
+			}
+
+		if (orientation.FlipH ())
+			{
+			int32 temp = cols0;
+			cols0 = fBounds.W () - cols1;
+			cols1 = fBounds.W () - temp;
+			}
+
+		dng_rect srcArea (fBounds.t + rows0,
+						  fBounds.l + cols0,
+						  fBounds.t + rows1,
+						  fBounds.l + cols1);
+
+		AutoPtr<dng_memory_block> block (fAllocator.Allocate (fCache->TileBytes ()));
+
+		dng_pixel_buffer srcBuffer (srcArea,
+									0,
+									fPlanes,
+									fPixelType,
+									pcInterleaved,
+									block->Buffer ());
+
+		Get (srcBuffer);
+
+		// View the source buffer in the destination orientation, in the
+		// same way as dng_simple_image::Rotate.
+
+		dng_pixel_buffer dstBuffer (srcBuffer);
+
+		int32 originV = srcArea.t;
+		int32 originH = srcArea.l;
+
+		if (orientation.FlipH ())
+			{
+			originH = srcArea.r - 1;
+			dstBuffer.fColStep = -dstBuffer.fColStep;
+			}
+
+		if (orientation.FlipV ())
+			{
+			originV = srcArea.b - 1;
+			dstBuffer.fRowStep = -dstBuffer.fRowStep;
+			}
+
+		if (flipD)
+			{
+
+			int32 temp = dstBuffer.fColStep;
+
+			dstBuffer.fColStep = dstBuffer.fRowStep;
+			dstBuffer.fRowStep = temp;
+
+			}
+
+		dstBuffer.fData = srcBuffer.DirtyPixel (originV, originH);
+
+		dstBuffer.fArea = dstTile;
+
+		dstImage.Put (dstBuffer);
+
+		}
+
+	fCache.Reset (dstImage.fCache.Release ());
+
+	fOrigin = dstImage.fOrigin;
+
+	fBounds = dstBounds;
+
+	}
+
+/*****************************************************************************/
+
+void dng_paged_image::AcquireTileBuffer (dng_tile_buffer &buffer,
+										 const dng_rect &area,
+										 bool dirty) const
+	{
+
+	AutoPtr<dng_paged_tile_ref> ref (new dng_paged_tile_ref);
+
+	ref->fRow0 = (uint32) (area.t - fOrigin.v	  ) / fTileSize.v;
+	ref->fRow1 = (uint32) (area.b - fOrigin.v - 1) / fTileSize.v;
+	ref->fCol0 = (uint32) (area.l - fOrigin.h	  ) / fTileSize.h;
+	ref->fCol1 = (uint32) (area.r - fOrigin.h - 1) / fTileSize.h;
+
+	// Lock every tile the area touches, releasing them again on failure.
+
+	uint32 locked = 0;
+
+	try
+		{
+
+		for (uint32 row = ref->fRow0; row <= ref->fRow1; row++)
+			{
+
+			for (uint32 col = ref->fCol0; col <= ref->fCol1; col++)
+				{
+
+				uint8 *data = fCache->Lock (fCache->TileIndex (row, col), true);
+
+				locked++;
+
+				if (ref->fRow0 == ref->fRow1 && ref->fCol0 == ref->fCol1)
+					{
+
+					(dng_pixel_buffer &) buffer = dng_pixel_buffer (TileArea (row, col),
+																	0,
+																	fPlanes,
+																	fPixelType,
+																	pcInterleaved,
+																	data);
+
+					}
+
+				}
+
+			}
+
+		}
+
+	catch (...)
+		{
+
+		for (uint32 row = ref->fRow0; row <= ref->fRow1 && locked; row++)
+			{
+			for (uint32 col = ref->fCol0; col <= ref->fCol1 && locked; col++, locked--)
+				{
+				fCache->Unlock (fCache->TileIndex (row, col), false);
+				}
+			}
+
+		throw;
+
+		}
+
+	if (ref->fRow0 != ref->fRow1 || ref->fCol0 != ref->fCol1)
+		{
+
+		uint32 bytes = ComputeBufferSize (fPixelType,
+										  area.Size (),
+										  fPlanes,
+										  padNone);
+
+		ref->fTemp.Reset (fAllocator.Allocate (bytes));
+
+		(dng_pixel_buffer &) buffer = dng_pixel_buffer (area,
+														0,
+														fPlanes,
+														fPixelType,
+														pcInterleaved,
+														ref->fTemp->Buffer ());
+
+		for (uint32 row = ref->fRow0; row <= ref->fRow1; row++)
+			{
+
+			for (uint32 col = ref->fCol0; col <= ref->fCol1; col++)
+				{
+
+				// The tile is locked, so this Lock only bumps its count.
+
+				uint32 index = fCache->TileIndex (row, col);
+
+				dng_rect tileArea = TileArea (row, col);
+
+				dng_pixel_buffer tileBuffer (tileArea,
+											 0,
+											 fPlanes,
+											 fPixelType,
+											 pcInterleaved,
+											 fCache->Lock (index, true));
+
+				buffer.CopyArea (tileBuffer,
+								 tileArea & area,
+								 0,
+								 fPlanes);
+
+				fCache->Unlock (index, false);
+
+				}
+
+			}
+
+		}
+
+	buffer.fData  = buffer.DirtyPixel (area.t, area.l, 0);
+	buffer.fArea  = area;
+	buffer.fDirty = dirty;
+
+	buffer.SetRefData (ref.Release ());
+
+	}
+
+/*****************************************************************************/
+
+void dng_paged_image::ReleaseTileBuffer (dng_tile_buffer &buffer) const
+	{
+
+	dng_paged_tile_ref *ref = (dng_paged_tile_ref *) buffer.GetRefData ();
+
+	if (!ref)
+		{
+		return;
+		}
+
+	for (uint32 row = ref->fRow0; row <= ref->fRow1; row++)
+		{
+
+		for (uint32 col = ref->fCol0; col <= ref->fCol1; col++)
+			{
+
+			uint32 index = fCache->TileIndex (row, col);
+
+			if (ref->fTemp.Get () && buffer.fDirty)
+				{
+
+				dng_rect tileArea = TileArea (row, col);
+
+				dng_pixel_buffer tileBuffer (tileArea,
+											 0,
+											 fPlanes,
+											 fPixelType,
+											 pcInterleaved,
+											 fCache->Lock (index, true));
+
+				tileBuffer.fDirty = true;
+
+				tileBuffer.CopyArea (buffer,
+									 tileArea & buffer.fArea,
+									 0,
+									 fPlanes);
+
+				fCache->Unlock (index, false);
+
+				}
+
+			fCache->Unlock (index, buffer.fDirty);
+
+			}
+
+		}
+
+	delete ref;
+
+	buffer.SetRefData (NULL);
+
+	}
+
+/*****************************************************************************/
+
+void dng_paged_image::DoGet (dng_pixel_buffer &buffer) const
+	{
+
+	dng_rect tile;
+
+	dng_tile_iterator iter (*this, buffer.fArea);
+
+	while (iter.GetOneTile (tile))
+		{
+
+		uint32 row = (uint32) (tile.t - fOrigin.v) / fTileSize.v;
+		uint32 col = (uint32) (tile.l - fOrigin.h) / fTileSize.h;
+
+		uint32 index = fCache->TileIndex (row, col);
+
+		dng_pixel_buffer tileBuffer (TileArea (row, col),
+									 0,
+									 fPlanes,
+									 fPixelType,
+									 pcInterleaved,
+									 fCache->Lock (index, true));
+
+		buffer.CopyArea (tileBuffer,
+						 tile,
+						 buffer.fPlane,
+						 buffer.fPlanes);
+
+		fCache->Unlock (index, false);
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+void dng_paged_image::DoPut (const dng_pixel_buffer &buffer)
+	{
+
+	dng_rect tile;
+
+	dng_tile_iterator iter (*this, buffer.fArea);
+
+	while (iter.GetOneTile (tile))
+		{
+
+		uint32 row = (uint32) (tile.t - fOrigin.v) / fTileSize.v;
+		uint32 col = (uint32) (tile.l - fOrigin.h) / fTileSize.h;
+
+		uint32 index = fCache->TileIndex (row, col);
+
+		dng_rect tileArea = TileArea (row, col);
+
+		// Skip reading the old contents if every plane of the whole tile,
+		// as far as it lies inside the image, is replaced.
+
+		bool load = (tile != (tileArea & Bounds ())) ||
+					buffer.fPlane != 0 ||
+					buffer.fPlanes != fPlanes;
+
+		dng_pixel_buffer tileBuffer (tileArea,
+									 0,
+									 fPlanes,
+									 fPixelType,
+									 pcInterleaved,
+									 fCache->Lock (index, load));
+
+		tileBuffer.fDirty = true;
+
+		tileBuffer.CopyArea (buffer,
+							 tile,
+							 buffer.fPlane,
+							 buffer.fPlanes);
+
+		fCache->Unlock (index, true);
+
+		}
+
+	}
+
+/*****************************************************************************/
@@ -0,0 +1,130 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+/** \file
+ * Tiled dng_image that keeps only part of its pixels in memory.
+ */
+
+/*****************************************************************************/
+
+#ifndef __dng_paged_image__
+#define __dng_paged_image__
+
+/*****************************************************************************/
+
+#include "dng_auto_ptr.h"
+#include "dng_image.h"
+#include "dng_memory.h"
+
+/*****************************************************************************/
+
+class dng_paged_tile_cache;
+
+/*****************************************************************************/
+
+/// \brief dng_image derived class for images too large to hold in memory.
+///
+/// The pixels are stored in fixed-size tiles. At most about cacheBytes of
+/// tiles are kept in memory. The least recently used unlocked tile is paged
+/// out to an anonymous scratch file when a new tile is needed. Tiles that
+/// were never written read as zero. Tile buffers that cover several tiles
+/// are assembled in a temporary buffer. All tiles they touch stay locked
+/// until the buffer is released.
+
+class dng_paged_image : public dng_image
+	{
+
+	protected:
+
+		dng_memory_allocator &fAllocator;
+
+		uint64 fCacheBytes;
+
+		dng_point fTileSize;
+
+		// Image coordinates of the top left corner of the tile grid. Trim
+		// and Offset move this instead of touching the tiles.
+
+		dng_point fOrigin;
+
+		AutoPtr<dng_paged_tile_cache> fCache;
+
+	public:
+
+		/// Create a paged image.
+		/// \param bounds Bounds of the image.
+		/// \param planes Number of planes.
+		/// \param pixelType Pixel type (TIFF tag type code).
+		/// \param cacheBytes Approximate amount of tile memory to keep resident.
+		/// \param allocator Allocator for tile memory.
+		/// \param tileSize Size of one tile, in pixels.
+
+		dng_paged_image (const dng_rect &bounds,
+						 uint32 planes,
+						 uint32 pixelType,
+						 uint64 cacheBytes,
+						 dng_memory_allocator &allocator = gDefaultDNGMemoryAllocator,
+						 const dng_point &tileSize = dng_point (256, 256));
+
+		virtual ~dng_paged_image ();
+
+		virtual dng_image * Clone () const;
+
+		virtual dng_rect RepeatingTile () const;
+
+		virtual void Trim (const dng_rect &r);
+
+		/// Rotate image according to orientation. The pixels are copied into a
+		/// new set of tiles, so the result is always stored in natural order.
+
+		virtual void Rotate (const dng_orientation &orientation);
+
+		virtual void Offset (const dng_point &offset);
+
+		/// Getter for the resident tile memory limit.
+
+		uint64 CacheBytes () const
+			{
+			return fCacheBytes;
+			}
+
+		/// Getter for the tile size.
+
+		const dng_point & TileSize () const
+			{
+			return fTileSize;
+			}
+
+		/// Number of tiles read back from the scratch file so far.
+
+		uint64 PageIns () const;
+
+		/// Number of tiles written to the scratch file so far.
+
+		uint64 PageOuts () const;
+
+	protected:
+
+		virtual void AcquireTileBuffer (dng_tile_buffer &buffer,
+										const dng_rect &area,
+										bool dirty) const;
+
+		virtual void ReleaseTileBuffer (dng_tile_buffer &buffer) const;
+
+		virtual void DoGet (dng_pixel_buffer &buffer) const;
+
+		virtual void DoPut (const dng_pixel_buffer &buffer);
+
+		/// Rectangle of the given tile, in image coordinates.
+
+		dng_rect TileArea (uint32 tileRow,
+						   uint32 tileCol) const;
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
@@ -36,6 +36,7 @@
 #endif
 
 #include <limits>
+#include <vector>
 
 /******************************************************************************/
 
@@ -1152,9 +1153,52 @@ void dng_image_spooler::Spool (const void *data,
 
 /*****************************************************************************/
 
+#if qDNGUseLibJPEG
+class dng_lossy_jpeg_decoder;
+#endif
+
+// Burst Photo addition: free list of lossy JPEG decompressors. Creating a
+// libjpeg decompressor allocates and initializes its memory pools and
+// module tables, so each thread reading tiles takes one from here and
+// returns it when the tile is done.
+
+class dng_lossy_jpeg_decoder_cache: private dng_uncopyable
+	{
+
+	private:
+
+		#if qDNGUseLibJPEG
+
+		dng_std_mutex fMutex;
+
+		std::vector<dng_lossy_jpeg_decoder *> fDecoders;
+
+		#endif
+
+	public:
+
+		dng_lossy_jpeg_decoder_cache ()
+			{
+			}
+
+		~dng_lossy_jpeg_decoder_cache ();
+
+		#if qDNGUseLibJPEG
+
+		dng_lossy_jpeg_decoder * Acquire ();
+
+		void Release (dng_lossy_jpeg_decoder *decoder);
+
+		#endif
+
+	};
+
+/*****************************************************************************/
+
 dng_read_image::dng_read_image ()
 
 	:	fJPEGTables ()
+	,	fLossyJPEGDecoders (new dng_lossy_jpeg_decoder_cache)
 	
 	{
 	
@@ -1511,149 +1555,313 @@ static void dng_output_message (j_common_ptr cinfo)
 
 /*****************************************************************************/
 
-#endif
+// Burst Photo addition: a libjpeg decompressor that is created once and then
+// used for any number of tiles. jpeg_finish_decompress only frees the
+// per-image memory pool, so the permanent pool and the error manager stay
+// set up between tiles.
+
+class dng_lossy_jpeg_decoder: private dng_uncopyable
+	{
+
+	private:
+
+		enum
+			{
+
+			// Target size for the decoded band copied to the image at once.
+
+			kBandBufferSize = 1024 * 1024
+
+			};
+
+		struct jpeg_decompress_struct fInfo;
+
+		struct jpeg_error_mgr fError;
+
+		AutoPtr<dng_memory_block> fBuffer;
+
+		std::vector<JSAMPROW> fRows;
+
+	public:
+
+		dng_lossy_jpeg_decoder ()
+			{
+
+			fInfo.err = jpeg_std_error (&fError);
+
+			fError.error_exit	  = dng_error_exit;
+			fError.output_message = dng_output_message;
+
+			jpeg_create_decompress (&fInfo);
+
+			}
+
+		~dng_lossy_jpeg_decoder ()
+			{
+
+			jpeg_destroy_decompress (&fInfo);
+
+			}
+
+		void Decode (dng_host &host,
+					 dng_image &image,
+					 const dng_rect &tileArea,
+					 uint32 plane,
+					 uint32 planes,
+					 uint32 jpegDataSize,
+					 uint8 *jpegDataInMemory);
+
+	};
 
 /*****************************************************************************/
 
-void dng_read_image::DecodeLossyJPEG (dng_host &host,
-									  dng_image &image,
-									  const dng_rect &tileArea,
-									  uint32 plane,
-									  uint32 planes,
-									  uint32 /* photometricInterpretation */,
-									  uint32 jpegDataSize,
-									  uint8 *jpegDataInMemory,
-									  bool /* usingMultipleThreads */)
+void dng_lossy_jpeg_decoder::Decode (dng_host &host,
+									 dng_image &image,
+									 const dng_rect &tileArea,
+									 uint32 plane,
+									 uint32 planes,
+									 uint32 jpegDataSize,
+									 uint8 *jpegDataInMemory)
 	{
 	
-	#if qDNGUseLibJPEG
+	// Set up the memory data source manager.
 	
-	struct jpeg_decompress_struct cinfo;
+	size_t jpegDataSizeAsSizet = 0;
 	
-	// Setup the error manager.
-	
-	struct jpeg_error_mgr jerr;
+	ConvertUnsigned (jpegDataSize, &jpegDataSizeAsSizet);
 
-	cinfo.err = jpeg_std_error (&jerr);
-	
-	jerr.error_exit		= dng_error_exit;
-	jerr.output_message = dng_output_message;
-	
-	try
-		{
-		
-		// Create the decompression context.
+	jpeg_source_mgr memorySource =
+		CreateJpegMemorySource (jpegDataInMemory,
+								jpegDataSizeAsSizet);
 
-		jpeg_create_decompress (&cinfo);
+	fInfo.src = &memorySource;
 		
-		// Set up the memory data source manager.
+	// Read the JPEG header.
 		
-		size_t jpegDataSizeAsSizet = 0;
-		
-		ConvertUnsigned (jpegDataSize, &jpegDataSizeAsSizet);
+	jpeg_read_header (&fInfo, TRUE);
+	
+	// Check header.
+	
+		{
 
-		jpeg_source_mgr memorySource =
-			CreateJpegMemorySource (jpegDataInMemory,
-									jpegDataSizeAsSizet);
+		// Number of components may not be negative.
 
-		cinfo.src = &memorySource;
-			
-		// Read the JPEG header.
-			
-		jpeg_read_header (&cinfo, TRUE);
-		
-		// Check header.
-		
+		if (fInfo.num_components < 0)
 			{
+			ThrowBadFormat ("invalid cinfo.num_components");
+			}
+		
+		// Convert relevant values from header to uint32.
 
-			// Number of components may not be negative.
+		uint32 imageWidthAsUint32	 = 0;
+		uint32 imageHeightAsUint32	 = 0;
+		uint32 numComponentsAsUint32 = 0;
 
-			if (cinfo.num_components < 0)
-				{
-				ThrowBadFormat ("invalid cinfo.num_components");
-				}
-			
-			// Convert relevant values from header to uint32.
+		ConvertUnsigned (fInfo.image_width,	 &imageWidthAsUint32);
+		ConvertUnsigned (fInfo.image_height, &imageHeightAsUint32);
 
-			uint32 imageWidthAsUint32	 = 0;
-			uint32 imageHeightAsUint32	 = 0;
-			uint32 numComponentsAsUint32 = 0;
+		// num_components is an int. Casting to unsigned is safe because
+		// the test above guarantees num_components is not negative.
 
-			ConvertUnsigned (cinfo.image_width,	 &imageWidthAsUint32);
-			ConvertUnsigned (cinfo.image_height, &imageHeightAsUint32);
-
-			// num_components is an int. Casting to unsigned is safe because
-			// the test above guarantees num_components is not negative.
+		ConvertUnsigned (static_cast<unsigned> (fInfo.num_components),
+						 &numComponentsAsUint32);
+		
+		// Check that dimensions of JPEG correspond to dimensions of tile.
 
-			ConvertUnsigned (static_cast<unsigned> (cinfo.num_components),
-							 &numComponentsAsUint32);
-			
-			// Check that dimensions of JPEG correspond to dimensions of tile.
+		if (imageWidthAsUint32	  != tileArea.W () ||
+			imageHeightAsUint32	  != tileArea.H () ||
+			numComponentsAsUint32 != planes)
+			{
+			ThrowBadFormat ("JPEG dimensions do not match tile");
+			}
 
-			if (imageWidthAsUint32	  != tileArea.W () ||
-				imageHeightAsUint32	  != tileArea.H () ||
-				numComponentsAsUint32 != planes)
-				{
-				ThrowBadFormat ("JPEG dimensions do not match tile");
-				}
+		}
+		
+	// Start the decompression.
+	
+	jpeg_start_decompress (&fInfo);
+	
+	// Decode a band of scanlines at a time, rather than one, so the image
+	// is only touched a few times per tile. Most tiles fit in one band.
+	
+	dng_pixel_buffer buffer (tileArea, 
+							 plane, 
+							 planes, 
+							 ttByte, 
+							 pcInterleaved,
+							 NULL);
 
-			}
-			
-		// Start the compression.
+	uint32 rowBytes = (uint32) buffer.fRowStep;
+	
+	uint32 bandRows = Pin_uint32 (1,
+								  kBandBufferSize / Max_uint32 (rowBytes, 1),
+								  tileArea.H ());
+	
+	uint32 bandBytes = SafeUint32Mult (bandRows, rowBytes);
+	
+	if (!fBuffer.Get () || fBuffer->LogicalSize () < bandBytes)
+		{
 		
-		jpeg_start_decompress (&cinfo);
+		fBuffer.Reset ();
 		
-		// Setup a one-scanline size buffer.
+		fBuffer.Reset (host.Allocate (bandBytes));
 		
-		dng_pixel_buffer buffer (tileArea, 
-								 plane, 
-								 planes, 
-								 ttByte, 
-								 pcInterleaved,
-								 NULL);
-
-		buffer.fArea.b = tileArea.t + 1;
+		}
 		
-		buffer.fDirty = true;
+	if (fRows.size () < bandRows)
+		{
+		fRows.resize (bandRows);
+		}
 		
-		AutoPtr<dng_memory_block> bufferData (host.Allocate (buffer.fRowStep));
+	for (uint32 row = 0; row < bandRows; row++)
+		{
+		fRows [row] = fBuffer->Buffer_uint8 () + row * rowBytes;
+		}
+	
+	buffer.fData = fBuffer->Buffer ();
+	
+	buffer.fDirty = true;
+	
+	buffer.fArea.b = tileArea.t;
+	
+	while (buffer.fArea.b < tileArea.b)
+		{
 		
-		buffer.fData = bufferData->Buffer ();
+		buffer.fArea.t = buffer.fArea.b;
+		buffer.fArea.b = Min_int32 (buffer.fArea.t + (int32) bandRows,
+									tileArea.b);
 		
-		uint8 *sampArray [1];
+		uint32 rows = (uint32) buffer.fArea.H ();
 		
-		sampArray [0] = bufferData->Buffer_uint8 ();
+		uint32 done = 0;
 		
-		// Read each scanline and save to image.
+		while (done < rows)
+			{
+			
+			uint32 count = jpeg_read_scanlines (&fInfo,
+												&fRows [done],
+												rows - done);
 			
-		while (buffer.fArea.t < tileArea.b)
+			if (count == 0)
+				{
+				ThrowBadFormat ();
+				}
+				
+			done += count;
+			
+			}
+		
+		image.Put (buffer);
+		
+		}
+		
+	// Cleanup.
+		
+	jpeg_finish_decompress (&fInfo);
+	
+	fInfo.src = NULL;
+	
+	}
+
+/*****************************************************************************/
+
+dng_lossy_jpeg_decoder * dng_lossy_jpeg_decoder_cache::Acquire ()
+	{
+	
+		{
+		
+		dng_lock_std_mutex lock (fMutex);
+		
+		if (!fDecoders.empty ())
 			{
 			
-			jpeg_read_scanlines (&cinfo, sampArray, 1);
+			dng_lossy_jpeg_decoder *decoder = fDecoders.back ();
 			
-			image.Put (buffer);
+			fDecoders.pop_back ();
 			
-			buffer.fArea.t = buffer.fArea.b;
-			buffer.fArea.b = buffer.fArea.t + 1;
+			return decoder;
 			
 			}
 			
-		// Cleanup.
-			
-		jpeg_finish_decompress (&cinfo);
+		}
+		
+	return new dng_lossy_jpeg_decoder;
+	
+	}
 
-		jpeg_destroy_decompress (&cinfo);
-			
+/*****************************************************************************/
+
+void dng_lossy_jpeg_decoder_cache::Release (dng_lossy_jpeg_decoder *decoder)
+	{
+	
+	dng_lock_std_mutex lock (fMutex);
+	
+	fDecoders.push_back (decoder);
+	
+	}
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
+
+dng_lossy_jpeg_decoder_cache::~dng_lossy_jpeg_decoder_cache ()
+	{
+	
+	#if qDNGUseLibJPEG
+	
+	for (size_t index = 0; index < fDecoders.size (); index++)
+		{
+		delete fDecoders [index];
+		}
+		
+	#endif
+	
+	}
+
+/*****************************************************************************/
+
+void dng_read_image::DecodeLossyJPEG (dng_host &host,
+									  dng_image &image,
+									  const dng_rect &tileArea,
+									  uint32 plane,
+									  uint32 planes,
+									  uint32 /* photometricInterpretation */,
+									  uint32 jpegDataSize,
+									  uint8 *jpegDataInMemory,
+									  bool /* usingMultipleThreads */)
+	{
+	
+	#if qDNGUseLibJPEG
+	
+	dng_lossy_jpeg_decoder *decoder = fLossyJPEGDecoders->Acquire ();
+	
+	try
+		{
+		
+		decoder->Decode (host,
+						 image,
+						 tileArea,
+						 plane,
+						 planes,
+						 jpegDataSize,
+						 jpegDataInMemory);
+		
 		}
 		
 	catch (...)
 		{
 		
-		jpeg_destroy_decompress (&cinfo);
+		// The decompressor may be left mid-image, so do not reuse it.
+		
+		delete decoder;
 		
 		throw;
 		
 		}
+		
+	fLossyJPEGDecoders->Release (decoder);
 	
 	#else
 				
@@ -59,6 +59,10 @@ class dng_row_interleaved_image: public dng_image
 
 /*****************************************************************************/
 
+class dng_lossy_jpeg_decoder_cache;
+
+/*****************************************************************************/
+
 class dng_read_image
 	{
 	
@@ -76,6 +80,11 @@ class dng_read_image
 			};
 			
 		AutoPtr<dng_memory_block> fJPEGTables;
+
+		// Burst Photo addition: lossy JPEG decompressors kept for reuse by
+		// the tiles of this image, one per thread that needed one.
+
+		AutoPtr<dng_lossy_jpeg_decoder_cache> fLossyJPEGDecoders;
 	
 	public:
 	
@@ -14,11 +14,16 @@
 #include "dng_host.h"
 #include "dng_image.h"
 #include "dng_memory.h"
+#include "dng_mutex.h"
 #include "dng_pixel_buffer.h"
+#include "dng_reference.h"
 #include "dng_safe_arithmetic.h"
+#include "dng_simd_type.h"
 #include "dng_tag_types.h"
 #include "dng_utils.h"
 
+#include <map>
+
 /******************************************************************************/
 
 real64 dng_resample_bicubic::Extent () const
@@ -50,6 +55,17 @@ real64 dng_resample_bicubic::Evaluate (real64 x) const
 
 /******************************************************************************/
 
+bool dng_resample_bicubic::Cacheable () const
+	{
+	
+	// Only the shared instance is guaranteed to outlive the cache.
+	
+	return this == &Get ();
+	
+	}
+
+/******************************************************************************/
+
 const dng_resample_function & dng_resample_bicubic::Get ()
 	{
 	
@@ -282,6 +298,271 @@ void dng_resample_weights::Initialize (real64 scale,
 
 /*****************************************************************************/
 
+namespace
+	{
+	
+	const uint32 kDefaultResampleTableCacheEntries = 64;
+	
+	struct dng_resample_table_key
+		{
+		
+		int32 fSrcOrigin;
+		int32 fDstOrigin;
+		
+		uint32 fSrcCount;
+		uint32 fDstCount;
+		
+		const dng_resample_function *fKernel;
+		
+		bool operator< (const dng_resample_table_key &key) const
+			{
+			
+			if (fSrcOrigin != key.fSrcOrigin) return fSrcOrigin < key.fSrcOrigin;
+			if (fDstOrigin != key.fDstOrigin) return fDstOrigin < key.fDstOrigin;
+			if (fSrcCount  != key.fSrcCount ) return fSrcCount	< key.fSrcCount;
+			if (fDstCount  != key.fDstCount ) return fDstCount	< key.fDstCount;
+			
+			return std::less<const dng_resample_function *> () (fKernel,
+																key.fKernel);
+			
+			}
+		
+		};
+		
+	struct dng_resample_table_entry
+		{
+		
+		std::shared_ptr<const dng_resample_coords> fCoords;
+		
+		std::shared_ptr<const dng_resample_weights> fWeights;
+		
+		uint64 fLastUse;
+		
+		};
+		
+	struct dng_resample_table_state
+		{
+		
+		dng_std_mutex fMutex;
+		
+		std::map<dng_resample_table_key, dng_resample_table_entry> fMap;
+		
+		uint32 fMaxEntries;
+		
+		uint64 fClock;
+		
+		dng_resample_table_state ()
+		
+			:	fMutex		()
+			,	fMap		()
+			,	fMaxEntries (kDefaultResampleTableCacheEntries)
+			,	fClock		(0)
+			
+			{
+			}
+		
+		void Trim (uint32 maxEntries)
+			{
+			
+			while (fMap.size () > maxEntries)
+				{
+				
+				auto oldest = fMap.begin ();
+				
+				for (auto it = fMap.begin (); it != fMap.end (); ++it)
+					{
+					
+					if (it->second.fLastUse < oldest->second.fLastUse)
+						{
+						oldest = it;
+						}
+					
+					}
+					
+				fMap.erase (oldest);
+				
+				}
+			
+			}
+		
+		};
+		
+	dng_resample_table_state & ResampleTableState ()
+		{
+		
+		static dng_resample_table_state state;
+		
+		return state;
+		
+		}
+		
+	void BuildResampleTables (int32 srcOrigin,
+							  int32 dstOrigin,
+							  uint32 srcCount,
+							  uint32 dstCount,
+							  const dng_resample_function &kernel,
+							  dng_memory_allocator &allocator,
+							  std::shared_ptr<const dng_resample_coords> &coords,
+							  std::shared_ptr<const dng_resample_weights> &weights)
+		{
+		
+		std::shared_ptr<dng_resample_coords> newCoords (new dng_resample_coords);
+		
+		newCoords->Initialize (srcOrigin,
+							   dstOrigin,
+							   srcCount,
+							   dstCount,
+							   allocator);
+		
+		real64 scale = (srcCount != 0) ? dstCount / (real64) srcCount : 0;
+		
+		std::shared_ptr<dng_resample_weights> newWeights (new dng_resample_weights);
+		
+		newWeights->Initialize (scale,
+								kernel,
+								allocator);
+								
+		coords	= newCoords;
+		weights = newWeights;
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void dng_resample_table_cache::Get (int32 srcOrigin,
+									int32 dstOrigin,
+									uint32 srcCount,
+									uint32 dstCount,
+									const dng_resample_function &kernel,
+									dng_memory_allocator &allocator,
+									std::shared_ptr<const dng_resample_coords> &coords,
+									std::shared_ptr<const dng_resample_weights> &weights)
+	{
+	
+	if (!kernel.Cacheable ())
+		{
+		
+		BuildResampleTables (srcOrigin,
+							 dstOrigin,
+							 srcCount,
+							 dstCount,
+							 kernel,
+							 allocator,
+							 coords,
+							 weights);
+							 
+		return;
+		
+		}
+		
+	dng_resample_table_state &state = ResampleTableState ();
+	
+	dng_resample_table_key key;
+	
+	key.fSrcOrigin = srcOrigin;
+	key.fDstOrigin = dstOrigin;
+	key.fSrcCount  = srcCount;
+	key.fDstCount  = dstCount;
+	key.fKernel	   = &kernel;
+	
+		{
+		
+		dng_lock_std_mutex lock (state.fMutex);
+		
+		auto it = state.fMap.find (key);
+		
+		if (it != state.fMap.end ())
+			{
+			
+			it->second.fLastUse = ++state.fClock;
+			
+			coords	= it->second.fCoords;
+			weights = it->second.fWeights;
+			
+			return;
+			
+			}
+		
+		}
+		
+	// Build outside the lock so threads resampling to other sizes are not
+	// serialized. The cached tables outlive the host, so they cannot use the
+	// host's allocator.
+		
+	BuildResampleTables (srcOrigin,
+						 dstOrigin,
+						 srcCount,
+						 dstCount,
+						 kernel,
+						 gDefaultDNGMemoryAllocator,
+						 coords,
+						 weights);
+	
+	dng_lock_std_mutex lock (state.fMutex);
+	
+	if (state.fMaxEntries == 0)
+		{
+		return;
+		}
+	
+	dng_resample_table_entry &entry = state.fMap [key];
+	
+	if (entry.fCoords)
+		{
+		
+		// Another thread got here first; share its tables.
+		
+		coords	= entry.fCoords;
+		weights = entry.fWeights;
+		
+		}
+		
+	else
+		{
+		
+		entry.fCoords  = coords;
+		entry.fWeights = weights;
+		
+		}
+		
+	entry.fLastUse = ++state.fClock;
+	
+	state.Trim (state.fMaxEntries);
+	
+	}
+
+/*****************************************************************************/
+
+void dng_resample_table_cache::SetMaxEntries (uint32 maxEntries)
+	{
+	
+	dng_resample_table_state &state = ResampleTableState ();
+	
+	dng_lock_std_mutex lock (state.fMutex);
+	
+	state.fMaxEntries = maxEntries;
+	
+	state.Trim (maxEntries);
+	
+	}
+
+/*****************************************************************************/
+
+void dng_resample_table_cache::Flush ()
+	{
+	
+	dng_resample_table_state &state = ResampleTableState ();
+	
+	dng_lock_std_mutex lock (state.fMutex);
+	
+	state.fMap.clear ();
+	
+	}
+
+/*****************************************************************************/
+
 dng_resample_weights_2d::dng_resample_weights_2d ()
 	
 	:	fRadius (0)
@@ -477,6 +758,524 @@ void dng_resample_weights_2d::Initialize (const dng_resample_function &kernel,
 
 /*****************************************************************************/
 
+// Vectorized versions of the 32-bit resample bottlenecks.
+//
+// The down pass is blocked over groups of columns so each group of source
+// rows is streamed once while its accumulators stay in registers. The across
+// pass computes each output pixel as a dot product over the full, zero padded
+// weight step, so it may read up to (wStep - wCount) entries past the last
+// source pixel. dng_resample_task pads and zeroes its temp buffers for this.
+
+#if qDNGIntrinsicsX86
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX2
+static void ResampleDown32_AVX2 (const real32 *sPtr,
+								 real32 *dPtr,
+								 uint32 sCount,
+								 int32 sRowStep,
+								 const real32 *wPtr,
+								 uint32 wCount)
+	{
+	
+	const __m256 kZero = _mm256_setzero_ps ();
+	const __m256 kOne  = _mm256_set1_ps (1.0f);
+	
+	uint32 col = 0;
+	
+	for (; col + 32 <= sCount; col += 32)
+		{
+		
+		const real32 *s = sPtr + col;
+		
+		__m256 w = _mm256_set1_ps (wPtr [0]);
+		
+		__m256 t0 = _mm256_mul_ps (w, _mm256_loadu_ps (s	  ));
+		__m256 t1 = _mm256_mul_ps (w, _mm256_loadu_ps (s +	8));
+		__m256 t2 = _mm256_mul_ps (w, _mm256_loadu_ps (s + 16));
+		__m256 t3 = _mm256_mul_ps (w, _mm256_loadu_ps (s + 24));
+		
+		for (uint32 j = 1; j < wCount; j++)
+			{
+			
+			s += sRowStep;
+			
+			w = _mm256_set1_ps (wPtr [j]);
+			
+			t0 = _mm256_fmadd_ps (w, _mm256_loadu_ps (s		), t0);
+			t1 = _mm256_fmadd_ps (w, _mm256_loadu_ps (s +  8), t1);
+			t2 = _mm256_fmadd_ps (w, _mm256_loadu_ps (s + 16), t2);
+			t3 = _mm256_fmadd_ps (w, _mm256_loadu_ps (s + 24), t3);
+			
+			}
+			
+		_mm256_storeu_ps (dPtr + col	 , _mm256_min_ps (_mm256_max_ps (t0, kZero), kOne));
+		_mm256_storeu_ps (dPtr + col +	8, _mm256_min_ps (_mm256_max_ps (t1, kZero), kOne));
+		_mm256_storeu_ps (dPtr + col + 16, _mm256_min_ps (_mm256_max_ps (t2, kZero), kOne));
+		_mm256_storeu_ps (dPtr + col + 24, _mm256_min_ps (_mm256_max_ps (t3, kZero), kOne));
+		
+		}
+		
+	for (; col + 8 <= sCount; col += 8)
+		{
+		
+		const real32 *s = sPtr + col;
+		
+		__m256 t = _mm256_mul_ps (_mm256_set1_ps (wPtr [0]),
+								  _mm256_loadu_ps (s));
+		
+		for (uint32 j = 1; j < wCount; j++)
+			{
+			
+			s += sRowStep;
+			
+			t = _mm256_fmadd_ps (_mm256_set1_ps (wPtr [j]),
+								 _mm256_loadu_ps (s),
+								 t);
+			
+			}
+			
+		_mm256_storeu_ps (dPtr + col, _mm256_min_ps (_mm256_max_ps (t, kZero), kOne));
+		
+		}
+		
+	for (; col < sCount; col++)
+		{
+		
+		const real32 *s = sPtr + col;
+		
+		real32 t = wPtr [0] * s [0];
+		
+		for (uint32 j = 1; j < wCount; j++)
+			{
+			
+			s += sRowStep;
+			
+			t += wPtr [j] * s [0];
+			
+			}
+			
+		dPtr [col] = Pin_real32 (0.0f, t, 1.0f);
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX2
+static void ResampleAcross32_AVX2 (const real32 *sPtr,
+								   real32 *dPtr,
+								   uint32 dCount,
+								   const int32 *coord,
+								   const real32 *wPtr,
+								   uint32 /* wCount */,
+								   uint32 wStep)
+	{
+	
+	for (uint32 j = 0; j < dCount; j++)
+		{
+		
+		int32 sCoord = coord [j];
+		
+		int32 sFract = sCoord &	 kResampleSubsampleMask;
+		int32 sPixel = sCoord >> kResampleSubsampleBits;
+		
+		const real32 *w = wPtr + sFract * wStep;
+		const real32 *s = sPtr + sPixel;
+		
+		__m256 t = _mm256_mul_ps (_mm256_loadu_ps (w),
+								  _mm256_loadu_ps (s));
+		
+		for (uint32 k = 8; k < wStep; k += 8)
+			{
+			
+			t = _mm256_fmadd_ps (_mm256_loadu_ps (w + k),
+								 _mm256_loadu_ps (s + k),
+								 t);
+			
+			}
+			
+		__m128 h = _mm_add_ps (_mm256_castps256_ps128 (t),
+							   _mm256_extractf128_ps (t, 1));
+		
+		h = _mm_add_ps (h, _mm_movehl_ps (h, h));
+		h = _mm_add_ss (h, _mm_shuffle_ps (h, h, 1));
+		
+		dPtr [j] = Pin_real32 (0.0f, _mm_cvtss_f32 (h), 1.0f);
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX512
+static inline __m512 Pin01_AVX512 (__m512 x)
+	{
+	
+	// GCC 12 warns of a maybe uninitialized value inside the plain
+	// _mm512_max_ps and _mm512_min_ps, whose builtins take an undefined
+	// vector to merge into. The zero-masking forms with every lane set
+	// compile to the same instructions without it.
+	
+	const __mmask16 kAll = (__mmask16) 0xFFFF;
+	
+	return _mm512_maskz_min_ps (kAll,
+								_mm512_maskz_max_ps (kAll, x, _mm512_setzero_ps ()),
+								_mm512_set1_ps (1.0f));
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX512
+static inline real32 Sum_AVX512 (__m512 x)
+	{
+	
+	// Same as _mm512_reduce_add_ps, which GCC 12 also warns about. Both
+	// halves are taken with zero-masked extracts for the same reason, since
+	// even _mm512_castps512_ps256 is an unmasked extract there.
+	
+	const __mmask8 kAll = (__mmask8) 0xF;
+	
+	__m512d d = _mm512_castps_pd (x);
+	
+	__m256 t = _mm256_add_ps (_mm256_castpd_ps (_mm512_maskz_extractf64x4_pd (kAll, d, 0)),
+							  _mm256_castpd_ps (_mm512_maskz_extractf64x4_pd (kAll, d, 1)));
+	
+	__m128 h = _mm_add_ps (_mm256_castps256_ps128 (t),
+						   _mm256_extractf128_ps (t, 1));
+	
+	h = _mm_add_ps (h, _mm_movehl_ps (h, h));
+	h = _mm_add_ss (h, _mm_shuffle_ps (h, h, 1));
+	
+	return _mm_cvtss_f32 (h);
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX512
+static void ResampleDown32_AVX512 (const real32 *sPtr,
+								   real32 *dPtr,
+								   uint32 sCount,
+								   int32 sRowStep,
+								   const real32 *wPtr,
+								   uint32 wCount)
+	{
+	
+	uint32 col = 0;
+	
+	for (; col + 32 <= sCount; col += 32)
+		{
+		
+		const real32 *s = sPtr + col;
+		
+		__m512 w = _mm512_set1_ps (wPtr [0]);
+		
+		__m512 t0 = _mm512_mul_ps (w, _mm512_loadu_ps (s	 ));
+		__m512 t1 = _mm512_mul_ps (w, _mm512_loadu_ps (s + 16));
+		
+		for (uint32 j = 1; j < wCount; j++)
+			{
+			
+			s += sRowStep;
+			
+			w = _mm512_set1_ps (wPtr [j]);
+			
+			t0 = _mm512_fmadd_ps (w, _mm512_loadu_ps (s		), t0);
+			t1 = _mm512_fmadd_ps (w, _mm512_loadu_ps (s + 16), t1);
+			
+			}
+			
+		_mm512_storeu_ps (dPtr + col	 , Pin01_AVX512 (t0));
+		_mm512_storeu_ps (dPtr + col + 16, Pin01_AVX512 (t1));
+		
+		}
+		
+	if (col < sCount)
+		{
+		
+		// Masked loads and stores handle the ragged right edge.
+		
+		while (col < sCount)
+			{
+			
+			uint32 count = Min_uint32 (sCount - col, 16);
+			
+			__mmask16 mask = (__mmask16) ((1u << count) - 1u);
+			
+			const real32 *s = sPtr + col;
+			
+			__m512 t = _mm512_mul_ps (_mm512_set1_ps (wPtr [0]),
+									  _mm512_maskz_loadu_ps (mask, s));
+			
+			for (uint32 j = 1; j < wCount; j++)
+				{
+				
+				s += sRowStep;
+				
+				t = _mm512_fmadd_ps (_mm512_set1_ps (wPtr [j]),
+									 _mm512_maskz_loadu_ps (mask, s),
+									 t);
+				
+				}
+				
+			_mm512_mask_storeu_ps (dPtr + col, mask, Pin01_AVX512 (t));
+			
+			col += count;
+			
+			}
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX512
+static void ResampleAcross32_AVX512 (const real32 *sPtr,
+									 real32 *dPtr,
+									 uint32 dCount,
+									 const int32 *coord,
+									 const real32 *wPtr,
+									 uint32 wCount,
+									 uint32 wStep)
+	{
+	
+	// With masked loads there is no need to touch entries past wCount.
+	
+	for (uint32 j = 0; j < dCount; j++)
+		{
+		
+		int32 sCoord = coord [j];
+		
+		int32 sFract = sCoord &	 kResampleSubsampleMask;
+		int32 sPixel = sCoord >> kResampleSubsampleBits;
+		
+		const real32 *w = wPtr + sFract * wStep;
+		const real32 *s = sPtr + sPixel;
+		
+		__m512 t = _mm512_setzero_ps ();
+		
+		for (uint32 k = 0; k < wCount; k += 16)
+			{
+			
+			uint32 count = Min_uint32 (wCount - k, 16);
+			
+			__mmask16 mask = (__mmask16) ((1u << count) - 1u);
+			
+			t = _mm512_fmadd_ps (_mm512_maskz_loadu_ps (mask, w + k),
+								 _mm512_maskz_loadu_ps (mask, s + k),
+								 t);
+			
+			}
+			
+		dPtr [j] = Pin_real32 (0.0f, Sum_AVX512 (t), 1.0f);
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+#endif	// qDNGIntrinsicsX86
+
+/*****************************************************************************/
+
+#if qDNGIntrinsicsNEON
+
+/*****************************************************************************/
+
+static void ResampleDown32_NEON (const real32 *sPtr,
+								 real32 *dPtr,
+								 uint32 sCount,
+								 int32 sRowStep,
+								 const real32 *wPtr,
+								 uint32 wCount)
+	{
+	
+	const float32x4_t kZero = vdupq_n_f32 (0.0f);
+	const float32x4_t kOne	= vdupq_n_f32 (1.0f);
+	
+	uint32 col = 0;
+	
+	for (; col + 16 <= sCount; col += 16)
+		{
+		
+		const real32 *s = sPtr + col;
+		
+		float32x4_t t0 = vmulq_n_f32 (vld1q_f32 (s	   ), wPtr [0]);
+		float32x4_t t1 = vmulq_n_f32 (vld1q_f32 (s +  4), wPtr [0]);
+		float32x4_t t2 = vmulq_n_f32 (vld1q_f32 (s +  8), wPtr [0]);
+		float32x4_t t3 = vmulq_n_f32 (vld1q_f32 (s + 12), wPtr [0]);
+		
+		for (uint32 j = 1; j < wCount; j++)
+			{
+			
+			s += sRowStep;
+			
+			float32x4_t w = vdupq_n_f32 (wPtr [j]);
+			
+			t0 = vfmaq_f32 (t0, w, vld1q_f32 (s		));
+			t1 = vfmaq_f32 (t1, w, vld1q_f32 (s +  4));
+			t2 = vfmaq_f32 (t2, w, vld1q_f32 (s +  8));
+			t3 = vfmaq_f32 (t3, w, vld1q_f32 (s + 12));
+			
+			}
+			
+		vst1q_f32 (dPtr + col	  , vminq_f32 (vmaxq_f32 (t0, kZero), kOne));
+		vst1q_f32 (dPtr + col +	 4, vminq_f32 (vmaxq_f32 (t1, kZero), kOne));
+		vst1q_f32 (dPtr + col +	 8, vminq_f32 (vmaxq_f32 (t2, kZero), kOne));
+		vst1q_f32 (dPtr + col + 12, vminq_f32 (vmaxq_f32 (t3, kZero), kOne));
+		
+		}
+		
+	for (; col < sCount; col++)
+		{
+		
+		const real32 *s = sPtr + col;
+		
+		real32 t = wPtr [0] * s [0];
+		
+		for (uint32 j = 1; j < wCount; j++)
+			{
+			
+			s += sRowStep;
+			
+			t += wPtr [j] * s [0];
+			
+			}
+			
+		dPtr [col] = Pin_real32 (0.0f, t, 1.0f);
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+static void ResampleAcross32_NEON (const real32 *sPtr,
+								   real32 *dPtr,
+								   uint32 dCount,
+								   const int32 *coord,
+								   const real32 *wPtr,
+								   uint32 /* wCount */,
+								   uint32 wStep)
+	{
+	
+	for (uint32 j = 0; j < dCount; j++)
+		{
+		
+		int32 sCoord = coord [j];
+		
+		int32 sFract = sCoord &	 kResampleSubsampleMask;
+		int32 sPixel = sCoord >> kResampleSubsampleBits;
+		
+		const real32 *w = wPtr + sFract * wStep;
+		const real32 *s = sPtr + sPixel;
+		
+		float32x4_t t0 = vmulq_f32 (vld1q_f32 (w	), vld1q_f32 (s	   ));
+		float32x4_t t1 = vmulq_f32 (vld1q_f32 (w + 4), vld1q_f32 (s + 4));
+		
+		for (uint32 k = 8; k < wStep; k += 8)
+			{
+			
+			t0 = vfmaq_f32 (t0, vld1q_f32 (w + k	), vld1q_f32 (s + k	   ));
+			t1 = vfmaq_f32 (t1, vld1q_f32 (w + k + 4), vld1q_f32 (s + k + 4));
+			
+			}
+			
+		dPtr [j] = Pin_real32 (0.0f, vaddvq_f32 (vaddq_f32 (t0, t1)), 1.0f);
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+#endif	// qDNGIntrinsicsNEON
+
+/*****************************************************************************/
+
+static ResampleDown32Proc * SelectResampleDown32 ()
+	{
+	
+	// Respect any replacement the host has installed in gDNGSuite.
+	
+	if (gDNGSuite.ResampleDown32 == RefResampleDown32)
+		{
+		
+		#if qDNGIntrinsicsX86
+		
+		if (gDNGMaxSIMD >= AVX512_SKX)
+			{
+			return ResampleDown32_AVX512;
+			}
+		
+		if (gDNGMaxSIMD >= AVX2)
+			{
+			return ResampleDown32_AVX2;
+			}
+		
+		#endif	// qDNGIntrinsicsX86
+		
+		#if qDNGIntrinsicsNEON
+		
+		if (gDNGMaxSIMD >= arm64_neon)
+			{
+			return ResampleDown32_NEON;
+			}
+		
+		#endif	// qDNGIntrinsicsNEON
+		
+		}
+	
+	return gDNGSuite.ResampleDown32;
+	
+	}
+
+/*****************************************************************************/
+
+static ResampleAcross32Proc * SelectResampleAcross32 ()
+	{
+	
+	if (gDNGSuite.ResampleAcross32 == RefResampleAcross32)
+		{
+		
+		#if qDNGIntrinsicsX86
+		
+		if (gDNGMaxSIMD >= AVX512_SKX)
+			{
+			return ResampleAcross32_AVX512;
+			}
+		
+		if (gDNGMaxSIMD >= AVX2)
+			{
+			return ResampleAcross32_AVX2;
+			}
+		
+		#endif	// qDNGIntrinsicsX86
+		
+		#if qDNGIntrinsicsNEON
+		
+		if (gDNGMaxSIMD >= arm64_neon)
+			{
+			return ResampleAcross32_NEON;
+			}
+		
+		#endif	// qDNGIntrinsicsNEON
+		
+		}
+	
+	return gDNGSuite.ResampleAcross32;
+	
+	}
+
+/*****************************************************************************/
+
 class dng_resample_task: public dng_filter_task
 	{
 	
@@ -490,11 +1289,14 @@ class dng_resample_task: public dng_filter_task
 		real64 fRowScale;
 		real64 fColScale;
 		
-		dng_resample_coords fRowCoords;
-		dng_resample_coords fColCoords;
+		std::shared_ptr<const dng_resample_coords> fRowCoords;
+		std::shared_ptr<const dng_resample_coords> fColCoords;
+		
+		std::shared_ptr<const dng_resample_weights> fWeightsV;
+		std::shared_ptr<const dng_resample_weights> fWeightsH;
 		
-		dng_resample_weights fWeightsV;
-		dng_resample_weights fWeightsH;
+		ResampleDown32Proc	 *fResampleDown32;
+		ResampleAcross32Proc *fResampleAcross32;
 		
 		dng_point fSrcTileSize;
 		
@@ -550,6 +1352,9 @@ dng_resample_task::dng_resample_task (const dng_image &srcImage,
 	,	fWeightsV ()
 	,	fWeightsH ()
 	
+	,	fResampleDown32	  (SelectResampleDown32	  ())
+	,	fResampleAcross32 (SelectResampleAcross32 ())
+	
 	,	fSrcTileSize ()
 	
 	{
@@ -585,24 +1390,24 @@ dng_resample_task::dng_resample_task (const dng_image &srcImage,
 dng_rect dng_resample_task::SrcArea (const dng_rect &dstArea)
 	{
 	
-	int32 offsetV = fWeightsV.Offset ();
-	int32 offsetH = fWeightsH.Offset ();
+	int32 offsetV = fWeightsV->Offset ();
+	int32 offsetH = fWeightsH->Offset ();
 	
-	int32 widthV = ConvertUint32ToInt32 (fWeightsV.Width ());
-	int32 widthH = ConvertUint32ToInt32 (fWeightsH.Width ());
+	int32 widthV = ConvertUint32ToInt32 (fWeightsV->Width ());
+	int32 widthH = ConvertUint32ToInt32 (fWeightsH->Width ());
 	
 	dng_rect srcArea;
 	
-	srcArea.t = SafeInt32Add (fRowCoords.Pixel (dstArea.t), offsetV);
-	srcArea.l = SafeInt32Add (fColCoords.Pixel (dstArea.l), offsetH);
+	srcArea.t = SafeInt32Add (fRowCoords->Pixel (dstArea.t), offsetV);
+	srcArea.l = SafeInt32Add (fColCoords->Pixel (dstArea.l), offsetH);
 
 	srcArea.b = SafeInt32Add (SafeInt32Add
-							  (fRowCoords.Pixel (SafeInt32Sub (dstArea.b, 1)),
+							  (fRowCoords->Pixel (SafeInt32Sub (dstArea.b, 1)),
 							   offsetV),
 							  widthV);
 	
 	srcArea.r = SafeInt32Add (SafeInt32Add
-							  (fColCoords.Pixel (SafeInt32Sub (dstArea.r, 1)),
+							  (fColCoords->Pixel (SafeInt32Sub (dstArea.r, 1)),
 							   offsetH),
 							  widthH);
 	
@@ -628,41 +1433,41 @@ void dng_resample_task::Start (uint32 threadCount,
 							   dng_abort_sniffer *sniffer)
 	{
 	
-	// Compute sub-pixel resolution coordinates in the source image for
-	// each row and column of the destination area.
-	
-	fRowCoords.Initialize (fSrcBounds.t,
-						   fDstBounds.t,
-						   fSrcBounds.H (),
-						   fDstBounds.H (),
-						   *allocator);
-	
-	fColCoords.Initialize (fSrcBounds.l,
-						   fDstBounds.l,
-						   fSrcBounds.W (),
-						   fDstBounds.W (),
-						   *allocator);
-			
-	// Compute resampling kernels.
-	
-	fWeightsV.Initialize (fRowScale,
-						  fKernel,
-						  *allocator);
-						  
-	fWeightsH.Initialize (fColScale,
-						  fKernel,
-						  *allocator);
+	// Get sub-pixel resolution coordinates in the source image for each
+	// row and column of the destination area, and the resampling kernels.
+	// These are shared with other tasks of the same geometry.
+	
+	dng_resample_table_cache::Get (fSrcBounds.t,
+								   fDstBounds.t,
+								   fSrcBounds.H (),
+								   fDstBounds.H (),
+								   fKernel,
+								   *allocator,
+								   fRowCoords,
+								   fWeightsV);
+	
+	dng_resample_table_cache::Get (fSrcBounds.l,
+								   fDstBounds.l,
+								   fSrcBounds.W (),
+								   fDstBounds.W (),
+								   fKernel,
+								   *allocator,
+								   fColCoords,
+								   fWeightsH);
 		
 	// Find upper bound on source source tile.
 		
-	fSrcTileSize.v = Round_int32 (tileSize.v / fRowScale) + fWeightsV.Width () + 2;
-	fSrcTileSize.h = Round_int32 (tileSize.h / fColScale) + fWeightsH.Width () + 2;
+	fSrcTileSize.v = Round_int32 (tileSize.v / fRowScale) + fWeightsV->Width () + 2;
+	fSrcTileSize.h = Round_int32 (tileSize.h / fColScale) + fWeightsH->Width () + 2;
 	
-	// Allocate temp buffers.
+	// Allocate temp buffers. These are padded by one weight step and zeroed,
+	// since the vectorized across pass reads the full (zero weighted) step
+	// past the last source pixel.
 	
 	uint32 tempBufferSize = 0;
 
-	if (!RoundUpUint32ToMultiple (fSrcTileSize.h, 8, &tempBufferSize) ||
+	if (!SafeUint32Add (fSrcTileSize.h, fWeightsH->Step (), &tempBufferSize) ||
+		!RoundUpUint32ToMultiple (tempBufferSize, 8, &tempBufferSize) ||
 		!SafeUint32Mult (tempBufferSize,
 						 static_cast<uint32> (sizeof (real32)),
 						 &tempBufferSize))
@@ -677,6 +1482,9 @@ void dng_resample_task::Start (uint32 threadCount,
 		
 		fTempBuffer [threadIndex] . Reset (allocator->Allocate (tempBufferSize));
 		
+		DoZeroBytes (fTempBuffer [threadIndex]->Buffer		(),
+					 fTempBuffer [threadIndex]->LogicalSize ());
+		
 		}
 		
 	// Allocate the pixel buffers.
@@ -702,21 +1510,24 @@ void dng_resample_task::ProcessArea (uint32 threadIndex,
 	uint32 srcCols = srcArea.W ();
 	uint32 dstCols = dstArea.W ();
 	
-	uint32 widthV = fWeightsV.Width ();
-	uint32 widthH = fWeightsH.Width ();
+	const dng_resample_weights &weightTableV = *fWeightsV;
+	const dng_resample_weights &weightTableH = *fWeightsH;
+	
+	uint32 widthV = weightTableV.Width ();
+	uint32 widthH = weightTableH.Width ();
 	
-	int32 offsetV = fWeightsV.Offset ();
-	int32 offsetH = fWeightsH.Offset ();
+	int32 offsetV = weightTableV.Offset ();
+	int32 offsetH = weightTableH.Offset ();
 	
-	uint32 stepH = fWeightsH.Step ();
+	uint32 stepH = weightTableH.Step ();
 	
-	const int32 *rowCoords = fRowCoords.Coords (0		 );
-	const int32 *colCoords = fColCoords.Coords (dstArea.l);
+	const int32 *rowCoords = fRowCoords->Coords (0		  );
+	const int32 *colCoords = fColCoords->Coords (dstArea.l);
 	
 	if (fSrcPixelType == ttFloat)
 		{
 	
-		const real32 *weightsH = fWeightsH.Weights32 (0);
+		const real32 *weightsH = weightTableH.Weights32 (0);
 				
 		real32 *tPtr = fTempBuffer [threadIndex]->Buffer_real32 ();
 		
@@ -729,7 +1540,7 @@ void dng_resample_task::ProcessArea (uint32 threadIndex,
 			
 			int32 rowFract = rowCoord & kResampleSubsampleMask;
 			
-			const real32 *weightsV = fWeightsV.Weights32 (rowFract); 
+			const real32 *weightsV = weightTableV.Weights32 (rowFract); 
 			
 			int32 srcRow = (rowCoord >> kResampleSubsampleBits) + offsetV;
 			
@@ -740,24 +1551,24 @@ void dng_resample_task::ProcessArea (uint32 threadIndex,
 																  srcArea.l,
 																  plane);
 
-				DoResampleDown32 (sPtr,
-								  tPtr,
-								  srcCols,
-								  srcBuffer.fRowStep,
-								  weightsV,
-								  widthV);
+				(*fResampleDown32) (sPtr,
+									tPtr,
+									srcCols,
+									srcBuffer.fRowStep,
+									weightsV,
+									widthV);
 
 				real32 *dPtr = dstBuffer.DirtyPixel_real32 (dstRow,
 															dstArea.l,
 															plane);
 															
-				DoResampleAcross32 (ttPtr,
-									dPtr,
-									dstCols,
-									colCoords,
-									weightsH,
-									widthH,
-									stepH);
+				(*fResampleAcross32) (ttPtr,
+									  dPtr,
+									  dstCols,
+									  colCoords,
+									  weightsH,
+									  widthH,
+									  stepH);
 
 				}
 			
@@ -768,7 +1579,7 @@ void dng_resample_task::ProcessArea (uint32 threadIndex,
 	else
 		{
 		
-		const int16 *weightsH = fWeightsH.Weights16 (0);
+		const int16 *weightsH = weightTableH.Weights16 (0);
 				
 		uint16 *tPtr = fTempBuffer [threadIndex]->Buffer_uint16 ();
 		
@@ -783,7 +1594,7 @@ void dng_resample_task::ProcessArea (uint32 threadIndex,
 			
 			int32 rowFract = rowCoord & kResampleSubsampleMask;
 			
-			const int16 *weightsV = fWeightsV.Weights16 (rowFract); 
+			const int16 *weightsV = weightTableV.Weights16 (rowFract); 
 			
 			int32 srcRow = (rowCoord >> kResampleSubsampleBits) + offsetV;
 			
@@ -18,6 +18,8 @@
 #include "dng_point.h"
 #include "dng_types.h"
 
+#include <memory>
+
 /*****************************************************************************/
 
 class dng_resample_function
@@ -36,6 +38,14 @@ class dng_resample_function
 		virtual real64 Extent () const = 0;
 		
 		virtual real64 Evaluate (real64 x) const = 0;
+		
+		/// Returns true if this kernel object lives for the life of the
+		/// process, so its address can be used as a resample table cache key.
+		
+		virtual bool Cacheable () const
+			{
+			return false;
+			}
 	
 	};
 
@@ -50,6 +60,8 @@ class dng_resample_bicubic: public dng_resample_function
 		
 		virtual real64 Evaluate (real64 x) const;
 		
+		virtual bool Cacheable () const;
+		
 		static const dng_resample_function & Get ();
 		
 	};
@@ -189,6 +201,43 @@ class dng_resample_weights
 
 /*****************************************************************************/
 
+/// \brief Process-wide cache of 1D resample coordinate and weight tables.
+///
+/// Batch preview and proxy generation resample many images of the same size
+/// to the same target size. The tables for one axis depend only on the source
+/// and destination origin and count and on the kernel, so they are built once
+/// and shared between tasks. Entries are evicted least recently used first.
+
+class dng_resample_table_cache
+	{
+	
+	public:
+	
+		/// Returns the coordinate and weight tables for one axis, building
+		/// and caching them if needed. Tables for kernels that are not
+		/// Cacheable are built using the given allocator and not cached.
+	
+		static void Get (int32 srcOrigin,
+						 int32 dstOrigin,
+						 uint32 srcCount,
+						 uint32 dstCount,
+						 const dng_resample_function &kernel,
+						 dng_memory_allocator &allocator,
+						 std::shared_ptr<const dng_resample_coords> &coords,
+						 std::shared_ptr<const dng_resample_weights> &weights);
+						 
+		/// Sets the maximum number of cached axes. Zero disables caching.
+		
+		static void SetMaxEntries (uint32 maxEntries);
+		
+		/// Discards all cached tables.
+		
+		static void Flush ();
+		
+	};
+
+/*****************************************************************************/
+
 const uint32 kResampleSubsampleBits2D  = 5;
 const uint32 kResampleSubsampleCount2D = 1 << kResampleSubsampleBits2D;
 const uint32 kResampleSubsampleMask2D  = kResampleSubsampleCount2D - 1;
@@ -83,6 +83,44 @@ const SIMDType SIMDTypeMaxValue = SIMDType(SIMD_Sentinel - 1);
 
 extern SIMDType	gDNGMaxSIMD;
 
+/// Returns the widest SIMDType that both the running CPU and the compiler
+/// support. Used to initialize gDNGMaxSIMD.
+
+SIMDType DetectMaxSIMD ();
+
+/*****************************************************************************/
+
+// Hand-written intrinsic paths for compilers other than the Intel compiler.
+// The x86 paths are compiled with per-function target attributes and are
+// selected at run time using gDNGMaxSIMD. NEON is part of the arm64 baseline.
+
+#if !qDNGIntelCompiler && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+#define qDNGIntrinsicsX86	1
+#define DNG_TARGET_SSE2		__attribute__((target("sse2")))
+#define DNG_TARGET_AVX2		__attribute__((target("avx2,fma")))
+#define DNG_TARGET_AVX512	__attribute__((target("avx512f,avx512cd,avx512bw,avx512dq,avx512vl")))
+
+#else
+
+#define qDNGIntrinsicsX86	0
+
+#endif
+
+#if qARM64 && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+
+#include <arm_neon.h>
+
+#define qDNGIntrinsicsNEON	1
+
+#else
+
+#define qDNGIntrinsicsNEON	0
+
+#endif
+
 /*****************************************************************************/
 
 #if qDNGIntelCompiler
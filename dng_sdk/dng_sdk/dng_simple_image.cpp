@@ -8,9 +8,12 @@
 
 #include "dng_simple_image.h"
 
+#include "dng_exceptions.h"
 #include "dng_orientation.h"
+#include "dng_simd_type.h"
 #include "dng_tag_types.h"
 #include "dng_tag_values.h"
+#include "dng_utils.h"
 
 /*****************************************************************************/
 
@@ -175,6 +178,537 @@ void dng_simple_image::Rotate (const dng_orientation &orientation)
 				
 /*****************************************************************************/
 
+// Transpose kernels used by MaterializeOrientation. A kernel of size n reads
+// n vectors of n consecutive samples, vector k starting at sPtr + k * sStep,
+// and stores lane j of every vector as destination row j, starting at
+// dPtr + j * dStep. Steps are in samples.
+
+typedef void (TransposeKernel16) (const uint16 *sPtr,
+								  int32 sStep,
+								  uint16 *dPtr,
+								  int32 dStep);
+
+typedef void (TransposeKernel32) (const uint32 *sPtr,
+								  int32 sStep,
+								  uint32 *dPtr,
+								  int32 dStep);
+
+/*****************************************************************************/
+
+#if qDNGIntrinsicsX86
+
+/*****************************************************************************/
+
+DNG_TARGET_SSE2
+static void Transpose8x8_16_SSE2 (const uint16 *sPtr,
+								  int32 sStep,
+								  uint16 *dPtr,
+								  int32 dStep)
+	{
+	
+	__m128i a0 = _mm_loadu_si128 ((const __m128i *) (sPtr			 ));
+	__m128i a1 = _mm_loadu_si128 ((const __m128i *) (sPtr +	   sStep));
+	__m128i a2 = _mm_loadu_si128 ((const __m128i *) (sPtr + 2 * sStep));
+	__m128i a3 = _mm_loadu_si128 ((const __m128i *) (sPtr + 3 * sStep));
+	__m128i a4 = _mm_loadu_si128 ((const __m128i *) (sPtr + 4 * sStep));
+	__m128i a5 = _mm_loadu_si128 ((const __m128i *) (sPtr + 5 * sStep));
+	__m128i a6 = _mm_loadu_si128 ((const __m128i *) (sPtr + 6 * sStep));
+	__m128i a7 = _mm_loadu_si128 ((const __m128i *) (sPtr + 7 * sStep));
+	
+	__m128i b0 = _mm_unpacklo_epi16 (a0, a1);
+	__m128i b1 = _mm_unpackhi_epi16 (a0, a1);
+	__m128i b2 = _mm_unpacklo_epi16 (a2, a3);
+	__m128i b3 = _mm_unpackhi_epi16 (a2, a3);
+	__m128i b4 = _mm_unpacklo_epi16 (a4, a5);
+	__m128i b5 = _mm_unpackhi_epi16 (a4, a5);
+	__m128i b6 = _mm_unpacklo_epi16 (a6, a7);
+	__m128i b7 = _mm_unpackhi_epi16 (a6, a7);
+	
+	__m128i c0 = _mm_unpacklo_epi32 (b0, b2);
+	__m128i c1 = _mm_unpackhi_epi32 (b0, b2);
+	__m128i c2 = _mm_unpacklo_epi32 (b1, b3);
+	__m128i c3 = _mm_unpackhi_epi32 (b1, b3);
+	__m128i c4 = _mm_unpacklo_epi32 (b4, b6);
+	__m128i c5 = _mm_unpackhi_epi32 (b4, b6);
+	__m128i c6 = _mm_unpacklo_epi32 (b5, b7);
+	__m128i c7 = _mm_unpackhi_epi32 (b5, b7);
+	
+	_mm_storeu_si128 ((__m128i *) (dPtr			   ), _mm_unpacklo_epi64 (c0, c4));
+	_mm_storeu_si128 ((__m128i *) (dPtr +	  dStep), _mm_unpackhi_epi64 (c0, c4));
+	_mm_storeu_si128 ((__m128i *) (dPtr + 2 * dStep), _mm_unpacklo_epi64 (c1, c5));
+	_mm_storeu_si128 ((__m128i *) (dPtr + 3 * dStep), _mm_unpackhi_epi64 (c1, c5));
+	_mm_storeu_si128 ((__m128i *) (dPtr + 4 * dStep), _mm_unpacklo_epi64 (c2, c6));
+	_mm_storeu_si128 ((__m128i *) (dPtr + 5 * dStep), _mm_unpackhi_epi64 (c2, c6));
+	_mm_storeu_si128 ((__m128i *) (dPtr + 6 * dStep), _mm_unpacklo_epi64 (c3, c7));
+	_mm_storeu_si128 ((__m128i *) (dPtr + 7 * dStep), _mm_unpackhi_epi64 (c3, c7));
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_SSE2
+static void Transpose4x4_32_SSE2 (const uint32 *sPtr,
+								  int32 sStep,
+								  uint32 *dPtr,
+								  int32 dStep)
+	{
+	
+	__m128i a0 = _mm_loadu_si128 ((const __m128i *) (sPtr			 ));
+	__m128i a1 = _mm_loadu_si128 ((const __m128i *) (sPtr +	   sStep));
+	__m128i a2 = _mm_loadu_si128 ((const __m128i *) (sPtr + 2 * sStep));
+	__m128i a3 = _mm_loadu_si128 ((const __m128i *) (sPtr + 3 * sStep));
+	
+	__m128i b0 = _mm_unpacklo_epi32 (a0, a1);
+	__m128i b1 = _mm_unpacklo_epi32 (a2, a3);
+	__m128i b2 = _mm_unpackhi_epi32 (a0, a1);
+	__m128i b3 = _mm_unpackhi_epi32 (a2, a3);
+	
+	_mm_storeu_si128 ((__m128i *) (dPtr			   ), _mm_unpacklo_epi64 (b0, b1));
+	_mm_storeu_si128 ((__m128i *) (dPtr +	  dStep), _mm_unpackhi_epi64 (b0, b1));
+	_mm_storeu_si128 ((__m128i *) (dPtr + 2 * dStep), _mm_unpacklo_epi64 (b2, b3));
+	_mm_storeu_si128 ((__m128i *) (dPtr + 3 * dStep), _mm_unpackhi_epi64 (b2, b3));
+	
+	}
+
+/*****************************************************************************/
+
+DNG_TARGET_AVX2
+static void Transpose8x8_32_AVX2 (const uint32 *sPtr,
+								  int32 sStep,
+								  uint32 *dPtr,
+								  int32 dStep)
+	{
+	
+	__m256i a0 = _mm256_loadu_si256 ((const __m256i *) (sPtr			));
+	__m256i a1 = _mm256_loadu_si256 ((const __m256i *) (sPtr +	   sStep));
+	__m256i a2 = _mm256_loadu_si256 ((const __m256i *) (sPtr + 2 * sStep));
+	__m256i a3 = _mm256_loadu_si256 ((const __m256i *) (sPtr + 3 * sStep));
+	__m256i a4 = _mm256_loadu_si256 ((const __m256i *) (sPtr + 4 * sStep));
+	__m256i a5 = _mm256_loadu_si256 ((const __m256i *) (sPtr + 5 * sStep));
+	__m256i a6 = _mm256_loadu_si256 ((const __m256i *) (sPtr + 6 * sStep));
+	__m256i a7 = _mm256_loadu_si256 ((const __m256i *) (sPtr + 7 * sStep));
+	
+	__m256i b0 = _mm256_unpacklo_epi32 (a0, a1);
+	__m256i b1 = _mm256_unpackhi_epi32 (a0, a1);
+	__m256i b2 = _mm256_unpacklo_epi32 (a2, a3);
+	__m256i b3 = _mm256_unpackhi_epi32 (a2, a3);
+	__m256i b4 = _mm256_unpacklo_epi32 (a4, a5);
+	__m256i b5 = _mm256_unpackhi_epi32 (a4, a5);
+	__m256i b6 = _mm256_unpacklo_epi32 (a6, a7);
+	__m256i b7 = _mm256_unpackhi_epi32 (a6, a7);
+	
+	// Each 128-bit half now holds lanes (0, 1, 2, 3) or (4, 5, 6, 7).
+	
+	__m256i c0 = _mm256_unpacklo_epi64 (b0, b2);
+	__m256i c1 = _mm256_unpackhi_epi64 (b0, b2);
+	__m256i c2 = _mm256_unpacklo_epi64 (b1, b3);
+	__m256i c3 = _mm256_unpackhi_epi64 (b1, b3);
+	__m256i c4 = _mm256_unpacklo_epi64 (b4, b6);
+	__m256i c5 = _mm256_unpackhi_epi64 (b4, b6);
+	__m256i c6 = _mm256_unpacklo_epi64 (b5, b7);
+	__m256i c7 = _mm256_unpackhi_epi64 (b5, b7);
+	
+	_mm256_storeu_si256 ((__m256i *) (dPtr			  ), _mm256_permute2x128_si256 (c0, c4, 0x20));
+	_mm256_storeu_si256 ((__m256i *) (dPtr +	 dStep), _mm256_permute2x128_si256 (c1, c5, 0x20));
+	_mm256_storeu_si256 ((__m256i *) (dPtr + 2 * dStep), _mm256_permute2x128_si256 (c2, c6, 0x20));
+	_mm256_storeu_si256 ((__m256i *) (dPtr + 3 * dStep), _mm256_permute2x128_si256 (c3, c7, 0x20));
+	_mm256_storeu_si256 ((__m256i *) (dPtr + 4 * dStep), _mm256_permute2x128_si256 (c0, c4, 0x31));
+	_mm256_storeu_si256 ((__m256i *) (dPtr + 5 * dStep), _mm256_permute2x128_si256 (c1, c5, 0x31));
+	_mm256_storeu_si256 ((__m256i *) (dPtr + 6 * dStep), _mm256_permute2x128_si256 (c2, c6, 0x31));
+	_mm256_storeu_si256 ((__m256i *) (dPtr + 7 * dStep), _mm256_permute2x128_si256 (c3, c7, 0x31));
+	
+	}
+
+/*****************************************************************************/
+
+#endif	// qDNGIntrinsicsX86
+
+/*****************************************************************************/
+
+#if qDNGIntrinsicsNEON
+
+/*****************************************************************************/
+
+static void Transpose8x8_16_NEON (const uint16 *sPtr,
+								  int32 sStep,
+								  uint16 *dPtr,
+								  int32 dStep)
+	{
+	
+	uint16x8x2_t t01 = vtrnq_u16 (vld1q_u16 (sPtr			 ),
+								  vld1q_u16 (sPtr +		sStep));
+	uint16x8x2_t t23 = vtrnq_u16 (vld1q_u16 (sPtr + 2 * sStep),
+								  vld1q_u16 (sPtr + 3 * sStep));
+	uint16x8x2_t t45 = vtrnq_u16 (vld1q_u16 (sPtr + 4 * sStep),
+								  vld1q_u16 (sPtr + 5 * sStep));
+	uint16x8x2_t t67 = vtrnq_u16 (vld1q_u16 (sPtr + 6 * sStep),
+								  vld1q_u16 (sPtr + 7 * sStep));
+	
+	// Lanes (0, 4) and (2, 6) of vectors 0 to 3, then of vectors 4 to 7.
+	
+	uint32x4x2_t u0 = vtrnq_u32 (vreinterpretq_u32_u16 (t01.val [0]),
+								 vreinterpretq_u32_u16 (t23.val [0]));
+	uint32x4x2_t v0 = vtrnq_u32 (vreinterpretq_u32_u16 (t45.val [0]),
+								 vreinterpretq_u32_u16 (t67.val [0]));
+	
+	// Lanes (1, 5) and (3, 7).
+	
+	uint32x4x2_t u1 = vtrnq_u32 (vreinterpretq_u32_u16 (t01.val [1]),
+								 vreinterpretq_u32_u16 (t23.val [1]));
+	uint32x4x2_t v1 = vtrnq_u32 (vreinterpretq_u32_u16 (t45.val [1]),
+								 vreinterpretq_u32_u16 (t67.val [1]));
+	
+	#define DNG_STORE_ROW(row, u, v, half)										\
+		vst1q_u16 (dPtr + (row) * dStep,										\
+				   vreinterpretq_u16_u32 (vcombine_u32 (vget_##half##_u32 (u),	\
+														vget_##half##_u32 (v))))
+	
+	DNG_STORE_ROW (0, u0.val [0], v0.val [0], low );
+	DNG_STORE_ROW (1, u1.val [0], v1.val [0], low );
+	DNG_STORE_ROW (2, u0.val [1], v0.val [1], low );
+	DNG_STORE_ROW (3, u1.val [1], v1.val [1], low );
+	DNG_STORE_ROW (4, u0.val [0], v0.val [0], high);
+	DNG_STORE_ROW (5, u1.val [0], v1.val [0], high);
+	DNG_STORE_ROW (6, u0.val [1], v0.val [1], high);
+	DNG_STORE_ROW (7, u1.val [1], v1.val [1], high);
+	
+	#undef DNG_STORE_ROW
+	
+	}
+
+/*****************************************************************************/
+
+static void Transpose4x4_32_NEON (const uint32 *sPtr,
+								  int32 sStep,
+								  uint32 *dPtr,
+								  int32 dStep)
+	{
+	
+	uint32x4x2_t t01 = vtrnq_u32 (vld1q_u32 (sPtr			 ),
+								  vld1q_u32 (sPtr +		sStep));
+	uint32x4x2_t t23 = vtrnq_u32 (vld1q_u32 (sPtr + 2 * sStep),
+								  vld1q_u32 (sPtr + 3 * sStep));
+	
+	vst1q_u32 (dPtr			   , vcombine_u32 (vget_low_u32  (t01.val [0]), vget_low_u32  (t23.val [0])));
+	vst1q_u32 (dPtr +	  dStep, vcombine_u32 (vget_low_u32  (t01.val [1]), vget_low_u32  (t23.val [1])));
+	vst1q_u32 (dPtr + 2 * dStep, vcombine_u32 (vget_high_u32 (t01.val [0]), vget_high_u32 (t23.val [0])));
+	vst1q_u32 (dPtr + 3 * dStep, vcombine_u32 (vget_high_u32 (t01.val [1]), vget_high_u32 (t23.val [1])));
+	
+	}
+
+/*****************************************************************************/
+
+#endif	// qDNGIntrinsicsNEON
+
+/*****************************************************************************/
+
+static TransposeKernel16 * SelectTransposeKernel (const uint16 *,
+												  uint32 &size)
+	{
+	
+	#if qDNGIntrinsicsX86
+	
+	if (gDNGMaxSIMD >= SSE2)
+		{
+		size = 8;
+		return Transpose8x8_16_SSE2;
+		}
+	
+	#endif	// qDNGIntrinsicsX86
+	
+	#if qDNGIntrinsicsNEON
+	
+	if (gDNGMaxSIMD >= arm64_neon)
+		{
+		size = 8;
+		return Transpose8x8_16_NEON;
+		}
+	
+	#endif	// qDNGIntrinsicsNEON
+	
+	size = 0;
+	
+	return NULL;
+	
+	}
+
+/*****************************************************************************/
+
+static TransposeKernel32 * SelectTransposeKernel (const uint32 *,
+												  uint32 &size)
+	{
+	
+	#if qDNGIntrinsicsX86
+	
+	if (gDNGMaxSIMD >= AVX2)
+		{
+		size = 8;
+		return Transpose8x8_32_AVX2;
+		}
+	
+	if (gDNGMaxSIMD >= SSE2)
+		{
+		size = 4;
+		return Transpose4x4_32_SSE2;
+		}
+	
+	#endif	// qDNGIntrinsicsX86
+	
+	#if qDNGIntrinsicsNEON
+	
+	if (gDNGMaxSIMD >= arm64_neon)
+		{
+		size = 4;
+		return Transpose4x4_32_NEON;
+		}
+	
+	#endif	// qDNGIntrinsicsNEON
+	
+	size = 0;
+	
+	return NULL;
+	
+	}
+
+/*****************************************************************************/
+
+template <typename T>
+struct dng_transpose_kernel
+	{
+	typedef void (Proc) (const T *sPtr,
+						 int32 sStep,
+						 T *dPtr,
+						 int32 dStep);
+	};
+
+template <typename T>
+static typename dng_transpose_kernel<T>::Proc * SelectTransposeKernel (const T *,
+																	   uint32 &size)
+	{
+	
+	size = 0;
+	
+	return NULL;
+	
+	}
+
+/*****************************************************************************/
+
+// Copies the area of sBuffer into the interleaved, unit column step dBuffer.
+// Source layouts whose columns are not adjacent in memory are copied in
+// square blocks so both sides stay in cache.
+
+template <typename T>
+static void CopyOrientedPixels (const dng_pixel_buffer &sBuffer,
+								dng_pixel_buffer &dBuffer)
+	{
+	
+	const uint32 kBlockSize = 64;
+	
+	const dng_rect &area = dBuffer.fArea;
+	
+	const uint32 rows	= area.H ();
+	const uint32 cols	= area.W ();
+	const uint32 planes = dBuffer.fPlanes;
+	
+	const ptrdiff_t sRowStep   = sBuffer.fRowStep;
+	const ptrdiff_t sColStep   = sBuffer.fColStep;
+	const ptrdiff_t sPlaneStep = sBuffer.fPlaneStep;
+	
+	const ptrdiff_t dRowStep = dBuffer.fRowStep;
+	
+	const T *sPtr = (const T *) sBuffer.ConstPixel (area.t, area.l, sBuffer.fPlane);
+	
+	T *dPtr = (T *) dBuffer.DirtyPixel (area.t, area.l, dBuffer.fPlane);
+	
+	// Rows are still the closer dimension: copy row by row.
+	
+	if (Abs_int32 ((int32) sColStep) < Abs_int32 ((int32) sRowStep))
+		{
+		
+		for (uint32 row = 0; row < rows; row++)
+			{
+			
+			const T *s = sPtr + row * sRowStep;
+			
+			T *d = dPtr + row * dRowStep;
+			
+			for (uint32 col = 0; col < cols; col++)
+				{
+				
+				for (uint32 plane = 0; plane < planes; plane++)
+					{
+					d [plane] = s [plane * sPlaneStep];
+					}
+				
+				s += sColStep;
+				d += planes;
+				
+				}
+			
+			}
+		
+		return;
+		
+		}
+	
+	// Transposed. Single plane images with adjacent source rows can use a
+	// SIMD kernel: source columns become the kernel's input vectors.
+	
+	uint32 kernelSize = 0;
+	
+	typename dng_transpose_kernel<T>::Proc *kernel = NULL;
+	
+	if (planes == 1 && (sRowStep == 1 || sRowStep == -1))
+		{
+		kernel = SelectTransposeKernel (sPtr, kernelSize);
+		}
+		
+	for (uint32 row0 = 0; row0 < rows; row0 += kBlockSize)
+		{
+		
+		const uint32 row1 = Min_uint32 (row0 + kBlockSize, rows);
+		
+		for (uint32 col0 = 0; col0 < cols; col0 += kBlockSize)
+			{
+			
+			const uint32 col1 = Min_uint32 (col0 + kBlockSize, cols);
+			
+			uint32 row = row0;
+			uint32 col = col0;
+			
+			if (kernel)
+				{
+				
+				for (; row + kernelSize <= row1; row += kernelSize)
+					{
+					
+					// With a negative source row step, start each vector at
+					// the last row of the group and write the rows bottom up.
+					
+					const uint32 kernelRow = (sRowStep > 0) ? row : row + kernelSize - 1;
+					
+					const int32 dStep = (int32) ((sRowStep > 0) ? dRowStep : -dRowStep);
+					
+					for (col = col0; col + kernelSize <= col1; col += kernelSize)
+						{
+						
+						kernel (sPtr + kernelRow * sRowStep + col * sColStep,
+								(int32) sColStep,
+								dPtr + kernelRow * dRowStep + col,
+								dStep);
+						
+						}
+						
+					for (uint32 r = row; r < row + kernelSize; r++)
+						{
+						for (uint32 c = col; c < col1; c++)
+							{
+							dPtr [r * dRowStep + c] = sPtr [r * sRowStep + c * sColStep];
+							}
+						}
+					
+					}
+				
+				}
+				
+			for (; row < row1; row++)
+				{
+				
+				const T *s = sPtr + row * sRowStep + col0 * sColStep;
+				
+				T *d = dPtr + row * dRowStep + col0 * planes;
+				
+				for (uint32 c = col0; c < col1; c++)
+					{
+					
+					for (uint32 plane = 0; plane < planes; plane++)
+						{
+						d [plane] = s [plane * sPlaneStep];
+						}
+					
+					s += sColStep;
+					d += planes;
+					
+					}
+				
+				}
+			
+			}
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void dng_simple_image::ApplyOrientation (const dng_orientation &orientation)
+	{
+	
+	Rotate (orientation);
+	
+	MaterializeOrientation ();
+	
+	}
+				
+/*****************************************************************************/
+
+void dng_simple_image::MaterializeOrientation ()
+	{
+	
+	if (fBuffer.fColStep	== (int32) fBuffer.fPlanes &&
+		fBuffer.fPlaneStep	== 1 &&
+		fBuffer.fRowStep	>  0)
+		{
+		return;
+		}
+		
+	uint32 bytes = ComputeBufferSize (fBuffer.fPixelType,
+									  fBounds.Size (),
+									  fBuffer.fPlanes,
+									  padSIMDBytes);
+									  
+	AutoPtr<dng_memory_block> memory (fAllocator.Allocate (bytes));
+	
+	dng_pixel_buffer buffer (fBounds,
+							 fBuffer.fPlane,
+							 fBuffer.fPlanes,
+							 fBuffer.fPixelType,
+							 pcInterleaved,
+							 memory->Buffer ());
+							 
+	switch (fBuffer.fPixelSize)
+		{
+		
+		case 1:
+			CopyOrientedPixels<uint8> (fBuffer, buffer);
+			break;
+			
+		case 2:
+			CopyOrientedPixels<uint16> (fBuffer, buffer);
+			break;
+			
+		case 4:
+			CopyOrientedPixels<uint32> (fBuffer, buffer);
+			break;
+			
+		case 8:
+			CopyOrientedPixels<uint64> (fBuffer, buffer);
+			break;
+			
+		default:
+			ThrowProgramError ("Unsupported pixel size in MaterializeOrientation");
+			
+		}
+		
+	fBuffer = buffer;
+	
+	fMemory.Reset (memory.Release ());
+	
+	}
+				
+/*****************************************************************************/
+
 void dng_simple_image::Offset (const dng_point &offset)
 	{
 	
@@ -57,6 +57,18 @@ class dng_simple_image : public dng_image
 		
 		virtual void Rotate (const dng_orientation &orientation);
 		
+		/// Rotate image according to orientation, then reorder the pixels in
+		/// memory (see MaterializeOrientation).
+		
+		virtual void ApplyOrientation (const dng_orientation &orientation);
+		
+		/// Copy the pixels into a new interleaved buffer with unit column
+		/// step if an earlier Rotate left the buffer with flipped or swapped
+		/// steps. Transposes use cache-blocked SIMD kernels for single plane
+		/// 16 and 32 bit images.
+		
+		void MaterializeOrientation ();
+		
 		/// Offset image.
 		
 		virtual void Offset (const dng_point &offset);
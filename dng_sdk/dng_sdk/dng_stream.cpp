@@ -16,6 +16,7 @@
 #include "dng_flags.h"
 #include "dng_memory.h"
 #include "dng_tag_types.h"
+#include "dng_trace.h"
 #include "dng_assertions.h"
 
 /*****************************************************************************/
@@ -315,6 +316,8 @@ void dng_stream::Get (void *data, uint32 count, uint32 maxOverRead)
 				
 				}
 				
+			dng_trace_scope trace ("stream", "dng_stream read", count);
+				
 			DoRead (data,
 					count,
 					fPosition);
@@ -354,6 +357,10 @@ void dng_stream::Get (void *data, uint32 count, uint32 maxOverRead)
 		
 		dng_abort_sniffer::SniffForAbort (fSniffer);
 		
+		dng_trace_scope trace ("stream",
+							   "dng_stream read",
+							   fBufferEnd - fBufferStart);
+		
 		DoRead (fBuffer,
 				(uint32) (fBufferEnd - fBufferStart),
 				fBufferStart);
@@ -753,6 +753,27 @@ class TempStreamSniffer: private dng_uncopyable
 				
 /*****************************************************************************/
 
+// Burst Photo addition: bytes of a block in a stream, so the block can be
+// copied to another stream without holding it in memory.
+
+struct dng_stream_range
+	{
+	
+	dng_stream *fStream = NULL;
+	
+	uint64 fOffset = 0;
+	
+	uint32 fCount = 0;
+	
+	bool IsValid () const
+		{
+		return fStream != NULL && fCount != 0;
+		}
+	
+	};
+
+/*****************************************************************************/
+
 class PreserveStreamReadPosition: private dng_uncopyable
 	{
 	
@@ -0,0 +1,617 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+#include "dng_threaded_host.h"
+
+#include "dng_abort_sniffer.h"
+#include "dng_area_task.h"
+#include "dng_auto_ptr.h"
+#include "dng_exceptions.h"
+#include "dng_flags.h"
+#include "dng_mutex.h"
+#include "dng_rect.h"
+#include "dng_trace.h"
+#include "dng_tracking_allocator.h"
+#include "dng_utils.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*****************************************************************************/
+
+namespace
+	{
+
+	/*************************************************************************/
+
+	// How often a yielding thread with nothing else to run checks whether
+	// the higher priority work has finished.
+
+	const int kYieldPollMilliseconds = 2;
+
+	/*************************************************************************/
+
+	// Sniffer handed to the area tasks of hosts whose sniffer is below the
+	// maximum priority. At each tile boundary it yields to any higher
+	// priority work, then sniffs the host's sniffer, if this thread may use
+	// it. Progress is not passed on.
+
+	class dng_yield_sniffer: public dng_abort_sniffer
+		{
+
+		private:
+
+			dng_abort_sniffer *fSniffer;
+
+		public:
+
+			dng_yield_sniffer (dng_abort_sniffer *sniffer,
+							   dng_priority priority)
+
+				:	fSniffer (sniffer)
+
+				{
+
+				SetPriority (priority);
+
+				}
+
+			virtual bool ThreadSafe () const
+				{
+				return !fSniffer || fSniffer->ThreadSafe ();
+				}
+
+		protected:
+
+			virtual void Sniff ();
+
+		};
+
+	/*************************************************************************/
+
+	// One call to PerformAreaTask. Parts are claimed by index, so each part
+	// runs exactly once, on either a pool worker or the calling thread.
+
+	struct dng_threaded_job
+		{
+
+		dng_area_task *fTask;
+
+		dng_point fTileSize;
+
+		std::vector<dng_rect> fParts;
+
+		dng_priority fPriority = dng_priority_maximum;
+
+		dng_abort_sniffer *fWorkerSniffer;
+
+		AutoPtr<dng_yield_sniffer> fWorkerYieldSniffer;
+
+		dng_std_mutex fMutex;
+
+		std::condition_variable fCondition;
+
+		uint32 fNextPart = 0;
+
+		uint32 fPartsLeft = 0;
+
+		bool fFailed = false;
+
+		std::exception_ptr fError;
+
+		// Returns false if there is nothing left to claim.
+
+		bool Claim (uint32 &part)
+			{
+
+			dng_lock_std_mutex lock (fMutex);
+
+			if (fFailed || fNextPart >= (uint32) fParts.size ())
+				{
+				return false;
+				}
+
+			part = fNextPart++;
+
+			return true;
+
+			}
+
+		void Run (uint32 part,
+				  dng_abort_sniffer *sniffer,
+				  dng_area_task_progress *progress)
+			{
+
+			try
+				{
+
+				fTask->ProcessOnThread (part,
+										fParts [part],
+										fTileSize,
+										sniffer,
+										progress);
+
+				}
+
+			catch (...)
+				{
+
+				dng_lock_std_mutex lock (fMutex);
+
+				if (!fError)
+					{
+					fError = std::current_exception ();
+					}
+
+				fFailed = true;
+
+				}
+
+			dng_lock_std_mutex lock (fMutex);
+
+			if (--fPartsLeft == 0)
+				{
+				fCondition.notify_all ();
+				}
+
+			}
+
+		};
+
+	/*************************************************************************/
+
+	// Process-wide pool. It is never destroyed, so that detached workers
+	// never see it go away during static destruction. Workers take the
+	// highest priority job first.
+
+	class dng_threaded_pool
+		{
+
+		private:
+
+			dng_std_mutex fMutex;
+
+			std::condition_variable fCondition;
+
+			std::deque<std::shared_ptr<dng_threaded_job> > fQueue [dng_priority_count];
+
+			uint32 fWorkers;
+
+		public:
+
+			explicit dng_threaded_pool (uint32 workers)
+
+				:	fWorkers (workers)
+
+				{
+
+				for (uint32 index = 0; index < workers; index++)
+					{
+
+					std::thread worker ([this] { WorkerLoop (); });
+
+					worker.detach ();
+
+					}
+
+				}
+
+			uint32 Workers () const
+				{
+				return fWorkers;
+				}
+
+			void Post (const std::shared_ptr<dng_threaded_job> &job,
+					   uint32 count)
+				{
+
+					{
+
+					dng_lock_std_mutex lock (fMutex);
+
+					for (uint32 index = 0; index < count; index++)
+						{
+						fQueue [job->fPriority].push_back (job);
+						}
+
+					}
+
+				fCondition.notify_all ();
+
+				}
+
+			// Runs queued parts of jobs at the current minimum priority or
+			// above until no dng_set_minimum_priority object is above
+			// priority. Pool workers therefore keep making progress while
+			// their own lower priority parts are on hold.
+
+			void Yield (dng_priority priority,
+						dng_abort_sniffer *sniffer)
+				{
+
+				dng_priority minimum;
+
+				while (priority < (minimum = dng_set_minimum_priority::Current ()))
+					{
+
+					std::shared_ptr<dng_threaded_job> job;
+
+						{
+
+						dng_unique_lock lock (fMutex);
+
+						job = Pop (minimum);
+
+						if (!job)
+							{
+
+							fCondition.wait_for (lock,
+												 std::chrono::milliseconds (kYieldPollMilliseconds));
+
+							}
+
+						}
+
+					uint32 part;
+
+					if (job && job->Claim (part))
+						{
+
+						job->Run (part, job->fWorkerSniffer, NULL);
+
+						}
+
+					// A job on hold can still be canceled.
+
+					if (sniffer)
+						{
+						sniffer->SniffNoPriorityWait ();
+						}
+
+					}
+
+				}
+
+			static dng_threaded_pool & Get ()
+				{
+
+				static dng_threaded_pool *pool =
+					new dng_threaded_pool (dng_threaded_host::CoreCount () - 1);
+
+				return *pool;
+
+				}
+
+		private:
+
+			// Assumes fMutex is locked.
+
+			std::shared_ptr<dng_threaded_job> Pop (dng_priority minimum)
+				{
+
+				for (int32 level = dng_priority_maximum;
+					 level >= (int32) minimum;
+					 level--)
+					{
+
+					if (!fQueue [level].empty ())
+						{
+
+						std::shared_ptr<dng_threaded_job> job = fQueue [level].front ();
+
+						fQueue [level].pop_front ();
+
+						return job;
+
+						}
+
+					}
+
+				return std::shared_ptr<dng_threaded_job> ();
+
+				}
+
+			void WorkerLoop ()
+				{
+
+				while (true)
+					{
+
+					std::shared_ptr<dng_threaded_job> job;
+
+						{
+
+						dng_unique_lock lock (fMutex);
+
+						while (!(job = Pop (dng_priority_minimum)))
+							{
+							fCondition.wait (lock);
+							}
+
+						}
+
+					uint32 part;
+
+					if (job->Claim (part))
+						{
+
+						job->Run (part, job->fWorkerSniffer, NULL);
+
+						}
+
+					}
+
+				}
+
+		};
+
+	/*************************************************************************/
+
+	void YieldToPriority (dng_priority priority,
+						  dng_abort_sniffer *sniffer)
+		{
+
+		if (priority < dng_set_minimum_priority::Current ())
+			{
+
+			dng_threaded_pool::Get ().Yield (priority, sniffer);
+
+			}
+
+		}
+
+	/*************************************************************************/
+
+	void dng_yield_sniffer::Sniff ()
+		{
+
+		YieldToPriority (Priority (), fSniffer);
+
+		if (fSniffer)
+			{
+			fSniffer->SniffNoPriorityWait ();
+			}
+
+		}
+
+	/*************************************************************************/
+
+	}
+
+/*****************************************************************************/
+
+dng_threaded_host::dng_threaded_host (dng_memory_allocator *allocator,
+									  dng_abort_sniffer *sniffer,
+									  uint32 threadCount)
+
+	:	dng_host (allocator, sniffer)
+
+	#if qDNGThreadSafe
+	,	fThreadCount (threadCount ? threadCount : CoreCount ())
+	#else
+	,	fThreadCount (1)
+	#endif
+
+	{
+
+	}
+
+/*****************************************************************************/
+
+uint32 dng_threaded_host::CoreCount ()
+	{
+
+	uint32 count = (uint32) std::thread::hardware_concurrency ();
+
+	return Max_uint32 (count, 1);
+
+	}
+
+/*****************************************************************************/
+
+uint32 dng_threaded_host::PerformAreaTaskThreads ()
+	{
+
+	return fThreadCount;
+
+	}
+
+/*****************************************************************************/
+
+void dng_threaded_host::SniffForAbort ()
+	{
+
+	dng_abort_sniffer *sniffer = Sniffer ();
+
+	if (sniffer)
+		{
+
+		YieldToPriority (sniffer->Priority (), sniffer);
+
+		sniffer->SniffNoPriorityWait ();
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+void dng_threaded_host::PerformAreaTask (dng_area_task &task,
+										 const dng_rect &area,
+										 dng_area_task_progress *progress)
+	{
+
+	dng_threaded_pool &pool = dng_threaded_pool::Get ();
+
+	// Below the maximum priority, tasks sniff through a dng_yield_sniffer,
+	// which puts them on hold while higher priority work is running.
+
+	dng_abort_sniffer *sniffer = Sniffer ();
+
+	dng_abort_sniffer *workerSniffer = (sniffer && sniffer->ThreadSafe ()) ? sniffer : NULL;
+
+	dng_priority priority = sniffer ? sniffer->Priority () : dng_priority_maximum;
+
+	AutoPtr<dng_yield_sniffer> yieldSniffer;
+
+	if (priority < dng_priority_maximum)
+		{
+
+		yieldSniffer.Reset (new dng_yield_sniffer (sniffer, priority));
+
+		sniffer = yieldSniffer.Get ();
+
+		}
+
+	dng_point tileSize (task.FindTileSize (area));
+
+	if (tileSize.v <= 0 || tileSize.h <= 0 || area.IsEmpty ())
+		{
+
+		dng_area_task::Perform (task, area, &Allocator (), sniffer, progress);
+
+		return;
+
+		}
+
+	// Split along whichever direction has more tiles, in whole tiles.
+
+	uint32 tilesV = (area.H () + tileSize.v - 1) / tileSize.v;
+	uint32 tilesH = (area.W () + tileSize.h - 1) / tileSize.h;
+
+	bool splitV = tilesV >= tilesH;
+
+	uint32 tiles = splitV ? tilesV : tilesH;
+
+	uint32 threadCount = Min_uint32 (fThreadCount, pool.Workers () + 1);
+
+	threadCount = Min_uint32 (threadCount, task.MaxThreads ());
+
+	threadCount = Min_uint32 (threadCount, tiles);
+
+	if (task.MinTaskArea ())
+		{
+
+		uint64 areaPixels = (uint64) area.H () * (uint64) area.W ();
+
+		uint64 limit = areaPixels / task.MinTaskArea ();
+
+		threadCount = (uint32) Min_uint64 (threadCount, Max_uint64 (limit, 1));
+
+		}
+
+	if (threadCount <= 1)
+		{
+
+		dng_area_task::Perform (task, area, &Allocator (), sniffer, progress);
+
+		return;
+
+		}
+
+	dng_trace_scope trace ("task", task.Name ());
+
+	dng_memory_label label (task.Name ());
+
+	auto job = std::make_shared<dng_threaded_job> ();
+
+	job->fTask = &task;
+
+	job->fTileSize = tileSize;
+
+	job->fPriority = priority;
+
+	job->fWorkerSniffer = workerSniffer;
+
+	if (priority < dng_priority_maximum)
+		{
+
+		job->fWorkerYieldSniffer.Reset (new dng_yield_sniffer (workerSniffer, priority));
+
+		job->fWorkerSniffer = job->fWorkerYieldSniffer.Get ();
+
+		}
+
+	for (uint32 index = 0; index < threadCount; index++)
+		{
+
+		uint32 first = (uint32) (((uint64) tiles *  index     ) / threadCount);
+		uint32 last  = (uint32) (((uint64) tiles * (index + 1)) / threadCount);
+
+		dng_rect part (area);
+
+		if (splitV)
+			{
+			part.t = area.t + (int32) (first * tileSize.v);
+			part.b = Min_int32 (area.t + (int32) (last * tileSize.v), area.b);
+			}
+
+		else
+			{
+			part.l = area.l + (int32) (first * tileSize.h);
+			part.r = Min_int32 (area.l + (int32) (last * tileSize.h), area.r);
+			}
+
+		job->fParts.push_back (part);
+
+		}
+
+	job->fPartsLeft = threadCount;
+
+	task.Start (threadCount, area, tileSize, &Allocator (), sniffer);
+
+	pool.Post (job, threadCount - 1);
+
+	// Work on parts here too, including any the workers are too busy to
+	// reach. This keeps nested and concurrent calls from waiting on each
+	// other.
+
+	uint32 part;
+
+	while (job->Claim (part))
+		{
+
+		job->Run (part, sniffer, progress);
+
+		}
+
+		{
+
+		dng_unique_lock lock (job->fMutex);
+
+		// Parts nobody started after a failure will never run.
+
+		if (job->fFailed)
+			{
+
+			uint32 unclaimed = (uint32) job->fParts.size () - job->fNextPart;
+
+			job->fNextPart = (uint32) job->fParts.size ();
+
+			job->fPartsLeft -= unclaimed;
+
+			}
+
+		while (job->fPartsLeft != 0)
+			{
+			job->fCondition.wait (lock);
+			}
+
+		}
+
+	if (job->fError)
+		{
+		std::rethrow_exception (job->fError);
+		}
+
+	task.Finish (threadCount);
+
+	}
+
+/*****************************************************************************/
@@ -0,0 +1,75 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+/** \file
+ * dng_host that runs area tasks on a shared pool of worker threads.
+ */
+
+/*****************************************************************************/
+
+#ifndef __dng_threaded_host__
+#define __dng_threaded_host__
+
+/*****************************************************************************/
+
+#include "dng_host.h"
+
+/*****************************************************************************/
+
+/// \brief dng_host derived class that spreads area tasks over several threads.
+///
+/// All dng_threaded_host objects share one process-wide pool with one worker
+/// per core, less one. The thread calling PerformAreaTask always processes
+/// its own share and then any shares no worker has picked up yet, so hosts
+/// used from many threads at once never use more threads than there are
+/// cores, and nested area tasks cannot deadlock.
+///
+/// If the abort sniffer or progress object is not thread safe, only the
+/// calling thread uses it. Without qDNGThreadSafe the SDK mutexes do
+/// nothing, so this host then runs everything on the calling thread.
+///
+/// Area tasks run at the priority of the abort sniffer. While a
+/// dng_set_minimum_priority object above that priority exists, they stop at
+/// the next tile boundary and resume once it is gone. Threads on hold work
+/// on queued parts of higher priority tasks meanwhile, instead of sleeping
+/// in the priority wait of dng_abort_sniffer::SniffForAbort.
+
+class dng_threaded_host : public dng_host
+	{
+
+	private:
+
+		uint32 fThreadCount;
+
+	public:
+
+		/// Create a threaded host.
+		/// \param allocator Allocator to use, or NULL for the default.
+		/// \param sniffer Abort sniffer to use, or NULL for none.
+		/// \param threadCount Largest number of threads per area task, or 0
+		/// to use one per core.
+
+		dng_threaded_host (dng_memory_allocator *allocator = NULL,
+						   dng_abort_sniffer *sniffer = NULL,
+						   uint32 threadCount = 0);
+
+		virtual void PerformAreaTask (dng_area_task &task,
+									  const dng_rect &area,
+									  dng_area_task_progress *progress = NULL);
+
+		virtual uint32 PerformAreaTaskThreads ();
+
+		virtual void SniffForAbort ();
+
+		/// Number of cores reported by the system, at least 1.
+
+		static uint32 CoreCount ();
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
@@ -0,0 +1,324 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+#include "dng_trace.h"
+
+#include "dng_exceptions.h"
+#include "dng_mutex.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+
+namespace
+	{
+
+	/*************************************************************************/
+
+	struct dng_trace_event
+		{
+
+		const char *fCategory;
+
+		std::string fName;
+
+		int64 fStart;
+
+		int64 fEnd;
+
+		uint64 fBytes;
+
+		};
+
+	/*************************************************************************/
+
+	// Events of one thread. The mutex is only contended while Start or
+	// Stop is running.
+
+	struct dng_trace_buffer
+		{
+
+		uint32 fThreadID;
+
+		dng_std_mutex fMutex;
+
+		std::vector<dng_trace_event> fEvents;
+
+		};
+
+	/*************************************************************************/
+
+	// All buffers ever created. Buffers are never freed, since pool worker
+	// threads may still record during static destruction.
+
+	struct dng_trace_registry
+		{
+
+		dng_std_mutex fMutex;
+
+		std::vector<dng_trace_buffer *> fBuffers;
+
+		int64 fStart = 0;
+
+		static dng_trace_registry & Get ()
+			{
+
+			static dng_trace_registry *registry = new dng_trace_registry;
+
+			return *registry;
+
+			}
+
+		};
+
+	/*************************************************************************/
+
+	thread_local dng_trace_buffer *tBuffer = NULL;
+
+	/*************************************************************************/
+
+	dng_trace_buffer & ThreadBuffer ()
+		{
+
+		if (!tBuffer)
+			{
+
+			dng_trace_registry &registry = dng_trace_registry::Get ();
+
+			dng_trace_buffer *buffer = new dng_trace_buffer;
+
+			dng_lock_std_mutex lock (registry.fMutex);
+
+			buffer->fThreadID = (uint32) registry.fBuffers.size () + 1;
+
+			registry.fBuffers.push_back (buffer);
+
+			tBuffer = buffer;
+
+			}
+
+		return *tBuffer;
+
+		}
+
+	/*************************************************************************/
+
+	// Names come from area task names and string literals, but escape them
+	// anyway so the file always parses.
+
+	void PutString (FILE *file,
+					const char *s)
+		{
+
+		fputc ('"', file);
+
+		for (; *s; s++)
+			{
+
+			uint8 c = (uint8) *s;
+
+			if (c == '"' || c == '\\')
+				{
+				fputc ('\\', file);
+				fputc (c, file);
+				}
+
+			else if (c < 0x20)
+				{
+				fprintf (file, "\\u%04x", (unsigned) c);
+				}
+
+			else
+				{
+				fputc (c, file);
+				}
+
+			}
+
+		fputc ('"', file);
+
+		}
+
+	/*************************************************************************/
+
+	}
+
+/*****************************************************************************/
+
+std::atomic<bool> dng_trace::sEnabled (false);
+
+/*****************************************************************************/
+
+int64 dng_trace::Now ()
+	{
+
+	using namespace std::chrono;
+
+	return (int64) duration_cast<nanoseconds>
+				   (steady_clock::now ().time_since_epoch ()).count ();
+
+	}
+
+/*****************************************************************************/
+
+void dng_trace::Start ()
+	{
+
+	dng_trace_registry &registry = dng_trace_registry::Get ();
+
+	dng_lock_std_mutex lock (registry.fMutex);
+
+	for (dng_trace_buffer *buffer : registry.fBuffers)
+		{
+
+		dng_lock_std_mutex bufferLock (buffer->fMutex);
+
+		buffer->fEvents.clear ();
+
+		}
+
+	registry.fStart = Now ();
+
+	sEnabled.store (true);
+
+	}
+
+/*****************************************************************************/
+
+void dng_trace::Stop (const char *path)
+	{
+
+	sEnabled.store (false);
+
+	dng_trace_registry &registry = dng_trace_registry::Get ();
+
+	dng_lock_std_mutex lock (registry.fMutex);
+
+	FILE *file = fopen (path, "wb");
+
+	if (!file)
+		{
+		ThrowOpenFile ();
+		}
+
+	fputs ("{\"traceEvents\":[\n", file);
+
+	bool first = true;
+
+	for (dng_trace_buffer *buffer : registry.fBuffers)
+		{
+
+		std::vector<dng_trace_event> events;
+
+			{
+
+			dng_lock_std_mutex bufferLock (buffer->fMutex);
+
+			events.swap (buffer->fEvents);
+
+			}
+
+		if (events.empty ())
+			{
+			continue;
+			}
+
+		fprintf (file,
+				 "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+				 "\"args\":{\"name\":\"dng thread %u\"}}",
+				 first ? "" : ",\n",
+				 (unsigned) buffer->fThreadID,
+				 (unsigned) buffer->fThreadID);
+
+		first = false;
+
+		for (const dng_trace_event &event : events)
+			{
+
+			fputs (",\n{\"name\":", file);
+
+			PutString (file, event.fName.c_str ());
+
+			fputs (",\"cat\":", file);
+
+			PutString (file, event.fCategory);
+
+			fprintf (file,
+					 ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+					 (double) (event.fStart - registry.fStart) * 1.0e-3,
+					 (double) (event.fEnd - event.fStart) * 1.0e-3,
+					 (unsigned) buffer->fThreadID);
+
+			if (event.fBytes)
+				{
+
+				fprintf (file,
+						 ",\"args\":{\"bytes\":%llu}",
+						 (unsigned long long) event.fBytes);
+
+				}
+
+			fputc ('}', file);
+
+			}
+
+		}
+
+	fputs ("\n]}\n", file);
+
+	bool failed = ferror (file) != 0;
+
+	if (fclose (file) != 0 || failed)
+		{
+		ThrowWriteFile ();
+		}
+
+	}
+
+/*****************************************************************************/
+
+void dng_trace::Record (const char *category,
+						const char *name,
+						int64 start,
+						int64 end,
+						uint64 bytes)
+	{
+
+	if (!IsEnabled ())
+		{
+		return;
+		}
+
+	// Called from destructors, so an event that cannot be stored is dropped.
+
+	try
+		{
+
+		dng_trace_buffer &buffer = ThreadBuffer ();
+
+		dng_lock_std_mutex lock (buffer.fMutex);
+
+		buffer.fEvents.push_back (dng_trace_event ());
+
+		dng_trace_event &event = buffer.fEvents.back ();
+
+		event.fCategory = category;
+		event.fName		= name ? name : "";
+		event.fStart	= start;
+		event.fEnd		= end;
+		event.fBytes	= bytes;
+
+		}
+
+	catch (...)
+		{
+
+		}
+
+	}
+
+/*****************************************************************************/
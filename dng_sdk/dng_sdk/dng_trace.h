@@ -0,0 +1,144 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+/** \file
+ * Opt-in timeline of area tasks, tiles, stream reads and API calls, written
+ * as Chrome trace event JSON.
+ */
+
+/*****************************************************************************/
+
+#ifndef __dng_trace__
+#define __dng_trace__
+
+/*****************************************************************************/
+
+#include "dng_types.h"
+#include "dng_uncopyable.h"
+
+#include <atomic>
+
+/*****************************************************************************/
+
+/// \brief Process-wide recorder of timed events.
+///
+/// Recording is off until Start is called. While it is off, a
+/// dng_trace_scope costs one atomic load. While it is on, each event is
+/// appended to a buffer owned by the recording thread, so threads never
+/// wait on each other. Stop writes all events in the Chrome trace event
+/// format, which chrome://tracing and Perfetto can open.
+
+class dng_trace
+	{
+
+	private:
+
+		static std::atomic<bool> sEnabled;
+
+	public:
+
+		/// Discard any earlier events and start recording.
+
+		static void Start ();
+
+		/// Stop recording and write the events recorded since Start to a
+		/// JSON file. Throws dng_error_open_file or dng_error_write_file on
+		/// failure.
+		/// \param path Path of the file to write.
+
+		static void Stop (const char *path);
+
+		/// Is recording on?
+
+		static bool IsEnabled ()
+			{
+			return sEnabled.load (std::memory_order_relaxed);
+			}
+
+		/// Time on the steady clock, in nanoseconds.
+
+		static int64 Now ();
+
+		/// Record a complete event on the calling thread.
+		/// \param category Event category, such as "tile". Must be a string
+		/// literal or otherwise outlive the recording.
+		/// \param name Event name. Copied.
+		/// \param start Start time from Now.
+		/// \param end End time from Now.
+		/// \param bytes Byte count to attach, or 0 for none.
+
+		static void Record (const char *category,
+							const char *name,
+							int64 start,
+							int64 end,
+							uint64 bytes = 0);
+
+	};
+
+/*****************************************************************************/
+
+/// \brief Records the lifetime of a stack allocated object as one event.
+
+class dng_trace_scope: private dng_uncopyable
+	{
+
+	private:
+
+		const char *fCategory;
+
+		const char *fName;
+
+		uint64 fBytes;
+
+		int64 fStart;
+
+	public:
+
+		/// \param category Event category. Must outlive the recording.
+		/// \param name Event name. Must stay valid until the scope ends.
+		/// \param bytes Byte count to attach, or 0 for none.
+
+		dng_trace_scope (const char *category,
+						 const char *name,
+						 uint64 bytes = 0)
+
+			:	fCategory (category)
+			,	fName	  (name)
+			,	fBytes	  (bytes)
+			,	fStart	  (dng_trace::IsEnabled () ? dng_trace::Now () : -1)
+
+			{
+
+			}
+
+		~dng_trace_scope ()
+			{
+
+			if (fStart >= 0)
+				{
+
+				dng_trace::Record (fCategory,
+								   fName,
+								   fStart,
+								   dng_trace::Now (),
+								   fBytes);
+
+				}
+
+			}
+
+		/// Set the byte count once it is known.
+
+		void SetBytes (uint64 bytes)
+			{
+			fBytes = bytes;
+			}
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
@@ -0,0 +1,393 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+#include "dng_tracking_allocator.h"
+
+#include "dng_auto_ptr.h"
+#include "dng_exceptions.h"
+#include "dng_utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+/*****************************************************************************/
+
+namespace
+	{
+
+	thread_local const char *tLabel = NULL;
+
+	// Tag the calling thread charged last, and the allocator it belongs to.
+
+	thread_local uint64 tCachedSerial = 0;
+
+	thread_local void *tCachedTag = NULL;
+
+	std::atomic<uint64> gNextSerial (1);
+
+	// Raise peak to at least value.
+
+	void UpdatePeak (std::atomic<uint64> &peak,
+					 uint64 value)
+		{
+
+		uint64 old = peak.load (std::memory_order_relaxed);
+
+		while (old < value &&
+			   !peak.compare_exchange_weak (old,
+											value,
+											std::memory_order_relaxed))
+			{
+			}
+
+		}
+
+	// Placed in front of each Malloc result to find its tag and size again
+	// in Free. Two words keep the result aligned as malloc aligns.
+
+	struct malloc_header
+		{
+
+		void *fTag;
+
+		uint64 fSize;
+
+		};
+
+	}
+
+/*****************************************************************************/
+
+dng_memory_label::dng_memory_label (const char *label)
+
+	:	fPrevious (tLabel)
+
+	{
+
+	tLabel = label;
+
+	}
+
+/*****************************************************************************/
+
+dng_memory_label::~dng_memory_label ()
+	{
+
+	tLabel = fPrevious;
+
+	}
+
+/*****************************************************************************/
+
+const char * dng_memory_label::Current ()
+	{
+
+	return tLabel;
+
+	}
+
+/*****************************************************************************/
+
+// Block from the base allocator, released back to the tracking allocator's
+// books when deleted.
+
+class dng_tracking_allocator::tracked_block: public dng_memory_block
+	{
+
+	private:
+
+		dng_tracking_allocator &fAllocator;
+
+		tag *fTag;
+
+		AutoPtr<dng_memory_block> fBlock;
+
+	public:
+
+		tracked_block (dng_tracking_allocator &allocator,
+					   tag *t,
+					   dng_memory_block *block)
+
+			:	dng_memory_block (block->LogicalSize ())
+			,	fAllocator (allocator)
+			,	fTag	   (t)
+			,	fBlock	   (block)
+
+			{
+
+			SetBuffer (fBlock->Buffer ());
+
+			}
+
+		virtual ~tracked_block ()
+			{
+
+			fAllocator.Release (fTag, LogicalSize ());
+
+			}
+
+	};
+
+/*****************************************************************************/
+
+dng_tracking_allocator::dng_tracking_allocator (dng_memory_allocator &base,
+												uint64 budget)
+
+	:	fBase		  (base)
+	,	fSerial		  (gNextSerial++)
+	,	fCurrentBytes (0)
+	,	fPeakBytes	  (0)
+	,	fBudget		  (budget)
+	,	fMutex		  ()
+	,	fTags		  ()
+
+	{
+
+	}
+
+/*****************************************************************************/
+
+void dng_tracking_allocator::SetBudget (uint64 budget)
+	{
+
+	fBudget.store (budget);
+
+	}
+
+/*****************************************************************************/
+
+dng_tracking_allocator::snapshot dng_tracking_allocator::Snapshot () const
+	{
+
+	snapshot result;
+
+	result.fCurrentBytes = fCurrentBytes.load ();
+	result.fPeakBytes	 = fPeakBytes.load ();
+	result.fBudget		 = fBudget.load ();
+
+		{
+
+		dng_lock_std_mutex lock (fMutex);
+
+		for (const auto &entry : fTags)
+			{
+
+			usage u;
+
+			u.fLabel		= entry.first;
+			u.fCurrentBytes = entry.second.fCurrentBytes.load ();
+			u.fPeakBytes	= entry.second.fPeakBytes.load ();
+
+			result.fLabels.push_back (u);
+
+			}
+
+		}
+
+	std::stable_sort (result.fLabels.begin (),
+					  result.fLabels.end (),
+					  [] (const usage &a, const usage &b)
+					  {
+					  return a.fPeakBytes > b.fPeakBytes;
+					  });
+
+	return result;
+
+	}
+
+/*****************************************************************************/
+
+dng_tracking_allocator::tag * dng_tracking_allocator::FindTag (const char *label)
+	{
+
+	if (!label)
+		{
+		label = "untagged";
+		}
+
+	// Task names are copied into each task, so compare the text rather
+	// than the pointer. A thread mostly charges the same label many times
+	// in a row.
+
+	if (tCachedSerial == fSerial)
+		{
+
+		tag *cached = static_cast<tag *> (tCachedTag);
+
+		if (strcmp (cached->fLabel.c_str (), label) == 0)
+			{
+			return cached;
+			}
+
+		}
+
+	tag *t;
+
+		{
+
+		dng_lock_std_mutex lock (fMutex);
+
+		auto it = fTags.find (label);
+
+		if (it == fTags.end ())
+			{
+
+			it = fTags.emplace (std::piecewise_construct,
+								std::forward_as_tuple (label),
+								std::forward_as_tuple ()).first;
+
+			it->second.fLabel = it->first;
+
+			}
+
+		t = &it->second;
+
+		}
+
+	tCachedSerial = fSerial;
+	tCachedTag	  = t;
+
+	return t;
+
+	}
+
+/*****************************************************************************/
+
+dng_tracking_allocator::tag * dng_tracking_allocator::Charge (uint64 size)
+	{
+
+	tag *t = FindTag (dng_memory_label::Current ());
+
+	uint64 total = fCurrentBytes.fetch_add (size) + size;
+
+	uint64 budget = fBudget.load (std::memory_order_relaxed);
+
+	if (budget && total > budget)
+		{
+
+		fCurrentBytes.fetch_sub (size);
+
+		ThrowMemoryFull ("Memory budget exceeded");
+
+		}
+
+	UpdatePeak (fPeakBytes, total);
+
+	UpdatePeak (t->fPeakBytes, t->fCurrentBytes.fetch_add (size) + size);
+
+	return t;
+
+	}
+
+/*****************************************************************************/
+
+void dng_tracking_allocator::Release (tag *t,
+									  uint64 size)
+	{
+
+	t->fCurrentBytes.fetch_sub (size);
+
+	fCurrentBytes.fetch_sub (size);
+
+	}
+
+/*****************************************************************************/
+
+dng_memory_block * dng_tracking_allocator::Allocate (uint32 size)
+	{
+
+	tag *t = Charge (size);
+
+	try
+		{
+
+		AutoPtr<dng_memory_block> block (fBase.Allocate (size));
+
+		dng_memory_block *result = new tracked_block (*this, t, block.Get ());
+
+		block.Release ();
+
+		return result;
+
+		}
+
+	catch (...)
+		{
+
+		Release (t, size);
+
+		throw;
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+void * dng_tracking_allocator::Malloc (size_t size)
+	{
+
+	if (size > ~((size_t) 0) - sizeof (malloc_header))
+		{
+		return NULL;
+		}
+
+	tag *t = Charge (size);
+
+	void *result = NULL;
+
+	try
+		{
+
+		result = fBase.Malloc (size + sizeof (malloc_header));
+
+		}
+
+	catch (...)
+		{
+
+		Release (t, size);
+
+		throw;
+
+		}
+
+	if (!result)
+		{
+
+		Release (t, size);
+
+		return NULL;
+
+		}
+
+	malloc_header *header = static_cast<malloc_header *> (result);
+
+	header->fTag  = t;
+	header->fSize = size;
+
+	return header + 1;
+
+	}
+
+/*****************************************************************************/
+
+void dng_tracking_allocator::Free (void *ptr)
+	{
+
+	if (!ptr)
+		{
+		return;
+		}
+
+	malloc_header *header = static_cast<malloc_header *> (ptr) - 1;
+
+	Release (static_cast<tag *> (header->fTag), header->fSize);
+
+	fBase.Free (header);
+
+	}
+
+/*****************************************************************************/
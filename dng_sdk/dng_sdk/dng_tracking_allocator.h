@@ -0,0 +1,191 @@
+/*****************************************************************************/
+// Burst Photo addition to the DNG SDK.
+/*****************************************************************************/
+
+/** \file
+ * Memory allocator that accounts for allocations by label and can enforce a
+ * budget.
+ */
+
+/*****************************************************************************/
+
+#ifndef __dng_tracking_allocator__
+#define __dng_tracking_allocator__
+
+/*****************************************************************************/
+
+#include "dng_memory.h"
+#include "dng_mutex.h"
+#include "dng_types.h"
+#include "dng_uncopyable.h"
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+
+/// \brief Labels the allocations made by the current thread while this
+/// object exists.
+///
+/// Labels nest; the innermost one applies. Area tasks label the work they
+/// do with their task name, so allocations in Start, Process and Finish
+/// are charged to the task. Instances are intended to be stack allocated.
+
+class dng_memory_label: private dng_uncopyable
+	{
+
+	private:
+
+		const char *fPrevious;
+
+	public:
+
+		/// \param label Label to apply. Must stay valid until this object is
+		/// destroyed.
+
+		explicit dng_memory_label (const char *label);
+
+		~dng_memory_label ();
+
+		/// Innermost label of the calling thread, or NULL if there is none.
+
+		static const char * Current ();
+
+	};
+
+/*****************************************************************************/
+
+/// \brief dng_memory_allocator that keeps current and peak bytes per label.
+///
+/// Allocations are passed on to a base allocator and charged to the
+/// dng_memory_label active on the allocating thread, or to "untagged". If a
+/// budget is set, an allocation that would take the total above it throws
+/// dng_error_memory instead, so a process can fail one job before the
+/// system runs out of memory. Sizes are the requested sizes, without the
+/// small padding dng_memory_block adds.
+///
+/// The counters are atomic and each thread remembers the label it last
+/// charged, so allocations from worker threads do not serialize on a lock.
+/// The lock is only taken the first time a thread charges a label, and by
+/// Snapshot.
+///
+/// The allocator must outlive every block it allocates.
+
+class dng_tracking_allocator: public dng_memory_allocator,
+							  private dng_uncopyable
+	{
+
+	public:
+
+		/// Bytes charged to one label.
+
+		struct usage
+			{
+
+			std::string fLabel;
+
+			uint64 fCurrentBytes;
+
+			uint64 fPeakBytes;
+
+			};
+
+		/// State of the allocator at one point in time.
+
+		struct snapshot
+			{
+
+			uint64 fCurrentBytes;
+
+			uint64 fPeakBytes;
+
+			uint64 fBudget;
+
+			/// Labels in order of decreasing peak bytes.
+
+			std::vector<usage> fLabels;
+
+			};
+
+	private:
+
+		struct tag
+			{
+
+			std::string fLabel;
+
+			std::atomic<uint64> fCurrentBytes {0};
+
+			std::atomic<uint64> fPeakBytes {0};
+
+			};
+
+		class tracked_block;
+
+		dng_memory_allocator &fBase;
+
+		// Distinguishes this allocator in the per-thread tag cache.
+
+		const uint64 fSerial;
+
+		std::atomic<uint64> fCurrentBytes;
+
+		std::atomic<uint64> fPeakBytes;
+
+		std::atomic<uint64> fBudget;
+
+		// Guards fTags. Tags are never removed, so blocks and the per-thread
+		// cache can keep pointers to them.
+
+		mutable dng_std_mutex fMutex;
+
+		std::map<std::string, tag> fTags;
+
+	public:
+
+		/// \param base Allocator doing the actual allocations.
+		/// \param budget Largest total number of bytes allocated at once, or
+		/// 0 for no limit.
+
+		explicit dng_tracking_allocator (dng_memory_allocator &base = gDefaultDNGMemoryAllocator,
+										 uint64 budget = 0);
+
+		/// Change the budget. Allocations already made are kept even if they
+		/// exceed the new budget.
+		/// \param budget Largest total number of bytes, or 0 for no limit.
+
+		void SetBudget (uint64 budget);
+
+		/// Current state of the allocator.
+
+		snapshot Snapshot () const;
+
+		virtual dng_memory_block * Allocate (uint32 size);
+
+		virtual void * Malloc (size_t size);
+
+		virtual void Free (void *ptr);
+
+	private:
+
+		// Charge size bytes to the label of the calling thread. Throws if
+		// the budget does not allow it.
+
+		tag * Charge (uint64 size);
+
+		// Tag of a label, created on first use.
+
+		tag * FindTag (const char *label);
+
+		void Release (tag *t,
+					  uint64 size);
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
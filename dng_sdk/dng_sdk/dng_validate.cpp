@@ -70,6 +70,10 @@ static uint32 gMaximumSize	 = 0;
 
 static uint32 gProxyDNGSize = 0;
 
+static bool gMosaicProxy = false;
+
+static dng_negative::MosaicProxyFilterEnum gMosaicProxyFilter = dng_negative::mosaicProxyBox;
+
 static const dng_color_space *gFinalSpace = &dng_space_sRGB::Get ();
 
 static uint32 gFinalPixelType = ttByte;
@@ -240,6 +244,22 @@ static dng_error_code dng_validate (const char *filename)
 			negative->BuildStage2Image (host);
 								 
 			}
+			
+		// Convert to a mosaic proxy, if requested. The stage 3 image is then
+		// only built from the proxy to render the previews.
+		
+		bool mosaicProxy = false;
+		
+		if (gProxyDNGSize && gMosaicProxy && negative->Stage2Image ())
+			{
+			
+			dng_timer timer ("ConvertToMosaicProxy time");
+			
+			mosaicProxy = negative->ConvertToMosaicProxy (host,
+														  gProxyDNGSize,
+														  gMosaicProxyFilter);
+			
+			}
 					 
 		if (gDumpStage2.NotEmpty ())
 			{
@@ -295,7 +315,7 @@ static dng_error_code dng_validate (const char *filename)
 			
 		// Convert to proxy, if requested.
 		
-		if (gProxyDNGSize)
+		if (gProxyDNGSize && !mosaicProxy)
 			{
 			
 			dng_timer timer ("ConvertToProxy time");
@@ -548,7 +568,7 @@ static dng_error_code dng_validate (const char *filename)
 				
 				}
 				
-			finalImage->Rotate (negative->Orientation ());
+			finalImage->ApplyOrientation (negative->Orientation ());
 			
 			// Now that Camera Raw supports non-raw formats, we should
 			// not keep any Camera Raw settings in the XMP around when
@@ -649,6 +669,8 @@ int main (int argc, char *argv [])
 					 "-min <num>			Minimum preview image size\n"
 					 "-max <num>			Maximum preview image size\n"
 					 "-proxy <num>			Target size for proxy DNG\n"
+					 "-mosaicproxy <filter>	Make -proxy DNGs by downsampling the CFA data\n"
+					 "						with a \"box\" or \"binomial\" filter\n"
 					 "-cs1					Color space: \"sRGB\" (default)\n"
 					 "-cs2					Color space: \"Adobe RGB\"\n"
 					 "-cs3					Color space: \"ProPhoto RGB\"\n"
@@ -794,6 +816,36 @@ int main (int argc, char *argv [])
 
 				}
 					
+			else if (option.Matches ("mosaicproxy", true))
+				{
+				
+				dng_string filter;
+				
+				if (index + 1 < argc)
+					{
+					filter.Set (argv [++index]);
+					}
+				
+				if (filter.Matches ("box"))
+					{
+					gMosaicProxyFilter = dng_negative::mosaicProxyBox;
+					}
+					
+				else if (filter.Matches ("binomial"))
+					{
+					gMosaicProxyFilter = dng_negative::mosaicProxyBinomial;
+					}
+					
+				else
+					{
+					fprintf (stderr, "*** Missing \"box\" or \"binomial\" after -mosaicproxy\n");
+					return 1;
+					}
+					
+				gMosaicProxy = true;
+
+				}
+					
 			else if (option.Matches ("cs1", true))
 				{
 				
@@ -12,6 +12,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 /* Private subobject */
@@ -185,6 +186,115 @@ rgb_ycc_convert (j_compress_ptr cinfo,
 }
 
 
+#if defined(JSIMD_SUPPORTED) && \
+    RGB_RED == 0 && RGB_GREEN == 1 && RGB_BLUE == 2 && RGB_PIXELSIZE == 3
+#define JSIMD_RGB_YCC
+
+/*
+ * SIMD versions of rgb_ycc_convert and rgb_gray_convert (local addition
+ * for the DNG SDK).  The table entries are the products FIX(k) * i, so
+ * multiplying by the constants gives the same sums.  The tables are still
+ * used for the last few pixels of each row.
+ */
+
+METHODDEF(void) JSIMD_TARGET
+rgb_ycc_convert_simd (j_compress_ptr cinfo,
+		      JSAMPARRAY input_buf, JSAMPIMAGE output_buf,
+		      JDIMENSION output_row, int num_rows)
+{
+  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+  INT32 * ctab = cconvert->rgb_ycc_tab;
+  int r, g, b;
+  JSAMPROW inptr;
+  JSAMPROW outptr0, outptr1, outptr2;
+  JDIMENSION col;
+  JDIMENSION num_cols = cinfo->image_width;
+  jsimd_v8 rv, gv, bv;
+
+  while (--num_rows >= 0) {
+    inptr = *input_buf++;
+    outptr0 = output_buf[0][output_row];
+    outptr1 = output_buf[1][output_row];
+    outptr2 = output_buf[2][output_row];
+    output_row++;
+    for (col = 0; col + 8 <= num_cols; col += 8) {
+      jsimd_load_rgb(inptr + col * RGB_PIXELSIZE, &rv, &gv, &bv);
+      /* Y */
+      jsimd_store_u8(outptr0 + col, jsimd_sra(
+	jsimd_add(jsimd_add(jsimd_mul(rv, jsimd_set1(FIX(0.299))),
+			    jsimd_mul(gv, jsimd_set1(FIX(0.587)))),
+		  jsimd_add(jsimd_mul(bv, jsimd_set1(FIX(0.114))),
+			    jsimd_set1(ONE_HALF))), SCALEBITS));
+      /* Cb */
+      jsimd_store_u8(outptr1 + col, jsimd_sra(
+	jsimd_add(jsimd_add(jsimd_mul(rv, jsimd_set1(-FIX(0.168735892))),
+			    jsimd_mul(gv, jsimd_set1(-FIX(0.331264108)))),
+		  jsimd_add(jsimd_mul(bv, jsimd_set1(FIX(0.5))),
+			    jsimd_set1(CBCR_OFFSET + ONE_HALF-1))), SCALEBITS));
+      /* Cr */
+      jsimd_store_u8(outptr2 + col, jsimd_sra(
+	jsimd_add(jsimd_add(jsimd_mul(rv, jsimd_set1(FIX(0.5))),
+			    jsimd_mul(gv, jsimd_set1(-FIX(0.418687589)))),
+		  jsimd_add(jsimd_mul(bv, jsimd_set1(-FIX(0.081312411))),
+			    jsimd_set1(CBCR_OFFSET + ONE_HALF-1))), SCALEBITS));
+    }
+    for (; col < num_cols; col++) {
+      r = GETJSAMPLE(inptr[col * RGB_PIXELSIZE + RGB_RED]);
+      g = GETJSAMPLE(inptr[col * RGB_PIXELSIZE + RGB_GREEN]);
+      b = GETJSAMPLE(inptr[col * RGB_PIXELSIZE + RGB_BLUE]);
+      outptr0[col] = (JSAMPLE)
+		((ctab[r+R_Y_OFF] + ctab[g+G_Y_OFF] + ctab[b+B_Y_OFF])
+		 >> SCALEBITS);
+      outptr1[col] = (JSAMPLE)
+		((ctab[r+R_CB_OFF] + ctab[g+G_CB_OFF] + ctab[b+B_CB_OFF])
+		 >> SCALEBITS);
+      outptr2[col] = (JSAMPLE)
+		((ctab[r+R_CR_OFF] + ctab[g+G_CR_OFF] + ctab[b+B_CR_OFF])
+		 >> SCALEBITS);
+    }
+  }
+}
+
+
+METHODDEF(void) JSIMD_TARGET
+rgb_gray_convert_simd (j_compress_ptr cinfo,
+		       JSAMPARRAY input_buf, JSAMPIMAGE output_buf,
+		       JDIMENSION output_row, int num_rows)
+{
+  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+  INT32 * ctab = cconvert->rgb_ycc_tab;
+  int r, g, b;
+  JSAMPROW inptr;
+  JSAMPROW outptr;
+  JDIMENSION col;
+  JDIMENSION num_cols = cinfo->image_width;
+  jsimd_v8 rv, gv, bv;
+
+  while (--num_rows >= 0) {
+    inptr = *input_buf++;
+    outptr = output_buf[0][output_row++];
+    for (col = 0; col + 8 <= num_cols; col += 8) {
+      jsimd_load_rgb(inptr + col * RGB_PIXELSIZE, &rv, &gv, &bv);
+      jsimd_store_u8(outptr + col, jsimd_sra(
+	jsimd_add(jsimd_add(jsimd_mul(rv, jsimd_set1(FIX(0.299))),
+			    jsimd_mul(gv, jsimd_set1(FIX(0.587)))),
+		  jsimd_add(jsimd_mul(bv, jsimd_set1(FIX(0.114))),
+			    jsimd_set1(ONE_HALF))), SCALEBITS));
+    }
+    for (; col < num_cols; col++) {
+      r = GETJSAMPLE(inptr[col * RGB_PIXELSIZE + RGB_RED]);
+      g = GETJSAMPLE(inptr[col * RGB_PIXELSIZE + RGB_GREEN]);
+      b = GETJSAMPLE(inptr[col * RGB_PIXELSIZE + RGB_BLUE]);
+      outptr[col] = (JSAMPLE)
+		((ctab[r+R_Y_OFF] + ctab[g+G_Y_OFF] + ctab[b+B_Y_OFF])
+		 >> SCALEBITS);
+    }
+  }
+}
+
+#endif /* JSIMD_RGB_YCC */
+
+
 /**************** Cases other than RGB -> YCbCr **************/
 
 
@@ -497,6 +607,10 @@ jinit_color_converter (j_compress_ptr cinfo)
     case JCS_RGB:
       cconvert->pub.start_pass = rgb_ycc_start;
       cconvert->pub.color_convert = rgb_gray_convert;
+#ifdef JSIMD_RGB_YCC
+      if (jsimd_support())
+	cconvert->pub.color_convert = rgb_gray_convert_simd;
+#endif
       break;
     default:
       ERREXIT(cinfo, JERR_CONVERSION_NOTIMPL);
@@ -529,6 +643,10 @@ jinit_color_converter (j_compress_ptr cinfo)
     case JCS_RGB:
       cconvert->pub.start_pass = rgb_ycc_start;
       cconvert->pub.color_convert = rgb_ycc_convert;
+#ifdef JSIMD_RGB_YCC
+      if (jsimd_support())
+	cconvert->pub.color_convert = rgb_ycc_convert_simd;
+#endif
       break;
     case JCS_YCbCr:
       cconvert->pub.color_convert = null_convert;
@@ -16,6 +16,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
 
 
 /* Private subobject for this module */
@@ -131,6 +132,51 @@ forward_DCT (j_compress_ptr cinfo, jpeg_component_info * compptr,
 }
 
 
+#ifdef JSIMD_SUPPORTED
+
+/*
+ * SIMD version of forward_DCT for ISLOW-style divisor tables (local
+ * addition for the DNG SDK).  The rounding and the sign handling are the
+ * same as above; jsimd_div gives the exact quotient for the magnitudes
+ * that occur with 8-bit samples.
+ */
+
+METHODDEF(void) JSIMD_TARGET
+forward_DCT_simd (j_compress_ptr cinfo, jpeg_component_info * compptr,
+		  JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+		  JDIMENSION start_row, JDIMENSION start_col,
+		  JDIMENSION num_blocks)
+{
+  my_fdct_ptr fdct = (my_fdct_ptr) cinfo->fdct;
+  forward_DCT_method_ptr do_dct = fdct->do_dct[compptr->component_index];
+  DCTELEM * divisors = (DCTELEM *) compptr->dct_table;
+  DCTELEM workspace[DCTSIZE2];	/* work area for FDCT subroutine */
+  JDIMENSION bi;
+  int i;
+
+  sample_data += start_row;	/* fold in the vertical offset once */
+
+  for (bi = 0; bi < num_blocks; bi++, start_col += compptr->DCT_h_scaled_size) {
+    /* Perform the DCT */
+    (*do_dct) (workspace, sample_data, start_col);
+
+    /* Quantize/descale the coefficients, and store into coef_blocks[] */
+    for (i = 0; i < DCTSIZE2; i += 8) {
+      jsimd_v8 qval = jsimd_load_s32(divisors + i);
+      jsimd_v8 temp = jsimd_load_s32(workspace + i);
+
+      jsimd_store_s16(coef_blocks[bi] + i,
+		      jsimd_apply_sign(jsimd_div(jsimd_add(jsimd_abs(temp),
+							   jsimd_sra(qval, 1)),
+						 qval),
+				       temp));
+    }
+  }
+}
+
+#endif /* JSIMD_SUPPORTED */
+
+
 #ifdef DCT_FLOAT_SUPPORTED
 
 METHODDEF(void)
@@ -330,6 +376,10 @@ start_pass_fdctmgr (j_compress_ptr cinfo)
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
 	fdct->do_dct[ci] = jpeg_fdct_islow;
+#ifdef JSIMD_SUPPORTED
+	if (jsimd_support())
+	  fdct->do_dct[ci] = jpeg_fdct_islow_simd;
+#endif
 	method = JDCT_ISLOW;
 	break;
 #endif
@@ -374,6 +424,10 @@ start_pass_fdctmgr (j_compress_ptr cinfo)
 	  ((DCTELEM) qtbl->quantval[i]) << (compptr->component_needed ? 4 : 3);
       }
       fdct->pub.forward_DCT[ci] = forward_DCT;
+#ifdef JSIMD_SUPPORTED
+      if (jsimd_support())
+	fdct->pub.forward_DCT[ci] = forward_DCT_simd;
+#endif
       break;
 #endif
 #ifdef DCT_IFAST_SUPPORTED
@@ -1005,6 +1005,120 @@ encode_one_block (working_state * state, JCOEFPTR block, int last_dc_val,
 }
 
 
+/*
+ * Faster version of encode_one_block (local addition for the DNG SDK),
+ * used when the output buffer has room for the largest possible block:
+ * at most 64 codes of up to 16 + MAX_COEF_BITS + 1 bits plus a few ZRL
+ * codes, doubled for byte stuffing, is under HUFF_FAST_BLOCK_BYTES.
+ * Bytes are stored without checking for a full buffer, the bits are kept
+ * right-justified in a local accumulator, and the magnitude categories
+ * come from a count-leading-zeros instruction where one is available.
+ * The output is identical to that of encode_one_block.
+ */
+
+#define HUFF_FAST_BLOCK_BYTES  (DCTSIZE2 * 8)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define HUFF_NBITS(nbits,temp)  \
+	((nbits) = (temp) ? 32 - __builtin_clz((unsigned int) (temp)) : 0)
+#else
+#define HUFF_NBITS(nbits,temp)  \
+	{ int t_ = (temp); (nbits) = 0; while (t_) { (nbits)++; t_ >>= 1; } }
+#endif
+
+#define HUFF_EMIT_FAST(code,size)  \
+	{ int s_ = (size);  \
+	  if (s_ == 0)  \
+	    ERREXIT(state->cinfo, JERR_HUFF_MISSING_CODE);  \
+	  put_buffer = (put_buffer << s_) |  \
+		       ((unsigned long) (code) & ((1UL << s_) - 1));  \
+	  put_bits += s_;  \
+	  while (put_bits >= 8) {  \
+	    int c_ = (int) ((put_buffer >> (put_bits - 8)) & 0xFF);  \
+	    *outptr++ = (JOCTET) c_;  \
+	    if (c_ == 0xFF)		/* need to stuff a zero byte? */  \
+	      *outptr++ = 0;  \
+	    put_bits -= 8;  \
+	  } }
+
+LOCAL(void)
+encode_one_block_fast (working_state * state, JCOEFPTR block, int last_dc_val,
+		       c_derived_tbl *dctbl, c_derived_tbl *actbl)
+{
+  register int temp, temp2;
+  register int nbits;
+  register int r, k;
+  register unsigned long put_buffer;
+  register int put_bits;
+  JOCTET * outptr = state->next_output_byte;
+  int Se = state->cinfo->lim_Se;
+  const int * natural_order = state->cinfo->natural_order;
+
+  /* Unpack the left-justified bit buffer. */
+  put_bits = state->cur.put_bits;
+  put_buffer = ((unsigned long) state->cur.put_buffer >> (24 - put_bits)) &
+	       ((1UL << put_bits) - 1);
+
+  /* Encode the DC coefficient difference per section F.1.2.1 */
+
+  temp = temp2 = block[0] - last_dc_val;
+
+  if (temp < 0) {
+    temp = -temp;
+    temp2--;
+  }
+
+  HUFF_NBITS(nbits, temp);
+  if (nbits > MAX_COEF_BITS+1)
+    ERREXIT(state->cinfo, JERR_BAD_DCT_COEF);
+
+  HUFF_EMIT_FAST(dctbl->ehufco[nbits], dctbl->ehufsi[nbits]);
+  if (nbits)
+    HUFF_EMIT_FAST((unsigned int) temp2, nbits);
+
+  /* Encode the AC coefficients per section F.1.2.2 */
+
+  r = 0;			/* r = run length of zeros */
+
+  for (k = 1; k <= Se; k++) {
+    if ((temp2 = block[natural_order[k]]) == 0) {
+      r++;
+    } else {
+      while (r > 15) {
+	HUFF_EMIT_FAST(actbl->ehufco[0xF0], actbl->ehufsi[0xF0]);
+	r -= 16;
+      }
+
+      temp = temp2;
+      if (temp < 0) {
+	temp = -temp;
+	temp2--;
+      }
+
+      HUFF_NBITS(nbits, temp);
+      if (nbits > MAX_COEF_BITS)
+	ERREXIT(state->cinfo, JERR_BAD_DCT_COEF);
+
+      temp = (r << 4) + nbits;
+      HUFF_EMIT_FAST(actbl->ehufco[temp], actbl->ehufsi[temp]);
+      HUFF_EMIT_FAST((unsigned int) temp2, nbits);
+
+      r = 0;
+    }
+  }
+
+  if (r > 0)
+    HUFF_EMIT_FAST(actbl->ehufco[0], actbl->ehufsi[0]);
+
+  /* Store the state back in the form the other routines expect. */
+  state->free_in_buffer -= (size_t) (outptr - state->next_output_byte);
+  state->next_output_byte = outptr;
+  state->cur.put_buffer =
+    (INT32) ((put_buffer & ((1UL << put_bits) - 1)) << (24 - put_bits));
+  state->cur.put_bits = put_bits;
+}
+
+
 /*
  * Encode and output one MCU's worth of Huffman-compressed coefficients.
  */
@@ -1034,10 +1148,15 @@ encode_mcu_huff (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     ci = cinfo->MCU_membership[blkn];
     compptr = cinfo->cur_comp_info[ci];
-    if (! encode_one_block(&state,
-			   MCU_data[blkn][0], state.cur.last_dc_val[ci],
-			   entropy->dc_derived_tbls[compptr->dc_tbl_no],
-			   entropy->ac_derived_tbls[compptr->ac_tbl_no]))
+    if (state.free_in_buffer >= HUFF_FAST_BLOCK_BYTES)
+      encode_one_block_fast(&state,
+			    MCU_data[blkn][0], state.cur.last_dc_val[ci],
+			    entropy->dc_derived_tbls[compptr->dc_tbl_no],
+			    entropy->ac_derived_tbls[compptr->ac_tbl_no]);
+    else if (! encode_one_block(&state,
+				MCU_data[blkn][0], state.cur.last_dc_val[ci],
+				entropy->dc_derived_tbls[compptr->dc_tbl_no],
+				entropy->ac_derived_tbls[compptr->ac_tbl_no]))
       return FALSE;
     /* Update last_dc_val */
     state.cur.last_dc_val[ci] = MCU_data[blkn][0][0];
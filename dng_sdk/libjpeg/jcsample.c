@@ -48,6 +48,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 /* Pointer to routine to downsample a single component */
@@ -293,6 +294,113 @@ h2v2_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
 }
 
 
+#ifdef JSIMD_SUPPORTED
+
+/*
+ * SIMD versions of h2v1_downsample, h2v2_downsample and the 1:1 horizontal,
+ * 2:1 vertical case of int_downsample (local addition for the DNG SDK).
+ * The dither bias pattern restarts at every row, so it lines up with
+ * groups of eight output samples.
+ */
+
+METHODDEF(void) JSIMD_TARGET
+h2v1_downsample_simd (j_compress_ptr cinfo, jpeg_component_info * compptr,
+		      JSAMPARRAY input_data, JSAMPARRAY output_data)
+{
+  static const int bias_tab[8] = { 0, 1, 0, 1, 0, 1, 0, 1 };
+  int inrow;
+  JDIMENSION outcol;
+  JDIMENSION output_cols = compptr->width_in_blocks * compptr->DCT_h_scaled_size;
+  JSAMPROW inptr, outptr;
+  jsimd_v8 bias = jsimd_load_s32(bias_tab);
+
+  expand_right_edge(input_data, cinfo->max_v_samp_factor,
+		    cinfo->image_width, output_cols * 2);
+
+  for (inrow = 0; inrow < cinfo->max_v_samp_factor; inrow++) {
+    outptr = output_data[inrow];
+    inptr = input_data[inrow];
+    for (outcol = 0; outcol + 8 <= output_cols; outcol += 8)
+      jsimd_store_u8(outptr + outcol,
+		     jsimd_sra(jsimd_add(jsimd_load_pairsum_u8(inptr + outcol * 2),
+					 bias), 1));
+    for (; outcol < output_cols; outcol++)
+      outptr[outcol] = (JSAMPLE)
+	((GETJSAMPLE(inptr[outcol * 2]) + GETJSAMPLE(inptr[outcol * 2 + 1])
+	  + (int) (outcol & 1)) >> 1);
+  }
+}
+
+
+METHODDEF(void) JSIMD_TARGET
+h2v2_downsample_simd (j_compress_ptr cinfo, jpeg_component_info * compptr,
+		      JSAMPARRAY input_data, JSAMPARRAY output_data)
+{
+  static const int bias_tab[8] = { 1, 2, 1, 2, 1, 2, 1, 2 };
+  int inrow, outrow;
+  JDIMENSION outcol;
+  JDIMENSION output_cols = compptr->width_in_blocks * compptr->DCT_h_scaled_size;
+  JSAMPROW inptr0, inptr1, outptr;
+  jsimd_v8 bias = jsimd_load_s32(bias_tab);
+
+  expand_right_edge(input_data, cinfo->max_v_samp_factor,
+		    cinfo->image_width, output_cols * 2);
+
+  inrow = outrow = 0;
+  while (inrow < cinfo->max_v_samp_factor) {
+    outptr = output_data[outrow];
+    inptr0 = input_data[inrow];
+    inptr1 = input_data[inrow+1];
+    for (outcol = 0; outcol + 8 <= output_cols; outcol += 8)
+      jsimd_store_u8(outptr + outcol,
+		     jsimd_sra(jsimd_add(jsimd_add(jsimd_load_pairsum_u8(inptr0 + outcol * 2),
+						   jsimd_load_pairsum_u8(inptr1 + outcol * 2)),
+					 bias), 2));
+    for (; outcol < output_cols; outcol++)
+      outptr[outcol] = (JSAMPLE)
+	((GETJSAMPLE(inptr0[outcol * 2]) + GETJSAMPLE(inptr0[outcol * 2 + 1]) +
+	  GETJSAMPLE(inptr1[outcol * 2]) + GETJSAMPLE(inptr1[outcol * 2 + 1])
+	  + 1 + (int) (outcol & 1)) >> 2);
+    inrow += 2;
+    outrow++;
+  }
+}
+
+
+METHODDEF(void) JSIMD_TARGET
+h1v2_downsample_simd (j_compress_ptr cinfo, jpeg_component_info * compptr,
+		      JSAMPARRAY input_data, JSAMPARRAY output_data)
+{
+  int inrow, outrow;
+  JDIMENSION outcol;
+  JDIMENSION output_cols = compptr->width_in_blocks * compptr->DCT_h_scaled_size;
+  JSAMPROW inptr0, inptr1, outptr;
+  jsimd_v8 one = jsimd_set1(1);
+
+  expand_right_edge(input_data, cinfo->max_v_samp_factor,
+		    cinfo->image_width, output_cols);
+
+  inrow = outrow = 0;
+  while (inrow < cinfo->max_v_samp_factor) {
+    outptr = output_data[outrow];
+    inptr0 = input_data[inrow];
+    inptr1 = input_data[inrow+1];
+    for (outcol = 0; outcol + 8 <= output_cols; outcol += 8)
+      jsimd_store_u8(outptr + outcol,
+		     jsimd_sra(jsimd_add(jsimd_add(jsimd_load_u8(inptr0 + outcol),
+						   jsimd_load_u8(inptr1 + outcol)),
+					 one), 1));
+    for (; outcol < output_cols; outcol++)
+      outptr[outcol] = (JSAMPLE)
+	((GETJSAMPLE(inptr0[outcol]) + GETJSAMPLE(inptr1[outcol]) + 1) >> 1);
+    inrow += 2;
+    outrow++;
+  }
+}
+
+#endif /* JSIMD_SUPPORTED */
+
+
 #ifdef INPUT_SMOOTHING_SUPPORTED
 
 /*
@@ -519,6 +627,10 @@ jinit_downsampler (j_compress_ptr cinfo)
 	       v_in_group == v_out_group) {
       smoothok = FALSE;
       downsample->methods[ci] = h2v1_downsample;
+#ifdef JSIMD_SUPPORTED
+      if (jsimd_support())
+	downsample->methods[ci] = h2v1_downsample_simd;
+#endif
     } else if (h_in_group == h_out_group * 2 &&
 	       v_in_group == v_out_group * 2) {
 #ifdef INPUT_SMOOTHING_SUPPORTED
@@ -527,13 +639,24 @@ jinit_downsampler (j_compress_ptr cinfo)
 	downsample->pub.need_context_rows = TRUE;
       } else
 #endif
+      {
 	downsample->methods[ci] = h2v2_downsample;
+#ifdef JSIMD_SUPPORTED
+	if (jsimd_support())
+	  downsample->methods[ci] = h2v2_downsample_simd;
+#endif
+      }
     } else if ((h_in_group % h_out_group) == 0 &&
 	       (v_in_group % v_out_group) == 0) {
       smoothok = FALSE;
       downsample->methods[ci] = int_downsample;
       downsample->h_expand[ci] = (UINT8) (h_in_group / h_out_group);
       downsample->v_expand[ci] = (UINT8) (v_in_group / v_out_group);
+#ifdef JSIMD_SUPPORTED
+      if (jsimd_support() &&
+	  downsample->h_expand[ci] == 1 && downsample->v_expand[ci] == 2)
+	downsample->methods[ci] = h1v2_downsample_simd;
+#endif
     } else
       ERREXIT(cinfo, JERR_FRACT_SAMPLE_NOTIMPL);
   }
@@ -12,6 +12,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 #if RANGE_BITS < 2
@@ -249,6 +250,74 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
 }
 
 
+#if defined(JSIMD_SUPPORTED) && \
+    RGB_RED == 0 && RGB_GREEN == 1 && RGB_BLUE == 2 && RGB_PIXELSIZE == 3
+#define JSIMD_YCC_RGB
+
+/*
+ * SIMD version of ycc_rgb_convert for the tables of build_ycc_rgb_table
+ * (local addition for the DNG SDK).  The table entries are computed
+ * directly with the same integer arithmetic, and the saturating pack to
+ * bytes does the range limiting.
+ */
+
+METHODDEF(void) JSIMD_TARGET
+ycc_rgb_convert_simd (j_decompress_ptr cinfo,
+		      JSAMPIMAGE input_buf, JDIMENSION input_row,
+		      JSAMPARRAY output_buf, int num_rows)
+{
+  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+  int y, cb, cr;
+  JSAMPROW outptr;
+  JSAMPROW inptr0, inptr1, inptr2;
+  JDIMENSION col;
+  JDIMENSION num_cols = cinfo->output_width;
+  JSAMPLE * range_limit = cinfo->sample_range_limit;
+  int * Crrtab = cconvert->Cr_r_tab;
+  int * Cbbtab = cconvert->Cb_b_tab;
+  INT32 * Crgtab = cconvert->Cr_g_tab;
+  INT32 * Cbgtab = cconvert->Cb_g_tab;
+  jsimd_v8 yv, cbv, crv;
+  jsimd_v8 center = jsimd_set1(CENTERJSAMPLE);
+  jsimd_v8 half = jsimd_set1(ONE_HALF);
+  SHIFT_TEMPS
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    for (col = 0; col + 8 <= num_cols; col += 8) {
+      yv  = jsimd_load_u8(inptr0 + col);
+      cbv = jsimd_sub(jsimd_load_u8(inptr1 + col), center);
+      crv = jsimd_sub(jsimd_load_u8(inptr2 + col), center);
+      jsimd_store_rgb(outptr + col * RGB_PIXELSIZE,
+	jsimd_add(yv, jsimd_sra(jsimd_add(jsimd_mul(crv, jsimd_set1(FIX(1.402))),
+					  half), SCALEBITS)),
+	jsimd_add(yv, jsimd_sra(jsimd_add(jsimd_add(jsimd_mul(cbv, jsimd_set1(- FIX(0.344136286))),
+						    half),
+					  jsimd_mul(crv, jsimd_set1(- FIX(0.714136286)))),
+				SCALEBITS)),
+	jsimd_add(yv, jsimd_sra(jsimd_add(jsimd_mul(cbv, jsimd_set1(FIX(1.772))),
+					  half), SCALEBITS)));
+    }
+    for (; col < num_cols; col++) {
+      y  = GETJSAMPLE(inptr0[col]);
+      cb = GETJSAMPLE(inptr1[col]);
+      cr = GETJSAMPLE(inptr2[col]);
+      outptr[col * RGB_PIXELSIZE + RGB_RED]   = range_limit[y + Crrtab[cr]];
+      outptr[col * RGB_PIXELSIZE + RGB_GREEN] = range_limit[y +
+			      ((int) RIGHT_SHIFT(Cbgtab[cb] + Crgtab[cr],
+						 SCALEBITS))];
+      outptr[col * RGB_PIXELSIZE + RGB_BLUE]  = range_limit[y + Cbbtab[cb]];
+    }
+  }
+}
+
+#endif /* JSIMD_YCC_RGB */
+
+
 /**************** Cases other than YCC -> RGB ****************/
 
 
@@ -659,6 +728,10 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
       break;
     case JCS_YCbCr:
       cconvert->pub.color_convert = ycc_rgb_convert;
+#ifdef JSIMD_YCC_RGB
+      if (jsimd_support())
+	cconvert->pub.color_convert = ycc_rgb_convert_simd;
+#endif
       build_ycc_rgb_table(cinfo);
       break;
     case JCS_BG_YCC:
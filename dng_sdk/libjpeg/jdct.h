@@ -167,6 +167,8 @@ typedef FAST_FLOAT FLOAT_MULT_TYPE; /* preferred floating type */
 
 EXTERN(void) jpeg_fdct_islow
     JPP((DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col));
+EXTERN(void) jpeg_fdct_islow_simd
+    JPP((DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col));
 EXTERN(void) jpeg_fdct_ifast
     JPP((DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col));
 EXTERN(void) jpeg_fdct_float
@@ -237,6 +239,9 @@ EXTERN(void) jpeg_fdct_1x2
 EXTERN(void) jpeg_idct_islow
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_islow_simd
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
 EXTERN(void) jpeg_idct_ifast
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
@@ -20,6 +20,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
 
 
 /*
@@ -231,6 +232,10 @@ start_pass (j_decompress_ptr cinfo)
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
 	method_ptr = jpeg_idct_islow;
+#ifdef JSIMD_SUPPORTED
+	if (jsimd_support())
+	  method_ptr = jpeg_idct_islow_simd;
+#endif
 	method = JDCT_ISLOW;
 	break;
 #endif
@@ -45,6 +45,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
 
 #ifdef DCT_ISLOW_SUPPORTED
 
@@ -324,6 +325,117 @@ jpeg_fdct_islow (DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col)
   }
 }
 
+#ifdef JSIMD_SUPPORTED
+
+/*
+ * SIMD version of jpeg_fdct_islow (local addition for the DNG SDK).
+ * Each vector holds one element of all eight rows (pass 1) or columns
+ * (pass 2), so the loops of the scalar code run across the vector lanes.
+ * The arithmetic is the same, so the output is bit-exact.
+ */
+
+GLOBAL(void) JSIMD_TARGET
+jpeg_fdct_islow_simd (DCTELEM * data, JSAMPARRAY sample_data,
+		      JDIMENSION start_col)
+{
+  jsimd_v8 d[DCTSIZE];
+  jsimd_v8 tmp0, tmp1, tmp2, tmp3;
+  jsimd_v8 tmp10, tmp11, tmp12, tmp13;
+  jsimd_v8 z1;
+  int ctr, pass;
+
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    d[ctr] = jsimd_load_u8(sample_data[ctr] + start_col);
+
+  for (pass = 1; pass <= 2; pass++) {
+    /* Pass 1 needs one vector per column, pass 2 one vector per row. */
+    jsimd_transpose8(d);
+
+    tmp0 = jsimd_add(d[0], d[7]);
+    tmp1 = jsimd_add(d[1], d[6]);
+    tmp2 = jsimd_add(d[2], d[5]);
+    tmp3 = jsimd_add(d[3], d[4]);
+
+    tmp10 = jsimd_add(tmp0, tmp3);
+    tmp12 = jsimd_sub(tmp0, tmp3);
+    tmp11 = jsimd_add(tmp1, tmp2);
+    tmp13 = jsimd_sub(tmp1, tmp2);
+
+    tmp0 = jsimd_sub(d[0], d[7]);
+    tmp1 = jsimd_sub(d[1], d[6]);
+    tmp2 = jsimd_sub(d[2], d[5]);
+    tmp3 = jsimd_sub(d[3], d[4]);
+
+    if (pass == 1) {
+      /* Apply unsigned->signed conversion. */
+      d[0] = jsimd_sll(jsimd_sub(jsimd_add(tmp10, tmp11),
+				 jsimd_set1(8 * CENTERJSAMPLE)), PASS1_BITS);
+      d[4] = jsimd_sll(jsimd_sub(tmp10, tmp11), PASS1_BITS);
+    } else {
+      tmp10 = jsimd_add(tmp10, jsimd_set1(ONE << (PASS1_BITS-1)));
+      d[0] = jsimd_sra(jsimd_add(tmp10, tmp11), PASS1_BITS);
+      d[4] = jsimd_sra(jsimd_sub(tmp10, tmp11), PASS1_BITS);
+    }
+
+    /* Even part, with the fudge factor for the final descale. */
+
+    z1 = jsimd_add(jsimd_mul(jsimd_add(tmp12, tmp13),
+			     jsimd_set1(FIX_0_541196100)),
+		   jsimd_set1(pass == 1 ? ONE << (CONST_BITS-PASS1_BITS-1)
+					: ONE << (CONST_BITS+PASS1_BITS-1)));
+
+    d[2] = jsimd_add(z1, jsimd_mul(tmp12, jsimd_set1(FIX_0_765366865)));
+    d[6] = jsimd_sub(z1, jsimd_mul(tmp13, jsimd_set1(FIX_1_847759065)));
+
+    /* Odd part. */
+
+    tmp12 = jsimd_add(tmp0, tmp2);
+    tmp13 = jsimd_add(tmp1, tmp3);
+
+    z1 = jsimd_add(jsimd_mul(jsimd_add(tmp12, tmp13),
+			     jsimd_set1(FIX_1_175875602)),
+		   jsimd_set1(pass == 1 ? ONE << (CONST_BITS-PASS1_BITS-1)
+					: ONE << (CONST_BITS+PASS1_BITS-1)));
+
+    tmp12 = jsimd_add(jsimd_mul(tmp12, jsimd_set1(- FIX_0_390180644)), z1);
+    tmp13 = jsimd_add(jsimd_mul(tmp13, jsimd_set1(- FIX_1_961570560)), z1);
+
+    z1 = jsimd_mul(jsimd_add(tmp0, tmp3), jsimd_set1(- FIX_0_899976223));
+    tmp0 = jsimd_add(jsimd_mul(tmp0, jsimd_set1(FIX_1_501321110)),
+		     jsimd_add(z1, tmp12));
+    tmp3 = jsimd_add(jsimd_mul(tmp3, jsimd_set1(FIX_0_298631336)),
+		     jsimd_add(z1, tmp13));
+
+    z1 = jsimd_mul(jsimd_add(tmp1, tmp2), jsimd_set1(- FIX_2_562915447));
+    tmp1 = jsimd_add(jsimd_mul(tmp1, jsimd_set1(FIX_3_072711026)),
+		     jsimd_add(z1, tmp13));
+    tmp2 = jsimd_add(jsimd_mul(tmp2, jsimd_set1(FIX_2_053119869)),
+		     jsimd_add(z1, tmp12));
+
+    if (pass == 1) {
+      d[2] = jsimd_sra(d[2], CONST_BITS-PASS1_BITS);
+      d[6] = jsimd_sra(d[6], CONST_BITS-PASS1_BITS);
+      d[1] = jsimd_sra(tmp0, CONST_BITS-PASS1_BITS);
+      d[3] = jsimd_sra(tmp1, CONST_BITS-PASS1_BITS);
+      d[5] = jsimd_sra(tmp2, CONST_BITS-PASS1_BITS);
+      d[7] = jsimd_sra(tmp3, CONST_BITS-PASS1_BITS);
+    } else {
+      d[2] = jsimd_sra(d[2], CONST_BITS+PASS1_BITS);
+      d[6] = jsimd_sra(d[6], CONST_BITS+PASS1_BITS);
+      d[1] = jsimd_sra(tmp0, CONST_BITS+PASS1_BITS);
+      d[3] = jsimd_sra(tmp1, CONST_BITS+PASS1_BITS);
+      d[5] = jsimd_sra(tmp2, CONST_BITS+PASS1_BITS);
+      d[7] = jsimd_sra(tmp3, CONST_BITS+PASS1_BITS);
+    }
+  }
+
+  /* The vectors now hold one row each of the output block. */
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    jsimd_store_s32(data + DCTSIZE * ctr, d[ctr]);
+}
+
+#endif /* JSIMD_SUPPORTED */
+
 #ifdef DCT_SCALING_SUPPORTED
 
 
@@ -52,6 +52,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
 
 #ifdef DCT_ISLOW_SUPPORTED
 
@@ -424,6 +425,126 @@ jpeg_idct_islow (j_decompress_ptr cinfo, jpeg_component_info * compptr,
   }
 }
 
+#ifdef JSIMD_SUPPORTED
+
+/* The SIMD code loads the multiplier table as 32-bit integers. */
+typedef char jsimd_islow_mult_check[SIZEOF(ISLOW_MULT_TYPE) == 4 ? 1 : -1];
+
+/*
+ * SIMD version of jpeg_idct_islow (local addition for the DNG SDK).
+ * Each vector holds one element of all eight columns (pass 1) or rows
+ * (pass 2).  The all-zero AC shortcuts of the scalar code are omitted;
+ * for them the full calculation gives the same result.  The final
+ * mask-and-table range limit is done as a mask, the RANGE_SUBSET offset
+ * and a saturating pack, which is what the standard sample_range_limit
+ * table (see prepare_range_limit_table in jdmaster.c) computes.
+ */
+
+GLOBAL(void) JSIMD_TARGET
+jpeg_idct_islow_simd (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  jsimd_v8 w[DCTSIZE];
+  jsimd_v8 tmp0, tmp1, tmp2, tmp3;
+  jsimd_v8 tmp10, tmp11, tmp12, tmp13;
+  jsimd_v8 z1, z2, z3;
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  int ctr, pass, shift;
+
+  /* Dequantize; the vectors hold one row each of the coefficient block. */
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    w[ctr] = jsimd_mul(jsimd_load_s16(coef_block + DCTSIZE * ctr),
+		       jsimd_load_s32(quantptr + DCTSIZE * ctr));
+
+  for (pass = 1; pass <= 2; pass++) {
+    /* Even part: reverse the even part of the forward DCT.
+     * The rotator is c(-6).
+     */
+
+    if (pass == 1) {
+      /* Add fudge factor here for final descale. */
+      z2 = jsimd_add(jsimd_sll(w[0], CONST_BITS),
+		     jsimd_set1(ONE << (CONST_BITS-PASS1_BITS-1)));
+      z3 = jsimd_sll(w[4], CONST_BITS);
+      tmp0 = jsimd_add(z2, z3);
+      tmp1 = jsimd_sub(z2, z3);
+      shift = CONST_BITS-PASS1_BITS;
+    } else {
+      /* Add range center and fudge factor for final descale and range-limit. */
+      z2 = jsimd_add(w[0], jsimd_set1((((INT32) RANGE_CENTER) << (PASS1_BITS+3)) +
+				      (ONE << (PASS1_BITS+2))));
+      z3 = w[4];
+      tmp0 = jsimd_sll(jsimd_add(z2, z3), CONST_BITS);
+      tmp1 = jsimd_sll(jsimd_sub(z2, z3), CONST_BITS);
+      shift = CONST_BITS+PASS1_BITS+3;
+    }
+
+    z2 = w[2];
+    z3 = w[6];
+
+    z1 = jsimd_mul(jsimd_add(z2, z3), jsimd_set1(FIX_0_541196100));
+    tmp2 = jsimd_add(z1, jsimd_mul(z2, jsimd_set1(FIX_0_765366865)));
+    tmp3 = jsimd_sub(z1, jsimd_mul(z3, jsimd_set1(FIX_1_847759065)));
+
+    tmp10 = jsimd_add(tmp0, tmp2);
+    tmp13 = jsimd_sub(tmp0, tmp2);
+    tmp11 = jsimd_add(tmp1, tmp3);
+    tmp12 = jsimd_sub(tmp1, tmp3);
+
+    /* Odd part per figure 8; the matrix is unitary and hence its
+     * transpose is its inverse.  i0..i3 are y7,y5,y3,y1 respectively.
+     */
+
+    tmp0 = w[7];
+    tmp1 = w[5];
+    tmp2 = w[3];
+    tmp3 = w[1];
+
+    z2 = jsimd_add(tmp0, tmp2);
+    z3 = jsimd_add(tmp1, tmp3);
+
+    z1 = jsimd_mul(jsimd_add(z2, z3), jsimd_set1(FIX_1_175875602));
+    z2 = jsimd_add(jsimd_mul(z2, jsimd_set1(- FIX_1_961570560)), z1);
+    z3 = jsimd_add(jsimd_mul(z3, jsimd_set1(- FIX_0_390180644)), z1);
+
+    z1 = jsimd_mul(jsimd_add(tmp0, tmp3), jsimd_set1(- FIX_0_899976223));
+    tmp0 = jsimd_add(jsimd_mul(tmp0, jsimd_set1(FIX_0_298631336)),
+		     jsimd_add(z1, z2));
+    tmp3 = jsimd_add(jsimd_mul(tmp3, jsimd_set1(FIX_1_501321110)),
+		     jsimd_add(z1, z3));
+
+    z1 = jsimd_mul(jsimd_add(tmp1, tmp2), jsimd_set1(- FIX_2_562915447));
+    tmp1 = jsimd_add(jsimd_mul(tmp1, jsimd_set1(FIX_2_053119869)),
+		     jsimd_add(z1, z3));
+    tmp2 = jsimd_add(jsimd_mul(tmp2, jsimd_set1(FIX_3_072711026)),
+		     jsimd_add(z1, z2));
+
+    /* Final output stage: inputs are tmp10..tmp13, tmp0..tmp3 */
+
+    w[0] = jsimd_sra(jsimd_add(tmp10, tmp3), shift);
+    w[7] = jsimd_sra(jsimd_sub(tmp10, tmp3), shift);
+    w[1] = jsimd_sra(jsimd_add(tmp11, tmp2), shift);
+    w[6] = jsimd_sra(jsimd_sub(tmp11, tmp2), shift);
+    w[2] = jsimd_sra(jsimd_add(tmp12, tmp1), shift);
+    w[5] = jsimd_sra(jsimd_sub(tmp12, tmp1), shift);
+    w[3] = jsimd_sra(jsimd_add(tmp13, tmp0), shift);
+    w[4] = jsimd_sra(jsimd_sub(tmp13, tmp0), shift);
+
+    /* Pass 2 needs one vector per column of the work array; after it the
+     * vectors must hold output rows again.
+     */
+    jsimd_transpose8(w);
+  }
+
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    jsimd_store_u8(output_buf[ctr] + output_col,
+		   jsimd_sub(jsimd_and(w[ctr], jsimd_set1(RANGE_MASK)),
+			     jsimd_set1(RANGE_SUBSET)));
+}
+
+#endif /* JSIMD_SUPPORTED */
+
 #ifdef IDCT_SCALING_SUPPORTED
 
 
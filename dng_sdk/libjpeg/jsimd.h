@@ -0,0 +1,500 @@
+/*
+ * jsimd.h
+ *
+ * This file is a local addition for the DNG SDK; it is not part of the
+ * IJG distribution.
+ *
+ * It provides a small vector layer used by the SIMD versions of the
+ * integer DCTs (jfdctint.c, jidctint.c), the quantizer (jcdctmgr.c), the
+ * color converters (jccolor.c, jdcolor.c) and the downsamplers
+ * (jcsample.c).  Every vector holds eight INT32 lanes: one AVX2 register
+ * on x86, or a pair of NEON registers on ARM64.  The SIMD routines repeat
+ * the integer arithmetic of the scalar routines lane by lane, so their
+ * results are bit-exact.
+ *
+ * The vector code is compiled only if JSIMD_SUPPORTED is defined.  It may
+ * be selected only if jsimd_support() returns nonzero, which requires a
+ * CPU with the needed instructions and no JSIMD_FORCENONE environment
+ * variable.  Define NO_JSIMD to build the plain C library.
+ */
+
+#ifndef JSIMD_H
+#define JSIMD_H
+
+#if !defined(NO_JSIMD) && BITS_IN_JSAMPLE == 8 && \
+    (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+#define JSIMD_SUPPORTED
+#define JSIMD_USE_AVX2
+#define JSIMD_TARGET  __attribute__((target("avx2")))
+
+#elif !defined(NO_JSIMD) && BITS_IN_JSAMPLE == 8 && \
+      defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+
+#include <arm_neon.h>
+
+#define JSIMD_SUPPORTED
+#define JSIMD_USE_NEON
+#define JSIMD_TARGET
+
+#endif
+
+
+/* Values returned by jsimd_support(). */
+
+#define JSIMD_NONE	0x00
+#define JSIMD_AVX2	0x01
+#define JSIMD_NEON	0x02
+
+EXTERN(int) jsimd_support JPP((void));
+
+
+#ifdef JSIMD_SUPPORTED
+
+#ifdef JSIMD_USE_AVX2
+
+typedef __m256i jsimd_v8;
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_set1 (INT32 a)
+{
+  return _mm256_set1_epi32((int) a);
+}
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_add (jsimd_v8 a, jsimd_v8 b)
+{
+  return _mm256_add_epi32(a, b);
+}
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_sub (jsimd_v8 a, jsimd_v8 b)
+{
+  return _mm256_sub_epi32(a, b);
+}
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_mul (jsimd_v8 a, jsimd_v8 b)
+{
+  return _mm256_mullo_epi32(a, b);
+}
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_sra (jsimd_v8 a, int n)
+{
+  return _mm256_srai_epi32(a, n);
+}
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_sll (jsimd_v8 a, int n)
+{
+  return _mm256_slli_epi32(a, n);
+}
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_and (jsimd_v8 a, jsimd_v8 b)
+{
+  return _mm256_and_si256(a, b);
+}
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_abs (jsimd_v8 a)
+{
+  return _mm256_abs_epi32(a);
+}
+
+/* Negate a where s is negative (a must be zero where s is zero). */
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_apply_sign (jsimd_v8 a, jsimd_v8 s)
+{
+  return _mm256_sign_epi32(a, s);
+}
+
+/* Quotient of nonnegative a by positive b.  Single precision division
+ * rounds to the exact integer quotient while a and b are below 2^22.
+ */
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_div (jsimd_v8 a, jsimd_v8 b)
+{
+  return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(a),
+					   _mm256_cvtepi32_ps(b)));
+}
+
+/* Load eight samples. */
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_load_u8 (const JSAMPLE * p)
+{
+  return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) p));
+}
+
+/* Load the sums of eight adjacent pairs of samples (sixteen samples). */
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_load_pairsum_u8 (const JSAMPLE * p)
+{
+  __m128i x = _mm_loadu_si128((const __m128i *) p);
+
+  return _mm256_cvtepi16_epi32(_mm_maddubs_epi16(x, _mm_set1_epi8(1)));
+}
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_load_s16 (const JCOEF * p)
+{
+  return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) p));
+}
+
+static INLINE JSIMD_TARGET jsimd_v8
+jsimd_load_s32 (const int * p)
+{
+  return _mm256_loadu_si256((const __m256i *) p);
+}
+
+static INLINE JSIMD_TARGET void
+jsimd_store_s32 (int * p, jsimd_v8 a)
+{
+  _mm256_storeu_si256((__m256i *) p, a);
+}
+
+static INLINE JSIMD_TARGET void
+jsimd_store_s16 (JCOEF * p, jsimd_v8 a)
+{
+  _mm_storeu_si128((__m128i *) p,
+		   _mm_packs_epi32(_mm256_castsi256_si128(a),
+				   _mm256_extracti128_si256(a, 1)));
+}
+
+/* Pack eight lanes to bytes with saturation to 0..255. */
+
+static INLINE JSIMD_TARGET __m128i
+jsimd_pack_u8 (jsimd_v8 a)
+{
+  __m128i x = _mm_packs_epi32(_mm256_castsi256_si128(a),
+			      _mm256_extracti128_si256(a, 1));
+
+  return _mm_packus_epi16(x, x);
+}
+
+static INLINE JSIMD_TARGET void
+jsimd_store_u8 (JSAMPLE * p, jsimd_v8 a)
+{
+  _mm_storel_epi64((__m128i *) p, jsimd_pack_u8(a));
+}
+
+/* Load eight interleaved RGB pixels (24 samples). */
+
+static INLINE JSIMD_TARGET void
+jsimd_load_rgb (const JSAMPLE * p, jsimd_v8 * r, jsimd_v8 * g, jsimd_v8 * b)
+{
+  __m128i lo = _mm_loadu_si128((const __m128i *) p);
+  __m128i hi = _mm_loadl_epi64((const __m128i *) (p + 16));
+
+  *r = _mm256_cvtepu8_epi32(_mm_or_si128(
+	 _mm_shuffle_epi8(lo, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1,
+					    -1, -1, -1, -1, -1, -1, -1, -1)),
+	 _mm_shuffle_epi8(hi, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5,
+					    -1, -1, -1, -1, -1, -1, -1, -1))));
+  *g = _mm256_cvtepu8_epi32(_mm_or_si128(
+	 _mm_shuffle_epi8(lo, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1,
+					    -1, -1, -1, -1, -1, -1, -1, -1)),
+	 _mm_shuffle_epi8(hi, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6,
+					    -1, -1, -1, -1, -1, -1, -1, -1))));
+  *b = _mm256_cvtepu8_epi32(_mm_or_si128(
+	 _mm_shuffle_epi8(lo, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1,
+					    -1, -1, -1, -1, -1, -1, -1, -1)),
+	 _mm_shuffle_epi8(hi, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7,
+					    -1, -1, -1, -1, -1, -1, -1, -1))));
+}
+
+/* Store eight interleaved RGB pixels with saturation to 0..255. */
+
+static INLINE JSIMD_TARGET void
+jsimd_store_rgb (JSAMPLE * p, jsimd_v8 r, jsimd_v8 g, jsimd_v8 b)
+{
+  /* rg = r0..r7 g0..g7, bb = b0..b7 */
+  __m128i rg = _mm_unpacklo_epi64(jsimd_pack_u8(r), jsimd_pack_u8(g));
+  __m128i bb = jsimd_pack_u8(b);
+
+  _mm_storeu_si128((__m128i *) p, _mm_or_si128(
+    _mm_shuffle_epi8(rg, _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10,
+				       -1, 3, 11, -1, 4, 12, -1, 5)),
+    _mm_shuffle_epi8(bb, _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1,
+				       2, -1, -1, 3, -1, -1, 4, -1))));
+  _mm_storel_epi64((__m128i *) (p + 16), _mm_or_si128(
+    _mm_shuffle_epi8(rg, _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1,
+				       -1, -1, -1, -1, -1, -1, -1, -1)),
+    _mm_shuffle_epi8(bb, _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7,
+				       -1, -1, -1, -1, -1, -1, -1, -1))));
+}
+
+/* Transpose an 8x8 block held one row per vector. */
+
+static INLINE JSIMD_TARGET void
+jsimd_transpose8 (jsimd_v8 v[8])
+{
+  __m256i t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+  __m256i t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+  __m256i t2 = _mm256_unpacklo_epi32(v[2], v[3]);
+  __m256i t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+  __m256i t4 = _mm256_unpacklo_epi32(v[4], v[5]);
+  __m256i t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+  __m256i t6 = _mm256_unpacklo_epi32(v[6], v[7]);
+  __m256i t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+  __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+  __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+  __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+  __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+  __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+  __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+  __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+  __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+  v[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+  v[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+  v[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+  v[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+  v[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  v[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  v[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  v[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+#endif /* JSIMD_USE_AVX2 */
+
+
+#ifdef JSIMD_USE_NEON
+
+typedef struct {
+  int32x4_t lo, hi;
+} jsimd_v8;
+
+static INLINE jsimd_v8
+jsimd_set1 (INT32 a)
+{
+  jsimd_v8 r;
+  r.lo = r.hi = vdupq_n_s32((int32_t) a);
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_add (jsimd_v8 a, jsimd_v8 b)
+{
+  jsimd_v8 r;
+  r.lo = vaddq_s32(a.lo, b.lo);
+  r.hi = vaddq_s32(a.hi, b.hi);
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_sub (jsimd_v8 a, jsimd_v8 b)
+{
+  jsimd_v8 r;
+  r.lo = vsubq_s32(a.lo, b.lo);
+  r.hi = vsubq_s32(a.hi, b.hi);
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_mul (jsimd_v8 a, jsimd_v8 b)
+{
+  jsimd_v8 r;
+  r.lo = vmulq_s32(a.lo, b.lo);
+  r.hi = vmulq_s32(a.hi, b.hi);
+  return r;
+}
+
+/* vshlq_s32 shifts right for negative counts; the count need not be an
+ * immediate.
+ */
+
+static INLINE jsimd_v8
+jsimd_sra (jsimd_v8 a, int n)
+{
+  jsimd_v8 r;
+  int32x4_t s = vdupq_n_s32(-n);
+  r.lo = vshlq_s32(a.lo, s);
+  r.hi = vshlq_s32(a.hi, s);
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_sll (jsimd_v8 a, int n)
+{
+  jsimd_v8 r;
+  int32x4_t s = vdupq_n_s32(n);
+  r.lo = vshlq_s32(a.lo, s);
+  r.hi = vshlq_s32(a.hi, s);
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_and (jsimd_v8 a, jsimd_v8 b)
+{
+  jsimd_v8 r;
+  r.lo = vandq_s32(a.lo, b.lo);
+  r.hi = vandq_s32(a.hi, b.hi);
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_abs (jsimd_v8 a)
+{
+  jsimd_v8 r;
+  r.lo = vabsq_s32(a.lo);
+  r.hi = vabsq_s32(a.hi);
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_apply_sign (jsimd_v8 a, jsimd_v8 s)
+{
+  jsimd_v8 r;
+  r.lo = vbslq_s32(vcltzq_s32(s.lo), vnegq_s32(a.lo), a.lo);
+  r.hi = vbslq_s32(vcltzq_s32(s.hi), vnegq_s32(a.hi), a.hi);
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_div (jsimd_v8 a, jsimd_v8 b)
+{
+  jsimd_v8 r;
+  r.lo = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(a.lo), vcvtq_f32_s32(b.lo)));
+  r.hi = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(a.hi), vcvtq_f32_s32(b.hi)));
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_widen_u8 (uint8x8_t x)
+{
+  jsimd_v8 r;
+  uint16x8_t w = vmovl_u8(x);
+  r.lo = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(w)));
+  r.hi = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(w)));
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_load_u8 (const JSAMPLE * p)
+{
+  return jsimd_widen_u8(vld1_u8(p));
+}
+
+static INLINE jsimd_v8
+jsimd_load_pairsum_u8 (const JSAMPLE * p)
+{
+  jsimd_v8 r;
+  uint16x8_t w = vpaddlq_u8(vld1q_u8(p));
+  r.lo = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(w)));
+  r.hi = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(w)));
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_load_s16 (const JCOEF * p)
+{
+  jsimd_v8 r;
+  int16x8_t w = vld1q_s16(p);
+  r.lo = vmovl_s16(vget_low_s16(w));
+  r.hi = vmovl_s16(vget_high_s16(w));
+  return r;
+}
+
+static INLINE jsimd_v8
+jsimd_load_s32 (const int * p)
+{
+  jsimd_v8 r;
+  r.lo = vld1q_s32(p);
+  r.hi = vld1q_s32(p + 4);
+  return r;
+}
+
+static INLINE void
+jsimd_store_s32 (int * p, jsimd_v8 a)
+{
+  vst1q_s32(p, a.lo);
+  vst1q_s32(p + 4, a.hi);
+}
+
+static INLINE void
+jsimd_store_s16 (JCOEF * p, jsimd_v8 a)
+{
+  vst1q_s16(p, vcombine_s16(vqmovn_s32(a.lo), vqmovn_s32(a.hi)));
+}
+
+static INLINE uint8x8_t
+jsimd_pack_u8 (jsimd_v8 a)
+{
+  return vqmovun_s16(vcombine_s16(vqmovn_s32(a.lo), vqmovn_s32(a.hi)));
+}
+
+static INLINE void
+jsimd_store_u8 (JSAMPLE * p, jsimd_v8 a)
+{
+  vst1_u8(p, jsimd_pack_u8(a));
+}
+
+static INLINE void
+jsimd_load_rgb (const JSAMPLE * p, jsimd_v8 * r, jsimd_v8 * g, jsimd_v8 * b)
+{
+  uint8x8x3_t x = vld3_u8(p);
+
+  *r = jsimd_widen_u8(x.val[0]);
+  *g = jsimd_widen_u8(x.val[1]);
+  *b = jsimd_widen_u8(x.val[2]);
+}
+
+static INLINE void
+jsimd_store_rgb (JSAMPLE * p, jsimd_v8 r, jsimd_v8 g, jsimd_v8 b)
+{
+  uint8x8x3_t x;
+
+  x.val[0] = jsimd_pack_u8(r);
+  x.val[1] = jsimd_pack_u8(g);
+  x.val[2] = jsimd_pack_u8(b);
+  vst3_u8(p, x);
+}
+
+static INLINE void
+jsimd_transpose4 (int32x4_t * a0, int32x4_t * a1,
+		  int32x4_t * a2, int32x4_t * a3)
+{
+  int64x2_t t0 = vreinterpretq_s64_s32(vtrn1q_s32(*a0, *a1));
+  int64x2_t t1 = vreinterpretq_s64_s32(vtrn2q_s32(*a0, *a1));
+  int64x2_t t2 = vreinterpretq_s64_s32(vtrn1q_s32(*a2, *a3));
+  int64x2_t t3 = vreinterpretq_s64_s32(vtrn2q_s32(*a2, *a3));
+
+  *a0 = vreinterpretq_s32_s64(vtrn1q_s64(t0, t2));
+  *a1 = vreinterpretq_s32_s64(vtrn1q_s64(t1, t3));
+  *a2 = vreinterpretq_s32_s64(vtrn2q_s64(t0, t2));
+  *a3 = vreinterpretq_s32_s64(vtrn2q_s64(t1, t3));
+}
+
+static INLINE void
+jsimd_transpose8 (jsimd_v8 v[8])
+{
+  int32x4_t t;
+  int i;
+
+  /* Transpose the four 4x4 quadrants, then swap the off-diagonal ones. */
+  jsimd_transpose4(&v[0].lo, &v[1].lo, &v[2].lo, &v[3].lo);
+  jsimd_transpose4(&v[0].hi, &v[1].hi, &v[2].hi, &v[3].hi);
+  jsimd_transpose4(&v[4].lo, &v[5].lo, &v[6].lo, &v[7].lo);
+  jsimd_transpose4(&v[4].hi, &v[5].hi, &v[6].hi, &v[7].hi);
+
+  for (i = 0; i < 4; i++) {
+    t = v[i].hi;
+    v[i].hi = v[i+4].lo;
+    v[i+4].lo = t;
+  }
+}
+
+#endif /* JSIMD_USE_NEON */
+
+#endif /* JSIMD_SUPPORTED */
+
+#endif /* JSIMD_H */
@@ -15,6 +15,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 /*
@@ -225,3 +226,41 @@ jcopy_block_row (JBLOCKROW input_row, JBLOCKROW output_row,
   }
 #endif
 }
+
+
+/*
+ * Determine which SIMD routines may be used (local addition for the DNG
+ * SDK, see jsimd.h).  The answer is computed once; the race between threads
+ * doing so concurrently is harmless since they all compute the same value.
+ */
+
+GLOBAL(int)
+jsimd_support (void)
+{
+#ifdef JSIMD_SUPPORTED
+  static int simd_support = -1;
+  int support;
+
+  if (simd_support >= 0)
+    return simd_support;
+
+#ifdef JSIMD_USE_AVX2
+  __builtin_cpu_init();
+  support = __builtin_cpu_supports("avx2") ? JSIMD_AVX2 : JSIMD_NONE;
+#else
+  support = JSIMD_NEON;
+#endif
+
+  {
+    const char * env = getenv("JSIMD_FORCENONE");
+
+    if (env != NULL && env[0] == '1')
+      support = JSIMD_NONE;
+  }
+
+  simd_support = support;
+  return support;
+#else
+  return JSIMD_NONE;
+#endif
+}